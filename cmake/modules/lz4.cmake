@@ -0,0 +1,24 @@
+#
+# lz4 (optional, enables SCAP_COMPRESSION_LZ4)
+#
+option(USE_LZ4 "Enable the lz4 compression of capture files" ON)
+
+if(NOT USE_LZ4)
+	# disabled
+elseif(LZ4_INCLUDE AND LZ4_LIB)
+	# we already have lz4
+else()
+	find_path(LZ4_INCLUDE lz4frame.h)
+	find_library(LZ4_LIB NAMES lz4)
+	if(LZ4_INCLUDE AND LZ4_LIB)
+		message(STATUS "Found lz4: include: ${LZ4_INCLUDE}, lib: ${LZ4_LIB}")
+	else()
+		message(STATUS "Couldn't find system lz4, lz4 compression disabled")
+		set(USE_LZ4 OFF)
+	endif()
+endif()
+
+if(USE_LZ4)
+	add_definitions(-DUSE_LZ4)
+	include_directories(${LZ4_INCLUDE})
+endif()
@@ -0,0 +1,24 @@
+#
+# zstd (optional, enables SCAP_COMPRESSION_ZSTD)
+#
+option(USE_ZSTD "Enable the zstd compression of capture files" ON)
+
+if(NOT USE_ZSTD)
+	# disabled
+elseif(ZSTD_INCLUDE AND ZSTD_LIB)
+	# we already have zstd
+else()
+	find_path(ZSTD_INCLUDE zstd.h)
+	find_library(ZSTD_LIB NAMES zstd)
+	if(ZSTD_INCLUDE AND ZSTD_LIB)
+		message(STATUS "Found zstd: include: ${ZSTD_INCLUDE}, lib: ${ZSTD_LIB}")
+	else()
+		message(STATUS "Couldn't find system zstd, zstd compression disabled")
+		set(USE_ZSTD OFF)
+	endif()
+endif()
+
+if(USE_ZSTD)
+	add_definitions(-DUSE_ZSTD)
+	include_directories(${ZSTD_INCLUDE})
+endif()
@@ -76,5 +76,14 @@ static int (*bpf_skb_under_cgroup)(void *ctx, void *map, int index) =
 	(void *)BPF_FUNC_skb_under_cgroup;
 static int (*bpf_skb_change_head)(void *, int len, int flags) =
 	(void *)BPF_FUNC_skb_change_head;
+#ifdef BPF_SUPPORTS_RINGBUF
+static int (*bpf_ringbuf_output)(void *ringbuf, void *data,
+				 unsigned long long size,
+				 unsigned long long flags) =
+	(void *)BPF_FUNC_ringbuf_output;
+static unsigned long long (*bpf_ringbuf_query)(void *ringbuf,
+					       unsigned long long flags) =
+	(void *)BPF_FUNC_ringbuf_query;
+#endif
 
 #endif
@@ -121,11 +121,16 @@ static __always_inline int __bpf_##x(struct filler_data *data)		\
 FILLER_RAW(terminate_filler)
 {
 	struct sysdig_bpf_per_cpu_state *state;
+	unsigned int cpu;
 
-	state = get_local_state(bpf_get_smp_processor_id());
+	cpu = bpf_get_smp_processor_id();
+
+	state = get_local_state(cpu);
 	if (!state)
 		return 0;
 
+	update_evt_type_stats(state, cpu);
+
 	switch (state->tail_ctx.prev_res) {
 	case PPM_SUCCESS:
 		break;
@@ -164,11 +169,16 @@ FILLER_RAW(terminate_filler)
 KP_FILLER_RAW(kp_terminate_filler)
 {
 	struct sysdig_bpf_per_cpu_state *state;
+	unsigned int cpu;
 
-	state = get_local_state(bpf_get_smp_processor_id());
+	cpu = bpf_get_smp_processor_id();
+
+	state = get_local_state(cpu);
 	if (!state)
 		return 0;
 
+	update_evt_type_stats(state, cpu);
+
 	switch (state->tail_ctx.prev_res) {
 	case PPM_SUCCESS:
 		break;
@@ -100,12 +100,37 @@ struct bpf_map_def __bpf_section("maps") stash_map = {
 #endif
 
 struct bpf_map_def __bpf_section("maps") rtt_static_map = {
-        .type = BPF_MAP_TYPE_HASH,
-        .key_size = sizeof(struct tuple),
-        .value_size = sizeof(struct statistics),
-        .max_entries = 65535,
+	.type = BPF_MAP_TYPE_LRU_HASH,
+	.key_size = sizeof(struct tuple),
+	.value_size = sizeof(struct statistics),
+	.max_entries = RTT_MAP_ENTRIES,
 };
 
+/*
+ * Per CPU and event type counters, indexed by
+ * cpu * PPM_EVENT_MAX + evt_type. The size is set by userspace.
+ */
+struct bpf_map_def __bpf_section("maps") evt_type_stats_map = {
+	.type = BPF_MAP_TYPE_ARRAY,
+	.key_size = sizeof(u32),
+	.value_size = sizeof(struct ppm_evt_type_stats),
+	.max_entries = 0,
+};
+
+#ifdef BPF_SUPPORTS_RINGBUF
+/*
+ * One BPF_MAP_TYPE_RINGBUF per group of CPUs, indexed by the ringbuf_group
+ * of the per-cpu state. The inner maps are created by userspace, and only
+ * used when settings->ringbuf is set.
+ */
+struct bpf_map_def __bpf_section("maps") ringbuf_maps = {
+	.type = BPF_MAP_TYPE_ARRAY_OF_MAPS,
+	.key_size = sizeof(u32),
+	.value_size = sizeof(u32),
+	.max_entries = 0,
+};
+#endif
+
 #endif // __KERNEL__
 
 #endif
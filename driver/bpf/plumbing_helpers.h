@@ -281,6 +281,51 @@ static __always_inline bool release_local_state(struct sysdig_bpf_per_cpu_state
 	return true;
 }
 
+/*
+ * Account the event that just went through the fillers to its type. The
+ * time is measured from the timestamp of the event, taken by
+ * call_filler()/prepare_filler() when the probe started processing it.
+ */
+static __always_inline void update_evt_type_stats(struct sysdig_bpf_per_cpu_state *state,
+						  unsigned int cpu)
+{
+	struct sysdig_bpf_settings *settings;
+	struct ppm_evt_type_stats *stats;
+	u32 evt_type = state->tail_ctx.evt_type;
+	unsigned long long now;
+	u32 key;
+
+	if (evt_type >= PPM_EVENT_MAX)
+		return;
+
+	key = cpu * PPM_EVENT_MAX + evt_type;
+	stats = bpf_map_lookup_elem(&evt_type_stats_map, &key);
+	if (!stats)
+		return;
+
+	switch (state->tail_ctx.prev_res) {
+	case PPM_SUCCESS:
+		++stats->n_evts;
+		stats->n_bytes += state->tail_ctx.len;
+		break;
+	case PPM_FAILURE_BUFFER_FULL:
+	case PPM_FAILURE_INVALID_USER_MEMORY:
+	case PPM_FAILURE_BUG:
+		++stats->n_drops;
+		break;
+	default:
+		return;
+	}
+
+	settings = get_bpf_settings();
+	if (!settings)
+		return;
+
+	now = settings->boot_time + bpf_ktime_get_ns();
+	if (now > state->tail_ctx.ts)
+		stats->n_ns += now - state->tail_ctx.ts;
+}
+
 static __always_inline int init_filler_data(void *ctx,
 					    struct filler_data *data,
 					    bool is_syscall)
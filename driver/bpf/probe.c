@@ -340,46 +340,132 @@ BPF_KPROBE(tcp_drop)
 	return 0;
 }
 
+static __always_inline u32 rtt_hist_bucket(u32 srtt)
+{
+	u32 bucket = 0;
+
+	if (srtt >> 16) {
+		bucket += 16;
+		srtt >>= 16;
+	}
+	if (srtt >> 8) {
+		bucket += 8;
+		srtt >>= 8;
+	}
+	if (srtt >> 4) {
+		bucket += 4;
+		srtt >>= 4;
+	}
+	if (srtt >> 2) {
+		bucket += 2;
+		srtt >>= 2;
+	}
+	if (srtt >> 1)
+		bucket += 1;
+
+	if (bucket >= RTT_HIST_BUCKETS)
+		bucket = RTT_HIST_BUCKETS - 1;
+
+	return bucket;
+}
+
+/*
+ * The counters are updated with atomic adds since the samples of a
+ * connection can come from different CPUs, min and max can race and miss
+ * a sample, which is fine for a statistic. Entries are created with
+ * rtt_init_sample(), so min_srtt is only 0 for a 0us sample.
+ */
+static __always_inline void rtt_add_sample(struct statistics *st, u32 srtt)
+{
+	u32 bucket = rtt_hist_bucket(srtt);
+
+	__sync_fetch_and_add(&st->count, 1);
+	__sync_fetch_and_add(&st->sum_srtt, srtt);
+	__sync_fetch_and_add(&st->hist[bucket], 1);
+
+	if (srtt < st->min_srtt)
+		st->min_srtt = srtt;
+	if (srtt > st->max_srtt)
+		st->max_srtt = srtt;
+}
+
+static __always_inline void rtt_init_sample(struct statistics *st, u32 srtt)
+{
+	st->count = 1;
+	st->sum_srtt = srtt;
+	st->min_srtt = srtt;
+	st->max_srtt = srtt;
+	st->hist[rtt_hist_bucket(srtt)] = 1;
+}
+
+/*
+ * Key of the connection in rtt_static_map. The local address of an IPv6
+ * socket bound to the wildcard address is left as such, it's still unique
+ * together with the ports.
+ */
+static __always_inline void rtt_fill_tuple(struct sock *sk, struct tuple *tp)
+{
+	const struct inet_sock *inet = inet_sk(sk);
+
+	bpf_probe_read(&tp->sport, sizeof(tp->sport), (void *)&inet->inet_sport);
+	bpf_probe_read(&tp->dport, sizeof(tp->dport), (void *)&inet->inet_dport);
+	bpf_probe_read(&tp->family, sizeof(tp->family), (void *)&sk->__sk_common.skc_family);
+
+	if (tp->family == AF_INET6) {
+		bpf_probe_read(tp->saddr, sizeof(tp->saddr), (void *)&sk->sk_v6_rcv_saddr);
+		bpf_probe_read(tp->daddr, sizeof(tp->daddr), (void *)&sk->sk_v6_daddr);
+	} else {
+		bpf_probe_read(&tp->saddr[0], sizeof(tp->saddr[0]), (void *)&inet->inet_saddr);
+		bpf_probe_read(&tp->daddr[0], sizeof(tp->daddr[0]), (void *)&inet->inet_daddr);
+	}
+
+	tp->pad = 1;
+}
+
 BPF_KPROBE(tcp_rcv_established)
 {
-	u16 sport = 0;
-	u16 dport = 0;
-	u32 saddr = 0;
-	u32 daddr = 0;
-	u16 family = 0;
 	struct sysdig_bpf_settings *settings;
+	struct sysdig_bpf_per_cpu_state *state;
 	enum ppm_event_type evt_type;
 	settings = get_bpf_settings();
 	if (!settings)
 		return 0;
 	struct sock *sk = (struct sock *)_READ(ctx->di);
 	struct tcp_sock *ts = tcp_sk(sk);
-	const struct inet_sock *inet = inet_sk(sk);
-
-	bpf_probe_read(&sport, sizeof(sport), (void *)&inet->inet_sport);
-	bpf_probe_read(&dport, sizeof(dport), (void *)&inet->inet_dport);
-	bpf_probe_read(&saddr, sizeof(saddr), (void *)&inet->inet_saddr);
-	bpf_probe_read(&daddr, sizeof(daddr), (void *)&inet->inet_daddr);
-	bpf_probe_read(&family, sizeof(family), (void *)&sk->__sk_common.skc_family);
 
 	struct tuple tp = {0};
-	tp.daddr = daddr;
-	tp.dport = dport;
-	tp.saddr = saddr;
-	tp.sport = sport;
-	tp.family = family;
-	tp.pad = 1;
-	if(ntohs(sport) == 22 || ntohs(dport) == 22 || ntohs(sport) == 0 || ntohs(dport) == 0) {
+	rtt_fill_tuple(sk, &tp);
+	if(ntohs(tp.sport) == 22 || ntohs(tp.dport) == 22 || ntohs(tp.sport) == 0 || ntohs(tp.dport) == 0) {
 		return 0;
 	}
 
+	/*
+	 * In aggregation mode the samples are only accumulated in the map,
+	 * userspace reads and deletes the entries periodically. Otherwise an
+	 * event is sent at most once per rtt_interval_ns per connection.
+	 */
 	struct statistics *st = bpf_map_lookup_elem(&rtt_static_map, &tp);
 	if (!st) {
 		struct statistics new_st = {0};
 		new_st.last_time = bpf_ktime_get_ns();
+		if (settings->rtt_aggregate)
+			rtt_init_sample(&new_st, _READ(ts->srtt_us) >> 3);
 		int ret = bpf_map_update_elem(&rtt_static_map, &tp, &new_st, BPF_NOEXIST);
+
+		/*
+		 * -EEXIST is another CPU adding the same connection first
+		 */
+		state = get_local_state(bpf_get_smp_processor_id());
+		if (state) {
+			if (ret == 0)
+				state->n_rtt_inserts++;
+			else if (ret != -EEXIST)
+				state->n_rtt_insert_fails++;
+		}
+	} else if (settings->rtt_aggregate) {
+		rtt_add_sample(st, _READ(ts->srtt_us) >> 3);
 	} else {
-		if (bpf_ktime_get_ns() - st->last_time > 5000000000) {
+		if (bpf_ktime_get_ns() - st->last_time > settings->rtt_interval_ns) {
 			st->last_time = bpf_ktime_get_ns();
 			evt_type = PPME_TCP_RCV_ESTABLISHED_E;
 			if(prepare_filler(ctx, ctx, evt_type, settings, UF_NEVER_DROP)) {
@@ -393,38 +479,31 @@ BPF_KPROBE(tcp_rcv_established)
 
 BPF_KPROBE(tcp_close)
 {
-	u16 sport = 0;
-	u16 dport = 0;
-	u32 saddr = 0;
-	u32 daddr = 0;
-	u16 family = 0;
 	struct sysdig_bpf_settings *settings;
+	struct sysdig_bpf_per_cpu_state *state;
 	enum ppm_event_type evt_type;
 	settings = get_bpf_settings();
 	if (!settings)
 		return 0;
 
 	struct sock *sk = (struct sock *)_READ(ctx->di);
-	struct tcp_sock *ts = tcp_sk(sk);
-	const struct inet_sock *inet = inet_sk(sk);
-
-	bpf_probe_read(&sport, sizeof(sport), (void *)&inet->inet_sport);
-	bpf_probe_read(&dport, sizeof(dport), (void *)&inet->inet_dport);
-	bpf_probe_read(&saddr, sizeof(saddr), (void *)&inet->inet_saddr);
-	bpf_probe_read(&daddr, sizeof(daddr), (void *)&inet->inet_daddr);
-	bpf_probe_read(&family, sizeof(family), (void *)&sk->__sk_common.skc_family);
 
 	struct tuple tp = {0};
-	tp.daddr = daddr;
-	tp.dport = dport;
-	tp.saddr = saddr;
-	tp.sport = sport;
-	tp.family = family;
-	tp.pad = 1;
-
-	int res = bpf_map_delete_elem(&rtt_static_map, &tp);
+	rtt_fill_tuple(sk, &tp);
+
+	/*
+	 * The aggregates of a closed connection are left for userspace to
+	 * collect, it deletes them with the next read. The entry may already
+	 * have been evicted, only the actual deletes are counted.
+	 */
+	if (!settings->rtt_aggregate &&
+	    bpf_map_delete_elem(&rtt_static_map, &tp) == 0) {
+		state = get_local_state(bpf_get_smp_processor_id());
+		if (state)
+			state->n_rtt_deletes++;
+	}
 
-	if(ntohs(sport)==22||ntohs(dport)==22||ntohs(sport)==0||ntohs(dport)==0){
+	if(ntohs(tp.sport)==22||ntohs(tp.dport)==22||ntohs(tp.sport)==0||ntohs(tp.dport)==0){
 		return 0;
 	}
 	evt_type = PPME_TCP_CLOSE_E;
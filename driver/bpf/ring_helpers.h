@@ -42,6 +42,44 @@ static __always_inline void fixup_evt_arg_len(char *p,
 	*((u16 *)&p[sizeof(struct ppm_evt_hdr)] + (argnumv & (PPM_MAX_EVENT_PARAMS - 1))) = arglen;
 }
 
+#ifdef BPF_SUPPORTS_RINGBUF
+static __always_inline int push_evt_frame_ringbuf(struct filler_data *data)
+{
+	unsigned long long flags = BPF_RB_NO_WAKEUP;
+	u32 group = data->state->ringbuf_group;
+	void *ringbuf;
+	int res;
+
+	ringbuf = bpf_map_lookup_elem(&ringbuf_maps, &group);
+	if (!ringbuf) {
+		bpf_printk("ring buffer %u not found\n", group);
+		return PPM_FAILURE_BUG;
+	}
+
+	/*
+	 * Only wake up the reader once the watermark is reached, and never
+	 * if it doesn't wait for us
+	 */
+	if (data->settings->ringbuf_wakeup_watermark &&
+	    bpf_ringbuf_query(ringbuf, BPF_RB_AVAIL_DATA) + data->state->tail_ctx.len >=
+	    data->settings->ringbuf_wakeup_watermark)
+		flags = BPF_RB_FORCE_WAKEUP;
+
+	res = bpf_ringbuf_output(ringbuf,
+				 data->buf,
+				 data->state->tail_ctx.len & SCRATCH_SIZE_MAX,
+				 flags);
+	/*
+	 * The only failure is the ring buffer being full, account it like
+	 * the other buffer drops
+	 */
+	if (res)
+		return PPM_FAILURE_BUFFER_FULL;
+
+	return PPM_SUCCESS;
+}
+#endif
+
 static __always_inline int push_evt_frame(void *ctx,
 					  struct filler_data *data)
 {
@@ -58,6 +96,11 @@ static __always_inline int push_evt_frame(void *ctx,
 
 	fixup_evt_len(data->buf, data->state->tail_ctx.len);
 
+#ifdef BPF_SUPPORTS_RINGBUF
+	if (data->settings->ringbuf)
+		return push_evt_frame_ringbuf(data);
+#endif
+
 #ifdef BPF_FORBIDS_ZERO_ACCESS
 	int res = bpf_perf_event_output(ctx,
 					&perf_map,
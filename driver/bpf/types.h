@@ -220,15 +220,41 @@ struct perf_event_sample {
 
 #endif /* __KERNEL__ */
 
+/*
+ * Number of log2 buckets of the srtt histogram, in microseconds. The last
+ * bucket also counts everything above it.
+ */
+#define RTT_HIST_BUCKETS 20
+
+/*
+ * Value of rtt_static_map. last_time rate limits the tcp_rcv_established
+ * events of a connection, the rest is only used when settings->rtt_aggregate
+ * is set and is drained by userspace.
+ */
 struct statistics {
 	uint64_t last_time;
+	uint64_t sum_srtt;
+	uint64_t count;
+	uint32_t min_srtt;
+	uint32_t max_srtt;
+	uint32_t hist[RTT_HIST_BUCKETS];
 };
 
+/*
+ * Size of rtt_static_map. It's an LRU hash, so once it's full the least
+ * recently updated connections are evicted to make room for the new ones.
+ */
+#define RTT_MAP_ENTRIES 65536
+
+/*
+ * Key of rtt_static_map. The addresses are in network byte order, an
+ * AF_INET connection only uses saddr[0] and daddr[0].
+ */
 struct tuple {
 	__u16 sport;
 	__u16 dport;
-	__u32 saddr;
-	__u32 daddr;
+	__u32 saddr[4];
+	__u32 daddr[4];
 	__u16 family;
 	__u16 pad;
 };
@@ -267,6 +293,10 @@ struct sysdig_bpf_settings {
 	uint16_t statsd_port;
 	char if_name[16];
 	bool events_mask[PPM_EVENT_MAX];
+	bool ringbuf;
+	uint32_t ringbuf_wakeup_watermark;
+	bool rtt_aggregate;
+	uint64_t rtt_interval_ns;
 } __attribute__((packed));
 
 struct tail_context {
@@ -284,7 +314,11 @@ struct sysdig_bpf_per_cpu_state {
 	unsigned long long n_drops_buffer;
 	unsigned long long n_drops_pf;
 	unsigned long long n_drops_bug;
+	unsigned long long n_rtt_inserts;
+	unsigned long long n_rtt_insert_fails;
+	unsigned long long n_rtt_deletes;
 	unsigned int hotplug_cpu;
+	unsigned int ringbuf_group;
 	bool in_use;
 } __attribute__((packed));
 
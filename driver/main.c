@@ -38,6 +38,7 @@ or GPL2.txt for full copies of the license.
 #endif
 #include <linux/vmalloc.h>
 #include <linux/wait.h>
+#include <linux/poll.h>
 #include <linux/tracepoint.h>
 #include <linux/cpu.h>
 #include <linux/jiffies.h>
@@ -143,6 +144,15 @@ static int ppm_open(struct inode *inode, struct file *filp);
 static int ppm_release(struct inode *inode, struct file *filp);
 static long ppm_ioctl(struct file *f, unsigned int cmd, unsigned long arg);
 static int ppm_mmap(struct file *filp, struct vm_area_struct *vma);
+#ifdef CAPTURE_WAKEUP
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 16, 0))
+typedef __poll_t ppm_poll_t;
+#else
+typedef unsigned int ppm_poll_t;
+#endif
+static ppm_poll_t ppm_poll(struct file *filp, poll_table *wait);
+static void ppm_wakeup_work(struct irq_work *work);
+#endif
 static int record_event_consumer(struct ppm_consumer_t *consumer,
                                  enum ppm_event_type event_type,
                                  enum syscall_flags drop_flags,
@@ -151,7 +161,7 @@ static int record_event_consumer(struct ppm_consumer_t *consumer,
 static void record_event_all_consumers(enum ppm_event_type event_type,
                                        enum syscall_flags drop_flags,
                                        struct event_data_t *event_datap);
-static int init_ring_buffer(struct ppm_ring_buffer_context *ring);
+static int init_ring_buffer(struct ppm_ring_buffer_context *ring, u32 size);
 static void free_ring_buffer(struct ppm_ring_buffer_context *ring);
 static void reset_ring_buffer(struct ppm_ring_buffer_context *ring);
 #if (LINUX_VERSION_CODE < KERNEL_VERSION(4, 4, 0))
@@ -200,6 +210,9 @@ static const struct file_operations g_ppm_fops = {
 	.release = ppm_release,
 	.mmap = ppm_mmap,
 	.unlocked_ioctl = ppm_ioctl,
+#ifdef CAPTURE_WAKEUP
+	.poll = ppm_poll,
+#endif
 	.owner = THIS_MODULE,
 };
 
@@ -242,6 +255,9 @@ static bool verbose = 0;
 #endif
 
 static unsigned int max_consumers = 5;
+static unsigned int ring_buf_size = RING_BUF_SIZE;
+/* The ring offsets are kept in signed integers */
+#define MAX_RING_BUF_SIZE (1U << 30)
 
 #if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 10, 0))
 static enum cpuhp_state hp_state = 0;
@@ -489,6 +505,27 @@ static int ppm_open(struct inode *inode, struct file *filp)
 
 		consumer->consumer_id = consumer_id;
 
+		/*
+		 * The size of the rings is latched when the consumer is created, so
+		 * that changing the parameter doesn't affect the running consumers.
+		 * The userspace side relies on the buffer being a power of two
+		 * multiple of the page size.
+		 */
+		consumer->ring_buf_size = READ_ONCE(ring_buf_size);
+		if (consumer->ring_buf_size < 2 * PAGE_SIZE ||
+		    consumer->ring_buf_size > MAX_RING_BUF_SIZE ||
+		    (consumer->ring_buf_size & (consumer->ring_buf_size - 1)) != 0) {
+			pr_err("invalid ring buffer size %u, must be a power of two between %lu and %u bytes\n",
+			       consumer->ring_buf_size,
+			       2 * PAGE_SIZE,
+			       MAX_RING_BUF_SIZE);
+
+			vfree(consumer);
+
+			ret = -EINVAL;
+			goto cleanup_open;
+		}
+
 		/*
 		 * Initialize the ring buffers array
 		 */
@@ -516,6 +553,11 @@ static int ppm_open(struct inode *inode, struct file *filp)
 			ring->str_storage = NULL;
 			ring->buffer = NULL;
 			ring->info = NULL;
+			ring->evt_stats = NULL;
+#ifdef CAPTURE_WAKEUP
+			init_waitqueue_head(&ring->wait_queue);
+			init_irq_work(&ring->wakeup_work, ppm_wakeup_work);
+#endif
 		}
 
 		/*
@@ -531,7 +573,7 @@ static int ppm_open(struct inode *inode, struct file *filp)
 
 			pr_info("initializing ring buffer for CPU %u\n", cpu);
 
-			if (!init_ring_buffer(ring)) {
+			if (!init_ring_buffer(ring, consumer->ring_buf_size)) {
 				pr_err("can't initialize the ring buffer for CPU %u\n", cpu);
 				ret = -ENOMEM;
 				goto err_init_ring_buffer;
@@ -585,6 +627,7 @@ static int ppm_open(struct inode *inode, struct file *filp)
 	consumer->fullcapture_port_range_start = 0;
 	consumer->fullcapture_port_range_end = 0;
 	consumer->statsd_port = PPM_PORT_STATSD;
+	consumer->wakeup_watermark = 0;
 	bitmap_fill(g_events_mask, PPM_EVENT_MAX); /* Enable all syscall to be passed to userspace */
 	reset_ring_buffer(ring);
 	ring->open = true;
@@ -986,6 +1029,33 @@ cleanup_ioctl_procinfo:
 		ret = 0;
 		goto cleanup_ioctl;
 	}
+	case PPM_IOCTL_GET_EVT_TYPE_STATS:
+	{
+#if LINUX_VERSION_CODE > KERNEL_VERSION(2, 6, 20)
+		int ring_no = iminor(filp->f_path.dentry->d_inode);
+#else
+		int ring_no = iminor(filp->f_dentry->d_inode);
+#endif
+		struct ppm_ring_buffer_context *ring = per_cpu_ptr(consumer->ring_buffers, ring_no);
+
+		if (!ring || !ring->evt_stats) {
+			ASSERT(false);
+			ret = -ENODEV;
+			goto cleanup_ioctl;
+		}
+
+		/*
+		 * The counters are updated without locks by the probes, a
+		 * concurrent update can make a single entry slightly stale
+		 */
+		if (copy_to_user((void *)arg, ring->evt_stats, sizeof(struct ppm_evt_type_stats) * PPM_EVENT_MAX)) {
+			ret = -EINVAL;
+			goto cleanup_ioctl;
+		}
+
+		ret = 0;
+		goto cleanup_ioctl;
+	}
 	case PPM_IOCTL_ENABLE_CAPTURE:
 	{
 #if LINUX_VERSION_CODE > KERNEL_VERSION(2, 6, 20)
@@ -1106,6 +1176,26 @@ cleanup_ioctl_procinfo:
 		ret = 0;
 		goto cleanup_ioctl;
 	}
+	case PPM_IOCTL_SET_WAKEUP_WATERMARK:
+	{
+#ifdef CAPTURE_WAKEUP
+		if (arg >= consumer->ring_buf_size) {
+			pr_err("invalid wakeup watermark %lu\n", arg);
+			ret = -EINVAL;
+			goto cleanup_ioctl;
+		}
+
+		consumer->wakeup_watermark = (u32)arg;
+
+		pr_info("new wakeup_watermark: %u\n", consumer->wakeup_watermark);
+
+		ret = 0;
+#else
+		pr_err("kernel doesn't support the wakeup watermark\n");
+		ret = -EINVAL;
+#endif
+		goto cleanup_ioctl;
+	}
 	case PPM_IOCTL_MASK_ZERO_EVENTS:
 	{
 		vpr_info("PPM_IOCTL_MASK_ZERO_EVENTS, consumer %p\n", consumer_id);
@@ -1352,23 +1442,6 @@ static int ppm_mmap(struct file *filp, struct vm_area_struct *vma)
 		       length,
 		       PAGE_SIZE);
 
-		/*
-		 * Enforce ring buffer size
-		 */
-		if (RING_BUF_SIZE < 2 * PAGE_SIZE) {
-			pr_err("Ring buffer size too small (%ld bytes, must be at least %ld bytes\n",
-			       (long)RING_BUF_SIZE,
-			       (long)PAGE_SIZE);
-			ret = -EIO;
-			goto cleanup_mmap;
-		}
-
-		if (RING_BUF_SIZE / PAGE_SIZE * PAGE_SIZE != RING_BUF_SIZE) {
-			pr_err("Ring buffer size is not a multiple of the page size\n");
-			ret = -EIO;
-			goto cleanup_mmap;
-		}
-
 		/*
 		 * Retrieve the ring structure for this CPU
 		 */
@@ -1400,7 +1473,7 @@ static int ppm_mmap(struct file *filp, struct vm_area_struct *vma)
 
 			ret = 0;
 			goto cleanup_mmap;
-		} else if (length == RING_BUF_SIZE * 2) {
+		} else if (length == (long)consumer->ring_buf_size * 2) {
 			long mlength;
 
 			/*
@@ -1481,6 +1554,60 @@ cleanup_mmap:
 	return ret;
 }
 
+#ifdef CAPTURE_WAKEUP
+static void ppm_wakeup_work(struct irq_work *work)
+{
+	struct ppm_ring_buffer_context *ring = container_of(work, struct ppm_ring_buffer_context, wakeup_work);
+
+	wake_up_interruptible(&ring->wait_queue);
+}
+
+/*
+ * The device is readable when the data in the ring reaches the consumer
+ * watermark, see PPM_IOCTL_SET_WAKEUP_WATERMARK. The consumer can't go away
+ * while one of its devices is open, so there's no need to take
+ * g_consumer_mutex here.
+ */
+static ppm_poll_t ppm_poll(struct file *filp, poll_table *wait)
+{
+	u32 head;
+	u32 tail;
+	u32 used;
+#if LINUX_VERSION_CODE > KERNEL_VERSION(2, 6, 20)
+	int ring_no = iminor(filp->f_path.dentry->d_inode);
+#else
+	int ring_no = iminor(filp->f_dentry->d_inode);
+#endif
+	struct task_struct *consumer_id = filp->private_data;
+	struct ppm_consumer_t *consumer = NULL;
+	struct ppm_ring_buffer_context *ring;
+
+	consumer = ppm_find_consumer(consumer_id);
+	if (!consumer) {
+		pr_err("poll: unknown consumer %p\n", consumer_id);
+		return POLLERR;
+	}
+
+	ring = per_cpu_ptr(consumer->ring_buffers, ring_no);
+	if (!ring->open) {
+		return POLLERR;
+	}
+
+	poll_wait(filp, &ring->wait_queue, wait);
+
+	smp_mb();
+
+	head = ring->info->head;
+	tail = ring->info->tail;
+	used = (head >= tail) ? head - tail : consumer->ring_buf_size + head - tail;
+
+	if (used >= consumer->wakeup_watermark)
+		return POLLIN | POLLRDNORM;
+
+	return 0;
+}
+#endif
+
 /* Argument list sizes for sys_socketcall */
 #define AL(x) ((x) * sizeof(unsigned long))
 static const unsigned char nas[21] = {
@@ -1732,6 +1859,23 @@ static inline int drop_event(struct ppm_consumer_t *consumer,
 	return 0;
 }
 
+/*
+ * Account to its type an event dropped before it got to the ring buffer
+ */
+static inline void count_evt_type_drop(struct ppm_consumer_t *consumer,
+				       enum ppm_event_type event_type)
+{
+	struct ppm_ring_buffer_context *ring;
+
+	ring = per_cpu_ptr(consumer->ring_buffers, get_cpu());
+	ASSERT(ring);
+
+	if (ring->capture_enabled)
+		ring->evt_stats[event_type].n_drops++;
+
+	put_cpu();
+}
+
 static void record_event_all_consumers(enum ppm_event_type event_type,
 	enum syscall_flags drop_flags,
 	struct event_data_t *event_datap)
@@ -1769,6 +1913,8 @@ static int record_event_consumer(struct ppm_consumer_t *consumer,
 	int drop = 1;
 	int32_t cbres = PPM_SUCCESS;
 	int cpu;
+	u32 ring_size = consumer->ring_buf_size;
+	struct ppm_evt_type_stats *evt_stats;
 
 	if (!test_bit(event_type, g_events_mask))
 		return res;
@@ -1783,8 +1929,10 @@ static int record_event_consumer(struct ppm_consumer_t *consumer,
 		               event_type,
 		               drop_flags,
 		               ns,
-		               event_datap->event_info.syscall_data.regs))
+		               event_datap->event_info.syscall_data.regs)) {
+			count_evt_type_drop(consumer, event_type);
 			return res;
+		}
 	}
 
 	/*
@@ -1829,6 +1977,7 @@ static int record_event_consumer(struct ppm_consumer_t *consumer,
 			ring_info->n_preemptions++;
 			ASSERT(false);
 		}
+		ring->evt_stats[event_type].n_drops++;
 		atomic_dec(&ring->preempt_count);
 		put_cpu();
 		return res;
@@ -1843,16 +1992,16 @@ static int record_event_consumer(struct ppm_consumer_t *consumer,
 	if (ttail > head)
 		freespace = ttail - head - 1;
 	else
-		freespace = RING_BUF_SIZE + ttail - head - 1;
+		freespace = ring_size + ttail - head - 1;
 
-	usedspace = RING_BUF_SIZE - freespace - 1;
-	delta_from_end = RING_BUF_SIZE + (2 * PAGE_SIZE) - head - 1;
+	usedspace = ring_size - freespace - 1;
+	delta_from_end = ring_size + (2 * PAGE_SIZE) - head - 1;
 
-	ASSERT(freespace <= RING_BUF_SIZE);
-	ASSERT(usedspace <= RING_BUF_SIZE);
-	ASSERT(ttail <= RING_BUF_SIZE);
-	ASSERT(head <= RING_BUF_SIZE);
-	ASSERT(delta_from_end < RING_BUF_SIZE + (2 * PAGE_SIZE));
+	ASSERT(freespace <= ring_size);
+	ASSERT(usedspace <= ring_size);
+	ASSERT(ttail <= ring_size);
+	ASSERT(head <= ring_size);
+	ASSERT(delta_from_end < ring_size + (2 * PAGE_SIZE));
 	ASSERT(delta_from_end > (2 * PAGE_SIZE) - 1);
 #ifdef _HAS_SOCKETCALL
 	/*
@@ -2024,20 +2173,20 @@ static int record_event_consumer(struct ppm_consumer_t *consumer,
 
 		next = head + event_size;
 
-		if (unlikely(next >= RING_BUF_SIZE)) {
+		if (unlikely(next >= ring_size)) {
 			/*
 			 * If something has been written in the cushion space at the end of
 			 * the buffer, copy it to the beginning and wrap the head around.
 			 * Note, we don't check that the copy fits because we assume that
 			 * filler_callback failed if the space was not enough.
 			 */
-			if (next > RING_BUF_SIZE) {
+			if (next > ring_size) {
 				memcpy(ring->buffer,
-				ring->buffer + RING_BUF_SIZE,
-				next - RING_BUF_SIZE);
+				ring->buffer + ring_size,
+				next - ring_size);
 			}
 
-			next -= RING_BUF_SIZE;
+			next -= ring_size;
 		}
 
 		/*
@@ -2050,6 +2199,26 @@ static int record_event_consumer(struct ppm_consumer_t *consumer,
 		ring_info->head = next;
 
 		++ring->nevents;
+
+#ifdef CAPTURE_WAKEUP
+		/*
+		 * Wake up the reader once the buffer crosses the watermark. We can't
+		 * call wake_up() from here, since some of the probes run with the
+		 * runqueue lock held, so the wakeup is deferred to an irq_work.
+		 * The barrier pairs with the one in ppm_poll(): either the reader
+		 * sees the new head, or we see it on the wait queue.
+		 */
+		if (consumer->wakeup_watermark) {
+			smp_mb();
+
+			if (waitqueue_active(&ring->wait_queue)) {
+				u32 used = ((u32)next >= ttail) ? (u32)next - ttail : ring_size + (u32)next - ttail;
+
+				if (used >= consumer->wakeup_watermark)
+					irq_work_queue(&ring->wakeup_work);
+			}
+		}
+#endif
 	} else {
 		if (cbres == PPM_SUCCESS) {
 			ASSERT(freespace < sizeof(struct ppm_evt_hdr) + args.arg_data_offset);
@@ -2066,11 +2235,23 @@ static int record_event_consumer(struct ppm_consumer_t *consumer,
 		}
 	}
 
+	/*
+	 * Per event type accounting. n_ns is left to the BPF probe: measuring it
+	 * here would take a second clock read for every event.
+	 */
+	evt_stats = &ring->evt_stats[event_type];
+	if (likely(!drop)) {
+		evt_stats->n_evts++;
+		evt_stats->n_bytes += event_size;
+	} else {
+		evt_stats->n_drops++;
+	}
+
 	if (MORE_THAN_ONE_SECOND_AHEAD(ns, ring->last_print_time + 1) && !(drop_flags & UF_ATOMIC)) {
 		vpr_info("consumer:%p CPU:%d, use:%d%%, ev:%llu, dr_buf:%llu, dr_pf:%llu, pr:%llu, cs:%llu\n",
 			   consumer->consumer_id,
 		       smp_processor_id(),
-		       (usedspace * 100) / RING_BUF_SIZE,
+		       usedspace / (ring_size / 100),
 		       ring_info->n_evts,
 		       ring_info->n_drops_buffer,
 		       ring_info->n_drops_pf,
@@ -2491,7 +2672,7 @@ TRACEPOINT_PROBE(net_dev_xmit_probe, struct sk_buff *skb, int rc, struct net_dev
 }
 #endif
 
-static int init_ring_buffer(struct ppm_ring_buffer_context *ring)
+static int init_ring_buffer(struct ppm_ring_buffer_context *ring, u32 size)
 {
 	unsigned int j;
 
@@ -2509,13 +2690,13 @@ static int init_ring_buffer(struct ppm_ring_buffer_context *ring)
 	 * Note how we allocate 2 additional pages: they are used as additional overflow space for
 	 * the event data generation functions, so that they always operate on a contiguous buffer.
 	 */
-	ring->buffer = vmalloc(RING_BUF_SIZE + 2 * PAGE_SIZE);
+	ring->buffer = vmalloc(size + 2 * PAGE_SIZE);
 	if (ring->buffer == NULL) {
 		pr_err("Error allocating ring memory\n");
 		goto init_ring_err;
 	}
 
-	for (j = 0; j < RING_BUF_SIZE + 2 * PAGE_SIZE; j++)
+	for (j = 0; j < size + 2 * PAGE_SIZE; j++)
 		ring->buffer[j] = 0;
 
 	/*
@@ -2527,13 +2708,19 @@ static int init_ring_buffer(struct ppm_ring_buffer_context *ring)
 		goto init_ring_err;
 	}
 
+	ring->evt_stats = vmalloc(sizeof(struct ppm_evt_type_stats) * PPM_EVENT_MAX);
+	if (ring->evt_stats == NULL) {
+		pr_err("Error allocating ring memory\n");
+		goto init_ring_err;
+	}
+
 	/*
 	 * Initialize the buffer info structure
 	 */
 	reset_ring_buffer(ring);
 	atomic_set(&ring->preempt_count, 0);
 
-	pr_info("CPU buffer initialized, size=%d\n", RING_BUF_SIZE);
+	pr_info("CPU buffer initialized, size=%u\n", size);
 
 	return 1;
 
@@ -2544,11 +2731,20 @@ init_ring_err:
 
 static void free_ring_buffer(struct ppm_ring_buffer_context *ring)
 {
+#ifdef CAPTURE_WAKEUP
+	irq_work_sync(&ring->wakeup_work);
+#endif
+
 	if (ring->info) {
 		vfree(ring->info);
 		ring->info = NULL;
 	}
 
+	if (ring->evt_stats) {
+		vfree(ring->evt_stats);
+		ring->evt_stats = NULL;
+	}
+
 	if (ring->buffer) {
 		vfree((void *)ring->buffer);
 		ring->buffer = NULL;
@@ -2576,6 +2772,7 @@ static void reset_ring_buffer(struct ppm_ring_buffer_context *ring)
 	ring->info->n_drops_pf = 0;
 	ring->info->n_preemptions = 0;
 	ring->info->n_context_switches = 0;
+	memset(ring->evt_stats, 0, sizeof(struct ppm_evt_type_stats) * PPM_EVENT_MAX);
 	ring->last_print_time = ppm_nsecs();
 }
 
@@ -2973,6 +3170,8 @@ MODULE_VERSION(PROBE_VERSION);
 
 module_param(max_consumers, uint, 0444);
 MODULE_PARM_DESC(max_consumers, "Maximum number of consumers that can simultaneously open the devices");
+module_param(ring_buf_size, uint, 0644);
+MODULE_PARM_DESC(ring_buf_size, "Size in bytes of the per-CPU ring buffers of the next consumer, must be a power of two multiple of the page size");
 #if LINUX_VERSION_CODE > KERNEL_VERSION(2, 6, 20)
 module_param(verbose, bool, 0444);
 #endif
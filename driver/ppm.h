@@ -37,6 +37,11 @@ or GPL2.txt for full copies of the license.
 #if (LINUX_VERSION_CODE > KERNEL_VERSION(3, 12, 0)) && defined(CONFIG_X86)
 #define CAPTURE_PAGE_FAULTS
 #endif
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(3, 8, 0))
+#define CAPTURE_WAKEUP
+#include <linux/wait.h>
+#include <linux/irq_work.h>
+#endif
 #endif // UDIG
 #define RW_SNAPLEN_EVENT 4096
 #define DPI_LOOKAHEAD_SIZE 16
@@ -66,6 +71,11 @@ struct ppm_ring_buffer_context {
 	atomic_t preempt_count;
 #endif	
 	char *str_storage;	/* String storage. Size is one page. */
+	struct ppm_evt_type_stats *evt_stats;	/* PPM_EVENT_MAX per event type counters */
+#ifdef CAPTURE_WAKEUP
+	wait_queue_head_t wait_queue;	/* Readers polling the device */
+	struct irq_work wakeup_work;	/* Wakes up the readers outside of the probe context */
+#endif
 };
 
 #ifndef UDIG
@@ -88,6 +98,8 @@ struct ppm_consumer_t {
 	uint16_t fullcapture_port_range_start;
 	uint16_t fullcapture_port_range_end;
 	uint16_t statsd_port;
+	u32 wakeup_watermark;
+	u32 ring_buf_size;
 };
 #endif // UDIG
 
@@ -1502,6 +1502,8 @@ struct ppm_evt_hdr {
 #define PPM_IOCTL_GET_PROBE_VERSION _IO(PPM_IOCTL_MAGIC, 21)
 #define PPM_IOCTL_SET_FULLCAPTURE_PORT_RANGE _IO(PPM_IOCTL_MAGIC, 22)
 #define PPM_IOCTL_SET_STATSD_PORT _IO(PPM_IOCTL_MAGIC, 23)
+#define PPM_IOCTL_SET_WAKEUP_WATERMARK _IO(PPM_IOCTL_MAGIC, 24)
+#define PPM_IOCTL_GET_EVT_TYPE_STATS _IO(PPM_IOCTL_MAGIC, 25)
 #endif // CYGWING_AGENT
 
 extern const struct ppm_name_value socket_families[];
@@ -1549,6 +1551,18 @@ enum ppm_driver_event_id {
 	DEI_ENABLE_DROPPING = 2,
 };
 
+/*!
+  \brief Counters of an event type. The kernel module keeps them per ring
+  and returns PPM_EVENT_MAX of them with the PPM_IOCTL_GET_EVT_TYPE_STATS
+  IOCTL, the BPF probe keeps them per CPU in evt_type_stats_map.
+*/
+struct ppm_evt_type_stats {
+	uint64_t n_evts;	/* Events written to the buffer. */
+	uint64_t n_drops;	/* Events dropped (buffer full, page faults, bugs). The kernel module also counts the events discarded by the dropping mode or lost to preemption. */
+	uint64_t n_bytes;	/* Bytes written to the buffer. */
+	uint64_t n_ns;		/* Time spent in the driver generating the events, written or dropped. Only measured by the BPF probe. */
+};
+
 /*!
   \brief Process information as returned by the PPM_IOCTL_GET_PROCLIST IOCTL.
 */
@@ -14,7 +14,11 @@ or GPL2.txt for full copies of the license.
 #include <linux/types.h>
 #endif
 
-static const __u32 RING_BUF_SIZE = 8 * 1024 * 1024;
+/*
+ * Default size of the per-CPU ring buffers. The kernel module takes the
+ * actual size from its ring_buf_size parameter when a consumer is created.
+ */
+#define RING_BUF_SIZE (8 * 1024 * 1024)
 static const __u32 MIN_USERSPACE_READ_SIZE = 128 * 1024;
 
 /*
@@ -90,6 +90,56 @@ void lua_stackdump(lua_State *L)
 
 	printf("\n");  // end the listing
 }
+
+//
+// Replacements of print() and io.write() for the chisels whose output
+// doesn't go to stdout. The stream is the upvalue of the closure.
+//
+static int chisel_print(lua_State* ls)
+{
+	ostream* out = (ostream*)lua_touserdata(ls, lua_upvalueindex(1));
+	int n = lua_gettop(ls);
+
+	lua_getglobal(ls, "tostring");
+
+	for(int j = 1; j <= n; j++)
+	{
+		lua_pushvalue(ls, -1);
+		lua_pushvalue(ls, j);
+		lua_call(ls, 1, 1);
+
+		const char* s = lua_tostring(ls, -1);
+		if(s == NULL)
+		{
+			return luaL_error(ls, "'tostring' must return a string to 'print'");
+		}
+
+		if(j > 1)
+		{
+			*out << '\t';
+		}
+		*out << s;
+		lua_pop(ls, 1);
+	}
+
+	*out << '\n';
+	return 0;
+}
+
+static int chisel_write(lua_State* ls)
+{
+	ostream* out = (ostream*)lua_touserdata(ls, lua_upvalueindex(1));
+	int n = lua_gettop(ls);
+
+	for(int j = 1; j <= n; j++)
+	{
+		size_t len;
+		const char* s = luaL_checklstring(ls, j, &len);
+		out->write(s, len);
+	}
+
+	return 0;
+}
 #endif
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -246,9 +296,10 @@ void chiselinfo::set_callback_precise_interval(uint64_t interval)
 ///////////////////////////////////////////////////////////////////////////////
 // chisel implementation
 ///////////////////////////////////////////////////////////////////////////////
-sinsp_chisel::sinsp_chisel(sinsp* inspector, string filename)
+sinsp_chisel::sinsp_chisel(sinsp* inspector, string filename, ostream* out)
 {
 	m_inspector = inspector;
+	m_out = out;
 	m_ls = NULL;
 	m_lua_has_handle_evt = false;
 	m_lua_is_first_evt = true;
@@ -1213,6 +1264,11 @@ void sinsp_chisel::load(string cmdstr)
 	luaL_openlib(m_ls, "chisel", ll_chisel, 0);
 	luaL_openlib(m_ls, "evt", ll_evt, 0);
 
+	if(m_out != &cout)
+	{
+		redirect_output();
+	}
+
 	//
 	// Add our chisel paths to package.path
 	//
@@ -1460,6 +1516,24 @@ void sinsp_chisel::set_args(vector<pair<string, string>> args)
 #endif
 }
 
+void sinsp_chisel::redirect_output()
+{
+#ifdef HAS_LUA_CHISELS
+	lua_pushlightuserdata(m_ls, m_out);
+	lua_pushcclosure(m_ls, chisel_print, 1);
+	lua_setglobal(m_ls, "print");
+
+	lua_getglobal(m_ls, "io");
+	if(lua_istable(m_ls, -1))
+	{
+		lua_pushlightuserdata(m_ls, m_out);
+		lua_pushcclosure(m_ls, chisel_write, 1);
+		lua_setfield(m_ls, -2, "write");
+	}
+	lua_pop(m_ls, 1);
+#endif
+}
+
 void sinsp_chisel::on_init()
 {
 	//
@@ -1613,7 +1687,7 @@ bool sinsp_chisel::run(sinsp_evt* evt)
 	{
 		if(m_lua_cinfo->m_formatter->tostring(evt, &line))
 		{
-			cout << line << endl;
+			*m_out << line << endl;
 		}
 	}
 
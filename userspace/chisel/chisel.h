@@ -17,6 +17,8 @@ limitations under the License.
 
 #pragma once
 
+#include <iostream>
+
 /*!
 	\brief Add a new directory containing chisels.
 
@@ -110,7 +112,11 @@ private:
 class SINSP_PUBLIC sinsp_chisel
 {
 public:
-	sinsp_chisel(sinsp* inspector, string filename);
+	//
+	// out receives what the chisel prints: the lines of its formatter and
+	// the output of print() and io.write() in its script
+	//
+	sinsp_chisel(sinsp* inspector, string filename, ostream* out = &cout);
 	~sinsp_chisel();
 	static void add_lua_package_path(lua_State* ls, const char* path);
 	static void get_chisel_list(vector<chisel_desc>* chisel_descs);
@@ -147,8 +153,10 @@ private:
 	static bool parse_view_info(lua_State *ls, OUT chisel_desc* cd);
 	static bool init_lua_chisel(chisel_desc &cd, string const &path);
 	void first_event_inits(sinsp_evt* evt);
+	void redirect_output();
 
 	sinsp* m_inspector;
+	ostream* m_out;
 	string m_description;
 	vector<string> m_argvals;
 	string m_filename;
@@ -0,0 +1,155 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include "sinsp.h"
+#include "sinsp_capture_interrupt_exception.h"
+#include "sinsp_int.h"
+#include "chisel_parallel_replay.h"
+
+sinsp_chisel_parallel_replay::sinsp_chisel_parallel_replay(const std::string& filename, uint32_t nworkers, const std::string& chisel, const std::string& args):
+	m_replay(filename, nworkers),
+	m_chisel(chisel),
+	m_args(args),
+	m_out(NULL),
+	m_next_output(0),
+	m_interrupted(false)
+{
+	m_replay.set_setup_handler([this](uint32_t chunk, sinsp* inspector)
+	{
+		setup_chunk(chunk, inspector);
+	});
+
+	m_replay.set_end_handler([this](uint32_t chunk, sinsp* inspector)
+	{
+		end_chunk(chunk);
+	});
+}
+
+sinsp_chisel_parallel_replay::~sinsp_chisel_parallel_replay()
+{
+}
+
+void sinsp_chisel_parallel_replay::set_filter(const std::string& filter)
+{
+	m_replay.set_filter(filter);
+}
+
+void sinsp_chisel_parallel_replay::open()
+{
+	m_replay.open();
+}
+
+void sinsp_chisel_parallel_replay::run(std::ostream& out)
+{
+	m_chunks.clear();
+	for(uint32_t j = 0; j < m_replay.get_num_chunks(); j++)
+	{
+		std::unique_ptr<chunk_state> state(new chunk_state());
+
+		state->m_started = false;
+		state->m_interrupted = false;
+		state->m_done = false;
+		m_chunks.push_back(std::move(state));
+	}
+
+	m_out = &out;
+	m_next_output = 0;
+	m_interrupted = false;
+
+	m_replay.run([this](uint32_t chunk, sinsp_evt* evt)
+	{
+		process_event(chunk, evt);
+	});
+
+	m_chunks.clear();
+}
+
+void sinsp_chisel_parallel_replay::setup_chunk(uint32_t chunk, sinsp* inspector)
+{
+	chunk_state* state = m_chunks[chunk].get();
+
+	state->m_chisel.reset(new sinsp_chisel(inspector, m_chisel, &state->m_output));
+	state->m_chisel->set_args(m_args);
+	state->m_chisel->on_init();
+}
+
+void sinsp_chisel_parallel_replay::process_event(uint32_t chunk, sinsp_evt* evt)
+{
+	chunk_state* state = m_chunks[chunk].get();
+
+	if(state->m_interrupted)
+	{
+		return;
+	}
+
+	if(!state->m_started)
+	{
+		state->m_chisel->on_capture_start();
+		state->m_started = true;
+	}
+
+	try
+	{
+		state->m_chisel->run(evt);
+	}
+	catch(const sinsp_capture_interrupt_exception&)
+	{
+		state->m_interrupted = true;
+	}
+}
+
+void sinsp_chisel_parallel_replay::end_chunk(uint32_t chunk)
+{
+	chunk_state* state = m_chunks[chunk].get();
+
+	if(!state->m_started)
+	{
+		state->m_chisel->on_capture_start();
+		state->m_started = true;
+	}
+
+	state->m_chisel->on_capture_end();
+	state->m_chisel.reset();
+
+	std::lock_guard<std::mutex> lock(m_output_mutex);
+
+	state->m_done = true;
+	flush_output();
+}
+
+void sinsp_chisel_parallel_replay::flush_output()
+{
+	//
+	// Write the output of the chunks done so far, up to the first one still
+	// being replayed
+	//
+	while(m_next_output < m_chunks.size() && m_chunks[m_next_output]->m_done)
+	{
+		chunk_state* state = m_chunks[m_next_output].get();
+
+		if(!m_interrupted)
+		{
+			*m_out << state->m_output.str();
+			m_interrupted = state->m_interrupted;
+		}
+
+		state->m_output.str("");
+		m_next_output++;
+	}
+
+	m_out->flush();
+}
@@ -0,0 +1,108 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+//
+// chisel_parallel_replay.h
+//
+// a chisel run over a trace file split in chunks, see sinsp_parallel_replay
+//
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "parallel_replay.h"
+#include "chisel.h"
+
+//
+// Chisel run by the workers of a sinsp_parallel_replay.
+//
+// Every chunk gets its own instance of the chisel, with its own Lua VM:
+// on_init() is called before the inspector of the chunk is opened,
+// on_capture_start() before its first event and on_capture_end() after its
+// last one. The output of every instance is buffered and written in chunk
+// order as soon as the previous chunks are done, so what the chisel prints
+// for every event comes out like in a sequential run.
+//
+// Limitations:
+//  - a chisel that aggregates over the whole capture, e.g. a top list,
+//    prints its results once per chunk, for the events of the chunk.
+//  - on_interval() is called from the first event of every chunk.
+//  - when a chisel ends the capture, the output of the following chunks is
+//    discarded, but they are still replayed.
+//
+class SINSP_PUBLIC sinsp_chisel_parallel_replay
+{
+public:
+	sinsp_chisel_parallel_replay(const std::string& filename, uint32_t nworkers, const std::string& chisel, const std::string& args);
+	~sinsp_chisel_parallel_replay();
+
+	/*!
+	  \brief Filter applied by the inspector of every chunk, see
+	  sinsp_parallel_replay::set_filter().
+	*/
+	void set_filter(const std::string& filter);
+
+	/*!
+	  \brief See sinsp_parallel_replay::open().
+	*/
+	void open();
+
+	uint32_t get_num_chunks() const
+	{
+		return m_replay.get_num_chunks();
+	}
+
+	/*!
+	  \brief Replay the chunks and return when all of them are done. The
+	  output of the chisel is written to out, from the worker threads.
+
+	  @throws the first exception thrown by a worker or by the chisel, after
+	   the other workers stopped.
+	*/
+	void run(std::ostream& out);
+
+private:
+	struct chunk_state
+	{
+		std::unique_ptr<sinsp_chisel> m_chisel;
+		std::ostringstream m_output;
+		bool m_started;
+		// The chisel ended the capture
+		bool m_interrupted;
+		bool m_done;
+	};
+
+	void setup_chunk(uint32_t chunk, sinsp* inspector);
+	void process_event(uint32_t chunk, sinsp_evt* evt);
+	void end_chunk(uint32_t chunk);
+	void flush_output();
+
+	sinsp_parallel_replay m_replay;
+	std::string m_chisel;
+	std::string m_args;
+	std::vector<std::unique_ptr<chunk_state>> m_chunks;
+	// Protects the fields below and m_done
+	std::mutex m_output_mutex;
+	std::ostream* m_out;
+	// First chunk whose output hasn't been written yet
+	uint32_t m_next_output;
+	bool m_interrupted;
+};
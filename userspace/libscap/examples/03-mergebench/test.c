@@ -0,0 +1,248 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+//
+// Microbenchmark of the ordered merge used by scap_next() to pick the next
+// event across the per-CPU buffers, compared with the linear scan it replaced.
+// The rings are simulated in memory, so no driver is needed.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include <scap.h>
+#include "scap_merge.h"
+
+#define EVT_SIZE 64
+#define EVTS_PER_REFILL 256
+#define NROUNDS 64
+
+typedef struct sim_device
+{
+	char* m_buffer;
+	char* m_sn_next_event;
+	uint32_t m_sn_len;
+}sim_device;
+
+static uint64_t now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * (uint64_t) 1000000000 + ts.tv_nsec;
+}
+
+//
+// Fill every device with EVTS_PER_REFILL events, interleaving the timestamps
+// randomly across devices like concurrently running CPUs would
+//
+static void refill(sim_device* devs, uint32_t ndevs, uint64_t* ts)
+{
+	uint32_t j;
+	uint32_t k;
+
+	for(j = 0; j < ndevs; j++)
+	{
+		devs[j].m_sn_next_event = devs[j].m_buffer;
+		devs[j].m_sn_len = EVTS_PER_REFILL * EVT_SIZE;
+	}
+
+	for(k = 0; k < EVTS_PER_REFILL; k++)
+	{
+		for(j = 0; j < ndevs; j++)
+		{
+			scap_evt* pe = (scap_evt*)(devs[j].m_buffer + k * EVT_SIZE);
+			*ts += rand() % 3;
+			pe->ts = *ts;
+			pe->len = EVT_SIZE;
+			pe->tid = j;
+			pe->type = 0;
+			pe->nparams = 0;
+		}
+	}
+}
+
+static uint64_t run_linear(sim_device* devs, uint32_t ndevs, uint64_t* nevts, uint64_t* elapsed)
+{
+	uint64_t checksum = 0;
+	uint64_t ts = 0;
+	uint32_t r;
+
+	srand(42);
+	*nevts = 0;
+	*elapsed = 0;
+
+	for(r = 0; r < NROUNDS; r++)
+	{
+		uint64_t start;
+
+		refill(devs, ndevs, &ts);
+		start = now_ns();
+
+		while(true)
+		{
+			uint32_t j;
+			uint64_t max_ts = 0xffffffffffffffffLL;
+			uint32_t cpuid = 65535;
+			scap_evt* pevent = NULL;
+
+			for(j = 0; j < ndevs; j++)
+			{
+				scap_evt* pe;
+
+				if(devs[j].m_sn_len == 0)
+				{
+					continue;
+				}
+
+				pe = (scap_evt*)devs[j].m_sn_next_event;
+				if(pe->ts < max_ts)
+				{
+					pevent = pe;
+					cpuid = j;
+					max_ts = pe->ts;
+				}
+			}
+
+			if(cpuid == 65535)
+			{
+				break;
+			}
+
+			devs[cpuid].m_sn_len -= pevent->len;
+			devs[cpuid].m_sn_next_event += pevent->len;
+			checksum = checksum * 31 + pevent->ts * 65536 + cpuid;
+			(*nevts)++;
+		}
+
+		*elapsed += now_ns() - start;
+	}
+
+	return checksum;
+}
+
+static uint64_t run_merge(sim_device* devs, uint32_t ndevs, uint64_t* nevts, uint64_t* elapsed)
+{
+	uint64_t checksum = 0;
+	uint64_t ts = 0;
+	uint32_t r;
+	scap_merge merge;
+
+	if(!scap_merge_init(&merge, ndevs))
+	{
+		fprintf(stderr, "error allocating the merge tree\n");
+		exit(-1);
+	}
+
+	srand(42);
+	*nevts = 0;
+	*elapsed = 0;
+
+	for(r = 0; r < NROUNDS; r++)
+	{
+		uint64_t start;
+		uint32_t j;
+
+		refill(devs, ndevs, &ts);
+		start = now_ns();
+
+		scap_merge_clear(&merge);
+		for(j = 0; j < ndevs; j++)
+		{
+			if(devs[j].m_sn_len != 0)
+			{
+				scap_merge_add(&merge, ((scap_evt*)devs[j].m_sn_next_event)->ts, j);
+			}
+		}
+		scap_merge_build(&merge);
+
+		while(!scap_merge_empty(&merge))
+		{
+			uint32_t cpuid = scap_merge_top(&merge);
+			sim_device* dev = &devs[cpuid];
+			scap_evt* pevent = (scap_evt*)dev->m_sn_next_event;
+
+			dev->m_sn_len -= pevent->len;
+			dev->m_sn_next_event += pevent->len;
+
+			if(dev->m_sn_len == 0)
+			{
+				scap_merge_pop(&merge);
+			}
+			else
+			{
+				scap_merge_update_top(&merge, ((scap_evt*)dev->m_sn_next_event)->ts);
+			}
+
+			checksum = checksum * 31 + pevent->ts * 65536 + cpuid;
+			(*nevts)++;
+		}
+
+		*elapsed += now_ns() - start;
+	}
+
+	scap_merge_free(&merge);
+	return checksum;
+}
+
+int main(int argc, char** argv)
+{
+	static const uint32_t ncpus[] = {8, 64, 256};
+	uint32_t c;
+	int ret = 0;
+
+	printf("%8s %16s %16s %10s\n", "cpus", "linear (ns/evt)", "merge (ns/evt)", "speedup");
+
+	for(c = 0; c < sizeof(ncpus) / sizeof(ncpus[0]); c++)
+	{
+		uint32_t ndevs = ncpus[c];
+		sim_device* devs = (sim_device*)calloc(ndevs, sizeof(sim_device));
+		uint64_t linear_nevts, linear_ns, linear_sum;
+		uint64_t merge_nevts, merge_ns, merge_sum;
+		uint32_t j;
+
+		for(j = 0; j < ndevs; j++)
+		{
+			devs[j].m_buffer = (char*)malloc(EVTS_PER_REFILL * EVT_SIZE);
+		}
+
+		linear_sum = run_linear(devs, ndevs, &linear_nevts, &linear_ns);
+		merge_sum = run_merge(devs, ndevs, &merge_nevts, &merge_ns);
+
+		printf("%8" PRIu32 " %16.2f %16.2f %9.2fx\n",
+		       ndevs,
+		       (double)linear_ns / linear_nevts,
+		       (double)merge_ns / merge_nevts,
+		       (double)linear_ns / merge_ns);
+
+		if(linear_sum != merge_sum || linear_nevts != merge_nevts)
+		{
+			fprintf(stderr, "event order mismatch with %" PRIu32 " cpus\n", ndevs);
+			ret = -1;
+		}
+
+		for(j = 0; j < ndevs; j++)
+		{
+			free(devs[j].m_buffer);
+		}
+		free(devs);
+	}
+
+	return ret;
+}
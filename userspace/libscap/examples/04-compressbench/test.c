@@ -0,0 +1,247 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+//
+// Benchmark of the capture file codecs: the events of a capture file are
+// loaded in memory, then written and read back with every codec libscap was
+// built with. Prints the write and read throughput, in MB/s of event data,
+// and the size of every file compared with the uncompressed one.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <scap.h>
+
+typedef struct loaded_event
+{
+	scap_evt* m_evt;
+	uint16_t m_cpuid;
+}loaded_event;
+
+typedef struct codec
+{
+	compression_mode m_mode;
+	const char* m_name;
+}codec;
+
+static const codec codecs[] =
+{
+	{SCAP_COMPRESSION_NONE, "none"},
+	{SCAP_COMPRESSION_GZIP, "gzip"},
+	{SCAP_COMPRESSION_ZSTD, "zstd"},
+	{SCAP_COMPRESSION_LZ4, "lz4"},
+};
+
+static uint64_t now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * (uint64_t) 1000000000 + ts.tv_nsec;
+}
+
+static double mb_per_sec(uint64_t bytes, uint64_t ns)
+{
+	return ns ? (double)bytes * 1000 / ns : 0;
+}
+
+int main(int argc, char** argv)
+{
+	char error[SCAP_LASTERR_SIZE];
+	char fname[] = "/tmp/scap-compressbench-XXXXXX";
+	int32_t res;
+	scap_t* h;
+	scap_evt* ev;
+	uint16_t cpuid;
+	loaded_event* evts = NULL;
+	uint64_t nevts = 0;
+	uint64_t capacity = 0;
+	uint64_t evt_bytes = 0;
+	uint64_t none_size = 0;
+	uint32_t block_size = 0;
+	uint64_t j;
+	uint32_t k;
+	int fd;
+
+	if(argc < 2)
+	{
+		fprintf(stderr, "usage: %s <file.scap> [event_block_size]\n", argv[0]);
+		return 1;
+	}
+
+	if(argc > 2)
+	{
+		block_size = (uint32_t)atoi(argv[2]);
+	}
+
+	h = scap_open_offline(argv[1], error, &res);
+	if(h == NULL)
+	{
+		fprintf(stderr, "%s (%d)\n", error, res);
+		return 1;
+	}
+
+	while((res = scap_next(h, &ev, &cpuid)) != SCAP_EOF)
+	{
+		if(res == SCAP_TIMEOUT)
+		{
+			continue;
+		}
+		else if(res != SCAP_SUCCESS)
+		{
+			fprintf(stderr, "%s\n", scap_getlasterr(h));
+			return 1;
+		}
+
+		if(nevts == capacity)
+		{
+			capacity = capacity ? capacity * 2 : 1024;
+			evts = (loaded_event*)realloc(evts, capacity * sizeof(loaded_event));
+			if(evts == NULL)
+			{
+				fprintf(stderr, "out of memory\n");
+				return 1;
+			}
+		}
+
+		evts[nevts].m_evt = (scap_evt*)malloc(ev->len);
+		if(evts[nevts].m_evt == NULL)
+		{
+			fprintf(stderr, "out of memory\n");
+			return 1;
+		}
+
+		memcpy(evts[nevts].m_evt, ev, ev->len);
+		evts[nevts].m_cpuid = cpuid;
+		evt_bytes += ev->len;
+		nevts++;
+	}
+
+	fd = mkstemp(fname);
+	if(fd == -1)
+	{
+		perror("mkstemp");
+		return 1;
+	}
+	close(fd);
+
+	printf("%" PRIu64 " events, %" PRIu64 " bytes, event block size %u\n", nevts, evt_bytes, block_size);
+	printf("%-6s %12s %12s %14s %8s\n", "codec", "write MB/s", "read MB/s", "file bytes", "ratio");
+
+	for(k = 0; k < sizeof(codecs) / sizeof(codecs[0]); k++)
+	{
+		scap_dumper_t* d;
+		scap_t* rh;
+		struct stat st;
+		uint64_t start;
+		uint64_t write_ns;
+		uint64_t read_ns;
+		uint64_t nread = 0;
+
+		start = now_ns();
+
+		d = scap_dump_open(h, fname, codecs[k].m_mode, true);
+		if(d == NULL)
+		{
+			printf("%-6s not supported\n", codecs[k].m_name);
+			continue;
+		}
+
+		if(block_size != 0 && scap_dump_set_event_block_size(d, block_size) != SCAP_SUCCESS)
+		{
+			fprintf(stderr, "%s\n", scap_getlasterr(h));
+			return 1;
+		}
+
+		for(j = 0; j < nevts; j++)
+		{
+			if(scap_dump(h, d, evts[j].m_evt, evts[j].m_cpuid, 0) != SCAP_SUCCESS)
+			{
+				fprintf(stderr, "%s\n", scap_getlasterr(h));
+				return 1;
+			}
+		}
+
+		scap_dump_close(d);
+		write_ns = now_ns() - start;
+
+		if(stat(fname, &st) != 0)
+		{
+			perror("stat");
+			return 1;
+		}
+
+		start = now_ns();
+
+		rh = scap_open_offline(fname, error, &res);
+		if(rh == NULL)
+		{
+			fprintf(stderr, "%s (%d)\n", error, res);
+			return 1;
+		}
+
+		while((res = scap_next(rh, &ev, &cpuid)) != SCAP_EOF)
+		{
+			if(res == SCAP_SUCCESS)
+			{
+				nread++;
+			}
+			else if(res != SCAP_TIMEOUT)
+			{
+				fprintf(stderr, "%s\n", scap_getlasterr(rh));
+				return 1;
+			}
+		}
+
+		scap_close(rh);
+		read_ns = now_ns() - start;
+
+		if(nread != nevts)
+		{
+			fprintf(stderr, "%s: read %" PRIu64 " events instead of %" PRIu64 "\n", codecs[k].m_name, nread, nevts);
+			return 1;
+		}
+
+		if(codecs[k].m_mode == SCAP_COMPRESSION_NONE)
+		{
+			none_size = st.st_size;
+		}
+
+		printf("%-6s %12.1f %12.1f %14" PRIu64 " %8.2f\n",
+		       codecs[k].m_name,
+		       mb_per_sec(evt_bytes, write_ns),
+		       mb_per_sec(evt_bytes, read_ns),
+		       (uint64_t)st.st_size,
+		       st.st_size ? (double)none_size / st.st_size : 0);
+	}
+
+	unlink(fname);
+
+	for(j = 0; j < nevts; j++)
+	{
+		free(evts[j].m_evt);
+	}
+	free(evts);
+	scap_close(h);
+
+	return 0;
+}
@@ -20,6 +20,7 @@ limitations under the License.
 ////////////////////////////////////////////////////////////////////////////
 
 #include "settings.h"
+#include "scap_merge.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -48,8 +49,11 @@ typedef struct wh_t wh_t;
 #define gzread(F, B, S) fread(B, 1, S, F)
 #define gztell(F) ftell(F)
 #define gzerror(F, E) ({*E = ferror(F); "error reading file descriptor";})
-#define gzseek fseek
+// Like gzseek(), return the new position
+#define gzseek(F, O, W) (fseek(F, O, W) == 0 ? ftell(F) : -1)
+#define gzdirect(F) 1
 #endif
+#include "scap_compression.h"
 
 //
 // Read buffer timeout constants
@@ -61,6 +65,10 @@ typedef struct wh_t wh_t;
 #endif
 #define BUFFER_EMPTY_WAIT_TIME_US_MAX (30 * 1000)
 #define BUFFER_EMPTY_THRESHOLD_B 20000
+#define SCAP_WAKEUP_MAX_EVENTS 16
+// Largest buffer size accepted at open, the kernel module keeps the ring
+// offsets in signed 32 bit integers
+#define SCAP_MAX_RING_BUF_SIZE (1024 * 1024 * 1024)
 
 //
 // Process flags
@@ -81,8 +89,9 @@ typedef struct scap_device
 	int m_fd;
 	int m_bufinfo_fd; // used by udig
 	char* m_buffer;
-	uint32_t m_buffer_size; // used by udig
+	uint32_t m_buffer_size; // Size of the ring, not counting the mirrored copy of the kernel module
 	uint32_t m_lastreadsize;
+	uint32_t m_high_water; // Highest m_lastreadsize seen since the open
 	char* m_sn_next_event; // Pointer to the next event available for scap_next
 	uint32_t m_sn_len; // Number of bytes available in the buffer pointed by m_sn_next_event
 	union
@@ -97,6 +106,12 @@ typedef struct scap_device
 		struct
 		{
 			uint64_t m_evt_lost;
+			// With the ring buffer backend m_buffer is the consumer page,
+			// followed in a separate mapping by the producer page and by
+			// the data, mapped twice
+			char* m_rb_producer;
+			char* m_rb_data;
+			uint64_t m_rb_size;
 		};
 	};
 }scap_device;
@@ -109,6 +124,34 @@ typedef struct scap_tid
 	UT_hash_handle hh; ///< makes this structure hashable
 } scap_tid;
 
+//
+// Consumer of the devices [m_first_dev, m_first_dev + m_ndevs) of a live
+// handle. The handle embeds one on all its devices, used by scap_next().
+//
+struct scap_reader
+{
+	scap_t* m_handle;
+	uint32_t m_first_dev;
+	uint32_t m_ndevs;
+	// Ordered merge of the device buffers, reloaded after every refill or
+	// when the handle flushed the buffers (m_flush_gen changed)
+	scap_merge m_merge;
+	bool m_merge_stale;
+	uint32_t m_flush_gen;
+	// Next device to drain in relaxed ordering mode, relative to m_first_dev
+	uint32_t m_relaxed_devid;
+	// Devices that ran out of data while serving the last event(s). Their tails
+	// are released at the next call, once the caller is done with the events.
+	uint32_t* m_release_devids;
+	uint32_t m_nrelease_devids;
+	uint64_t m_buffer_empty_wait_time_us;
+	// epoll instance on the devices, -1 without the event driven wait
+	int m_wakeup_fd;
+	// Points to m_lasterr_buf, or to the handle m_lasterr for the handle reader
+	char* m_lasterr;
+	char m_lasterr_buf[SCAP_LASTERR_SIZE];
+};
+
 //
 // The open instance handle
 //
@@ -117,13 +160,29 @@ struct scap
 	scap_mode_t m_mode;
 	scap_device* m_devs;
 	uint32_t m_ndevs;
-#ifdef USE_ZLIB
-	gzFile m_file;
-#else
-	FILE* m_file;
-#endif
+	scap_reader m_reader;
+	// Number of readers open with scap_reader_open()
+	uint32_t m_nreaders;
+	// Incremented every time the device buffers are flushed
+	uint32_t m_flush_gen;
+	// Drain one device at a time instead of merging them by timestamp
+	bool m_relaxed_ordering;
+	scap_cfile* m_file;
 	char* m_file_evt_buf;
 	uint32_t m_last_evt_dump_flags;
+	// Event batch block being returned by scap_next_offline(): the next
+	// event is at m_file_evb_pos, and m_file_evb_nevents are left
+	char* m_file_evb_buf;
+	uint32_t m_file_evb_bufsize;
+	char* m_file_evb_pos;
+	char* m_file_evb_end;
+	uint32_t m_file_evb_nevents;
+	// Timestamp index of the capture, loaded by scap_find_index_entry()
+	scap_index_entry* m_file_index;
+	uint32_t m_file_index_nentries;
+	bool m_file_index_loaded;
+	// Position of the index block skipped by scap_next(), 0 if not seen yet
+	uint64_t m_file_index_pos;
 	char m_lasterr[SCAP_LASTERR_SIZE];
 
 	// Used for scap_strerror
@@ -136,7 +195,11 @@ struct scap
 	scap_addrlist* m_addrlist;
 	scap_machine_info m_machine_info;
 	scap_userlist* m_userlist;
-	uint64_t m_buffer_empty_wait_time_us;
+	// Event driven wait on the devices, enabled if the watermark is not zero
+	uint32_t m_wakeup_watermark;
+	// Size of the buffer of every device. Set to the requested size (0 for
+	// the default) at open, and to the actual one once the devices are open.
+	uint32_t m_ring_buf_size;
 	proc_entry_callback m_proc_callback;
 	void* m_proc_callback_context;
 	struct ppm_proclist_info* m_driver_procinfo;
@@ -162,6 +225,17 @@ struct scap
 		int m_bpf_event_fd[BPF_PROGS_MAX];
 		int m_bpf_map_fds[BPF_MAPS_MAX];
 		int m_bpf_prog_array_map_idx;
+		// The maps below are located by name, since the index of the
+		// maps declared after stash_map depends on the kernel version
+		int m_bpf_ringbuf_map_idx;
+		int m_bpf_rtt_map_idx;
+		uint32_t m_bpf_rtt_map_entries;
+		// Entries of rtt_static_map deleted by scap_read_rtt_stats()
+		uint64_t m_bpf_rtt_user_deletes;
+		int m_bpf_evt_type_stats_map_idx;
+		// Number of BPF ring buffers, one device each, or 0 to use one
+		// perf buffer per CPU
+		uint32_t m_bpf_ringbuf_groups;
 	};
 
 	// The set of process names that are suppressed
@@ -191,11 +265,25 @@ typedef enum ppm_dumper_type
 
 struct scap_dumper
 {
-	gzFile m_f;
+	scap_cfile* m_f;
 	ppm_dumper_type m_type;
 	uint8_t* m_targetbuf;
 	uint8_t* m_targetbufcurpos;
 	uint8_t* m_targetbufend;
+	// Events waiting to be written in an event batch block, see
+	// scap_dump_set_event_block_size(). m_evb_buf is NULL if disabled.
+	uint8_t* m_evb_buf;
+	uint32_t m_evb_size;
+	uint32_t m_evb_len;
+	uint32_t m_evb_nevents;
+	// Timestamp index written by scap_dump_close(), see
+	// scap_dump_set_index_interval(). Disabled if m_index_interval is 0.
+	uint64_t m_index_interval;
+	scap_index_entry* m_index;
+	uint32_t m_index_nentries;
+	uint32_t m_index_capacity;
+	// Position of the latest section, see scap_dump_checkpoint()
+	uint64_t m_section_pos;
 };
 
 struct scap_ns_socket_list
@@ -254,9 +342,9 @@ uint32_t scap_fd_info_len(scap_fdinfo* fdi);
 // Write the given fd info to disk
 int32_t scap_fd_write_to_disk(scap_t* handle, scap_fdinfo* fdi, scap_dumper_t* dumper, uint32_t len);
 // Populate the given fd by reading the info from disk
-uint32_t scap_fd_read_from_disk(scap_t* handle, OUT scap_fdinfo* fdi, OUT size_t* nbytes, uint32_t block_type, gzFile f);
+uint32_t scap_fd_read_from_disk(scap_t* handle, OUT scap_fdinfo* fdi, OUT size_t* nbytes, uint32_t block_type, scap_cfile* f);
 // Parse the headers of a trace file and load the tables
-int32_t scap_read_init(scap_t* handle, gzFile f);
+int32_t scap_read_init(scap_t* handle, scap_cfile* f);
 // Add the file descriptor info pointed by fdi to the fd table for process pi.
 // Note: silently skips if fdi->type is SCAP_FD_UNKNOWN.
 int32_t scap_add_fd_to_proc_table(scap_t* handle, scap_threadinfo* pi, scap_fdinfo* fdi, char *error);
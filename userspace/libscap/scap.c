@@ -27,6 +27,7 @@ limitations under the License.
 #include <sys/ioctl.h>
 #include <fcntl.h>
 #include <poll.h>
+#include <sys/epoll.h>
 #include <errno.h>
 #include <sys/time.h>
 #include <sys/mman.h>
@@ -96,7 +97,11 @@ scap_t* scap_open_live_int(char *error, int32_t *rc,
 			   const char **suppressed_comms,
 			   void(*debug_log_fn)(const char* msg),
 			   uint64_t proc_scan_timeout_ms,
-			   uint64_t proc_scan_log_interval_ms)
+			   uint64_t proc_scan_log_interval_ms,
+			   bool relaxed_ordering,
+			   uint32_t wakeup_watermark,
+			   uint32_t bpf_ringbuf_groups,
+			   uint32_t ring_buf_size)
 {
 	snprintf(error, SCAP_LASTERR_SIZE, "live capture not supported on %s", PLATFORM_NAME);
 	*rc = SCAP_NOT_SUPPORTED;
@@ -112,7 +117,8 @@ scap_t* scap_open_udig_int(char *error, int32_t *rc,
 			   const char **suppressed_comms,
 			   void(*debug_log_fn)(const char* msg),
 			   uint64_t proc_scan_timeout_ms,
-			   uint64_t proc_scan_log_interval_ms)
+			   uint64_t proc_scan_log_interval_ms,
+			   bool relaxed_ordering)
 {
 	snprintf(error, SCAP_LASTERR_SIZE, "udig capture not supported on %s", PLATFORM_NAME);
 	*rc = SCAP_NOT_SUPPORTED;
@@ -120,6 +126,143 @@ scap_t* scap_open_udig_int(char *error, int32_t *rc,
 }
 #else
 
+//
+// Set up a reader on the devices [first_dev, first_dev + ndevs). lasterr is
+// where the reader reports its errors, on failure the cause is written there.
+//
+static int32_t scap_reader_init(scap_t* handle, scap_reader* reader, uint32_t first_dev, uint32_t ndevs, char* lasterr)
+{
+	reader->m_handle = handle;
+	reader->m_first_dev = first_dev;
+	reader->m_ndevs = ndevs;
+	reader->m_merge_stale = true;
+	reader->m_flush_gen = handle->m_flush_gen;
+	reader->m_relaxed_devid = 0;
+	reader->m_nrelease_devids = 0;
+	reader->m_buffer_empty_wait_time_us = BUFFER_EMPTY_WAIT_TIME_US_START;
+	reader->m_wakeup_fd = -1;
+	reader->m_lasterr = lasterr;
+
+	if(!scap_merge_init(&reader->m_merge, ndevs))
+	{
+		snprintf(lasterr, SCAP_LASTERR_SIZE, "error allocating the device merge tree");
+		return SCAP_FAILURE;
+	}
+
+	reader->m_release_devids = (uint32_t*) calloc(sizeof(uint32_t), ndevs);
+	if(!reader->m_release_devids)
+	{
+		snprintf(lasterr, SCAP_LASTERR_SIZE, "error allocating the device release list");
+		return SCAP_FAILURE;
+	}
+
+	return SCAP_SUCCESS;
+}
+
+static void scap_reader_deinit(scap_reader* reader)
+{
+#ifndef _WIN32
+	if(reader->m_wakeup_fd != -1)
+	{
+		close(reader->m_wakeup_fd);
+		reader->m_wakeup_fd = -1;
+	}
+#endif
+
+	free(reader->m_release_devids);
+	reader->m_release_devids = NULL;
+	scap_merge_free(&reader->m_merge);
+}
+
+#ifndef _WIN32
+//
+// Register the devices of the reader in an epoll set, so that
+// refill_read_buffers() can sleep until one of them crosses the wakeup
+// watermark.
+//
+static int32_t scap_reader_init_wakeup(scap_reader* reader)
+{
+	uint32_t j;
+
+	reader->m_wakeup_fd = epoll_create1(EPOLL_CLOEXEC);
+	if(reader->m_wakeup_fd == -1)
+	{
+		snprintf(reader->m_lasterr, SCAP_LASTERR_SIZE, "error creating the wakeup epoll instance: %s", scap_strerror(reader->m_handle, errno));
+		return SCAP_FAILURE;
+	}
+
+	for(j = reader->m_first_dev; j < reader->m_first_dev + reader->m_ndevs; j++)
+	{
+		struct epoll_event ev;
+
+		ev.events = EPOLLIN;
+		ev.data.u32 = j;
+
+		if(epoll_ctl(reader->m_wakeup_fd, EPOLL_CTL_ADD, reader->m_handle->m_devs[j].m_fd, &ev) != 0)
+		{
+			snprintf(reader->m_lasterr, SCAP_LASTERR_SIZE, "error adding device %u to the wakeup epoll instance: %s", j, scap_strerror(reader->m_handle, errno));
+			return SCAP_FAILURE;
+		}
+	}
+
+	return SCAP_SUCCESS;
+}
+#endif
+
+#ifndef _WIN32
+//
+// The kernel module sizes the rings of a consumer with its ring_buf_size
+// parameter when the consumer opens its first device. Set the parameter if a
+// size was requested, otherwise read it to know how much to map.
+//
+static int32_t set_kmod_ring_buf_size(scap_t* handle, char* error)
+{
+	FILE *pfile;
+	uint32_t size = RING_BUF_SIZE;
+
+	if(handle->m_ring_buf_size != 0)
+	{
+		pfile = fopen("/sys/module/" PROBE_DEVICE_NAME "_probe/parameters/ring_buf_size", "w");
+		if(pfile == NULL)
+		{
+			//
+			// Older drivers only support the default size
+			//
+			if(handle->m_ring_buf_size == RING_BUF_SIZE)
+			{
+				return SCAP_SUCCESS;
+			}
+
+			snprintf(error, SCAP_LASTERR_SIZE, "can't set the ring buffer size, error opening /sys/module/" PROBE_DEVICE_NAME "_probe/parameters/ring_buf_size: %s", scap_strerror(handle, errno));
+			return SCAP_FAILURE;
+		}
+
+		fprintf(pfile, "%"PRIu32, handle->m_ring_buf_size);
+		if(fclose(pfile) != 0)
+		{
+			snprintf(error, SCAP_LASTERR_SIZE, "can't set the ring buffer size to %"PRIu32": %s", handle->m_ring_buf_size, scap_strerror(handle, errno));
+			return SCAP_FAILURE;
+		}
+
+		return SCAP_SUCCESS;
+	}
+
+	pfile = fopen("/sys/module/" PROBE_DEVICE_NAME "_probe/parameters/ring_buf_size", "r");
+	if(pfile != NULL)
+	{
+		if(fscanf(pfile, "%"PRIu32, &size) != 1)
+		{
+			size = RING_BUF_SIZE;
+		}
+
+		fclose(pfile);
+	}
+
+	handle->m_ring_buf_size = size;
+	return SCAP_SUCCESS;
+}
+#endif
+
 static uint32_t get_max_consumers()
 {
 #ifndef _WIN32
@@ -142,6 +285,28 @@ static uint32_t get_max_consumers()
 }
 
 #ifndef _WIN32
+//
+// Set up the event driven wait of the handle reader. The BPF probe already
+// configured the watermark on the perf events while loading, the kernel module
+// gets it with an ioctl.
+//
+static int32_t scap_init_wakeup(scap_t* handle)
+{
+	if(!handle->m_bpf)
+	{
+		if(ioctl(handle->m_devs[0].m_fd, PPM_IOCTL_SET_WAKEUP_WATERMARK, handle->m_wakeup_watermark))
+		{
+			//
+			// Older drivers don't support it, keep the sleep based backoff
+			//
+			handle->m_wakeup_watermark = 0;
+			return SCAP_SUCCESS;
+		}
+	}
+
+	return scap_reader_init_wakeup(&handle->m_reader);
+}
+
 scap_t* scap_open_live_int(char *error, int32_t *rc,
 			   proc_entry_callback proc_callback,
 			   void* proc_callback_context,
@@ -150,7 +315,11 @@ scap_t* scap_open_live_int(char *error, int32_t *rc,
 			   const char **suppressed_comms,
 			   void(*debug_log_fn)(const char* msg),
 			   uint64_t proc_scan_timeout_ms,
-			   uint64_t proc_scan_log_interval_ms)
+			   uint64_t proc_scan_log_interval_ms,
+			   bool relaxed_ordering,
+			   uint32_t wakeup_watermark,
+			   uint32_t bpf_ringbuf_groups,
+			   uint32_t ring_buf_size)
 {
 	uint32_t j;
 	char filename[SCAP_MAX_PATH_SIZE];
@@ -176,6 +345,18 @@ scap_t* scap_open_live_int(char *error, int32_t *rc,
 	handle->m_debug_log_fn = debug_log_fn;
 	handle->m_proc_scan_timeout_ms = proc_scan_timeout_ms;
 	handle->m_proc_scan_log_interval_ms = proc_scan_log_interval_ms;
+	handle->m_relaxed_ordering = relaxed_ordering;
+	handle->m_wakeup_watermark = wakeup_watermark;
+	handle->m_ring_buf_size = ring_buf_size;
+
+	if(ring_buf_size != 0 &&
+	   (ring_buf_size < 2 * (uint32_t)getpagesize() || ring_buf_size > SCAP_MAX_RING_BUF_SIZE || (ring_buf_size & (ring_buf_size - 1)) != 0))
+	{
+		snprintf(error, SCAP_LASTERR_SIZE, "invalid ring buffer size %u, must be a power of two between %u and %u", ring_buf_size, 2 * (uint32_t)getpagesize(), SCAP_MAX_RING_BUF_SIZE);
+		free(handle);
+		*rc = SCAP_FAILURE;
+		return NULL;
+	}
 
 	//
 	// While in theory we could always rely on the scap caller to properly
@@ -234,6 +415,14 @@ scap_t* scap_open_live_int(char *error, int32_t *rc,
 		return NULL;
 	}
 
+	//
+	// With the BPF ring buffers there's one device per group of CPUs instead
+	//
+	if(handle->m_bpf && bpf_ringbuf_groups != 0 && bpf_ringbuf_groups < ndevs)
+	{
+		ndevs = bpf_ringbuf_groups;
+	}
+
 	handle->m_devs = (scap_device*) calloc(sizeof(scap_device), ndevs);
 	if(!handle->m_devs)
 	{
@@ -243,6 +432,13 @@ scap_t* scap_open_live_int(char *error, int32_t *rc,
 		return NULL;
 	}
 
+	if((*rc = scap_reader_init(handle, &handle->m_reader, 0, ndevs, handle->m_lasterr)) != SCAP_SUCCESS)
+	{
+		snprintf(error, SCAP_LASTERR_SIZE, "%s", handle->m_lasterr);
+		scap_close(handle);
+		return NULL;
+	}
+
 	for(j = 0; j < ndevs; j++)
 	{
 		handle->m_devs[j].m_buffer = (char*)MAP_FAILED;
@@ -251,6 +447,10 @@ scap_t* scap_open_live_int(char *error, int32_t *rc,
 			handle->m_devs[j].m_bufinfo = (struct ppm_ring_buffer_info*)MAP_FAILED;
 			handle->m_devs[j].m_bufstatus = (struct udig_ring_buffer_status*)MAP_FAILED;
 		}
+		else
+		{
+			handle->m_devs[j].m_rb_producer = (char*)MAP_FAILED;
+		}
 	}
 
 	handle->m_ndevs = ndevs;
@@ -314,7 +514,6 @@ scap_t* scap_open_live_int(char *error, int32_t *rc,
 	handle->m_num_suppressed_comms = 0;
 	handle->m_suppressed_tids = NULL;
 	handle->m_num_suppressed_evts = 0;
-	handle->m_buffer_empty_wait_time_us = BUFFER_EMPTY_WAIT_TIME_US_START;
 
 	if ((*rc = copy_comms(handle, suppressed_comms)) != SCAP_SUCCESS)
 	{
@@ -328,7 +527,7 @@ scap_t* scap_open_live_int(char *error, int32_t *rc,
 	//
 	if(handle->m_bpf)
 	{
-		if((*rc = scap_bpf_load(handle, bpf_probe)) != SCAP_SUCCESS)
+		if((*rc = scap_bpf_load(handle, bpf_probe, bpf_ringbuf_groups != 0 ? ndevs : 0)) != SCAP_SUCCESS)
 		{
 			snprintf(error, SCAP_LASTERR_SIZE, "%s", handle->m_lasterr);
 			scap_close(handle);
@@ -337,13 +536,19 @@ scap_t* scap_open_live_int(char *error, int32_t *rc,
 	}
 	else
 	{
-		int len;
+		size_t len;
 		uint32_t all_scanned_devs;
 
+		if((*rc = set_kmod_ring_buf_size(handle, error)) != SCAP_SUCCESS)
+		{
+			scap_close(handle);
+			return NULL;
+		}
+
 		//
 		// Allocate the device descriptors.
 		//
-		len = RING_BUF_SIZE * 2;
+		len = (size_t)handle->m_ring_buf_size * 2;
 
 		for(j = 0, all_scanned_devs = 0; j < handle->m_ndevs && all_scanned_devs < handle->m_ncpus; ++all_scanned_devs)
 		{
@@ -400,11 +605,13 @@ scap_t* scap_open_live_int(char *error, int32_t *rc,
 				close(handle->m_devs[j].m_fd);
 
 				scap_close(handle);
-				snprintf(error, SCAP_LASTERR_SIZE, "error mapping the ring buffer for device %s", filename);
+				snprintf(error, SCAP_LASTERR_SIZE, "error mapping the ring buffer for device %s (%u bytes)", filename, handle->m_ring_buf_size);
 				*rc = SCAP_FAILURE;
 				return NULL;
 			}
 
+			handle->m_devs[j].m_buffer_size = handle->m_ring_buf_size;
+
 			//
 			// Map the ppm_ring_buffer_info that contains the buffer pointers
 			//
@@ -442,6 +649,24 @@ scap_t* scap_open_live_int(char *error, int32_t *rc,
 		scap_stop_dropping_mode(handle);
 	}
 
+	if(handle->m_wakeup_watermark >= handle->m_ring_buf_size)
+	{
+		snprintf(error, SCAP_LASTERR_SIZE, "invalid wakeup watermark %u, must be lower than the buffer size %u", handle->m_wakeup_watermark, handle->m_ring_buf_size);
+		scap_close(handle);
+		*rc = SCAP_FAILURE;
+		return NULL;
+	}
+
+	if(handle->m_wakeup_watermark != 0)
+	{
+		if((*rc = scap_init_wakeup(handle)) != SCAP_SUCCESS)
+		{
+			snprintf(error, SCAP_LASTERR_SIZE, "%s", handle->m_lasterr);
+			scap_close(handle);
+			return NULL;
+		}
+	}
+
 	//
 	// Create the process list
 	//
@@ -475,7 +700,8 @@ scap_t* scap_open_udig_int(char *error, int32_t *rc,
 			   const char **suppressed_comms,
 			   void(*debug_log_fn)(const char* msg),
 			   uint64_t proc_scan_timeout_ms,
-			   uint64_t proc_scan_log_interval_ms)
+			   uint64_t proc_scan_log_interval_ms,
+			   bool relaxed_ordering)
 {
 	char filename[SCAP_MAX_PATH_SIZE];
 	scap_t* handle = NULL;
@@ -499,6 +725,7 @@ scap_t* scap_open_udig_int(char *error, int32_t *rc,
 	handle->m_debug_log_fn = debug_log_fn;
 	handle->m_proc_scan_timeout_ms = proc_scan_timeout_ms;
 	handle->m_proc_scan_log_interval_ms = proc_scan_log_interval_ms;
+	handle->m_relaxed_ordering = relaxed_ordering;
 	handle->m_bpf = false;
 	handle->m_udig_capturing = false;
 	handle->m_ncpus = 1;
@@ -514,6 +741,13 @@ scap_t* scap_open_udig_int(char *error, int32_t *rc,
 		return NULL;
 	}
 
+	if((*rc = scap_reader_init(handle, &handle->m_reader, 0, handle->m_ndevs, handle->m_lasterr)) != SCAP_SUCCESS)
+	{
+		snprintf(error, SCAP_LASTERR_SIZE, "%s", handle->m_lasterr);
+		scap_close(handle);
+		return NULL;
+	}
+
 	handle->m_devs[0].m_buffer = MAP_FAILED;
 	handle->m_devs[0].m_bufinfo = MAP_FAILED;
 	handle->m_devs[0].m_bufstatus = MAP_FAILED;
@@ -578,7 +812,6 @@ scap_t* scap_open_udig_int(char *error, int32_t *rc,
 	handle->m_num_suppressed_comms = 0;
 	handle->m_suppressed_tids = NULL;
 	handle->m_num_suppressed_evts = 0;
-	handle->m_buffer_empty_wait_time_us = BUFFER_EMPTY_WAIT_TIME_US_START;
 
 #ifdef _WIN32
 	handle->m_whh = scap_windows_hal_open(error);
@@ -677,7 +910,7 @@ scap_t* scap_open_udig_int(char *error, int32_t *rc,
 }
 #endif // !defined(HAS_CAPTURE) || defined(CYGWING_AGENT)
 
-scap_t* scap_open_offline_int(gzFile gzfile,
+scap_t* scap_open_offline_int(scap_cfile* cfile,
 			      char *error,
 			      int32_t *rc,
 			      proc_entry_callback proc_callback,
@@ -737,7 +970,7 @@ scap_t* scap_open_offline_int(gzFile gzfile,
 		return NULL;
 	}
 
-	handle->m_file = gzfile;
+	handle->m_file = cfile;
 
 	//
 	// If this is a merged file, we might have to move the read offset to the next section
@@ -791,33 +1024,33 @@ scap_t* scap_open_offline_int(gzFile gzfile,
 
 scap_t* scap_open_offline(const char* fname, char *error, int32_t* rc)
 {
-	gzFile gzfile = gzopen(fname, "rb");
-	if(gzfile == NULL)
+	scap_cfile* cfile = scap_cfile_open(fname, false, SCAP_COMPRESSION_NONE);
+	if(cfile == NULL)
 	{
 		snprintf(error, SCAP_LASTERR_SIZE, "can't open file %s", fname);
 		*rc = SCAP_FAILURE;
 		return NULL;
 	}
 
-	return scap_open_offline_int(gzfile, error, rc, NULL, NULL, true, 0, NULL);
+	return scap_open_offline_int(cfile, error, rc, NULL, NULL, true, 0, NULL);
 }
 
 scap_t* scap_open_offline_fd(int fd, char *error, int32_t *rc)
 {
-	gzFile gzfile = gzdopen(fd, "rb");
-	if(gzfile == NULL)
+	scap_cfile* cfile = scap_cfile_dopen(fd, false, SCAP_COMPRESSION_NONE);
+	if(cfile == NULL)
 	{
 		snprintf(error, SCAP_LASTERR_SIZE, "can't open fd %d", fd);
 		*rc = SCAP_FAILURE;
 		return NULL;
 	}
 
-	return scap_open_offline_int(gzfile, error, rc, NULL, NULL, true, 0, NULL);
+	return scap_open_offline_int(cfile, error, rc, NULL, NULL, true, 0, NULL);
 }
 
 scap_t* scap_open_live(char *error, int32_t *rc)
 {
-	return scap_open_live_int(error, rc, NULL, NULL, true, NULL, NULL, NULL, SCAP_PROC_SCAN_TIMEOUT_NONE, SCAP_PROC_SCAN_LOG_NONE);
+	return scap_open_live_int(error, rc, NULL, NULL, true, NULL, NULL, NULL, SCAP_PROC_SCAN_TIMEOUT_NONE, SCAP_PROC_SCAN_LOG_NONE, false, 0, 0, 0);
 }
 
 scap_t* scap_open_nodriver_int(char *error, int32_t *rc,
@@ -949,18 +1182,18 @@ scap_t* scap_open(scap_open_args args, char *error, int32_t *rc)
 	{
 	case SCAP_MODE_CAPTURE:
 	{
-		gzFile gzfile;
+		scap_cfile* cfile;
 
 		if(args.fd != 0)
 		{
-			gzfile = gzdopen(args.fd, "rb");
+			cfile = scap_cfile_dopen(args.fd, false, SCAP_COMPRESSION_NONE);
 		}
 		else
 		{
-			gzfile = gzopen(args.fname, "rb");
+			cfile = scap_cfile_open(args.fname, false, SCAP_COMPRESSION_NONE);
 		}
 
-		if(gzfile == NULL)
+		if(cfile == NULL)
 		{
 			if(args.fd != 0)
 			{
@@ -974,7 +1207,7 @@ scap_t* scap_open(scap_open_args args, char *error, int32_t *rc)
 			return NULL;
 		}
 
-		return scap_open_offline_int(gzfile, error, rc,
+		return scap_open_offline_int(cfile, error, rc,
 					     args.proc_callback, args.proc_callback_context,
 					     args.import_users, args.start_offset,
 					     args.suppressed_comms);
@@ -989,7 +1222,8 @@ scap_t* scap_open(scap_open_args args, char *error, int32_t *rc)
 						args.suppressed_comms,
 						args.debug_log_fn,
 						args.proc_scan_timeout_ms,
-						args.proc_scan_log_interval_ms);
+						args.proc_scan_log_interval_ms,
+						args.relaxed_ordering);
 		}
 		else
 		{
@@ -1000,7 +1234,11 @@ scap_t* scap_open(scap_open_args args, char *error, int32_t *rc)
 						args.suppressed_comms,
 						args.debug_log_fn,
 						args.proc_scan_timeout_ms,
-						args.proc_scan_log_interval_ms);
+						args.proc_scan_log_interval_ms,
+						args.relaxed_ordering,
+						args.wakeup_watermark,
+						args.bpf_ringbuf_groups,
+						args.ring_buf_size);
 		}
 #else
 		snprintf(error,	SCAP_LASTERR_SIZE, "scap_open: live mode currently not supported on windows. Use nodriver mode instead.");
@@ -1062,7 +1300,7 @@ void scap_close(scap_t* handle)
 {
 	if(handle->m_file)
 	{
-		gzclose(handle->m_file);
+		scap_cfile_close(handle->m_file);
 	}
 	else if(handle->m_mode == SCAP_MODE_LIVE)
 	{
@@ -1100,7 +1338,7 @@ void scap_close(scap_t* handle)
 					if(handle->m_devs[j].m_buffer != MAP_FAILED)
 					{
 						munmap(handle->m_devs[j].m_bufinfo, sizeof(struct ppm_ring_buffer_info));
-						munmap(handle->m_devs[j].m_buffer, RING_BUF_SIZE * 2);
+						munmap(handle->m_devs[j].m_buffer, (size_t)handle->m_devs[j].m_buffer_size * 2);
 						close(handle->m_devs[j].m_fd);
 					}
 				}
@@ -1109,6 +1347,7 @@ void scap_close(scap_t* handle)
 			//
 			// Free the memory
 			//
+			scap_reader_deinit(&handle->m_reader);
 			free(handle->m_devs);
 		}
 #endif // HAS_CAPTURE
@@ -1126,6 +1365,9 @@ void scap_close(scap_t* handle)
 		free(handle->m_file_evt_buf);
 	}
 
+	free(handle->m_file_evb_buf);
+	free(handle->m_file_index);
+
 	// Free the process table
 	if(handle->m_proclist != NULL)
 	{
@@ -1215,9 +1457,9 @@ uint32_t scap_get_ndevs(scap_t* handle)
 #if defined(HAS_CAPTURE) && !defined(CYGWING_AGENT)
 
 #ifndef _WIN32
-static inline void get_buf_pointers(struct ppm_ring_buffer_info* bufinfo, uint32_t* phead, uint32_t* ptail, uint64_t* pread_size)
+static inline void get_buf_pointers(struct ppm_ring_buffer_info* bufinfo, uint32_t buf_size, uint32_t* phead, uint32_t* ptail, uint64_t* pread_size)
 #else
-void get_buf_pointers(struct ppm_ring_buffer_info* bufinfo, uint32_t* phead, uint32_t* ptail, uint64_t* pread_size)
+void get_buf_pointers(struct ppm_ring_buffer_info* bufinfo, uint32_t buf_size, uint32_t* phead, uint32_t* ptail, uint64_t* pread_size)
 #endif
 {
 	*phead = bufinfo->head;
@@ -1225,7 +1467,7 @@ void get_buf_pointers(struct ppm_ring_buffer_info* bufinfo, uint32_t* phead, uin
 
 	if(*ptail > *phead)
 	{
-		*pread_size = RING_BUF_SIZE - *ptail + *phead;
+		*pread_size = buf_size - *ptail + *phead;
 	}
 	else
 	{
@@ -1263,18 +1505,30 @@ static void scap_advance_tail(scap_t* handle, uint32_t cpuid)
 	__sync_synchronize();
 #endif
 
-	if(ttail < RING_BUF_SIZE)
+	if(ttail < handle->m_devs[cpuid].m_buffer_size)
 	{
 		handle->m_devs[cpuid].m_bufinfo->tail = ttail;
 	}
 	else
 	{
-		handle->m_devs[cpuid].m_bufinfo->tail = ttail - RING_BUF_SIZE;
+		handle->m_devs[cpuid].m_bufinfo->tail = ttail - handle->m_devs[cpuid].m_buffer_size;
 	}
 
 	handle->m_devs[cpuid].m_lastreadsize = 0;
 }
 
+//
+// Everything up to the head is consumed by a read, so the read size is the
+// fill level of the buffer at that moment
+//
+static inline void update_high_water(scap_device* dev)
+{
+	if(dev->m_lastreadsize > dev->m_high_water)
+	{
+		dev->m_high_water = dev->m_lastreadsize;
+	}
+}
+
 int32_t scap_readbuf(scap_t* handle, uint32_t cpuid, OUT char** buf, OUT uint32_t* len)
 {
 	uint32_t thead;
@@ -1284,7 +1538,10 @@ int32_t scap_readbuf(scap_t* handle, uint32_t cpuid, OUT char** buf, OUT uint32_
 #ifndef _WIN32
 	if(handle->m_bpf)
 	{
-		return scap_bpf_readbuf(handle, cpuid, buf, len);
+		int32_t res = scap_bpf_readbuf(handle, cpuid, buf, len);
+
+		update_high_water(&handle->m_devs[cpuid]);
+		return res;
 	}
 #endif
 
@@ -1292,6 +1549,7 @@ int32_t scap_readbuf(scap_t* handle, uint32_t cpuid, OUT char** buf, OUT uint32_
 	// Read the pointers.
 	//
 	get_buf_pointers(handle->m_devs[cpuid].m_bufinfo,
+	                 handle->m_devs[cpuid].m_buffer_size,
 	                 &thead,
 	                 &ttail,
 	                 &read_size);
@@ -1300,6 +1558,7 @@ int32_t scap_readbuf(scap_t* handle, uint32_t cpuid, OUT char** buf, OUT uint32_
 	// Remember read_size so we can update the tail at the next call
 	//
 	handle->m_devs[cpuid].m_lastreadsize = (uint32_t)read_size;
+	update_high_water(&handle->m_devs[cpuid]);
 
 	//
 	// Return the results
@@ -1317,10 +1576,7 @@ static uint64_t buf_size_used(scap_t* handle, uint32_t cpu)
 	if (handle->m_bpf)
 	{
 #ifndef _WIN32
-		uint64_t thead;
-		uint64_t ttail;
-
-		scap_bpf_get_buf_pointers(handle->m_devs[cpu].m_buffer, &thead, &ttail, &read_size);
+		read_size = scap_bpf_buf_size_used(handle, cpu);
 #endif
 	}
 	else
@@ -1328,19 +1584,30 @@ static uint64_t buf_size_used(scap_t* handle, uint32_t cpu)
 		uint32_t thead;
 		uint32_t ttail;
 
-		get_buf_pointers(handle->m_devs[cpu].m_bufinfo, &thead, &ttail, &read_size);
+		get_buf_pointers(handle->m_devs[cpu].m_bufinfo, handle->m_devs[cpu].m_buffer_size, &thead, &ttail, &read_size);
 	}
 
 	return read_size;
 }
 
-static bool are_buffers_empty(scap_t* handle)
+static bool are_buffers_empty(scap_reader* reader)
 {
+	scap_t* handle = reader->m_handle;
 	uint32_t j;
+	uint64_t threshold = BUFFER_EMPTY_THRESHOLD_B;
+
+	//
+	// With the event driven wait, a buffer that reached the watermark
+	// won't necessarily signal it again, so don't wait for it
+	//
+	if(handle->m_wakeup_watermark != 0)
+	{
+		threshold = handle->m_wakeup_watermark - 1;
+	}
 
-	for(j = 0; j < handle->m_ndevs; j++)
+	for(j = reader->m_first_dev; j < reader->m_first_dev + reader->m_ndevs; j++)
 	{
-		if(buf_size_used(handle, j) > BUFFER_EMPTY_THRESHOLD_B)
+		if(buf_size_used(handle, j) > threshold)
 		{
 			return false;
 		}
@@ -1349,31 +1616,61 @@ static bool are_buffers_empty(scap_t* handle)
 	return true;
 }
 
-int32_t refill_read_buffers(scap_t* handle)
+#ifndef _WIN32
+//
+// Sleep until a device crosses the wakeup watermark. The wait is bounded by
+// the maximum backoff of the sleep based mode, so that an idle capture keeps
+// returning SCAP_TIMEOUT to the caller at the same pace.
+//
+static void scap_wait_for_data(scap_reader* reader)
+{
+	struct epoll_event evs[SCAP_WAKEUP_MAX_EVENTS];
+	int res;
+
+	res = epoll_wait(reader->m_wakeup_fd, evs, SCAP_WAKEUP_MAX_EVENTS, BUFFER_EMPTY_WAIT_TIME_US_MAX / 1000);
+	if(res < 0 && errno != EINTR)
+	{
+		//
+		// Shouldn't happen, but make sure we don't spin
+		//
+		ASSERT(false);
+		usleep(reader->m_buffer_empty_wait_time_us);
+	}
+}
+#endif
+
+static int32_t refill_read_buffers(scap_reader* reader)
 {
+	scap_t* handle = reader->m_handle;
 	uint32_t j;
-	uint32_t ndevs = handle->m_ndevs;
 
-	if(are_buffers_empty(handle))
+	if(are_buffers_empty(reader))
 	{
 #ifdef _WIN32
-		Sleep((DWORD)handle->m_buffer_empty_wait_time_us / 1000);
+		Sleep((DWORD)reader->m_buffer_empty_wait_time_us / 1000);
 #else
-		usleep(handle->m_buffer_empty_wait_time_us);
+		if(reader->m_wakeup_fd != -1)
+		{
+			scap_wait_for_data(reader);
+		}
+		else
+		{
+			usleep(reader->m_buffer_empty_wait_time_us);
+		}
 #endif
-		handle->m_buffer_empty_wait_time_us = MIN(handle->m_buffer_empty_wait_time_us * 2,
+		reader->m_buffer_empty_wait_time_us = MIN(reader->m_buffer_empty_wait_time_us * 2,
 							  BUFFER_EMPTY_WAIT_TIME_US_MAX);
 	}
 	else
 	{
-		handle->m_buffer_empty_wait_time_us = BUFFER_EMPTY_WAIT_TIME_US_START;
+		reader->m_buffer_empty_wait_time_us = BUFFER_EMPTY_WAIT_TIME_US_START;
 	}
 
 	//
 	// Refill our data for each of the devices
 	//
 
-	for(j = 0; j < ndevs; j++)
+	for(j = reader->m_first_dev; j < reader->m_first_dev + reader->m_ndevs; j++)
 	{
 		struct scap_device *dev = &(handle->m_devs[j]);
 
@@ -1396,203 +1693,330 @@ int32_t refill_read_buffers(scap_t* handle)
 	return SCAP_TIMEOUT;
 }
 
-#endif // HAS_CAPTURE
-
+static inline scap_evt* scap_dev_next_evt(scap_t* handle, scap_device* dev)
+{
+	if(handle->m_bpf)
+	{
 #ifndef _WIN32
-static inline int32_t scap_next_live(scap_t* handle, OUT scap_evt** pevent, OUT uint16_t* pcpuid)
-#else
-static int32_t scap_next_live(scap_t* handle, OUT scap_evt** pevent, OUT uint16_t* pcpuid)
+		return scap_bpf_evt_from_sample(handle, dev->m_sn_next_event);
 #endif
+	}
+
+	return (scap_evt *) dev->m_sn_next_event;
+}
+
+//
+// Load the ordered merge with the first event of every device that has data.
+// This is done once per refill, the merge is then updated incrementally as
+// the devices are consumed. The leaves of the merge are indexed from the
+// first device of the reader.
+//
+static void scap_merge_load(scap_reader* reader)
 {
-#if !defined(HAS_CAPTURE) || defined(CYGWING_AGENT)
-	//
-	// this should be prevented at open time
-	//
-	ASSERT(false);
-	return SCAP_FAILURE;
-#else
+	scap_t* handle = reader->m_handle;
 	uint32_t j;
-	uint64_t max_ts = 0xffffffffffffffffLL;
-	scap_evt* pe = NULL;
-	uint32_t ndevs = handle->m_ndevs;
 
-	*pcpuid = 65535;
+	scap_merge_clear(&reader->m_merge);
 
-	for(j = 0; j < ndevs; j++)
+	for(j = 0; j < reader->m_ndevs; j++)
 	{
-		scap_device* dev = &(handle->m_devs[j]);
+		scap_device* dev = &(handle->m_devs[reader->m_first_dev + j]);
 
-		if(dev->m_sn_len == 0)
+		if(dev->m_sn_len != 0)
 		{
-			//
-			// If we don't have data from this ring, but we are
-			// still occupying, free the resources for the
-			// producer rather than sitting on them.
-			//
-			if(dev->m_lastreadsize > 0)
-			{
-				scap_advance_tail(handle, j);
-			}
-
-			continue;
+			scap_merge_add(&reader->m_merge, scap_dev_next_evt(handle, dev)->ts, j);
 		}
+	}
 
-		if(handle->m_bpf)
-		{
-#ifndef _WIN32
-			pe = scap_bpf_evt_from_perf_sample(dev->m_sn_next_event);
-#endif
-		}
-		else
-		{
-			pe = (scap_evt *) dev->m_sn_next_event;
-		}
+	scap_merge_build(&reader->m_merge);
+	reader->m_merge_stale = false;
+	reader->m_flush_gen = handle->m_flush_gen;
+}
 
-		//
-		// We want to consume the event with the lowest timestamp
-		//
-		if(pe->ts < max_ts)
-		{
-			if(pe->len > dev->m_sn_len)
-			{
-				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "scap_next buffer corruption");
+//
+// Return the event at the head of a device and move its pointers past it
+//
+static inline int32_t scap_dev_consume_evt(scap_reader* reader, uint32_t devid, OUT scap_evt** pevent)
+{
+	scap_t* handle = reader->m_handle;
+	scap_device* dev = &handle->m_devs[devid];
+	scap_evt* pe = scap_dev_next_evt(handle, dev);
 
-				//
-				// if you get the following assertion, first recompile the driver and libscap
-				//
-				ASSERT(false);
-				return SCAP_FAILURE;
-			}
+	if(pe->len > dev->m_sn_len)
+	{
+		snprintf(reader->m_lasterr, SCAP_LASTERR_SIZE, "scap_next buffer corruption");
 
-			*pevent = pe;
-			*pcpuid = j;
-			max_ts = pe->ts;
-		}
+		//
+		// if you get the following assertion, first recompile the driver and libscap
+		//
+		ASSERT(false);
+		return SCAP_FAILURE;
 	}
 
+	*pevent = pe;
+
 	//
-	// Check which buffer has been picked
+	// Update the pointers.
 	//
-	if(*pcpuid != 65535)
+	if(handle->m_bpf)
 	{
-		struct scap_device *dev = &handle->m_devs[*pcpuid];
-
-		//
-		// Update the pointers.
-		//
-		if(handle->m_bpf)
-		{
 #ifndef _WIN32
-			scap_bpf_advance_to_evt(handle, *pcpuid, true,
-						dev->m_sn_next_event,
-						&dev->m_sn_next_event,
-						&dev->m_sn_len);
+		scap_bpf_advance_to_evt(handle, devid, true,
+					dev->m_sn_next_event,
+					&dev->m_sn_next_event,
+					&dev->m_sn_len);
 #endif
-		}
-		else
-		{
-			ASSERT(dev->m_sn_len >= (*pevent)->len);
-			dev->m_sn_len -= (*pevent)->len;
-			dev->m_sn_next_event += (*pevent)->len;
-		}
-
-		return SCAP_SUCCESS;
 	}
 	else
 	{
-		//
-		// All the buffers have been consumed. Check if there's enough data to keep going or
-		// if we should wait.
-		//
-		return refill_read_buffers(handle);
+		ASSERT(dev->m_sn_len >= pe->len);
+		dev->m_sn_len -= pe->len;
+		dev->m_sn_next_event += pe->len;
 	}
-#endif
+
+	return SCAP_SUCCESS;
 }
 
-#ifndef _WIN32
-static inline int32_t scap_next_udig(scap_t* handle, OUT scap_evt** pevent, OUT uint16_t* pcpuid)
-#else
-static int32_t scap_next_udig(scap_t* handle, OUT scap_evt** pevent, OUT uint16_t* pcpuid)
-#endif
+//
+// Release the buffers we are still occupying (e.g. BPF buffers containing
+// only lost samples) before refilling all of them
+//
+static void scap_release_devs(scap_reader* reader)
 {
-#if !defined(HAS_CAPTURE) || defined(CYGWING_AGENT)
-	//
-	// this should be prevented at open time
-	//
-	ASSERT(false);
-	return SCAP_FAILURE;
-#else
 	uint32_t j;
-	uint64_t max_ts = 0xffffffffffffffffLL;
-	scap_evt* pe = NULL;
-	uint32_t ndevs = handle->m_ndevs;
 
-	*pcpuid = 65535;
+	for(j = reader->m_first_dev; j < reader->m_first_dev + reader->m_ndevs; j++)
+	{
+		if(reader->m_handle->m_devs[j].m_lastreadsize > 0)
+		{
+			scap_advance_tail(reader->m_handle, j);
+		}
+	}
+}
+
+//
+// Free, for the producers, the buffers that ran out of data while serving the
+// events returned by the previous call, now that the caller is done with them.
+//
+static inline void scap_release_consumed_devs(scap_reader* reader)
+{
+	uint32_t j;
+
+	for(j = 0; j < reader->m_nrelease_devids; j++)
+	{
+		uint32_t devid = reader->m_release_devids[j];
+
+		if(reader->m_handle->m_devs[devid].m_lastreadsize > 0)
+		{
+			scap_advance_tail(reader->m_handle, devid);
+		}
+	}
+
+	reader->m_nrelease_devids = 0;
+}
+
+static inline void scap_defer_release(scap_reader* reader, uint32_t devid)
+{
+	ASSERT(reader->m_nrelease_devids < reader->m_ndevs);
+	reader->m_release_devids[reader->m_nrelease_devids++] = devid;
+}
+
+static inline bool scap_is_release_deferred(scap_reader* reader, uint32_t devid)
+{
+	uint32_t j;
+
+	for(j = 0; j < reader->m_nrelease_devids; j++)
+	{
+		if(reader->m_release_devids[j] == devid)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+//
+// Ordered merge: serve the event with the lowest timestamp among the data
+// read at the last refill. Returns SCAP_TIMEOUT when all of it has been
+// consumed and the buffers need to be refilled.
+//
+static inline int32_t scap_next_buffered_merged(scap_reader* reader, OUT scap_evt** pevent, OUT uint16_t* pcpuid)
+{
+	int32_t res;
+	uint32_t devid;
+	scap_device* dev;
+
+	if(reader->m_merge_stale || reader->m_flush_gen != reader->m_handle->m_flush_gen)
+	{
+		scap_merge_load(reader);
+	}
+
+	if(scap_merge_empty(&reader->m_merge))
+	{
+		return SCAP_TIMEOUT;
+	}
+
+	devid = reader->m_first_dev + scap_merge_top(&reader->m_merge);
+	res = scap_dev_consume_evt(reader, devid, pevent);
+	if(res != SCAP_SUCCESS)
+	{
+		return res;
+	}
+
+	*pcpuid = devid;
+	dev = &reader->m_handle->m_devs[devid];
+
+	//
+	// Re-key the device on its next event, or drop it from the merge
+	// until the next refill if it has been fully consumed.
+	//
+	if(dev->m_sn_len == 0)
+	{
+		scap_merge_pop(&reader->m_merge);
+		scap_defer_release(reader, devid);
+	}
+	else
+	{
+		scap_merge_update_top(&reader->m_merge, scap_dev_next_evt(reader->m_handle, dev)->ts);
+	}
+
+	return SCAP_SUCCESS;
+}
+
+//
+// Relaxed ordering: serve the events of a device until its buffer is drained,
+// then move to the next one and read whatever its producer wrote in the
+// meantime. No timestamp comparison is made across devices. Returns
+// SCAP_TIMEOUT when no device has data, or when we get back to a device
+// whose events have been returned in the current batch.
+//
+static inline int32_t scap_next_buffered_relaxed(scap_reader* reader, OUT scap_evt** pevent, OUT uint16_t* pcpuid)
+{
+	scap_t* handle = reader->m_handle;
+	uint32_t j;
+	uint32_t ndevs = reader->m_ndevs;
 
 	for(j = 0; j < ndevs; j++)
 	{
-		scap_device* dev = &(handle->m_devs[j]);
+		uint32_t devid = reader->m_first_dev + reader->m_relaxed_devid;
+		scap_device* dev = &handle->m_devs[devid];
+		int32_t res;
 
 		if(dev->m_sn_len == 0)
 		{
-			//
-			// If we don't have data from this ring, but we are
-			// still occupying, free the resources for the
-			// producer rather than sitting on them.
-			//
+			if(reader->m_nrelease_devids != 0 && scap_is_release_deferred(reader, devid))
+			{
+				return SCAP_TIMEOUT;
+			}
+
 			if(dev->m_lastreadsize > 0)
 			{
-				scap_advance_tail(handle, j);
+				scap_advance_tail(handle, devid);
 			}
 
-			continue;
+			res = scap_readbuf(handle, devid, &dev->m_sn_next_event, &dev->m_sn_len);
+			if(res != SCAP_SUCCESS)
+			{
+				return res;
+			}
 		}
 
-		pe = (scap_evt *) dev->m_sn_next_event;
-
-		//
-		// We want to consume the event with the lowest timestamp
-		//
-		if(pe->ts < max_ts)
+		if(dev->m_sn_len != 0)
 		{
-			if(pe->len > dev->m_sn_len)
+			res = scap_dev_consume_evt(reader, devid, pevent);
+			if(res != SCAP_SUCCESS)
 			{
-				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "scap_next buffer corruption");
+				return res;
+			}
 
-				//
-				// if you get the following assertion, first recompile the driver and libscap
-				//
-				ASSERT(false);
-				return SCAP_FAILURE;
+			*pcpuid = devid;
+
+			if(dev->m_sn_len == 0)
+			{
+				scap_defer_release(reader, devid);
+				reader->m_relaxed_devid = reader->m_relaxed_devid + 1 < ndevs ? reader->m_relaxed_devid + 1 : 0;
 			}
 
-			*pevent = pe;
-			*pcpuid = j;
-			max_ts = pe->ts;
+			return SCAP_SUCCESS;
 		}
+
+		reader->m_relaxed_devid = reader->m_relaxed_devid + 1 < ndevs ? reader->m_relaxed_devid + 1 : 0;
+	}
+
+	return SCAP_TIMEOUT;
+}
+
+static inline int32_t scap_next_buffered(scap_reader* reader, OUT scap_evt** pevent, OUT uint16_t* pcpuid)
+{
+	if(reader->m_handle->m_relaxed_ordering)
+	{
+		return scap_next_buffered_relaxed(reader, pevent, pcpuid);
 	}
 
+	return scap_next_buffered_merged(reader, pevent, pcpuid);
+}
+
+//
+// All the data read from the buffers has been consumed. Check if there's
+// enough data to keep going or if we should wait.
+//
+static int32_t scap_refill(scap_reader* reader)
+{
+	scap_release_devs(reader);
+	reader->m_merge_stale = true;
+	return refill_read_buffers(reader);
+}
+
+#endif // HAS_CAPTURE
+
+#ifndef _WIN32
+static inline int32_t scap_next_live(scap_t* handle, OUT scap_evt** pevent, OUT uint16_t* pcpuid)
+#else
+static int32_t scap_next_live(scap_t* handle, OUT scap_evt** pevent, OUT uint16_t* pcpuid)
+#endif
+{
+#if !defined(HAS_CAPTURE) || defined(CYGWING_AGENT)
 	//
-	// Check which buffer has been picked
+	// this should be prevented at open time
 	//
-	if(*pcpuid != 65535)
-	{
-		struct scap_device *dev = &handle->m_devs[*pcpuid];
-		ASSERT(dev->m_sn_len >= (*pevent)->len);
-		dev->m_sn_len -= (*pevent)->len;
-		dev->m_sn_next_event += (*pevent)->len;
+	ASSERT(false);
+	return SCAP_FAILURE;
+#else
+	int32_t res;
 
-		return SCAP_SUCCESS;
+	*pcpuid = 65535;
+
+	if(handle->m_nreaders != 0)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "the devices are being consumed by scap_reader instances");
+		return SCAP_FAILURE;
 	}
-	else
+
+	scap_release_consumed_devs(&handle->m_reader);
+
+	res = scap_next_buffered(&handle->m_reader, pevent, pcpuid);
+	if(res == SCAP_TIMEOUT)
 	{
-		//
-		// All the buffers have been consumed. Check if there's enough data to keep going or
-		// if we should wait.
-		//
-		return refill_read_buffers(handle);
+		return scap_refill(&handle->m_reader);
 	}
+
+	return res;
+#endif
+}
+
+#ifndef _WIN32
+static inline int32_t scap_next_udig(scap_t* handle, OUT scap_evt** pevent, OUT uint16_t* pcpuid)
+#else
+static int32_t scap_next_udig(scap_t* handle, OUT scap_evt** pevent, OUT uint16_t* pcpuid)
 #endif
+{
+	//
+	// udig rings carry plain scap events (m_bpf is never set), so they go
+	// through the same consumer as the kernel driver
+	//
+	ASSERT(!handle->m_bpf);
+	return scap_next_live(handle, pevent, pcpuid);
 }
 
 #ifndef _WIN32
@@ -1633,6 +2057,31 @@ uint64_t scap_max_buf_used(scap_t* handle)
 #endif
 }
 
+//
+// Check to see if the event should be suppressed due to coming from a
+// supressed tid, and update the event counters accordingly
+//
+static inline int32_t scap_count_evt(scap_t* handle, scap_evt* pevent, OUT bool* suppressed)
+{
+	int32_t res;
+
+	if((res = scap_check_suppressed(handle, pevent, suppressed)) != SCAP_SUCCESS)
+	{
+		return res;
+	}
+
+	if(*suppressed)
+	{
+		handle->m_num_suppressed_evts++;
+	}
+	else
+	{
+		handle->m_evtcnt++;
+	}
+
+	return SCAP_SUCCESS;
+}
+
 int32_t scap_next(scap_t* handle, OUT scap_evt** pevent, OUT uint16_t* pcpuid)
 {
 	int32_t res = SCAP_FAILURE;
@@ -1665,27 +2114,249 @@ int32_t scap_next(scap_t* handle, OUT scap_evt** pevent, OUT uint16_t* pcpuid)
 	{
 		bool suppressed;
 
-		// Check to see if the event should be suppressed due
-		// to coming from a supressed tid
-		if((res = scap_check_suppressed(handle, *pevent, &suppressed)) != SCAP_SUCCESS)
+		if((res = scap_count_evt(handle, *pevent, &suppressed)) != SCAP_SUCCESS)
 		{
 			return res;
 		}
 
 		if(suppressed)
 		{
-			handle->m_num_suppressed_evts++;
 			return SCAP_TIMEOUT;
 		}
-		else
+	}
+
+	return res;
+}
+
+int32_t scap_next_batch(scap_t* handle, uint32_t max_events, OUT scap_evt** pevents, OUT uint16_t* pcpuids, OUT uint32_t* nevents)
+{
+	int32_t res = SCAP_FAILURE;
+	uint32_t n = 0;
+
+	*nevents = 0;
+
+	if(max_events == 0)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "scap_next_batch: max_events must be greater than zero");
+		return SCAP_FAILURE;
+	}
+
+	if(handle->m_mode != SCAP_MODE_LIVE)
+	{
+		//
+		// Offline events are read into a single buffer and nodriver
+		// events are synthesized, so they can only be returned one at a time
+		//
+		res = scap_next(handle, &pevents[0], &pcpuids[0]);
+		if(res == SCAP_SUCCESS)
+		{
+			*nevents = 1;
+		}
+
+		return res;
+	}
+
+#if defined(HAS_CAPTURE) && !defined(CYGWING_AGENT)
+	if(handle->m_nreaders != 0)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "the devices are being consumed by scap_reader instances");
+		return SCAP_FAILURE;
+	}
+
+	scap_release_consumed_devs(&handle->m_reader);
+
+	while(n < max_events)
+	{
+		bool suppressed;
+
+		res = scap_next_buffered(&handle->m_reader, &pevents[n], &pcpuids[n]);
+		if(res != SCAP_SUCCESS)
+		{
+			break;
+		}
+
+		if((res = scap_count_evt(handle, pevents[n], &suppressed)) != SCAP_SUCCESS)
+		{
+			//
+			// The events before this one are still valid
+			//
+			*nevents = n;
+			return res;
+		}
+
+		if(!suppressed)
 		{
-			handle->m_evtcnt++;
+			n++;
 		}
 	}
 
+	*nevents = n;
+
+	if(res == SCAP_TIMEOUT)
+	{
+		//
+		// Only refill when we have nothing to return, otherwise we
+		// would release buffers the returned events point into
+		//
+		return n > 0 ? SCAP_SUCCESS : scap_refill(&handle->m_reader);
+	}
+#endif
+
 	return res;
 }
 
+#if !defined(HAS_CAPTURE) || defined(CYGWING_AGENT)
+scap_reader* scap_reader_open(scap_t* handle, uint32_t first_dev, uint32_t ndevs, char *error, int32_t *rc)
+{
+	snprintf(error, SCAP_LASTERR_SIZE, "readers not supported on %s", PLATFORM_NAME);
+	*rc = SCAP_NOT_SUPPORTED;
+	return NULL;
+}
+
+void scap_reader_close(scap_reader* reader)
+{
+}
+
+int32_t scap_reader_next_batch(scap_reader* reader, uint32_t max_events, OUT scap_evt** pevents, OUT uint16_t* pcpuids, OUT uint32_t* nevents)
+{
+	*nevents = 0;
+	return SCAP_NOT_SUPPORTED;
+}
+
+const char* scap_reader_getlasterr(scap_reader* reader)
+{
+	return "readers not supported";
+}
+#else
+scap_reader* scap_reader_open(scap_t* handle, uint32_t first_dev, uint32_t ndevs, char *error, int32_t *rc)
+{
+	scap_reader* reader;
+
+	if(handle->m_mode != SCAP_MODE_LIVE)
+	{
+		snprintf(error, SCAP_LASTERR_SIZE, "readers are only supported for live captures");
+		*rc = SCAP_NOT_SUPPORTED;
+		return NULL;
+	}
+
+	if(ndevs == 0 || first_dev >= handle->m_ndevs || ndevs > handle->m_ndevs - first_dev)
+	{
+		snprintf(error, SCAP_LASTERR_SIZE, "invalid device range %u-%u, the capture has %u devices",
+			 first_dev, first_dev + ndevs, handle->m_ndevs);
+		*rc = SCAP_FAILURE;
+		return NULL;
+	}
+
+	//
+	// Suppression updates the handle tid table as it goes, which can't be
+	// done from multiple threads
+	//
+	if(handle->m_num_suppressed_comms != 0)
+	{
+		snprintf(error, SCAP_LASTERR_SIZE, "readers can't be used with suppressed comms");
+		*rc = SCAP_NOT_SUPPORTED;
+		return NULL;
+	}
+
+	reader = (scap_reader*) calloc(sizeof(scap_reader), 1);
+	if(!reader)
+	{
+		snprintf(error, SCAP_LASTERR_SIZE, "error allocating the scap_reader structure");
+		*rc = SCAP_FAILURE;
+		return NULL;
+	}
+
+	if((*rc = scap_reader_init(handle, reader, first_dev, ndevs, reader->m_lasterr_buf)) != SCAP_SUCCESS)
+	{
+		snprintf(error, SCAP_LASTERR_SIZE, "%s", reader->m_lasterr_buf);
+		scap_reader_deinit(reader);
+		free(reader);
+		return NULL;
+	}
+
+#ifndef _WIN32
+	if(handle->m_wakeup_watermark != 0)
+	{
+		if((*rc = scap_reader_init_wakeup(reader)) != SCAP_SUCCESS)
+		{
+			snprintf(error, SCAP_LASTERR_SIZE, "%s", reader->m_lasterr_buf);
+			scap_reader_deinit(reader);
+			free(reader);
+			return NULL;
+		}
+	}
+#endif
+
+	handle->m_nreaders++;
+
+	*rc = SCAP_SUCCESS;
+	return reader;
+}
+
+void scap_reader_close(scap_reader* reader)
+{
+	ASSERT(reader->m_handle->m_nreaders > 0);
+	reader->m_handle->m_nreaders--;
+
+	//
+	// Give the buffers back to the producers
+	//
+	scap_release_consumed_devs(reader);
+	scap_release_devs(reader);
+
+	scap_reader_deinit(reader);
+	free(reader);
+}
+
+int32_t scap_reader_next_batch(scap_reader* reader, uint32_t max_events, OUT scap_evt** pevents, OUT uint16_t* pcpuids, OUT uint32_t* nevents)
+{
+	int32_t res = SCAP_TIMEOUT;
+	uint32_t n = 0;
+
+	*nevents = 0;
+
+	if(max_events == 0)
+	{
+		snprintf(reader->m_lasterr, SCAP_LASTERR_SIZE, "scap_reader_next_batch: max_events must be greater than zero");
+		return SCAP_FAILURE;
+	}
+
+	scap_release_consumed_devs(reader);
+
+	while(n < max_events)
+	{
+		res = scap_next_buffered(reader, &pevents[n], &pcpuids[n]);
+		if(res != SCAP_SUCCESS)
+		{
+			break;
+		}
+
+		n++;
+	}
+
+	*nevents = n;
+
+	if(res == SCAP_TIMEOUT)
+	{
+		return n > 0 ? SCAP_SUCCESS : scap_refill(reader);
+	}
+
+	return res;
+}
+
+const char* scap_reader_getlasterr(scap_reader* reader)
+{
+	return reader->m_lasterr;
+}
+#endif
+
+int32_t scap_reader_next(scap_reader* reader, OUT scap_evt** pevent, OUT uint16_t* pcpuid)
+{
+	uint32_t nevents;
+
+	return scap_reader_next_batch(reader, 1, pevent, pcpuid, &nevents);
+}
+
 //
 // Return the process list for the given handle
 //
@@ -1734,6 +2405,83 @@ int32_t scap_get_stats(scap_t* handle, OUT scap_stats* stats)
 	return SCAP_SUCCESS;
 }
 
+int32_t scap_get_buffer_stats(scap_t* handle, uint32_t devid, OUT scap_buffer_stats* stats)
+{
+#if defined(HAS_CAPTURE) && !defined(CYGWING_AGENT)
+	if(handle->m_mode == SCAP_MODE_LIVE && devid < handle->m_ndevs)
+	{
+		stats->size = handle->m_devs[devid].m_buffer_size;
+		stats->used = buf_size_used(handle, devid);
+		stats->high_water = handle->m_devs[devid].m_high_water;
+		return SCAP_SUCCESS;
+	}
+#endif
+
+	snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "no buffer %u in this capture", devid);
+	return SCAP_FAILURE;
+}
+
+int32_t scap_get_evt_type_stats(scap_t* handle, OUT scap_evt_type_stats* stats)
+{
+	memset(stats, 0, sizeof(scap_evt_type_stats) * PPM_EVENT_MAX);
+
+	if(handle->m_mode != SCAP_MODE_LIVE)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "event type statistics not supported on this scap mode");
+		return SCAP_FAILURE;
+	}
+
+#if !defined(HAS_CAPTURE) || defined(CYGWING_AGENT)
+	snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "live capture not supported on %s", PLATFORM_NAME);
+	return SCAP_FAILURE;
+#else
+	if(handle->m_bpf)
+	{
+		return scap_bpf_get_evt_type_stats(handle, stats);
+	}
+	else if(handle->m_udig)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "event type statistics not supported on udig");
+		return SCAP_FAILURE;
+	}
+	else
+	{
+		struct ppm_evt_type_stats* dev_stats;
+		uint32_t j;
+		uint32_t k;
+
+		dev_stats = (struct ppm_evt_type_stats*)malloc(sizeof(struct ppm_evt_type_stats) * PPM_EVENT_MAX);
+		if(dev_stats == NULL)
+		{
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error allocating the event type statistics");
+			return SCAP_FAILURE;
+		}
+
+		for(j = 0; j < handle->m_ndevs; j++)
+		{
+			if(ioctl(handle->m_devs[j].m_fd, PPM_IOCTL_GET_EVT_TYPE_STATS, dev_stats))
+			{
+				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "scap_get_evt_type_stats failed for device %u: %s",
+					 j, scap_strerror(handle, errno));
+				free(dev_stats);
+				return SCAP_FAILURE;
+			}
+
+			for(k = 0; k < PPM_EVENT_MAX; k++)
+			{
+				stats[k].n_evts += dev_stats[k].n_evts;
+				stats[k].n_drops += dev_stats[k].n_drops;
+				stats[k].n_bytes += dev_stats[k].n_bytes;
+				stats[k].n_ns += dev_stats[k].n_ns;
+			}
+		}
+
+		free(dev_stats);
+		return SCAP_SUCCESS;
+	}
+#endif
+}
+
 //
 // Stop capturing the events
 //
@@ -2051,6 +2799,16 @@ int32_t scap_set_snaplen(scap_t* handle, uint32_t snaplen)
 	}
 	else
 	{
+		//
+		// The read buffers are flushed below, which can't be done under the
+		// scap_reader instances consuming them from other threads
+		//
+		if(handle->m_nreaders != 0)
+		{
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "snaplen can't be changed while scap_reader instances are open");
+			return SCAP_FAILURE;
+		}
+
 		//
 		// Tell the driver to change the snaplen
 		//
@@ -2076,6 +2834,8 @@ int32_t scap_set_snaplen(scap_t* handle, uint32_t snaplen)
 
 				handle->m_devs[j].m_sn_len = 0;
 			}
+
+			handle->m_flush_gen++;
 		}
 	}
 #endif // _WIN32
@@ -2092,7 +2852,17 @@ int64_t scap_get_readfile_offset(scap_t* handle)
 		return -1;
 	}
 
-	return gzoffset(handle->m_file);
+	return scap_cfile_offset(handle->m_file);
+}
+
+bool scap_is_compressed_capture(scap_t* handle)
+{
+	if(handle->m_mode != SCAP_MODE_CAPTURE || handle->m_file == NULL)
+	{
+		return false;
+	}
+
+	return scap_cfile_compressed(handle->m_file);
 }
 
 #ifndef CYGWING_AGENT
@@ -2139,6 +2909,12 @@ static int32_t scap_handle_eventmask(scap_t* handle, uint32_t op, uint32_t event
 	}
 	else
 	{
+		if(handle->m_nreaders != 0)
+		{
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "the event mask can't be changed while scap_reader instances are open");
+			return SCAP_FAILURE;
+		}
+
 		if(ioctl(handle->m_devs[0].m_fd, op, event_id))
 		{
 			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE,
@@ -2163,6 +2939,8 @@ static int32_t scap_handle_eventmask(scap_t* handle, uint32_t op, uint32_t event
 
 				handle->m_devs[j].m_sn_len = 0;
 			}
+
+			handle->m_flush_gen++;
 		}
 	}
 
@@ -2505,8 +3283,15 @@ bool scap_get_bpf_enabled(scap_t *handle)
 
 int32_t scap_suppress_events_comm(scap_t *handle, const char *comm)
 {
-	// If the comm is already present in the list, do nothing
 	uint32_t i;
+
+	if(handle->m_nreaders != 0)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "comms can't be suppressed while scap_reader instances are open");
+		return SCAP_FAILURE;
+	}
+
+	// If the comm is already present in the list, do nothing
 	for(i=0; i<handle->m_num_suppressed_comms; i++)
 	{
 		if(strcmp(handle->m_suppressed_comms[i], comm) == 0)
@@ -2559,6 +3344,12 @@ int32_t scap_set_fullcapture_port_range(scap_t* handle, uint16_t range_start, ui
 	}
 	else
 	{
+		if(handle->m_nreaders != 0)
+		{
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "the fullcapture port range can't be changed while scap_reader instances are open");
+			return SCAP_FAILURE;
+		}
+
 		//
 		// Encode the port range
 		//
@@ -2589,6 +3380,8 @@ int32_t scap_set_fullcapture_port_range(scap_t* handle, uint16_t range_start, ui
 
 				handle->m_devs[j].m_sn_len = 0;
 			}
+
+			handle->m_flush_gen++;
 		}
 	}
 
@@ -2622,6 +3415,12 @@ int32_t scap_set_statsd_port(scap_t* const handle, const uint16_t port)
 	}
 	else
 	{
+		if(handle->m_nreaders != 0)
+		{
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "the statsd port can't be changed while scap_reader instances are open");
+			return SCAP_FAILURE;
+		}
+
 		//
 		// Beam the value down to the module
 		//
@@ -2650,6 +3449,8 @@ int32_t scap_set_statsd_port(scap_t* const handle, const uint16_t port)
 
 				handle->m_devs[j].m_sn_len = 0;
 			}
+
+			handle->m_flush_gen++;
 		}
 	}
 
@@ -2714,4 +3515,84 @@ int32_t scap_disable_skb_capture(scap_t *handle)
 		return SCAP_FAILURE;
 	}
 #endif
-}
\ No newline at end of file
+}
+
+int32_t scap_set_rtt_aggregation(scap_t *handle, bool aggregate, uint64_t interval_ns)
+{
+	//
+	// Not supported on files
+	//
+	if(handle->m_mode != SCAP_MODE_LIVE)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "rtt aggregation not supported on this scap mode");
+		return SCAP_FAILURE;
+	}
+
+#if !defined(HAS_CAPTURE) || defined(CYGWING_AGENT)
+	snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "live capture not supported on %s", PLATFORM_NAME);
+	return SCAP_FAILURE;
+#else
+
+	if(handle->m_bpf)
+	{
+		return scap_bpf_set_rtt_aggregation(handle, aggregate, interval_ns != 0 ? interval_ns : SCAP_RTT_DEFAULT_INTERVAL_NS);
+	}
+	else
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "rtt aggregation not supported on kernel module");
+		return SCAP_FAILURE;
+	}
+#endif
+}
+
+int32_t scap_read_rtt_stats(scap_t *handle, OUT scap_rtt_stats *stats, uint32_t max_stats, OUT uint32_t *nstats)
+{
+	*nstats = 0;
+
+	if(handle->m_mode != SCAP_MODE_LIVE)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "rtt aggregation not supported on this scap mode");
+		return SCAP_FAILURE;
+	}
+
+#if !defined(HAS_CAPTURE) || defined(CYGWING_AGENT)
+	snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "live capture not supported on %s", PLATFORM_NAME);
+	return SCAP_FAILURE;
+#else
+
+	if(handle->m_bpf)
+	{
+		return scap_bpf_read_rtt_stats(handle, stats, max_stats, nstats);
+	}
+	else
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "rtt aggregation not supported on kernel module");
+		return SCAP_FAILURE;
+	}
+#endif
+}
+
+int32_t scap_get_rtt_map_stats(scap_t *handle, OUT scap_rtt_map_stats *stats)
+{
+	if(handle->m_mode != SCAP_MODE_LIVE)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "rtt aggregation not supported on this scap mode");
+		return SCAP_FAILURE;
+	}
+
+#if !defined(HAS_CAPTURE) || defined(CYGWING_AGENT)
+	snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "live capture not supported on %s", PLATFORM_NAME);
+	return SCAP_FAILURE;
+#else
+
+	if(handle->m_bpf)
+	{
+		return scap_bpf_get_rtt_map_stats(handle, stats);
+	}
+	else
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "rtt aggregation not supported on kernel module");
+		return SCAP_FAILURE;
+	}
+#endif
+}
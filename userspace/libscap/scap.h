@@ -49,6 +49,7 @@ extern "C" {
 // Forward declarations
 //
 typedef struct scap scap_t;
+typedef struct scap_reader scap_reader;
 typedef struct ppm_evt_hdr scap_evt;
 
 struct iovec;
@@ -112,6 +113,66 @@ typedef struct scap_stats
 	uint64_t n_tids_suppressed; ///< Number of threads currently being suppressed
 }scap_stats;
 
+/*!
+  \brief Statistics about the buffer of a device of a live capture
+*/
+typedef struct scap_buffer_stats
+{
+	uint64_t size; ///< Size of the buffer, in bytes.
+	uint64_t used; ///< Number of bytes currently waiting to be consumed.
+	uint64_t high_water; ///< Highest number of bytes found waiting in the buffer by a read since the capture was opened.
+}scap_buffer_stats;
+
+/*!
+  \brief Statistics about an event type of a live capture, summed over all
+  the devices
+*/
+typedef struct scap_evt_type_stats
+{
+	uint64_t n_evts; ///< Number of events written to the buffers.
+	uint64_t n_drops; ///< Number of events dropped (buffer full, page faults, driver bugs).
+	uint64_t n_bytes; ///< Number of bytes written to the buffers.
+	uint64_t n_ns; ///< Time spent by the driver generating the events, written or dropped, in nanoseconds. Always 0 with the kernel module.
+}scap_evt_type_stats;
+
+#define SCAP_RTT_HIST_BUCKETS 20
+#define SCAP_RTT_DEFAULT_INTERVAL_NS 5000000000ULL
+
+/*!
+  \brief The smoothed RTT samples of a TCP connection accumulated by the BPF
+  probe since the previous scap_read_rtt_stats()
+*/
+typedef struct scap_rtt_stats
+{
+	uint32_t saddr[4]; ///< Local address, in network byte order. Only saddr[0] is used for AF_INET.
+	uint32_t daddr[4]; ///< Remote address, in network byte order. Only daddr[0] is used for AF_INET.
+	uint16_t sport; ///< Local port.
+	uint16_t dport; ///< Remote port.
+	uint16_t family; ///< Address family.
+	uint32_t min_srtt_us; ///< Lowest sample, in microseconds.
+	uint32_t max_srtt_us; ///< Highest sample, in microseconds.
+	uint64_t sum_srtt_us; ///< Sum of the samples, in microseconds.
+	uint64_t count; ///< Number of samples.
+	uint32_t hist[SCAP_RTT_HIST_BUCKETS]; ///< hist[j] counts the samples between 2^j and 2^(j+1) - 1 us (0 and 1 us for hist[0]).
+	                                      // The last bucket also counts everything above it.
+}scap_rtt_stats;
+
+/*!
+  \brief Occupancy and churn of the connection table the BPF probe uses to
+  track the RTT of the TCP connections. The table is an LRU hash: when it's
+  full the least recently updated connections are evicted, and n_evictions
+  counts the connections lost that way.
+*/
+typedef struct scap_rtt_map_stats
+{
+	uint64_t n_entries; ///< Connections currently in the table.
+	uint64_t max_entries; ///< Size of the table.
+	uint64_t n_inserts; ///< Connections added by the probe.
+	uint64_t n_insert_fails; ///< Connections the probe couldn't add.
+	uint64_t n_deletes; ///< Connections removed on close or read by scap_read_rtt_stats().
+	uint64_t n_evictions; ///< Connections evicted to make room for new ones. Estimated from the other counters.
+}scap_rtt_map_stats;
+
 /*!
   \brief Information about the parameter of an event
 */
@@ -321,6 +382,23 @@ typedef struct scap_open_args
 	void(*debug_log_fn)(const char* msg); // Function which SCAP may use to log a debug message
 	uint64_t proc_scan_timeout_ms; // Timeout in msec, after which so-far-successful scan of /proc should be cut short with success return
 	uint64_t proc_scan_log_interval_ms; // Interval for logging progress messages from /proc scan
+	bool relaxed_ordering; ///< If true, scap_next() returns all the buffered events of a CPU before moving to the next one,
+	                       // instead of merging the CPUs by timestamp. Events of a CPU keep their order, but events of
+	                       // different CPUs (and of a thread that migrated between CPUs) can be returned out of order.
+	                       // Ignored for offline captures.
+	uint32_t wakeup_watermark; ///< If non-zero, when the buffers are empty scap_next() waits for the driver to signal that a
+	                           // buffer holds at least this many bytes, instead of sleeping with an exponential backoff.
+	                           // Supported by the kernel module and the BPF probe, ignored otherwise. Must be lower
+	                           // than the buffer size.
+	uint32_t bpf_ringbuf_groups; ///< If non-zero, the BPF probe writes to this many BPF ring buffers (kernel >= 5.8), each one
+	                             // shared by a group of contiguous CPUs, instead of one perf buffer per CPU. The groups are
+	                             // the devices of the capture, so the cpuid of the events is the one of the group, and
+	                             // the events of a group are only approximately ordered by timestamp. Ignored without
+	                             // the BPF probe.
+	uint32_t ring_buf_size; ///< Size in bytes of the buffer of every device, must be a power of two multiple of the page
+	                        // size. If zero, the kernel module keeps the size it is configured with and the BPF probe
+	                        // uses the default. For the kernel module this sets the ring_buf_size module parameter, so
+	                        // it affects every consumer created later and requires write access to /sys/module.
 }scap_open_args;
 
 
@@ -508,7 +586,9 @@ typedef enum event_direction
 typedef enum compression_mode
 {
 	SCAP_COMPRESSION_NONE = 0,
-	SCAP_COMPRESSION_GZIP = 1
+	SCAP_COMPRESSION_GZIP = 1,
+	SCAP_COMPRESSION_ZSTD = 2, ///< Requires libscap built with USE_ZSTD
+	SCAP_COMPRESSION_LZ4 = 3 ///< Requires libscap built with USE_LZ4
 }compression_mode;
 
 /*!
@@ -672,6 +752,74 @@ uint64_t scap_max_buf_used(scap_t* handle);
 */
 int32_t scap_next(scap_t* handle, OUT scap_evt** pevent, OUT uint16_t* pcpuid);
 
+/*!
+  \brief Get up to max_events events from the given capture instance in a single call
+
+  \param handle Handle to the capture instance.
+  \param max_events Maximum number of events to return. Must be greater than zero.
+  \param pevents User-provided array of at least max_events pointers that will be initialized
+    with the addresses of the events.
+  \param pcpuids User-provided array of at least max_events entries that will be initialized
+    with the IDs of the CPUs where the events were captured.
+  \param nevents User-provided pointer that will be set to the number of returned events.
+
+  \return SCAP_SUCCESS if the call is successful and at least one event was returned.
+   SCAP_TIMEOUT in case the read timeout expired and no event is available.
+   SCAP_EOF when the end of an offline capture is reached.
+   On Failure, SCAP_FAILURE is returned and scap_getlasterr() can be used to obtain the cause of the error.
+
+  \note For live captures the events are not copied: they point into the driver buffers and are
+   valid until the next call to scap_next() or scap_next_batch(). A batch stops short of
+   max_events when the data already read from the buffers is exhausted, so this function never
+   waits more than scap_next() does. Offline and nodriver captures return one event per call.
+*/
+int32_t scap_next_batch(scap_t* handle, uint32_t max_events, OUT scap_evt** pevents, OUT uint16_t* pcpuids, OUT uint32_t* nevents);
+
+/*!
+  \brief Create a reader that consumes a subset of the devices of a live capture
+
+  \param handle Handle to the capture instance.
+  \param first_dev First device consumed by the reader.
+  \param ndevs Number of devices consumed by the reader, starting from first_dev.
+    scap_get_ndevs() returns the number of devices of the capture.
+  \param error Pointer to a buffer that will contain the error string in case the
+    function fails. The buffer must have size SCAP_LASTERR_SIZE.
+  \param rc Integer pointer that will contain the scap return code in case the
+    function fails.
+
+  \return The reader, or NULL on failure.
+
+  \note Readers on disjoint device ranges can be consumed concurrently, each from its own
+   thread. While readers are open, scap_next() and scap_next_batch() fail on the handle,
+   and the functions changing the capture configuration (snaplen, event mask, dropping
+   mode...) must not be called concurrently with the readers. Readers don't support
+   suppressed comms and don't update the event count of the handle.
+*/
+scap_reader* scap_reader_open(scap_t* handle, uint32_t first_dev, uint32_t ndevs, char *error, int32_t *rc);
+
+/*!
+  \brief Close a reader, releasing the buffers it is still holding. Must be called before
+   closing the capture.
+*/
+void scap_reader_close(scap_reader* reader);
+
+/*!
+  \brief Equivalent of scap_next() for a reader. The event is valid until the next call on
+   the same reader.
+*/
+int32_t scap_reader_next(scap_reader* reader, OUT scap_evt** pevent, OUT uint16_t* pcpuid);
+
+/*!
+  \brief Equivalent of scap_next_batch() for a reader. The events are valid until the next
+   call on the same reader.
+*/
+int32_t scap_reader_next_batch(scap_reader* reader, uint32_t max_events, OUT scap_evt** pevents, OUT uint16_t* pcpuids, OUT uint32_t* nevents);
+
+/*!
+  \brief Return a string with the last error that happened on the given reader.
+*/
+const char* scap_reader_getlasterr(scap_reader* reader);
+
 /*!
   \brief Get the length of an event
 
@@ -733,6 +881,15 @@ uint32_t scap_event_get_dump_flags(scap_t* handle);
 */
 int64_t scap_get_readfile_offset(scap_t* handle);
 
+/*!
+  \brief Return true if the file opened by scap_open_offline() is
+  compressed. Seeking in a compressed file, or opening it at an offset,
+  decompresses it from the beginning.
+
+  \param handle Handle to the capture instance.
+*/
+bool scap_is_compressed_capture(scap_t* handle);
+
 /*!
   \brief Open a trace file for writing
 
@@ -784,6 +941,83 @@ int64_t scap_dump_ftell(scap_dumper_t *d);
 */
 void scap_dump_flush(scap_dumper_t *d);
 
+/*!
+  \brief Buffer the events and write them in blocks of up to size bytes,
+         instead of one block per event. The buffered events are written
+         when the block is full, and by \ref scap_dump_flush and
+         \ref scap_dump_close. 0 writes one block per event again.
+
+  \note Files with event batch blocks can't be read by older versions of
+   the library. \ref scap_dump_get_offset and \ref scap_dump_ftell don't
+   account for the buffered events.
+
+  \param d The dump handle, returned by \ref scap_dump_open
+  \param size The size of the blocks, up to EVB_MAX_BLOCK_SIZE.
+
+  \return SCAP_SUCCESS if the call is successful, SCAP_NOT_SUPPORTED for
+   memory dumps or too big sizes, SCAP_FAILURE if the buffered events
+   can't be written.
+*/
+int32_t scap_dump_set_event_block_size(scap_dumper_t *d, uint32_t size);
+
+/*!
+  \brief An entry of the timestamp index of a capture file, see
+  \ref scap_dump_set_index_interval.
+*/
+typedef struct scap_index_entry
+{
+	uint64_t ts; ///< Timestamp of the first event of the indexed block.
+	uint64_t offset; ///< Position of the block, to be passed to \ref scap_fseek.
+	uint64_t checkpoint; ///< Position of the section whose tables hold the state to load before replaying from offset.
+}scap_index_entry;
+
+/*!
+  \brief Write a timestamp index block when the dump file is closed, with
+  an entry for the first event block written after every interval bytes.
+  Readers use it to seek by timestamp with \ref scap_find_index_entry.
+
+  \note Files with an index block can't be read by older versions of the
+   library.
+
+  \note The offsets are in uncompressed bytes. Reaching an entry with a
+   cheap seek only works on uncompressed files: compressed ones are
+   decompressed from the beginning up to the entry.
+
+  \param d The dump handle, returned by \ref scap_dump_open
+  \param interval The minimum distance in bytes between two entries, 0
+   (the default) to disable the index.
+
+  \return SCAP_SUCCESS if the call is successful, SCAP_NOT_SUPPORTED for
+   memory dumps.
+*/
+int32_t scap_dump_set_index_interval(scap_dumper_t *d, uint64_t interval);
+
+/*!
+  \brief Start a new section of the dump file, a checkpoint with the
+  current machine info, interface list and user list of the handle, and its
+  process and fd tables if proc_tables is true. The events written after it
+  can be replayed without the previous part of the file, starting from the
+  state saved in the section, and \ref scap_next_section finds it.
+
+  Callers that track the processes themselves pass false and write their
+  own tables right after, with the scap_write_proclist_* functions and
+  scap_write_proc_fds().
+
+  \note Readers see the section like the start of a file appended to the
+   capture: they reload the tables from it.
+
+  \note Not supported on compressed dumps: a reader would reopen the file
+   at every section, decompressing it again from the beginning.
+
+  \param handle Handle to the capture instance.
+  \param d The dump handle, returned by \ref scap_dump_open
+  \param proc_tables true to write the process and fd tables of the handle.
+
+  \return SCAP_SUCCESS if the call is successful, SCAP_NOT_SUPPORTED for
+   memory dumps and compressed dumps, SCAP_FAILURE on write errors.
+*/
+int32_t scap_dump_checkpoint(scap_t *handle, scap_dumper_t *d, bool proc_tables);
+
 /*!
   \brief Tell how many bytes would be written (a dry run of scap_dump)
 
@@ -812,6 +1046,15 @@ int32_t scap_number_of_bytes_to_write(scap_evt *e, uint16_t cpuid, int32_t* byte
 */
 int32_t scap_dump(scap_t *handle, scap_dumper_t *d, scap_evt* e, uint16_t cpuid, uint32_t flags);
 
+/*!
+  \brief Same as \ref scap_dump, for writers running on another thread than
+  the one using the handle: the error is written to error instead of the last
+  error of the handle.
+
+  \param error Buffer of SCAP_LASTERR_SIZE bytes, filled in case of failure.
+*/
+int32_t scap_dump_errbuf(scap_dumper_t *d, scap_evt* e, uint16_t cpuid, uint32_t flags, char *error);
+
 /*!
   \brief Get the process list for the given capture instance
 
@@ -853,6 +1096,37 @@ scap_threadinfo* scap_get_proc_table(scap_t* handle);
 */
 int32_t scap_get_stats(scap_t* handle, OUT scap_stats* stats);
 
+/*!
+  \brief Return the statistics of the buffer of one of the devices of a live
+  capture. Comparing the high water mark with the size tells how close the
+  device got to dropping events, and therefore how big its buffer should be.
+
+  \param handle Handle to the capture instance.
+  \param devid The device, between 0 and scap_get_ndevs() - 1. Every device is a
+  CPU, or a group of CPUs when the BPF probe uses ring buffers.
+  \param stats Pointer to a \ref scap_buffer_stats structure that will be filled
+  with the statistics.
+
+  \return SCAP_SUCCESS if the call is successful.
+   On Failure, SCAP_FAILURE is returned and scap_getlasterr() can be used to obtain
+   the cause of the error.
+*/
+int32_t scap_get_buffer_stats(scap_t* handle, uint32_t devid, OUT scap_buffer_stats* stats);
+
+/*!
+  \brief Return the per event type counters of the driver for the current
+  capture, which tell which events cause the buffer pressure and the drops.
+
+  \param handle Handle to the capture instance.
+  \param stats Pointer to an array of PPM_EVENT_MAX \ref scap_evt_type_stats
+  structures, indexed by event type, that will be filled with the statistics.
+
+  \return SCAP_SUCCESS if the call is successful.
+   On Failure, SCAP_FAILURE is returned and scap_getlasterr() can be used to obtain
+   the cause of the error.
+*/
+int32_t scap_get_evt_type_stats(scap_t* handle, OUT scap_evt_type_stats* stats);
+
 /*!
   \brief This function can be used to temporarily interrupt event capture.
 
@@ -1058,10 +1332,55 @@ void scap_refresh_proc_table(scap_t* handle);
 void scap_set_refresh_proc_table_when_saving(scap_t* handle, bool refresh);
 uint64_t scap_ftell(scap_t *handle);
 void scap_fseek(scap_t *handle, uint64_t off);
+
+/*!
+  \brief Find the last entry of the timestamp index of the capture with a
+  timestamp lower or equal than ts, or the first entry if there's none.
+  The index is loaded on the first call: the tail of uncompressed files is
+  read directly, compressed ones are scanned from the current position (or
+  from the index block, if scap_next() already went past it), which is
+  restored. The lookup is O(log n) afterwards, but on compressed files
+  \ref scap_fseek to the entry still decompresses the file up to it.
+
+  \return SCAP_SUCCESS, SCAP_NOTFOUND if the capture doesn't have an index,
+   SCAP_FAILURE on read errors. The entry is valid until the handle is
+   closed.
+*/
+int32_t scap_find_index_entry(scap_t *handle, uint64_t ts, OUT const scap_index_entry** entry);
+
+/*!
+  \brief Skip the blocks of the capture up to the start of the next section,
+  i.e. the next capture appended to it or the next checkpoint written with
+  \ref scap_dump_checkpoint, and return its position. Only the block
+  headers are read, so uncompressed files are skipped with cheap seeks.
+
+  \note The events buffered by the handle are discarded, and the read
+   position is left after the section header block: use a dedicated
+   handle, or \ref scap_fseek before reading events again.
+
+  \return SCAP_SUCCESS, SCAP_EOF if there are no more sections,
+   SCAP_FAILURE if the file is corrupted.
+*/
+int32_t scap_next_section(scap_t *handle, OUT uint64_t* pos);
 int32_t scap_enable_tracers_capture(scap_t* handle);
 int32_t scap_enable_page_faults(scap_t *handle);
 int32_t scap_enable_skb_capture(scap_t *handle);
 int32_t scap_disable_skb_capture(scap_t *handle);
+
+// Control the tcp_rcv_established probe of the BPF probe. If aggregate is
+// true the RTT samples are accumulated per connection in the probe and
+// collected with scap_read_rtt_stats(), otherwise a connection generates at
+// most one event per interval_ns. 0 selects SCAP_RTT_DEFAULT_INTERVAL_NS.
+int32_t scap_set_rtt_aggregation(scap_t *handle, bool aggregate, uint64_t interval_ns);
+// Move up to max_stats connections out of the probe. nstats can be lower
+// than max_stats while connections are left, call again until it's 0.
+// Returns SCAP_INPUT_TOO_SMALL if a bucket of the connection table doesn't
+// fit in max_stats.
+int32_t scap_read_rtt_stats(scap_t *handle, OUT scap_rtt_stats *stats, uint32_t max_stats, OUT uint32_t *nstats);
+// Fill stats with the occupancy and counters of the RTT connection table.
+// Counting the entries walks the whole table, this isn't meant to be called
+// on every event.
+int32_t scap_get_rtt_map_stats(scap_t *handle, OUT scap_rtt_map_stats *stats);
 uint64_t scap_get_unexpected_block_readsize(scap_t* handle);
 int32_t scap_proc_add(scap_t* handle, uint64_t tid, scap_threadinfo* tinfo);
 int32_t scap_fd_add(scap_t *handle, scap_threadinfo* tinfo, uint64_t fd, scap_fdinfo* fdinfo);
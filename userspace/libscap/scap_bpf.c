@@ -22,6 +22,7 @@ limitations under the License.
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <arpa/inet.h>
 #include <sys/syscall.h>
 #include <sys/utsname.h>
 #include <gelf.h>
@@ -58,6 +59,7 @@ struct bpf_map_data {
 	int fd;
 	size_t elf_offset;
 	struct bpf_map_def def;
+	const char *name;
 };
 
 static const int BUF_SIZE_PAGES = 2048;
@@ -126,9 +128,99 @@ static int bpf_map_lookup_elem(int fd, const void *key, void *value)
 	return sys_bpf(BPF_MAP_LOOKUP_ELEM, &attr, sizeof(attr));
 }
 
+static int bpf_map_delete_elem(int fd, const void *key)
+{
+	union bpf_attr attr;
+
+	bzero(&attr, sizeof(attr));
+
+	attr.map_fd = fd;
+	attr.key = (unsigned long) key;
+
+	return sys_bpf(BPF_MAP_DELETE_ELEM, &attr, sizeof(attr));
+}
+
+static int bpf_map_get_next_key(int fd, const void *key, void *next_key)
+{
+	union bpf_attr attr;
+
+	bzero(&attr, sizeof(attr));
+
+	attr.map_fd = fd;
+	attr.key = (unsigned long) key;
+	attr.next_key = (unsigned long) next_key;
+
+	return sys_bpf(BPF_MAP_GET_NEXT_KEY, &attr, sizeof(attr));
+}
+
+//
+// Look up up to *count entries starting from the in_batch position (NULL
+// for the beginning), leaving them in the map. *count is updated like in
+// bpf_map_lookup_and_delete_batch().
+//
+static int bpf_map_lookup_batch(int fd, void *in_batch, void *out_batch, void *keys, void *values, uint32_t *count)
+{
+	union bpf_attr attr;
+	int ret;
+
+	bzero(&attr, sizeof(attr));
+
+	attr.batch.map_fd = fd;
+	attr.batch.in_batch = (unsigned long) in_batch;
+	attr.batch.out_batch = (unsigned long) out_batch;
+	attr.batch.keys = (unsigned long) keys;
+	attr.batch.values = (unsigned long) values;
+	attr.batch.count = *count;
+
+	ret = sys_bpf(BPF_MAP_LOOKUP_BATCH, &attr, sizeof(attr));
+	if(ret == 0 || errno == ENOENT)
+	{
+		*count = attr.batch.count;
+	}
+	else
+	{
+		*count = 0;
+	}
+
+	return ret;
+}
+
+//
+// Look up and delete up to *count entries starting from the in_batch
+// position (NULL for the beginning). On return *count holds the number of
+// entries read, which can be non zero even if the call fails with ENOENT
+// at the end of the map.
+//
+static int bpf_map_lookup_and_delete_batch(int fd, void *in_batch, void *out_batch, void *keys, void *values, uint32_t *count)
+{
+	union bpf_attr attr;
+	int ret;
+
+	bzero(&attr, sizeof(attr));
+
+	attr.batch.map_fd = fd;
+	attr.batch.in_batch = (unsigned long) in_batch;
+	attr.batch.out_batch = (unsigned long) out_batch;
+	attr.batch.keys = (unsigned long) keys;
+	attr.batch.values = (unsigned long) values;
+	attr.batch.count = *count;
+
+	ret = sys_bpf(BPF_MAP_LOOKUP_AND_DELETE_BATCH, &attr, sizeof(attr));
+	if(ret == 0 || errno == ENOENT || errno == ENOSPC)
+	{
+		*count = attr.batch.count;
+	}
+	else
+	{
+		*count = 0;
+	}
+
+	return ret;
+}
+
 static int bpf_map_create(enum bpf_map_type map_type,
 			  int key_size, int value_size, int max_entries,
-			  uint32_t map_flags)
+			  uint32_t map_flags, int inner_map_fd)
 {
 	union bpf_attr attr;
 
@@ -139,6 +231,7 @@ static int bpf_map_create(enum bpf_map_type map_type,
 	attr.value_size = value_size;
 	attr.max_entries = max_entries;
 	attr.map_flags = map_flags;
+	attr.inner_map_fd = inner_map_fd;
 
 	return sys_bpf(BPF_MAP_CREATE, &attr, sizeof(attr));
 }
@@ -348,6 +441,7 @@ static int32_t load_elf_maps_section(scap_t *handle, struct bpf_map_data *maps,
 		offset = sym[i].st_value;
 		def = (struct bpf_map_def *)(data_maps->d_buf + offset);
 		maps[i].elf_offset = offset;
+		maps[i].name = elf_strptr(elf, strtabidx, sym[i].st_name);
 		memcpy(&maps[i].def, def, sizeof(struct bpf_map_def));
 	}
 
@@ -356,12 +450,99 @@ static int32_t load_elf_maps_section(scap_t *handle, struct bpf_map_data *maps,
 }
 #endif // MINIMAL_BUILD
 
+//
+// Create the ring buffers of the ring buffer backend, one per device, and the
+// array of maps the probe finds them in. Without the ring buffer backend the
+// array stays empty, but it still needs a ring buffer as template.
+//
+static int32_t create_ringbuf_maps(scap_t *handle, struct bpf_map_data *map, int idx)
+{
+	int page_size = getpagesize();
+	uint32_t ringbuf_size = handle->m_bpf_ringbuf_groups != 0 ? handle->m_ring_buf_size : page_size;
+	uint32_t j;
+	int inner_fd;
+	int outer_fd;
+
+	if(map->def.type != BPF_MAP_TYPE_ARRAY_OF_MAPS)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "unexpected type %u of the ring buffer map", map->def.type);
+		return SCAP_FAILURE;
+	}
+
+	inner_fd = bpf_map_create(BPF_MAP_TYPE_RINGBUF, 0, 0, ringbuf_size, 0, 0);
+	if(inner_fd < 0)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "can't create ring buffer: %s", scap_strerror(handle, errno));
+		return SCAP_FAILURE;
+	}
+
+	outer_fd = bpf_map_create(BPF_MAP_TYPE_ARRAY_OF_MAPS,
+				  map->def.key_size,
+				  map->def.value_size,
+				  handle->m_bpf_ringbuf_groups != 0 ? handle->m_bpf_ringbuf_groups : 1,
+				  map->def.map_flags,
+				  inner_fd);
+	handle->m_bpf_map_fds[idx] = outer_fd;
+	map->fd = outer_fd;
+
+	if(outer_fd < 0)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "can't create map: %s", scap_strerror(handle, errno));
+		close(inner_fd);
+		return SCAP_FAILURE;
+	}
+
+	if(handle->m_bpf_ringbuf_groups == 0)
+	{
+		close(inner_fd);
+		return SCAP_SUCCESS;
+	}
+
+	//
+	// The template is the ring buffer of the first group, the devices own
+	// the ring buffer fds from now on
+	//
+	for(j = 0; j < handle->m_bpf_ringbuf_groups; j++)
+	{
+		int fd = j == 0 ? inner_fd : bpf_map_create(BPF_MAP_TYPE_RINGBUF, 0, 0, ringbuf_size, 0, 0);
+
+		if(fd < 0)
+		{
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "can't create ring buffer: %s", scap_strerror(handle, errno));
+			return SCAP_FAILURE;
+		}
+
+		handle->m_devs[j].m_fd = fd;
+		handle->m_devs[j].m_rb_size = ringbuf_size;
+		handle->m_devs[j].m_buffer_size = ringbuf_size;
+
+		if(bpf_map_update_elem(outer_fd, &j, &fd, BPF_ANY) != 0)
+		{
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "ringbuf_maps bpf_map_update_elem < 0: %s", scap_strerror(handle, errno));
+			return SCAP_FAILURE;
+		}
+	}
+
+	return SCAP_SUCCESS;
+}
+
 static int32_t load_maps(scap_t *handle, struct bpf_map_data *maps, int nr_maps)
 {
 	int j;
 
 	for(j = 0; j < nr_maps; ++j)
 	{
+		if(maps[j].name != NULL && strcmp(maps[j].name, "ringbuf_maps") == 0)
+		{
+			if(create_ringbuf_maps(handle, &maps[j], j) != SCAP_SUCCESS)
+			{
+				return SCAP_FAILURE;
+			}
+
+			handle->m_bpf_ringbuf_map_idx = j;
+			continue;
+		}
+
 		if(j == SYSDIG_PERF_MAP ||
 		   j == SYSDIG_LOCAL_STATE_MAP ||
 		   j == SYSDIG_FRAME_SCRATCH_MAP ||
@@ -369,12 +550,18 @@ static int32_t load_maps(scap_t *handle, struct bpf_map_data *maps, int nr_maps)
 		{
 			maps[j].def.max_entries = handle->m_ncpus;
 		}
+		else if(maps[j].name != NULL && strcmp(maps[j].name, "evt_type_stats_map") == 0)
+		{
+			maps[j].def.max_entries = handle->m_ncpus * PPM_EVENT_MAX;
+			handle->m_bpf_evt_type_stats_map_idx = j;
+		}
 
 		handle->m_bpf_map_fds[j] = bpf_map_create(maps[j].def.type,
 							  maps[j].def.key_size,
 							  maps[j].def.value_size,
 							  maps[j].def.max_entries,
-							  maps[j].def.map_flags);
+							  maps[j].def.map_flags,
+							  0);
 
 		maps[j].fd = handle->m_bpf_map_fds[j];
 
@@ -388,6 +575,17 @@ static int32_t load_maps(scap_t *handle, struct bpf_map_data *maps, int nr_maps)
 		{
 			handle->m_bpf_prog_array_map_idx = j;
 		}
+		else if(maps[j].name != NULL && strcmp(maps[j].name, "rtt_static_map") == 0)
+		{
+			handle->m_bpf_rtt_map_idx = j;
+			handle->m_bpf_rtt_map_entries = maps[j].def.max_entries;
+		}
+	}
+
+	if(handle->m_bpf_ringbuf_groups != 0 && handle->m_bpf_ringbuf_map_idx == -1)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "the BPF probe has been built without ring buffer support (requires kernel >= 5.8)");
+		return SCAP_FAILURE;
 	}
 
 	return SCAP_SUCCESS;
@@ -811,9 +1009,9 @@ cleanup:
 static void *perf_event_mmap(scap_t *handle, int fd)
 {
 	int page_size = getpagesize();
-	int ring_size = page_size * BUF_SIZE_PAGES;
-	int header_size = page_size;
-	int total_size = ring_size * 2 + header_size;
+	size_t ring_size = handle->m_ring_buf_size;
+	size_t header_size = page_size;
+	size_t total_size = ring_size * 2 + header_size;
 
 	//
 	// All this playing with MAP_FIXED might be very very wrong, revisit
@@ -1215,13 +1413,25 @@ int32_t scap_bpf_close(scap_t *handle)
 	int j;
 
 	int page_size = getpagesize();
-	int ring_size = page_size * BUF_SIZE_PAGES;
-	int header_size = page_size;
-	int total_size = ring_size * 2 + header_size;
+	size_t ring_size = handle->m_ring_buf_size;
+	size_t header_size = page_size;
+	size_t total_size = ring_size * 2 + header_size;
 
 	for(j = 0; j < handle->m_ndevs; j++)
 	{
-		if(handle->m_devs[j].m_buffer != MAP_FAILED)
+		if(handle->m_bpf_ringbuf_groups != 0)
+		{
+			if(handle->m_devs[j].m_buffer != MAP_FAILED)
+			{
+				munmap(handle->m_devs[j].m_buffer, page_size);
+			}
+
+			if(handle->m_devs[j].m_rb_producer != MAP_FAILED)
+			{
+				munmap(handle->m_devs[j].m_rb_producer, page_size + 2 * handle->m_devs[j].m_rb_size);
+			}
+		}
+		else if(handle->m_devs[j].m_buffer != MAP_FAILED)
 		{
 #ifdef _DEBUG
 			int ret;
@@ -1267,6 +1477,9 @@ int32_t scap_bpf_close(scap_t *handle)
 
 	handle->m_bpf_prog_cnt = 0;
 	handle->m_bpf_prog_array_map_idx = -1;
+	handle->m_bpf_ringbuf_map_idx = -1;
+	handle->m_bpf_rtt_map_idx = -1;
+	handle->m_bpf_evt_type_stats_map_idx = -1;
 
 	return SCAP_SUCCESS;
 }
@@ -1397,6 +1610,10 @@ static int32_t set_default_settings(scap_t *handle)
 	for (int i = 0; i < PPM_EVENT_MAX; i++) {
 	    settings.events_mask[i] = true;
 	}
+	settings.ringbuf = handle->m_bpf_ringbuf_groups != 0;
+	settings.ringbuf_wakeup_watermark = handle->m_wakeup_watermark;
+	settings.rtt_aggregate = false;
+	settings.rtt_interval_ns = SCAP_RTT_DEFAULT_INTERVAL_NS;
 
 	int k = 0;
 	if(bpf_map_update_elem(handle->m_bpf_map_fds[SYSDIG_SETTINGS_MAP], &k, &settings, BPF_ANY) != 0)
@@ -1408,56 +1625,14 @@ static int32_t set_default_settings(scap_t *handle)
 	return SCAP_SUCCESS;
 }
 
-int32_t scap_bpf_load(scap_t *handle, const char *bpf_probe)
+//
+// One perf buffer per online CPU, fed through the perf map
+//
+static int32_t open_perf_buffers(scap_t *handle)
 {
-#ifdef MINIMAL_BUILD
-	snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "The eBPF probe driver is not supported when using a minimal build");
-	return SCAP_FAILURE;
-#else
 	int online_cpu;
 	int j;
 
-	if(set_runtime_params(handle) != SCAP_SUCCESS)
-	{
-		return SCAP_FAILURE;
-	}
-
-	handle->m_bpf_prog_array_map_idx = -1;
-
-	if(!bpf_probe)
-	{
-		ASSERT(false);
-		return SCAP_FAILURE;
-	}
-
-	if(load_bpf_file(handle, bpf_probe) != SCAP_SUCCESS)
-	{
-		return SCAP_FAILURE;
-	}
-
-	if(populate_syscall_routing_table_map(handle) != SCAP_SUCCESS)
-	{
-		return SCAP_FAILURE;
-	}
-
-	if(populate_syscall_table_map(handle) != SCAP_SUCCESS)
-	{
-		return SCAP_FAILURE;
-	}
-
-	if(populate_event_table_map(handle) != SCAP_SUCCESS)
-	{
-		return SCAP_FAILURE;
-	}
-
-	if(populate_fillers_table_map(handle) != SCAP_SUCCESS)
-	{
-		return SCAP_FAILURE;
-	}
-
-	//
-	// Open and initialize all the devices
-	//
 	online_cpu = 0;
 	for(j = 0; j < handle->m_ncpus; ++j)
 	{
@@ -1468,6 +1643,16 @@ int32_t scap_bpf_load(scap_t *handle, const char *bpf_probe)
 		};
 		int pmu_fd;
 
+		//
+		// Let the kernel wake up the reader once this many bytes are
+		// buffered, see scap_init_wakeup()
+		//
+		if(handle->m_wakeup_watermark != 0)
+		{
+			attr.watermark = 1;
+			attr.wakeup_watermark = handle->m_wakeup_watermark;
+		}
+
 		if(j > 0)
 		{
 			char filename[SCAP_MAX_PATH_SIZE];
@@ -1535,6 +1720,8 @@ int32_t scap_bpf_load(scap_t *handle, const char *bpf_probe)
 			return SCAP_FAILURE;
 		}
 
+		handle->m_devs[online_cpu].m_buffer_size = handle->m_ring_buf_size;
+
 		++online_cpu;
 	}
 
@@ -1544,6 +1731,142 @@ int32_t scap_bpf_load(scap_t *handle, const char *bpf_probe)
 		return SCAP_FAILURE;
 	}
 
+	return SCAP_SUCCESS;
+}
+
+//
+// Map the ring buffers created with the maps and assign every CPU to the
+// ring buffer of its group. Contiguous CPUs share a ring buffer, to keep the
+// groups within a NUMA node when possible.
+//
+static int32_t open_ring_buffers(scap_t *handle)
+{
+	int page_size = getpagesize();
+	uint32_t ngroups = handle->m_bpf_ringbuf_groups;
+	uint32_t j;
+
+	if(ngroups != handle->m_ndevs)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "ring buffers: %u, devices: %u", ngroups, handle->m_ndevs);
+		return SCAP_FAILURE;
+	}
+
+	for(j = 0; j < ngroups; j++)
+	{
+		scap_device *dev = &handle->m_devs[j];
+
+		dev->m_buffer = mmap(NULL, page_size, PROT_READ | PROT_WRITE, MAP_SHARED, dev->m_fd, 0);
+		if(dev->m_buffer == MAP_FAILED)
+		{
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "ring buffer consumer mmap: %s", scap_strerror(handle, errno));
+			return SCAP_FAILURE;
+		}
+
+		//
+		// The kernel maps the data pages twice after the producer page
+		//
+		dev->m_rb_producer = mmap(NULL, page_size + 2 * dev->m_rb_size, PROT_READ, MAP_SHARED, dev->m_fd, page_size);
+		if(dev->m_rb_producer == MAP_FAILED)
+		{
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "ring buffer producer mmap: %s", scap_strerror(handle, errno));
+			return SCAP_FAILURE;
+		}
+
+		dev->m_rb_data = dev->m_rb_producer + page_size;
+	}
+
+	for(j = 0; j < handle->m_ncpus; j++)
+	{
+		struct sysdig_bpf_per_cpu_state v;
+
+		if(bpf_map_lookup_elem(handle->m_bpf_map_fds[SYSDIG_LOCAL_STATE_MAP], &j, &v))
+		{
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "Error looking up local state %d\n", j);
+			return SCAP_FAILURE;
+		}
+
+		v.ringbuf_group = (uint64_t)j * ngroups / handle->m_ncpus;
+
+		if(bpf_map_update_elem(handle->m_bpf_map_fds[SYSDIG_LOCAL_STATE_MAP], &j, &v, BPF_ANY) != 0)
+		{
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "SYSDIG_LOCAL_STATE_MAP bpf_map_update_elem < 0: %s", scap_strerror(handle, errno));
+			return SCAP_FAILURE;
+		}
+	}
+
+	return SCAP_SUCCESS;
+}
+
+int32_t scap_bpf_load(scap_t *handle, const char *bpf_probe, uint32_t ringbuf_groups)
+{
+#ifdef MINIMAL_BUILD
+	snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "The eBPF probe driver is not supported when using a minimal build");
+	return SCAP_FAILURE;
+#else
+	if(set_runtime_params(handle) != SCAP_SUCCESS)
+	{
+		return SCAP_FAILURE;
+	}
+
+	handle->m_bpf_prog_array_map_idx = -1;
+	handle->m_bpf_ringbuf_map_idx = -1;
+	handle->m_bpf_rtt_map_idx = -1;
+	handle->m_bpf_rtt_map_entries = 0;
+	handle->m_bpf_rtt_user_deletes = 0;
+	handle->m_bpf_evt_type_stats_map_idx = -1;
+	handle->m_bpf_ringbuf_groups = ringbuf_groups;
+
+	if(handle->m_ring_buf_size == 0)
+	{
+		handle->m_ring_buf_size = getpagesize() * BUF_SIZE_PAGES;
+	}
+
+	if(!bpf_probe)
+	{
+		ASSERT(false);
+		return SCAP_FAILURE;
+	}
+
+	if(load_bpf_file(handle, bpf_probe) != SCAP_SUCCESS)
+	{
+		return SCAP_FAILURE;
+	}
+
+	if(populate_syscall_routing_table_map(handle) != SCAP_SUCCESS)
+	{
+		return SCAP_FAILURE;
+	}
+
+	if(populate_syscall_table_map(handle) != SCAP_SUCCESS)
+	{
+		return SCAP_FAILURE;
+	}
+
+	if(populate_event_table_map(handle) != SCAP_SUCCESS)
+	{
+		return SCAP_FAILURE;
+	}
+
+	if(populate_fillers_table_map(handle) != SCAP_SUCCESS)
+	{
+		return SCAP_FAILURE;
+	}
+
+	//
+	// Open and initialize all the devices
+	//
+	if(handle->m_bpf_ringbuf_groups != 0)
+	{
+		if(open_ring_buffers(handle) != SCAP_SUCCESS)
+		{
+			return SCAP_FAILURE;
+		}
+	}
+	else if(open_perf_buffers(handle) != SCAP_SUCCESS)
+	{
+		return SCAP_FAILURE;
+	}
+
 	if(set_default_settings(handle) != SCAP_SUCCESS)
 	{
 		return SCAP_FAILURE;
@@ -1567,15 +1890,121 @@ int32_t scap_bpf_get_stats(scap_t* handle, OUT scap_stats* stats)
 		}
 
 		stats->n_evts += v.n_evts;
-		stats->n_drops_buffer += handle->m_devs[j].m_evt_lost + v.n_drops_buffer;
+		stats->n_drops_buffer += v.n_drops_buffer;
 		stats->n_drops_pf += v.n_drops_pf;
 		stats->n_drops_bug += v.n_drops_bug;
-		stats->n_drops += handle->m_devs[j].m_evt_lost +
-				  v.n_drops_buffer +
+		stats->n_drops += v.n_drops_buffer +
 				  v.n_drops_pf +
 				  v.n_drops_bug;
 	}
 
+	//
+	// Samples lost by the perf buffers. The ring buffers don't lose
+	// samples, the probe counts the failed writes in n_drops_buffer.
+	//
+	for(j = 0; j < handle->m_ndevs; j++)
+	{
+		stats->n_drops_buffer += handle->m_devs[j].m_evt_lost;
+		stats->n_drops += handle->m_devs[j].m_evt_lost;
+	}
+
+	return SCAP_SUCCESS;
+}
+
+//
+// evt_type_stats_map has one slot per CPU and event type. It's read in
+// batches where supported (kernel >= 5.6), otherwise one slot at a time.
+//
+int32_t scap_bpf_get_evt_type_stats(scap_t* handle, OUT scap_evt_type_stats* stats)
+{
+	uint32_t nslots = handle->m_ncpus * PPM_EVENT_MAX;
+	struct ppm_evt_type_stats *values;
+	uint32_t *keys;
+	uint32_t in_batch;
+	uint32_t out_batch;
+	uint32_t nread = 0;
+	bool batch = true;
+	int fd;
+	uint32_t j;
+
+	if(handle->m_bpf_evt_type_stats_map_idx == -1)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "the BPF probe doesn't have the evt_type_stats_map map");
+		return SCAP_FAILURE;
+	}
+
+	fd = handle->m_bpf_map_fds[handle->m_bpf_evt_type_stats_map_idx];
+
+	keys = (uint32_t *) malloc(nslots * sizeof(uint32_t));
+	values = (struct ppm_evt_type_stats *) malloc(nslots * sizeof(struct ppm_evt_type_stats));
+	if(keys == NULL || values == NULL)
+	{
+		free(keys);
+		free(values);
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error allocating the evt_type_stats_map batch");
+		return SCAP_FAILURE;
+	}
+
+	while(nread < nslots)
+	{
+		uint32_t count = nslots - nread;
+		int ret;
+
+		ret = bpf_map_lookup_batch(fd, nread == 0 ? NULL : &in_batch, &out_batch,
+					   keys + nread, values + nread, &count);
+		nread += count;
+
+		if(ret != 0)
+		{
+			if(errno == ENOENT)
+			{
+				break;
+			}
+
+			if(errno == EINVAL && nread == 0)
+			{
+				batch = false;
+				break;
+			}
+
+			free(keys);
+			free(values);
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "evt_type_stats_map batch read: %s", scap_strerror(handle, errno));
+			return SCAP_FAILURE;
+		}
+
+		in_batch = out_batch;
+	}
+
+	if(!batch)
+	{
+		for(j = 0; j < nslots; j++)
+		{
+			keys[j] = j;
+			if(bpf_map_lookup_elem(fd, &keys[j], &values[j]))
+			{
+				free(keys);
+				free(values);
+				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "Error looking up event type stats %u\n", j);
+				return SCAP_FAILURE;
+			}
+		}
+
+		nread = nslots;
+	}
+
+	for(j = 0; j < nread; j++)
+	{
+		uint32_t evt_type = keys[j] % PPM_EVENT_MAX;
+
+		stats[evt_type].n_evts += values[j].n_evts;
+		stats[evt_type].n_drops += values[j].n_drops;
+		stats[evt_type].n_bytes += values[j].n_bytes;
+		stats[evt_type].n_ns += values[j].n_ns;
+	}
+
+	free(keys);
+	free(values);
 	return SCAP_SUCCESS;
 }
 
@@ -1642,6 +2071,227 @@ int32_t scap_bpf_disable_skb_capture(scap_t *handle)
 	return SCAP_SUCCESS;
 }
 
+int32_t scap_bpf_set_rtt_aggregation(scap_t *handle, bool aggregate, uint64_t interval_ns)
+{
+	struct sysdig_bpf_settings settings;
+	int k = 0;
+
+	if(bpf_map_lookup_elem(handle->m_bpf_map_fds[SYSDIG_SETTINGS_MAP], &k, &settings) != 0)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "SYSDIG_SETTINGS_MAP bpf_map_lookup_elem < 0");
+		return SCAP_FAILURE;
+	}
+
+	settings.rtt_aggregate = aggregate;
+	settings.rtt_interval_ns = interval_ns;
+	if(bpf_map_update_elem(handle->m_bpf_map_fds[SYSDIG_SETTINGS_MAP], &k, &settings, BPF_ANY) != 0)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "SYSDIG_SETTINGS_MAP bpf_map_update_elem < 0");
+		return SCAP_FAILURE;
+	}
+
+	return SCAP_SUCCESS;
+}
+
+#if RTT_HIST_BUCKETS != SCAP_RTT_HIST_BUCKETS
+#error "the RTT histogram of the probe and of scap_rtt_stats must match"
+#endif
+
+static void rtt_stats_from_map(scap_rtt_stats *stats, const struct tuple *tp, const struct statistics *st)
+{
+	memcpy(stats->saddr, tp->saddr, sizeof(stats->saddr));
+	memcpy(stats->daddr, tp->daddr, sizeof(stats->daddr));
+	stats->sport = ntohs(tp->sport);
+	stats->dport = ntohs(tp->dport);
+	stats->family = tp->family;
+	stats->min_srtt_us = st->min_srtt;
+	stats->max_srtt_us = st->max_srtt;
+	stats->sum_srtt_us = st->sum_srtt;
+	stats->count = st->count;
+	memcpy(stats->hist, st->hist, sizeof(stats->hist));
+}
+
+//
+// The entries are deleted as they are read, so every call starts from the
+// beginning of the map and the probe starts a new aggregate for every
+// connection. Kernels older than 5.6 don't have the batch operations, the
+// map is then drained one key at a time.
+//
+int32_t scap_bpf_read_rtt_stats(scap_t *handle, scap_rtt_stats *stats, uint32_t max_stats, uint32_t *nstats)
+{
+	struct tuple *keys;
+	struct statistics *values;
+	struct tuple in_batch;
+	struct tuple out_batch;
+	bool first = true;
+	bool batch = true;
+	int fd;
+	uint32_t j;
+
+	*nstats = 0;
+
+	if(handle->m_bpf_rtt_map_idx == -1)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "the BPF probe doesn't have the rtt_static_map map");
+		return SCAP_FAILURE;
+	}
+
+	fd = handle->m_bpf_map_fds[handle->m_bpf_rtt_map_idx];
+
+	keys = (struct tuple *) malloc(max_stats * sizeof(struct tuple));
+	values = (struct statistics *) malloc(max_stats * sizeof(struct statistics));
+	if(keys == NULL || values == NULL)
+	{
+		free(keys);
+		free(values);
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error allocating the rtt_static_map batch");
+		return SCAP_FAILURE;
+	}
+
+	while(*nstats < max_stats)
+	{
+		uint32_t count = max_stats - *nstats;
+		int ret;
+
+		ret = bpf_map_lookup_and_delete_batch(fd, first ? NULL : &in_batch, &out_batch,
+						      keys + *nstats, values + *nstats, &count);
+		*nstats += count;
+
+		if(ret != 0)
+		{
+			//
+			// ENOENT is the end of the map, ENOSPC a hash bucket bigger
+			// than the space left, that will be read by the next call.
+			// A bucket bigger than the whole buffer would never be read.
+			//
+			if(errno == EINVAL && first)
+			{
+				batch = false;
+				break;
+			}
+
+			if(errno == ENOSPC && *nstats == 0)
+			{
+				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "a rtt_static_map bucket holds more than %u connections", max_stats);
+				free(keys);
+				free(values);
+				return SCAP_INPUT_TOO_SMALL;
+			}
+
+			if(errno == ENOENT || errno == ENOSPC)
+			{
+				handle->m_bpf_rtt_user_deletes += *nstats;
+
+				for(j = 0; j < *nstats; j++)
+				{
+					rtt_stats_from_map(&stats[j], &keys[j], &values[j]);
+				}
+
+				free(keys);
+				free(values);
+				return SCAP_SUCCESS;
+			}
+
+			*nstats = 0;
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "rtt_static_map batch read: %s", scap_strerror(handle, errno));
+			free(keys);
+			free(values);
+			return SCAP_FAILURE;
+		}
+
+		in_batch = out_batch;
+		first = false;
+	}
+
+	if(!batch)
+	{
+		while(*nstats < max_stats && bpf_map_get_next_key(fd, NULL, &keys[*nstats]) == 0)
+		{
+			bool found = bpf_map_lookup_elem(fd, &keys[*nstats], &values[*nstats]) == 0;
+
+			if(bpf_map_delete_elem(fd, &keys[*nstats]) == 0)
+			{
+				handle->m_bpf_rtt_user_deletes++;
+			}
+
+			if(found)
+			{
+				(*nstats)++;
+			}
+		}
+	}
+	else
+	{
+		handle->m_bpf_rtt_user_deletes += *nstats;
+	}
+
+	for(j = 0; j < *nstats; j++)
+	{
+		rtt_stats_from_map(&stats[j], &keys[j], &values[j]);
+	}
+
+	free(keys);
+	free(values);
+	return SCAP_SUCCESS;
+}
+
+//
+// An LRU hash evicts silently, so the evictions are whatever went into the
+// map and didn't leave it through a delete. The counters are read while the
+// probe runs, hence the clamp.
+//
+int32_t scap_bpf_get_rtt_map_stats(scap_t *handle, scap_rtt_map_stats *stats)
+{
+	struct tuple key;
+	struct tuple next_key;
+	uint64_t removed;
+	int fd;
+	int j;
+
+	memset(stats, 0, sizeof(*stats));
+
+	if(handle->m_bpf_rtt_map_idx == -1)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "the BPF probe doesn't have the rtt_static_map map");
+		return SCAP_FAILURE;
+	}
+
+	fd = handle->m_bpf_map_fds[handle->m_bpf_rtt_map_idx];
+
+	for(j = 0; j < handle->m_ncpus; j++)
+	{
+		struct sysdig_bpf_per_cpu_state v;
+		if(bpf_map_lookup_elem(handle->m_bpf_map_fds[SYSDIG_LOCAL_STATE_MAP], &j, &v))
+		{
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "Error looking up local state %d\n", j);
+			return SCAP_FAILURE;
+		}
+
+		stats->n_inserts += v.n_rtt_inserts;
+		stats->n_insert_fails += v.n_rtt_insert_fails;
+		stats->n_deletes += v.n_rtt_deletes;
+	}
+
+	stats->n_deletes += handle->m_bpf_rtt_user_deletes;
+	stats->max_entries = handle->m_bpf_rtt_map_entries;
+
+	if(bpf_map_get_next_key(fd, NULL, &key) == 0)
+	{
+		stats->n_entries++;
+
+		while(bpf_map_get_next_key(fd, &key, &next_key) == 0)
+		{
+			stats->n_entries++;
+			key = next_key;
+		}
+	}
+
+	removed = stats->n_deletes + stats->n_entries;
+	stats->n_evictions = stats->n_inserts > removed ? stats->n_inserts - removed : 0;
+
+	return SCAP_SUCCESS;
+}
+
 int32_t scap_bpf_handle_eventmask(scap_t* handle, uint32_t op, uint32_t event_id)
 {
 	if (event_id >= PPM_EVENT_MAX || event_id < 0)
@@ -19,6 +19,14 @@ limitations under the License.
 
 #include "compat/perf_event.h"
 
+//
+// Layout of the records of a BPF ring buffer, as in the uapi bpf.h of
+// kernels >= 5.8
+//
+#define SCAP_BPF_RINGBUF_BUSY_BIT (1U << 31)
+#define SCAP_BPF_RINGBUF_DISCARD_BIT (1U << 30)
+#define SCAP_BPF_RINGBUF_HDR_SZ 8
+
 struct perf_event_sample {
 	struct perf_event_header header;
 	uint32_t size;
@@ -31,7 +39,7 @@ struct perf_lost_sample {
 	uint64_t lost;
 };
 
-int32_t scap_bpf_load(scap_t *handle, const char *bpf_probe);
+int32_t scap_bpf_load(scap_t *handle, const char *bpf_probe, uint32_t ringbuf_groups);
 int32_t scap_bpf_start_capture(scap_t *handle);
 int32_t scap_bpf_stop_capture(scap_t *handle);
 int32_t scap_bpf_close(scap_t *handle);
@@ -48,6 +56,10 @@ int32_t scap_bpf_get_stats(scap_t* handle, OUT scap_stats* stats);
 int32_t scap_bpf_get_n_tracepoint_hit(scap_t* handle, long* ret);
 int32_t scap_bpf_enable_skb_capture(scap_t *handle, const char *ifname);
 int32_t scap_bpf_disable_skb_capture(scap_t *handle);
+int32_t scap_bpf_set_rtt_aggregation(scap_t *handle, bool aggregate, uint64_t interval_ns);
+int32_t scap_bpf_read_rtt_stats(scap_t *handle, scap_rtt_stats *stats, uint32_t max_stats, uint32_t *nstats);
+int32_t scap_bpf_get_rtt_map_stats(scap_t *handle, scap_rtt_map_stats *stats);
+int32_t scap_bpf_get_evt_type_stats(scap_t *handle, scap_evt_type_stats *stats);
 int32_t scap_bpf_handle_eventmask(scap_t* handle, uint32_t op, uint32_t event_id);
 
 static inline scap_evt *scap_bpf_evt_from_perf_sample(void *evt)
@@ -85,6 +97,105 @@ static inline void scap_bpf_get_buf_pointers(char *buf, uint64_t *phead, uint64_
 	}
 }
 
+//
+// BPF ring buffer backend. Every record is an 8 byte header, whose first word
+// is the length of the data with the busy and discard bits, followed by the
+// data, padded to 8 bytes. The data pages are mapped twice, so a record
+// crossing the end of the buffer can be read contiguously.
+//
+static inline uint32_t scap_bpf_ringbuf_rec_len(uint32_t hdr_len)
+{
+	hdr_len &= ~(SCAP_BPF_RINGBUF_BUSY_BIT | SCAP_BPF_RINGBUF_DISCARD_BIT);
+	return (hdr_len + SCAP_BPF_RINGBUF_HDR_SZ + 7) & ~7U;
+}
+
+static inline scap_evt *scap_bpf_evt_from_sample(scap_t *handle, void *evt)
+{
+	if(handle->m_bpf_ringbuf_groups != 0)
+	{
+		return (scap_evt *) ((char *) evt + SCAP_BPF_RINGBUF_HDR_SZ);
+	}
+
+	return scap_bpf_evt_from_perf_sample(evt);
+}
+
+static inline void scap_bpf_get_ringbuf_pointers(struct scap_device *dev, uint64_t *phead, uint64_t *ptail, uint64_t *pread_size)
+{
+	*ptail = *(uint64_t *) dev->m_buffer;
+	*phead = __atomic_load_n((uint64_t *) dev->m_rb_producer, __ATOMIC_ACQUIRE);
+	*pread_size = *phead - *ptail;
+}
+
+static inline uint64_t scap_bpf_buf_size_used(scap_t *handle, uint32_t cpuid)
+{
+	uint64_t head;
+	uint64_t tail;
+	uint64_t read_size;
+
+	if(handle->m_bpf_ringbuf_groups != 0)
+	{
+		scap_bpf_get_ringbuf_pointers(&handle->m_devs[cpuid], &head, &tail, &read_size);
+	}
+	else
+	{
+		scap_bpf_get_buf_pointers(handle->m_devs[cpuid].m_buffer, &head, &tail, &read_size);
+	}
+
+	return read_size;
+}
+
+static inline int32_t scap_bpf_ringbuf_advance_to_evt(scap_t *handle, uint16_t cpuid, bool skip_current,
+						      char *cur_evt, char **next_evt, uint32_t *len)
+{
+	struct scap_device *dev = &handle->m_devs[cpuid];
+	char *begin = cur_evt;
+
+	while(*len)
+	{
+		uint32_t hdr_len = __atomic_load_n((uint32_t *) begin, __ATOMIC_ACQUIRE);
+		uint32_t rec_len;
+
+		//
+		// Reserved but not committed yet: leave it, and everything after
+		// it, for the next read
+		//
+		if(hdr_len & SCAP_BPF_RINGBUF_BUSY_BIT)
+		{
+			dev->m_lastreadsize -= *len;
+			*len = 0;
+			break;
+		}
+
+		rec_len = scap_bpf_ringbuf_rec_len(hdr_len);
+		ASSERT(*len >= rec_len);
+
+		if(!(hdr_len & SCAP_BPF_RINGBUF_DISCARD_BIT))
+		{
+			ASSERT(((scap_evt *) (begin + SCAP_BPF_RINGBUF_HDR_SZ))->len <= rec_len - SCAP_BPF_RINGBUF_HDR_SZ);
+
+			if(skip_current)
+			{
+				skip_current = false;
+			}
+			else
+			{
+				*next_evt = begin;
+				break;
+			}
+		}
+
+		begin += rec_len;
+		if(begin >= dev->m_rb_data + dev->m_rb_size)
+		{
+			begin -= dev->m_rb_size;
+		}
+
+		*len -= rec_len;
+	}
+
+	return SCAP_SUCCESS;
+}
+
 static inline int32_t scap_bpf_advance_to_evt(scap_t *handle, uint16_t cpuid, bool skip_current,
 					      char *cur_evt, char **next_evt, uint32_t *len)
 {
@@ -92,6 +203,11 @@ static inline int32_t scap_bpf_advance_to_evt(scap_t *handle, uint16_t cpuid, bo
 	void *base;
 	void *begin;
 
+	if(handle->m_bpf_ringbuf_groups != 0)
+	{
+		return scap_bpf_ringbuf_advance_to_evt(handle, cpuid, skip_current, cur_evt, next_evt, len);
+	}
+
 	dev = &handle->m_devs[cpuid];
 
 	struct perf_event_mmap_page *header = (struct perf_event_mmap_page *) dev->m_buffer;
@@ -163,6 +279,19 @@ static inline void scap_bpf_advance_tail(scap_t *handle, uint32_t cpuid)
 	struct scap_device *dev;
 
 	dev = &handle->m_devs[cpuid];
+
+	if(handle->m_bpf_ringbuf_groups != 0)
+	{
+		//
+		// Give the space back to the producer once we're done reading it
+		//
+		__atomic_store_n((uint64_t *) dev->m_buffer,
+				 *(uint64_t *) dev->m_buffer + dev->m_lastreadsize,
+				 __ATOMIC_RELEASE);
+		dev->m_lastreadsize = 0;
+		return;
+	}
+
 	header = (struct perf_event_mmap_page *)dev->m_buffer;
 
 	// clang-format off
@@ -184,9 +313,22 @@ static inline int32_t scap_bpf_readbuf(scap_t *handle, uint32_t cpuid, char **bu
 	char *p;
 
 	dev = &handle->m_devs[cpuid];
-	header = (struct perf_event_mmap_page *) dev->m_buffer;
 
 	ASSERT(dev->m_lastreadsize == 0);
+
+	if(handle->m_bpf_ringbuf_groups != 0)
+	{
+		scap_bpf_get_ringbuf_pointers(dev, &head, &tail, &read_size);
+
+		dev->m_lastreadsize = read_size;
+		p = dev->m_rb_data + (tail & (dev->m_rb_size - 1));
+		*len = read_size;
+
+		return scap_bpf_ringbuf_advance_to_evt(handle, cpuid, false, p, buf, len);
+	}
+
+	header = (struct perf_event_mmap_page *) dev->m_buffer;
+
 	scap_bpf_get_buf_pointers((char *) header, &head, &tail, &read_size);
 
 	dev->m_lastreadsize = read_size;
@@ -0,0 +1,960 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "scap.h"
+#include "scap-int.h"
+#include "scap_compression.h"
+
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef USE_LZ4
+#include <lz4frame.h>
+#endif
+
+//
+// Size of the buffers of the zstd and lz4 codecs
+//
+#define SCAP_CFILE_BUF_SIZE (64 * 1024)
+
+struct scap_cfile
+{
+	compression_mode m_compress;
+	bool m_write;
+	// SCAP_COMPRESSION_NONE and SCAP_COMPRESSION_GZIP
+	gzFile m_gz;
+	// SCAP_COMPRESSION_ZSTD and SCAP_COMPRESSION_LZ4
+	FILE* m_f;
+	// Offset of the beginning of the stream in m_f
+	int64_t m_start;
+	// Size of the file opened for reading, from the beginning of the
+	// stream, or -1 if unknown
+	int64_t m_size;
+#ifdef USE_ZSTD
+	ZSTD_CStream* m_zcs;
+	ZSTD_DStream* m_zds;
+#endif
+#ifdef USE_LZ4
+	LZ4F_cctx* m_lcctx;
+	LZ4F_dctx* m_ldctx;
+#endif
+	// Compressed data read from m_f and not consumed yet
+	uint8_t* m_in;
+	size_t m_in_size;
+	size_t m_in_pos;
+	size_t m_in_len;
+	// Decompressed data not returned yet when reading, compressed data
+	// to write when writing
+	uint8_t* m_out;
+	size_t m_out_size;
+	size_t m_out_pos;
+	size_t m_out_len;
+	// The decompressor filled m_out, and may have more data without any
+	// further input
+	bool m_pending;
+	bool m_eof;
+	// Position in the uncompressed stream
+	int64_t m_pos;
+	int m_errnum;
+	const char* m_errstr;
+};
+
+static const uint8_t zstd_magic[] = {0x28, 0xb5, 0x2f, 0xfd};
+static const uint8_t lz4_magic[] = {0x04, 0x22, 0x4d, 0x18};
+
+bool scap_cfile_supported(compression_mode compress)
+{
+	switch(compress)
+	{
+	case SCAP_COMPRESSION_NONE:
+	case SCAP_COMPRESSION_GZIP:
+		return true;
+#ifdef USE_ZSTD
+	case SCAP_COMPRESSION_ZSTD:
+		return true;
+#endif
+#ifdef USE_LZ4
+	case SCAP_COMPRESSION_LZ4:
+		return true;
+#endif
+	default:
+		return false;
+	}
+}
+
+static compression_mode scap_cfile_detect(const uint8_t* magic, size_t len)
+{
+	if(len == sizeof(zstd_magic) && memcmp(magic, zstd_magic, sizeof(zstd_magic)) == 0)
+	{
+		return SCAP_COMPRESSION_ZSTD;
+	}
+
+	if(len == sizeof(lz4_magic) && memcmp(magic, lz4_magic, sizeof(lz4_magic)) == 0)
+	{
+		return SCAP_COMPRESSION_LZ4;
+	}
+
+	//
+	// zlib reads both gzip and uncompressed files
+	//
+	return SCAP_COMPRESSION_GZIP;
+}
+
+static void scap_cfile_free(scap_cfile* f)
+{
+#ifdef USE_ZSTD
+	ZSTD_freeCStream(f->m_zcs);
+	ZSTD_freeDStream(f->m_zds);
+#endif
+#ifdef USE_LZ4
+	if(f->m_lcctx != NULL)
+	{
+		LZ4F_freeCompressionContext(f->m_lcctx);
+	}
+
+	if(f->m_ldctx != NULL)
+	{
+		LZ4F_freeDecompressionContext(f->m_ldctx);
+	}
+#endif
+	free(f->m_in);
+	free(f->m_out);
+	free(f);
+}
+
+static int scap_cfile_set_error(scap_cfile* f, const char* errstr)
+{
+	f->m_errnum = -1;
+	f->m_errstr = errstr;
+	return -1;
+}
+
+#if defined(USE_ZSTD) || defined(USE_LZ4)
+//
+// Write the compressed data in m_out to the file
+//
+static int scap_cfile_write_out(scap_cfile* f, size_t len)
+{
+	if(len != 0 && fwrite(f->m_out, 1, len, f->m_f) != len)
+	{
+		f->m_errnum = errno;
+		f->m_errstr = strerror(errno);
+		return -1;
+	}
+
+	return 0;
+}
+#endif
+
+//
+// Create the codec of a zstd or lz4 stream on an open FILE
+//
+static scap_cfile* scap_cfile_create(FILE* fp, bool write, compression_mode compress)
+{
+	scap_cfile* f = (scap_cfile*)calloc(1, sizeof(scap_cfile));
+
+	if(f == NULL)
+	{
+		return NULL;
+	}
+
+	f->m_compress = compress;
+	f->m_write = write;
+	f->m_f = fp;
+#ifndef _WIN32
+	f->m_start = ftello(fp);
+#else
+	f->m_start = _ftelli64(fp);
+#endif
+	f->m_size = -1;
+
+	switch(compress)
+	{
+#ifdef USE_ZSTD
+	case SCAP_COMPRESSION_ZSTD:
+		if(write)
+		{
+			f->m_zcs = ZSTD_createCStream();
+			f->m_out_size = ZSTD_CStreamOutSize();
+			if(f->m_zcs == NULL)
+			{
+				goto error;
+			}
+		}
+		else
+		{
+			f->m_zds = ZSTD_createDStream();
+			f->m_in_size = ZSTD_DStreamInSize();
+			f->m_out_size = ZSTD_DStreamOutSize();
+			if(f->m_zds == NULL || ZSTD_isError(ZSTD_initDStream(f->m_zds)))
+			{
+				goto error;
+			}
+		}
+		break;
+#endif
+#ifdef USE_LZ4
+	case SCAP_COMPRESSION_LZ4:
+		if(write)
+		{
+			LZ4F_preferences_t prefs;
+
+			memset(&prefs, 0, sizeof(prefs));
+
+			if(LZ4F_isError(LZ4F_createCompressionContext(&f->m_lcctx, LZ4F_VERSION)))
+			{
+				goto error;
+			}
+
+			f->m_out_size = LZ4F_compressBound(SCAP_CFILE_BUF_SIZE, &prefs);
+		}
+		else
+		{
+			if(LZ4F_isError(LZ4F_createDecompressionContext(&f->m_ldctx, LZ4F_VERSION)))
+			{
+				goto error;
+			}
+
+			f->m_in_size = SCAP_CFILE_BUF_SIZE;
+			f->m_out_size = SCAP_CFILE_BUF_SIZE;
+		}
+		break;
+#endif
+	default:
+		goto error;
+	}
+
+	if(f->m_in_size != 0)
+	{
+		f->m_in = (uint8_t*)malloc(f->m_in_size);
+		if(f->m_in == NULL)
+		{
+			goto error;
+		}
+	}
+
+	f->m_out = (uint8_t*)malloc(f->m_out_size);
+	if(f->m_out == NULL)
+	{
+		goto error;
+	}
+
+#ifdef USE_LZ4
+	//
+	// The lz4 frame header is written right away
+	//
+	if(write && compress == SCAP_COMPRESSION_LZ4)
+	{
+		LZ4F_preferences_t prefs;
+		size_t res;
+
+		memset(&prefs, 0, sizeof(prefs));
+
+		res = LZ4F_compressBegin(f->m_lcctx, f->m_out, f->m_out_size, &prefs);
+		if(LZ4F_isError(res) || scap_cfile_write_out(f, res) != 0)
+		{
+			goto error;
+		}
+	}
+#endif
+
+	return f;
+
+error:
+	scap_cfile_free(f);
+	return NULL;
+}
+
+static scap_cfile* scap_cfile_create_gz(gzFile gz, bool write, compression_mode compress)
+{
+	scap_cfile* f;
+
+	if(gz == NULL)
+	{
+		return NULL;
+	}
+
+	f = (scap_cfile*)calloc(1, sizeof(scap_cfile));
+	if(f == NULL)
+	{
+		gzclose(gz);
+		return NULL;
+	}
+
+	f->m_compress = compress;
+	f->m_write = write;
+	f->m_gz = gz;
+	f->m_size = -1;
+
+	return f;
+}
+
+scap_cfile* scap_cfile_open(const char* fname, bool write, compression_mode compress)
+{
+	FILE* fp;
+	scap_cfile* f;
+
+	if(write)
+	{
+		switch(compress)
+		{
+		case SCAP_COMPRESSION_GZIP:
+			return scap_cfile_create_gz(gzopen(fname, "wb"), true, compress);
+		case SCAP_COMPRESSION_NONE:
+			return scap_cfile_create_gz(gzopen(fname, "wbT"), true, compress);
+		default:
+			if(!scap_cfile_supported(compress))
+			{
+				return NULL;
+			}
+
+			fp = fopen(fname, "wb");
+			break;
+		}
+	}
+	else
+	{
+		uint8_t magic[sizeof(zstd_magic)];
+		size_t len;
+
+		fp = fopen(fname, "rb");
+		if(fp == NULL)
+		{
+			return NULL;
+		}
+
+		len = fread(magic, 1, sizeof(magic), fp);
+		compress = scap_cfile_detect(magic, len);
+
+		if(compress == SCAP_COMPRESSION_GZIP)
+		{
+			struct stat st;
+
+			fclose(fp);
+			f = scap_cfile_create_gz(gzopen(fname, "rb"), false, compress);
+			if(f != NULL && stat(fname, &st) == 0 && S_ISREG(st.st_mode))
+			{
+				f->m_size = st.st_size;
+			}
+
+			return f;
+		}
+
+		rewind(fp);
+	}
+
+	if(fp == NULL)
+	{
+		return NULL;
+	}
+
+	f = scap_cfile_create(fp, write, compress);
+	if(f == NULL)
+	{
+		fclose(fp);
+	}
+
+	return f;
+}
+
+scap_cfile* scap_cfile_dopen(int fd, bool write, compression_mode compress)
+{
+	FILE* fp = NULL;
+	scap_cfile* f;
+
+	if(write)
+	{
+		switch(compress)
+		{
+		case SCAP_COMPRESSION_GZIP:
+			return scap_cfile_create_gz(gzdopen(fd, "wb"), true, compress);
+		case SCAP_COMPRESSION_NONE:
+			return scap_cfile_create_gz(gzdopen(fd, "wbT"), true, compress);
+		default:
+			if(!scap_cfile_supported(compress))
+			{
+				return NULL;
+			}
+
+#ifndef _WIN32
+			fp = fdopen(fd, "wb");
+#endif
+			break;
+		}
+	}
+	else
+	{
+		int64_t size = -1;
+
+		compress = SCAP_COMPRESSION_GZIP;
+
+#ifndef _WIN32
+		//
+		// Peek the magic number if the fd can be rewound
+		//
+		off_t start = lseek(fd, 0, SEEK_CUR);
+
+		if(start != -1)
+		{
+			uint8_t magic[sizeof(zstd_magic)];
+			ssize_t len = read(fd, magic, sizeof(magic));
+
+			if(lseek(fd, start, SEEK_SET) == -1)
+			{
+				return NULL;
+			}
+
+			if(len > 0)
+			{
+				compress = scap_cfile_detect(magic, (size_t)len);
+			}
+
+			struct stat st;
+			if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+			{
+				size = st.st_size - start;
+			}
+		}
+#endif
+
+		if(compress == SCAP_COMPRESSION_GZIP)
+		{
+			f = scap_cfile_create_gz(gzdopen(fd, "rb"), false, compress);
+			if(f != NULL)
+			{
+				f->m_size = size;
+			}
+
+			return f;
+		}
+
+#ifndef _WIN32
+		fp = fdopen(fd, "rb");
+#endif
+	}
+
+	if(fp == NULL)
+	{
+		return NULL;
+	}
+
+	f = scap_cfile_create(fp, write, compress);
+	if(f == NULL)
+	{
+		fclose(fp);
+	}
+
+	return f;
+}
+
+//
+// Decompress more data into m_out. Return the number of bytes available,
+// 0 at the end of the file and -1 on error.
+//
+static int scap_cfile_fill(scap_cfile* f)
+{
+	while(true)
+	{
+		size_t produced = 0;
+
+		if(f->m_in_pos == f->m_in_len && !f->m_pending)
+		{
+			if(f->m_eof)
+			{
+				return 0;
+			}
+
+			f->m_in_pos = 0;
+			f->m_in_len = fread(f->m_in, 1, f->m_in_size, f->m_f);
+
+			if(f->m_in_len == 0)
+			{
+				if(ferror(f->m_f))
+				{
+					f->m_errnum = errno;
+					f->m_errstr = strerror(errno);
+					return -1;
+				}
+
+				f->m_eof = true;
+				return 0;
+			}
+		}
+
+		switch(f->m_compress)
+		{
+#ifdef USE_ZSTD
+		case SCAP_COMPRESSION_ZSTD:
+		{
+			ZSTD_inBuffer in = {f->m_in, f->m_in_len, f->m_in_pos};
+			ZSTD_outBuffer out = {f->m_out, f->m_out_size, 0};
+			size_t res = ZSTD_decompressStream(f->m_zds, &out, &in);
+
+			if(ZSTD_isError(res))
+			{
+				return scap_cfile_set_error(f, ZSTD_getErrorName(res));
+			}
+
+			f->m_in_pos = in.pos;
+			produced = out.pos;
+			break;
+		}
+#endif
+#ifdef USE_LZ4
+		case SCAP_COMPRESSION_LZ4:
+		{
+			size_t dst_size = f->m_out_size;
+			size_t src_size = f->m_in_len - f->m_in_pos;
+			size_t res = LZ4F_decompress(f->m_ldctx, f->m_out, &dst_size, f->m_in + f->m_in_pos, &src_size, NULL);
+
+			if(LZ4F_isError(res))
+			{
+				return scap_cfile_set_error(f, LZ4F_getErrorName(res));
+			}
+
+			f->m_in_pos += src_size;
+			produced = dst_size;
+			break;
+		}
+#endif
+		default:
+			ASSERT(false);
+			return scap_cfile_set_error(f, "unsupported compression");
+		}
+
+		f->m_pending = (produced == f->m_out_size);
+		f->m_out_pos = 0;
+		f->m_out_len = produced;
+
+		if(produced != 0)
+		{
+			return (int)produced;
+		}
+	}
+}
+
+int scap_cfile_read(scap_cfile* f, void* buf, unsigned len)
+{
+	unsigned done = 0;
+
+	if(f->m_gz != NULL)
+	{
+		return gzread(f->m_gz, buf, len);
+	}
+
+	while(done < len)
+	{
+		size_t n;
+
+		if(f->m_out_pos == f->m_out_len)
+		{
+			int res = scap_cfile_fill(f);
+
+			if(res < 0)
+			{
+				return -1;
+			}
+			else if(res == 0)
+			{
+				break;
+			}
+		}
+
+		n = f->m_out_len - f->m_out_pos;
+		if(n > len - done)
+		{
+			n = len - done;
+		}
+
+		memcpy((uint8_t*)buf + done, f->m_out + f->m_out_pos, n);
+		f->m_out_pos += n;
+		done += (unsigned)n;
+	}
+
+	f->m_pos += done;
+	return (int)done;
+}
+
+int scap_cfile_write(scap_cfile* f, const void* buf, unsigned len)
+{
+	if(f->m_gz != NULL)
+	{
+		return gzwrite(f->m_gz, buf, len);
+	}
+
+	switch(f->m_compress)
+	{
+#ifdef USE_ZSTD
+	case SCAP_COMPRESSION_ZSTD:
+	{
+		ZSTD_inBuffer in = {buf, len, 0};
+
+		while(in.pos < in.size)
+		{
+			ZSTD_outBuffer out = {f->m_out, f->m_out_size, 0};
+			size_t res = ZSTD_compressStream2(f->m_zcs, &out, &in, ZSTD_e_continue);
+
+			if(ZSTD_isError(res))
+			{
+				return scap_cfile_set_error(f, ZSTD_getErrorName(res));
+			}
+
+			if(scap_cfile_write_out(f, out.pos) != 0)
+			{
+				return -1;
+			}
+		}
+		break;
+	}
+#endif
+#ifdef USE_LZ4
+	case SCAP_COMPRESSION_LZ4:
+	{
+		unsigned done = 0;
+
+		while(done < len)
+		{
+			unsigned n = len - done;
+			size_t res;
+
+			if(n > SCAP_CFILE_BUF_SIZE)
+			{
+				n = SCAP_CFILE_BUF_SIZE;
+			}
+
+			res = LZ4F_compressUpdate(f->m_lcctx, f->m_out, f->m_out_size, (const uint8_t*)buf + done, n, NULL);
+			if(LZ4F_isError(res))
+			{
+				return scap_cfile_set_error(f, LZ4F_getErrorName(res));
+			}
+
+			if(scap_cfile_write_out(f, res) != 0)
+			{
+				return -1;
+			}
+
+			done += n;
+		}
+		break;
+	}
+#endif
+	default:
+		ASSERT(false);
+		return scap_cfile_set_error(f, "unsupported compression");
+	}
+
+	f->m_pos += len;
+	return (int)len;
+}
+
+//
+// Compress and write everything buffered by the codec, ending the frame if
+// end is true
+//
+static int scap_cfile_drain(scap_cfile* f, bool end)
+{
+	switch(f->m_compress)
+	{
+#ifdef USE_ZSTD
+	case SCAP_COMPRESSION_ZSTD:
+	{
+		ZSTD_inBuffer in = {NULL, 0, 0};
+		size_t res;
+
+		do
+		{
+			ZSTD_outBuffer out = {f->m_out, f->m_out_size, 0};
+
+			res = ZSTD_compressStream2(f->m_zcs, &out, &in, end ? ZSTD_e_end : ZSTD_e_flush);
+			if(ZSTD_isError(res))
+			{
+				return scap_cfile_set_error(f, ZSTD_getErrorName(res));
+			}
+
+			if(scap_cfile_write_out(f, out.pos) != 0)
+			{
+				return -1;
+			}
+		} while(res != 0);
+		break;
+	}
+#endif
+#ifdef USE_LZ4
+	case SCAP_COMPRESSION_LZ4:
+	{
+		size_t res;
+
+		if(end)
+		{
+			res = LZ4F_compressEnd(f->m_lcctx, f->m_out, f->m_out_size, NULL);
+		}
+		else
+		{
+			res = LZ4F_flush(f->m_lcctx, f->m_out, f->m_out_size, NULL);
+		}
+
+		if(LZ4F_isError(res))
+		{
+			return scap_cfile_set_error(f, LZ4F_getErrorName(res));
+		}
+
+		if(scap_cfile_write_out(f, res) != 0)
+		{
+			return -1;
+		}
+		break;
+	}
+#endif
+	default:
+		break;
+	}
+
+	return fflush(f->m_f) == 0 ? 0 : -1;
+}
+
+//
+// Go back to the beginning of the stream
+//
+static int scap_cfile_rewind(scap_cfile* f)
+{
+#ifndef _WIN32
+	if(fseeko(f->m_f, f->m_start, SEEK_SET) != 0)
+#else
+	if(_fseeki64(f->m_f, f->m_start, SEEK_SET) != 0)
+#endif
+	{
+		return -1;
+	}
+
+	switch(f->m_compress)
+	{
+#ifdef USE_ZSTD
+	case SCAP_COMPRESSION_ZSTD:
+		ZSTD_DCtx_reset(f->m_zds, ZSTD_reset_session_only);
+		break;
+#endif
+#ifdef USE_LZ4
+	case SCAP_COMPRESSION_LZ4:
+		LZ4F_resetDecompressionContext(f->m_ldctx);
+		break;
+#endif
+	default:
+		break;
+	}
+
+	f->m_in_pos = 0;
+	f->m_in_len = 0;
+	f->m_out_pos = 0;
+	f->m_out_len = 0;
+	f->m_pending = false;
+	f->m_eof = false;
+	f->m_pos = 0;
+
+	return 0;
+}
+
+int64_t scap_cfile_seek(scap_cfile* f, int64_t off, int whence)
+{
+	int64_t target;
+
+	if(f->m_gz != NULL)
+	{
+		return gzseek(f->m_gz, (long)off, whence);
+	}
+
+	if(whence == SEEK_SET)
+	{
+		target = off;
+	}
+	else if(whence == SEEK_CUR)
+	{
+		target = f->m_pos + off;
+	}
+	else
+	{
+		return -1;
+	}
+
+	if(target == f->m_pos)
+	{
+		return target;
+	}
+
+	if(f->m_write || target < 0)
+	{
+		return -1;
+	}
+
+	if(target < f->m_pos)
+	{
+		//
+		// Short steps back, like the one done by scap_read_init() after
+		// the first event block header, stay in the decompressed buffer
+		//
+		if((uint64_t)(f->m_pos - target) <= f->m_out_pos)
+		{
+			f->m_out_pos -= (size_t)(f->m_pos - target);
+			f->m_pos = target;
+			return target;
+		}
+
+		if(scap_cfile_rewind(f) != 0)
+		{
+			return -1;
+		}
+	}
+
+	//
+	// Decompress and discard the data up to the target
+	//
+	while(f->m_pos < target)
+	{
+		size_t n;
+
+		if(f->m_out_pos == f->m_out_len && scap_cfile_fill(f) <= 0)
+		{
+			return -1;
+		}
+
+		n = f->m_out_len - f->m_out_pos;
+		if((int64_t)n > target - f->m_pos)
+		{
+			n = (size_t)(target - f->m_pos);
+		}
+
+		f->m_out_pos += n;
+		f->m_pos += n;
+	}
+
+	return f->m_pos;
+}
+
+int64_t scap_cfile_tell(scap_cfile* f)
+{
+	if(f->m_gz != NULL)
+	{
+		return gztell(f->m_gz);
+	}
+
+	return f->m_pos;
+}
+
+int64_t scap_cfile_offset(scap_cfile* f)
+{
+	if(f->m_gz != NULL)
+	{
+		return gzoffset(f->m_gz);
+	}
+
+	//
+	// The compressed data read ahead is not consumed yet
+	//
+#ifndef _WIN32
+	return ftello(f->m_f) - f->m_start - (int64_t)(f->m_in_len - f->m_in_pos);
+#else
+	return _ftelli64(f->m_f) - f->m_start - (int64_t)(f->m_in_len - f->m_in_pos);
+#endif
+}
+
+int64_t scap_cfile_size(scap_cfile* f)
+{
+	//
+	// zlib reads uncompressed files directly
+	//
+	if(f->m_gz != NULL && !f->m_write && f->m_size >= 0 && gzdirect(f->m_gz))
+	{
+		return f->m_size;
+	}
+
+	return -1;
+}
+
+bool scap_cfile_compressed(scap_cfile* f)
+{
+	//
+	// Both for reading and for writing, gzdirect() tells whether zlib
+	// passes the data through
+	//
+	if(f->m_gz != NULL)
+	{
+		return !gzdirect(f->m_gz);
+	}
+
+	return true;
+}
+
+int scap_cfile_flush(scap_cfile* f)
+{
+	if(f->m_gz != NULL)
+	{
+		return gzflush(f->m_gz, Z_FULL_FLUSH);
+	}
+
+	if(!f->m_write)
+	{
+		return 0;
+	}
+
+	return scap_cfile_drain(f, false);
+}
+
+int scap_cfile_close(scap_cfile* f)
+{
+	int res = 0;
+
+	if(f->m_gz != NULL)
+	{
+		res = gzclose(f->m_gz);
+		free(f);
+		return res;
+	}
+
+	if(f->m_write && scap_cfile_drain(f, true) != 0)
+	{
+		res = -1;
+	}
+
+	if(fclose(f->m_f) != 0)
+	{
+		res = -1;
+	}
+
+	scap_cfile_free(f);
+	return res;
+}
+
+const char* scap_cfile_error(scap_cfile* f, int* errnum)
+{
+	if(f->m_gz != NULL)
+	{
+		return gzerror(f->m_gz, errnum);
+	}
+
+	*errnum = f->m_errnum;
+	return f->m_errstr != NULL ? f->m_errstr : "";
+}
@@ -0,0 +1,90 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#ifndef _SCAP_COMPRESSION_H
+#define _SCAP_COMPRESSION_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// Capture file with its compression codec, used by the savefile reader and
+// the dumpers in place of a gzFile.
+//
+// SCAP_COMPRESSION_NONE and SCAP_COMPRESSION_GZIP go through zlib, that also
+// reads uncompressed files. SCAP_COMPRESSION_ZSTD and SCAP_COMPRESSION_LZ4 are
+// streams of zstd and lz4 frames, available if the library is built with
+// USE_ZSTD and USE_LZ4. When a file is opened for reading the codec is
+// detected from the magic number of its first frame.
+//
+// The positions are in uncompressed bytes, except the one returned by
+// scap_cfile_offset(), that's in the compressed file. Seeking backwards in a
+// zstd or lz4 file restarts the decompression from the beginning, like
+// gzseek() does.
+//
+typedef struct scap_cfile scap_cfile;
+
+//
+// Open a file for reading (write false, compress is ignored) or for
+// writing. Return NULL on failure.
+//
+scap_cfile* scap_cfile_open(const char* fname, bool write, compression_mode compress);
+
+//
+// Same as scap_cfile_open(), on an open file descriptor, which is closed by
+// scap_cfile_close(). The codec of a non seekable fd opened for reading can't
+// be detected, and is assumed to be gzip.
+//
+scap_cfile* scap_cfile_dopen(int fd, bool write, compression_mode compress);
+
+//
+// Return true if the library was built with the codec
+//
+bool scap_cfile_supported(compression_mode compress);
+
+int scap_cfile_read(scap_cfile* f, void* buf, unsigned len);
+int scap_cfile_write(scap_cfile* f, const void* buf, unsigned len);
+int64_t scap_cfile_seek(scap_cfile* f, int64_t off, int whence);
+int64_t scap_cfile_tell(scap_cfile* f);
+int64_t scap_cfile_offset(scap_cfile* f);
+
+//
+// Size of an uncompressed file opened for reading, which makes its tail
+// reachable with a cheap seek, or -1 if the file is compressed or not a
+// regular file.
+//
+int64_t scap_cfile_size(scap_cfile* f);
+
+//
+// Return true if the data is compressed. Seeking in a compressed file opened
+// for reading decompresses it from the beginning of the stream.
+//
+bool scap_cfile_compressed(scap_cfile* f);
+
+int scap_cfile_flush(scap_cfile* f);
+int scap_cfile_close(scap_cfile* f);
+const char* scap_cfile_error(scap_cfile* f, int* errnum);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
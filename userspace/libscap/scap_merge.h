@@ -0,0 +1,191 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _SCAP_MERGE_H
+#define _SCAP_MERGE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+//
+// Ordered merge of the per-device event streams.
+//
+// This is a tournament (loser) tree with one leaf per device, keyed by the
+// timestamp of the event at the head of that device. Every internal node
+// remembers the loser of the match played there and node 0 holds the overall
+// winner, so picking the next event is O(1) and advancing a device replays
+// exactly log2(ndevs) matches along its path to the root, without the data
+// dependent child selection of a binary heap. Ties are broken on the device
+// id, so the resulting order is exactly the one of a linear scan picking the
+// first device with the lowest timestamp. Devices without data are keyed
+// with SCAP_MERGE_TS_NONE and always lose.
+//
+#define SCAP_MERGE_TS_NONE 0xffffffffffffffffULL
+
+typedef struct scap_merge
+{
+	uint64_t* m_ts; // Head timestamp of every leaf
+	uint32_t* m_tree; // Losers of the internal nodes, the winner in m_tree[0]
+	uint32_t* m_winners; // Scratch space used by scap_merge_build()
+	uint32_t m_nleaves; // Number of devices rounded up to a power of two
+}scap_merge;
+
+static inline bool scap_merge_less(const scap_merge* merge, uint32_t a, uint32_t b)
+{
+	return merge->m_ts[a] < merge->m_ts[b] || (merge->m_ts[a] == merge->m_ts[b] && a < b);
+}
+
+//
+// Allocate a tree for ndevs devices. Returns false on allocation failure.
+//
+static inline bool scap_merge_init(scap_merge* merge, uint32_t ndevs)
+{
+	uint32_t nleaves = 1;
+	uint32_t j;
+
+	while(nleaves < ndevs)
+	{
+		nleaves <<= 1;
+	}
+
+	merge->m_nleaves = nleaves;
+	merge->m_ts = (uint64_t*)malloc(sizeof(uint64_t) * nleaves);
+	merge->m_tree = (uint32_t*)malloc(sizeof(uint32_t) * nleaves);
+	merge->m_winners = (uint32_t*)malloc(sizeof(uint32_t) * nleaves * 2);
+
+	if(merge->m_ts == NULL || merge->m_tree == NULL || merge->m_winners == NULL)
+	{
+		return false;
+	}
+
+	for(j = 0; j < nleaves; j++)
+	{
+		merge->m_ts[j] = SCAP_MERGE_TS_NONE;
+	}
+	merge->m_tree[0] = 0;
+
+	return true;
+}
+
+static inline void scap_merge_free(scap_merge* merge)
+{
+	free(merge->m_ts);
+	free(merge->m_tree);
+	free(merge->m_winners);
+	merge->m_ts = NULL;
+	merge->m_tree = NULL;
+	merge->m_winners = NULL;
+	merge->m_nleaves = 0;
+}
+
+static inline void scap_merge_clear(scap_merge* merge)
+{
+	uint32_t j;
+
+	for(j = 0; j < merge->m_nleaves; j++)
+	{
+		merge->m_ts[j] = SCAP_MERGE_TS_NONE;
+	}
+}
+
+//
+// Set the head timestamp of a device without replaying the matches. Used to
+// load all the devices after a refill; call scap_merge_build() once they are
+// all in.
+//
+static inline void scap_merge_add(scap_merge* merge, uint64_t ts, uint32_t devid)
+{
+	merge->m_ts[devid] = ts;
+}
+
+static inline void scap_merge_build(scap_merge* merge)
+{
+	uint32_t nleaves = merge->m_nleaves;
+	uint32_t* winners = merge->m_winners;
+	uint32_t j;
+
+	for(j = 0; j < nleaves; j++)
+	{
+		winners[nleaves + j] = j;
+	}
+
+	for(j = nleaves - 1; j > 0; j--)
+	{
+		uint32_t left = winners[2 * j];
+		uint32_t right = winners[2 * j + 1];
+
+		if(scap_merge_less(merge, left, right))
+		{
+			winners[j] = left;
+			merge->m_tree[j] = right;
+		}
+		else
+		{
+			winners[j] = right;
+			merge->m_tree[j] = left;
+		}
+	}
+
+	merge->m_tree[0] = nleaves > 1 ? winners[1] : 0;
+}
+
+static inline bool scap_merge_empty(const scap_merge* merge)
+{
+	return merge->m_ts[merge->m_tree[0]] == SCAP_MERGE_TS_NONE;
+}
+
+//
+// Device holding the event with the lowest timestamp. The tree must not be empty.
+//
+static inline uint32_t scap_merge_top(const scap_merge* merge)
+{
+	return merge->m_tree[0];
+}
+
+//
+// The device returned by scap_merge_top() advanced to an event with timestamp ts.
+//
+static inline void scap_merge_update_top(scap_merge* merge, uint64_t ts)
+{
+	uint32_t winner = merge->m_tree[0];
+	uint32_t node;
+
+	merge->m_ts[winner] = ts;
+
+	for(node = (winner + merge->m_nleaves) >> 1; node > 0; node >>= 1)
+	{
+		uint32_t loser = merge->m_tree[node];
+
+		if(scap_merge_less(merge, loser, winner))
+		{
+			merge->m_tree[node] = winner;
+			winner = loser;
+		}
+	}
+
+	merge->m_tree[0] = winner;
+}
+
+//
+// The device returned by scap_merge_top() ran out of events.
+//
+static inline void scap_merge_pop(scap_merge* merge)
+{
+	scap_merge_update_top(merge, SCAP_MERGE_TS_NONE);
+}
+
+#endif
@@ -46,7 +46,7 @@ int scap_dump_write(scap_dumper_t *d, void* buf, unsigned len)
 {
 	if(d->m_type == DT_FILE)
 	{
-		return gzwrite(d->m_f, buf, len);
+		return scap_cfile_write(d->m_f, buf, len);
 	}
 	else
 	{
@@ -782,17 +782,14 @@ static int32_t scap_write_userlist(scap_t *handle, scap_dumper_t* d)
 }
 
 //
-// Create the dump file headers and add the tables
+// Write the header of a new section
 //
-int32_t scap_setup_dump(scap_t *handle, scap_dumper_t* d, const char *fname)
+static int32_t scap_write_section_header(scap_t *handle, scap_dumper_t* d, const char *fname)
 {
 	block_header bh;
 	section_header_block sh;
 	uint32_t bt;
 
-	//
-	// Write the section header
-	//
 	bh.block_type = SHB_BLOCK_TYPE;
 	bh.block_total_length = sizeof(block_header) + sizeof(section_header_block) + 4;
 
@@ -811,30 +808,14 @@ int32_t scap_setup_dump(scap_t *handle, scap_dumper_t* d, const char *fname)
 		return SCAP_FAILURE;
 	}
 
-	//
-	// If we're dumping in live mode, refresh the process tables list
-	// so we don't lose information about processes created in the interval
-	// between opening the handle and starting the dump
-	//
-#if defined(HAS_CAPTURE) && !defined(WIN32)
-	if(handle->m_file == NULL && handle->refresh_proc_table_when_saving)
-	{
-		proc_entry_callback tcb = handle->m_proc_callback;
-		handle->m_proc_callback = NULL;
-
-		scap_proc_free_table(handle);
-		char filename[SCAP_MAX_PATH_SIZE];
-		snprintf(filename, sizeof(filename), "%s/proc", scap_get_host_root());
-		if(scap_proc_scan_proc_dir(handle, filename, handle->m_lasterr) != SCAP_SUCCESS)
-		{
-			handle->m_proc_callback = tcb;
-			return SCAP_FAILURE;
-		}
-
-		handle->m_proc_callback = tcb;
-	}
-#endif
+	return SCAP_SUCCESS;
+}
 
+//
+// Write the tables following the section header
+//
+static int32_t scap_write_tables(scap_t *handle, scap_dumper_t* d, bool proc_tables)
+{
 	//
 	// Write the machine info
 	//
@@ -859,6 +840,11 @@ int32_t scap_setup_dump(scap_t *handle, scap_dumper_t* d, const char *fname)
 		return SCAP_FAILURE;
 	}
 
+	if(!proc_tables)
+	{
+		return SCAP_SUCCESS;
+	}
+
 	//
 	// Write the process list
 	//
@@ -875,6 +861,51 @@ int32_t scap_setup_dump(scap_t *handle, scap_dumper_t* d, const char *fname)
 		return SCAP_FAILURE;
 	}
 
+	return SCAP_SUCCESS;
+}
+
+//
+// Create the dump file headers and add the tables
+//
+int32_t scap_setup_dump(scap_t *handle, scap_dumper_t* d, const char *fname)
+{
+	//
+	// Write the section header
+	//
+	if(scap_write_section_header(handle, d, fname) != SCAP_SUCCESS)
+	{
+		return SCAP_FAILURE;
+	}
+
+	//
+	// If we're dumping in live mode, refresh the process tables list
+	// so we don't lose information about processes created in the interval
+	// between opening the handle and starting the dump
+	//
+#if defined(HAS_CAPTURE) && !defined(WIN32)
+	if(handle->m_file == NULL && handle->refresh_proc_table_when_saving)
+	{
+		proc_entry_callback tcb = handle->m_proc_callback;
+		handle->m_proc_callback = NULL;
+
+		scap_proc_free_table(handle);
+		char filename[SCAP_MAX_PATH_SIZE];
+		snprintf(filename, sizeof(filename), "%s/proc", scap_get_host_root());
+		if(scap_proc_scan_proc_dir(handle, filename, handle->m_lasterr) != SCAP_SUCCESS)
+		{
+			handle->m_proc_callback = tcb;
+			return SCAP_FAILURE;
+		}
+
+		handle->m_proc_callback = tcb;
+	}
+#endif
+
+	if(scap_write_tables(handle, d, true) != SCAP_SUCCESS)
+	{
+		return SCAP_FAILURE;
+	}
+
 	//
 	// If the user doesn't need the thread table, free it
 	//
@@ -890,14 +921,23 @@ int32_t scap_setup_dump(scap_t *handle, scap_dumper_t* d, const char *fname)
 }
 
 // fname is only used for log messages in scap_setup_dump
-static scap_dumper_t *scap_dump_open_gzfile(scap_t *handle, gzFile gzfile, const char *fname, bool skip_proc_scan)
+static scap_dumper_t *scap_dump_open_cfile(scap_t *handle, scap_cfile* f, const char *fname, bool skip_proc_scan)
 {
 	scap_dumper_t* res = (scap_dumper_t*)malloc(sizeof(scap_dumper_t));
-	res->m_f = gzfile;
+	res->m_f = f;
 	res->m_type = DT_FILE;
 	res->m_targetbuf = NULL;
 	res->m_targetbufcurpos = NULL;
 	res->m_targetbufend = NULL;
+	res->m_evb_buf = NULL;
+	res->m_evb_size = 0;
+	res->m_evb_len = 0;
+	res->m_evb_nevents = 0;
+	res->m_index_interval = 0;
+	res->m_index = NULL;
+	res->m_index_nentries = 0;
+	res->m_index_capacity = 0;
+	res->m_section_pos = 0;
 
 	bool tmp_refresh_proc_table_when_saving = handle->refresh_proc_table_when_saving;
 	if(skip_proc_scan)
@@ -923,21 +963,12 @@ static scap_dumper_t *scap_dump_open_gzfile(scap_t *handle, gzFile gzfile, const
 //
 scap_dumper_t *scap_dump_open(scap_t *handle, const char *fname, compression_mode compress, bool skip_proc_scan)
 {
-	gzFile f = NULL;
+	scap_cfile* f = NULL;
 	int fd = -1;
-	const char* mode;
 
-	switch(compress)
+	if(!scap_cfile_supported(compress))
 	{
-	case SCAP_COMPRESSION_GZIP:
-		mode = "wb";
-		break;
-	case SCAP_COMPRESSION_NONE:
-		mode = "wbT";
-		break;
-	default:
-		ASSERT(false);
-		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "invalid compression mode");
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "compression mode %d not supported", (int)compress);
 		return NULL;
 	}
 
@@ -950,13 +981,13 @@ scap_dumper_t *scap_dump_open(scap_t *handle, const char *fname, compression_mod
 #endif
 		if(fd != -1)
 		{
-			f = gzdopen(fd, mode);
+			f = scap_cfile_dopen(fd, true, compress);
 			fname = "standard output";
 		}
 	}
 	else
 	{
-		f = gzopen(fname, mode);
+		f = scap_cfile_open(fname, true, compress);
 	}
 
 	if(f == NULL)
@@ -972,31 +1003,22 @@ scap_dumper_t *scap_dump_open(scap_t *handle, const char *fname, compression_mod
 		return NULL;
 	}
 
-	return scap_dump_open_gzfile(handle, f, fname, skip_proc_scan);
+	return scap_dump_open_cfile(handle, f, fname, skip_proc_scan);
 }
 
 //
 // Open a savefile for writing, using the provided fd
 scap_dumper_t* scap_dump_open_fd(scap_t *handle, int fd, compression_mode compress, bool skip_proc_scan)
 {
-	gzFile f = NULL;
-	const char* mode;
+	scap_cfile* f = NULL;
 
-	switch(compress)
+	if(!scap_cfile_supported(compress))
 	{
-	case SCAP_COMPRESSION_GZIP:
-		mode = "wb";
-		break;
-	case SCAP_COMPRESSION_NONE:
-		mode = "wbT";
-		break;
-	default:
-		ASSERT(false);
-		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "invalid compression mode");
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "compression mode %d not supported", (int)compress);
 		return NULL;
 	}
 
-	f = gzdopen(fd, mode);
+	f = scap_cfile_dopen(fd, true, compress);
 
 	if(f == NULL)
 	{
@@ -1004,7 +1026,7 @@ scap_dumper_t* scap_dump_open_fd(scap_t *handle, int fd, compression_mode compre
 		return NULL;
 	}
 
-	return scap_dump_open_gzfile(handle, f, "", skip_proc_scan);
+	return scap_dump_open_cfile(handle, f, "", skip_proc_scan);
 }
 
 //
@@ -1024,6 +1046,15 @@ scap_dumper_t *scap_memory_dump_open(scap_t *handle, uint8_t* targetbuf, uint64_
 	res->m_targetbuf = targetbuf;
 	res->m_targetbufcurpos = targetbuf;
 	res->m_targetbufend = targetbuf + targetbufsize;
+	res->m_evb_buf = NULL;
+	res->m_evb_size = 0;
+	res->m_evb_len = 0;
+	res->m_evb_nevents = 0;
+	res->m_index_interval = 0;
+	res->m_index = NULL;
+	res->m_index_nentries = 0;
+	res->m_index_capacity = 0;
+	res->m_section_pos = 0;
 
 	//
 	// Disable proc parsing since it would be too heavy when saving to memory.
@@ -1044,6 +1075,216 @@ scap_dumper_t *scap_memory_dump_open(scap_t *handle, uint8_t* targetbuf, uint64_
 	return res;
 }
 
+//
+// Add an index entry for the event block about to be written, whose first
+// event has timestamp ts, if it's far enough from the previous entry
+//
+static int32_t scap_dump_index_block(scap_dumper_t *d, uint64_t ts)
+{
+	scap_index_entry* entry;
+	uint64_t pos;
+
+	if(d->m_index_interval == 0)
+	{
+		return SCAP_SUCCESS;
+	}
+
+	pos = (uint64_t)scap_cfile_tell(d->m_f);
+
+	if(d->m_index_nentries != 0)
+	{
+		entry = &d->m_index[d->m_index_nentries - 1];
+
+		//
+		// The entries must stay sorted by timestamp for the lookups
+		//
+		if(pos - entry->offset < d->m_index_interval || ts < entry->ts)
+		{
+			return SCAP_SUCCESS;
+		}
+	}
+
+	if(d->m_index_nentries == d->m_index_capacity)
+	{
+		uint32_t capacity = d->m_index_capacity ? d->m_index_capacity * 2 : 1024;
+		scap_index_entry* index = (scap_index_entry*)realloc(d->m_index, capacity * sizeof(scap_index_entry));
+
+		if(index == NULL)
+		{
+			return SCAP_FAILURE;
+		}
+
+		d->m_index = index;
+		d->m_index_capacity = capacity;
+	}
+
+	//
+	// The state to load before replaying the block is in the latest
+	// section
+	//
+	entry = &d->m_index[d->m_index_nentries++];
+	entry->ts = ts;
+	entry->offset = pos;
+	entry->checkpoint = d->m_section_pos;
+
+	return SCAP_SUCCESS;
+}
+
+//
+// Write the index block, which must be the last one of the file
+//
+static int32_t scap_dump_write_index(scap_dumper_t *d)
+{
+	block_header bh;
+	uint32_t bt;
+	uint64_t pos = (uint64_t)scap_cfile_tell(d->m_f);
+	uint32_t len = sizeof(pos) + sizeof(d->m_index_nentries) + d->m_index_nentries * sizeof(scap_index_entry);
+
+	bh.block_type = IDX_BLOCK_TYPE;
+	bh.block_total_length = scap_normalize_block_len(sizeof(block_header) + len + 4);
+	bt = bh.block_total_length;
+
+	if(scap_dump_write(d, &bh, sizeof(bh)) != sizeof(bh) ||
+	        scap_dump_write(d, &pos, sizeof(pos)) != sizeof(pos) ||
+	        scap_dump_write(d, &d->m_index_nentries, sizeof(d->m_index_nentries)) != sizeof(d->m_index_nentries) ||
+	        scap_dump_write(d, d->m_index, d->m_index_nentries * sizeof(scap_index_entry)) != d->m_index_nentries * sizeof(scap_index_entry) ||
+	        scap_write_padding(d, len) != SCAP_SUCCESS ||
+	        scap_dump_write(d, &bt, sizeof(bt)) != sizeof(bt))
+	{
+		return SCAP_FAILURE;
+	}
+
+	return SCAP_SUCCESS;
+}
+
+//
+// Write the events buffered by scap_dump() in an event batch block
+//
+static int32_t scap_dump_write_event_block(scap_dumper_t *d)
+{
+	block_header bh;
+	uint32_t bt;
+
+	if(d->m_evb_nevents == 0)
+	{
+		return SCAP_SUCCESS;
+	}
+
+	if(scap_dump_index_block(d, ((scap_evt*)(d->m_evb_buf + sizeof(evb_event_header)))->ts) != SCAP_SUCCESS)
+	{
+		return SCAP_FAILURE;
+	}
+
+	bh.block_type = EVB_BLOCK_TYPE;
+	bh.block_total_length = scap_normalize_block_len(sizeof(block_header) + sizeof(d->m_evb_nevents) + d->m_evb_len + 4);
+	bt = bh.block_total_length;
+
+	if(scap_dump_write(d, &bh, sizeof(bh)) != sizeof(bh) ||
+	        scap_dump_write(d, &d->m_evb_nevents, sizeof(d->m_evb_nevents)) != sizeof(d->m_evb_nevents) ||
+	        scap_dump_write(d, d->m_evb_buf, d->m_evb_len) != d->m_evb_len ||
+	        scap_write_padding(d, sizeof(d->m_evb_nevents) + d->m_evb_len) != SCAP_SUCCESS ||
+	        scap_dump_write(d, &bt, sizeof(bt)) != sizeof(bt))
+	{
+		return SCAP_FAILURE;
+	}
+
+	d->m_evb_len = 0;
+	d->m_evb_nevents = 0;
+
+	return SCAP_SUCCESS;
+}
+
+int32_t scap_dump_set_event_block_size(scap_dumper_t *d, uint32_t size)
+{
+	if(d->m_type != DT_FILE || size > EVB_MAX_BLOCK_SIZE)
+	{
+		return SCAP_NOT_SUPPORTED;
+	}
+
+	if(scap_dump_write_event_block(d) != SCAP_SUCCESS)
+	{
+		return SCAP_FAILURE;
+	}
+
+	free(d->m_evb_buf);
+	d->m_evb_buf = NULL;
+	d->m_evb_size = 0;
+
+	if(size == 0)
+	{
+		return SCAP_SUCCESS;
+	}
+
+	//
+	// The block header, the number of events and the trailer are not
+	// buffered
+	//
+	if(size < sizeof(block_header) + sizeof(d->m_evb_nevents) + 4)
+	{
+		return SCAP_NOT_SUPPORTED;
+	}
+
+	d->m_evb_size = size - sizeof(block_header) - sizeof(d->m_evb_nevents) - 4;
+	d->m_evb_buf = (uint8_t*)malloc(d->m_evb_size);
+	if(d->m_evb_buf == NULL)
+	{
+		d->m_evb_size = 0;
+		return SCAP_FAILURE;
+	}
+
+	return SCAP_SUCCESS;
+}
+
+int32_t scap_dump_set_index_interval(scap_dumper_t *d, uint64_t interval)
+{
+	if(d->m_type != DT_FILE)
+	{
+		return SCAP_NOT_SUPPORTED;
+	}
+
+	d->m_index_interval = interval;
+
+	return SCAP_SUCCESS;
+}
+
+int32_t scap_dump_checkpoint(scap_t *handle, scap_dumper_t *d, bool proc_tables)
+{
+	if(d->m_type != DT_FILE)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "checkpoints are not supported on memory dumps");
+		return SCAP_NOT_SUPPORTED;
+	}
+
+	//
+	// Readers reopen the file at every section, which would decompress it
+	// again from the beginning
+	//
+	if(scap_cfile_compressed(d->m_f))
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "checkpoints are not supported on compressed files");
+		return SCAP_NOT_SUPPORTED;
+	}
+
+	//
+	// The buffered events belong to the previous section
+	//
+	if(scap_dump_write_event_block(d) != SCAP_SUCCESS)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error writing to file (8)");
+		return SCAP_FAILURE;
+	}
+
+	d->m_section_pos = (uint64_t)scap_cfile_tell(d->m_f);
+
+	if(scap_write_section_header(handle, d, "") != SCAP_SUCCESS ||
+	   scap_write_tables(handle, d, proc_tables) != SCAP_SUCCESS)
+	{
+		return SCAP_FAILURE;
+	}
+
+	return SCAP_SUCCESS;
+}
+
 //
 // Close a "savefile" opened with scap_dump_open
 //
@@ -1051,9 +1292,18 @@ void scap_dump_close(scap_dumper_t *d)
 {
 	if(d->m_type == DT_FILE)
 	{
-		gzclose(d->m_f);
+		scap_dump_write_event_block(d);
+
+		if(d->m_index_interval != 0)
+		{
+			scap_dump_write_index(d);
+		}
+
+		scap_cfile_close(d->m_f);
 	}
 
+	free(d->m_evb_buf);
+	free(d->m_index);
 	free(d);
 }
 
@@ -1064,7 +1314,7 @@ int64_t scap_dump_get_offset(scap_dumper_t *d)
 {
 	if(d->m_type == DT_FILE)
 	{
-		return gzoffset(d->m_f);
+		return scap_cfile_offset(d->m_f);
 	}
 	else
 	{
@@ -1076,7 +1326,7 @@ int64_t scap_dump_ftell(scap_dumper_t *d)
 {
 	if(d->m_type == DT_FILE)
 	{
-		return gztell(d->m_f);
+		return scap_cfile_tell(d->m_f);
 	}
 	else
 	{
@@ -1088,7 +1338,8 @@ void scap_dump_flush(scap_dumper_t *d)
 {
 	if(d->m_type == DT_FILE)
 	{
-		gzflush(d->m_f, Z_FULL_FLUSH);
+		scap_dump_write_event_block(d);
+		scap_cfile_flush(d->m_f);
 	}
 }
 
@@ -1105,11 +1356,46 @@ int32_t scap_number_of_bytes_to_write(scap_evt *e, uint16_t cpuid, int32_t *byte
 //
 // Write an event to a dump file
 //
-int32_t scap_dump(scap_t *handle, scap_dumper_t *d, scap_evt *e, uint16_t cpuid, uint32_t flags)
+int32_t scap_dump_errbuf(scap_dumper_t *d, scap_evt *e, uint16_t cpuid, uint32_t flags, char *error)
 {
 	block_header bh;
 	uint32_t bt;
 
+	if(d->m_evb_buf != NULL)
+	{
+		uint32_t entry_len = sizeof(evb_event_header) + e->len;
+
+		if(d->m_evb_len + entry_len > d->m_evb_size &&
+		   scap_dump_write_event_block(d) != SCAP_SUCCESS)
+		{
+			snprintf(error, SCAP_LASTERR_SIZE, "error writing to file (8)");
+			return SCAP_FAILURE;
+		}
+
+		//
+		// Events bigger than a block get a block of their own below
+		//
+		if(entry_len <= d->m_evb_size)
+		{
+			evb_event_header* eh = (evb_event_header*)(d->m_evb_buf + d->m_evb_len);
+
+			eh->cpuid = cpuid;
+			eh->flags = flags;
+			memcpy(d->m_evb_buf + d->m_evb_len + sizeof(evb_event_header), e, e->len);
+
+			d->m_evb_len += entry_len;
+			d->m_evb_nevents++;
+
+			return SCAP_SUCCESS;
+		}
+	}
+
+	if(scap_dump_index_block(d, e->ts) != SCAP_SUCCESS)
+	{
+		snprintf(error, SCAP_LASTERR_SIZE, "error allocating the index");
+		return SCAP_FAILURE;
+	}
+
 	if(flags == 0)
 	{
 		//
@@ -1125,7 +1411,7 @@ int32_t scap_dump(scap_t *handle, scap_dumper_t *d, scap_evt *e, uint16_t cpuid,
 				scap_write_padding(d, sizeof(cpuid) + e->len) != SCAP_SUCCESS ||
 				scap_dump_write(d, &bt, sizeof(bt)) != sizeof(bt))
 		{
-			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error writing to file (6)");
+			snprintf(error, SCAP_LASTERR_SIZE, "error writing to file (6)");
 			return SCAP_FAILURE;
 		}
 	}
@@ -1145,7 +1431,7 @@ int32_t scap_dump(scap_t *handle, scap_dumper_t *d, scap_evt *e, uint16_t cpuid,
 				scap_write_padding(d, sizeof(cpuid) + e->len) != SCAP_SUCCESS ||
 				scap_dump_write(d, &bt, sizeof(bt)) != sizeof(bt))
 		{
-			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error writing to file (7)");
+			snprintf(error, SCAP_LASTERR_SIZE, "error writing to file (7)");
 			return SCAP_FAILURE;
 		}
 	}
@@ -1160,6 +1446,11 @@ int32_t scap_dump(scap_t *handle, scap_dumper_t *d, scap_evt *e, uint16_t cpuid,
 	return SCAP_SUCCESS;
 }
 
+int32_t scap_dump(scap_t *handle, scap_dumper_t *d, scap_evt *e, uint16_t cpuid, uint32_t flags)
+{
+	return scap_dump_errbuf(d, e, cpuid, flags, handle->m_lasterr);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 // READ FUNCTIONS
@@ -1169,12 +1460,12 @@ int32_t scap_dump(scap_t *handle, scap_dumper_t *d, scap_evt *e, uint16_t cpuid,
 //
 // Load the machine info block
 //
-static int32_t scap_read_machine_info(scap_t *handle, gzFile f, uint32_t block_length)
+static int32_t scap_read_machine_info(scap_t *handle, scap_cfile* f, uint32_t block_length)
 {
 	//
 	// Read the section header block
 	//
-	if(gzread(f, &handle->m_machine_info, sizeof(handle->m_machine_info)) !=
+	if(scap_cfile_read(f, &handle->m_machine_info, sizeof(handle->m_machine_info)) !=
 		sizeof(handle->m_machine_info))
 	{
 		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error reading from file (1)");
@@ -1187,7 +1478,7 @@ static int32_t scap_read_machine_info(scap_t *handle, gzFile f, uint32_t block_l
 //
 // Parse a process list block
 //
-static int32_t scap_read_proclist(scap_t *handle, gzFile f, uint32_t block_length, uint32_t block_type)
+static int32_t scap_read_proclist(scap_t *handle, scap_cfile* f, uint32_t block_length, uint32_t block_type)
 {
 	size_t readsize;
 	size_t subreadsize = 0;
@@ -1242,7 +1533,7 @@ static int32_t scap_read_proclist(scap_t *handle, gzFile f, uint32_t block_lengt
 		case PL_BLOCK_TYPE_V8:
 			break;
 		case PL_BLOCK_TYPE_V9:
-			readsize = gzread(f, &(sub_len), sizeof(uint32_t));
+			readsize = scap_cfile_read(f, &(sub_len), sizeof(uint32_t));
 			CHECK_READ_SIZE(readsize, sizeof(uint32_t));
 
 			subreadsize += readsize;
@@ -1256,7 +1547,7 @@ static int32_t scap_read_proclist(scap_t *handle, gzFile f, uint32_t block_lengt
 		//
 		// tid
 		//
-		readsize = gzread(f, &(tinfo.tid), sizeof(uint64_t));
+		readsize = scap_cfile_read(f, &(tinfo.tid), sizeof(uint64_t));
 		CHECK_READ_SIZE(readsize, sizeof(uint64_t));
 
 		subreadsize += readsize;
@@ -1264,7 +1555,7 @@ static int32_t scap_read_proclist(scap_t *handle, gzFile f, uint32_t block_lengt
 		//
 		// pid
 		//
-		readsize = gzread(f, &(tinfo.pid), sizeof(uint64_t));
+		readsize = scap_cfile_read(f, &(tinfo.pid), sizeof(uint64_t));
 		CHECK_READ_SIZE(readsize, sizeof(uint64_t));
 
 		subreadsize += readsize;
@@ -1272,7 +1563,7 @@ static int32_t scap_read_proclist(scap_t *handle, gzFile f, uint32_t block_lengt
 		//
 		// ptid
 		//
-		readsize = gzread(f, &(tinfo.ptid), sizeof(uint64_t));
+		readsize = scap_cfile_read(f, &(tinfo.ptid), sizeof(uint64_t));
 		CHECK_READ_SIZE(readsize, sizeof(uint64_t));
 
 		subreadsize += readsize;
@@ -1292,7 +1583,7 @@ static int32_t scap_read_proclist(scap_t *handle, gzFile f, uint32_t block_lengt
 		case PL_BLOCK_TYPE_V7:
 		case PL_BLOCK_TYPE_V8:
 		case PL_BLOCK_TYPE_V9:
-			readsize = gzread(f, &(tinfo.sid), sizeof(uint64_t));
+			readsize = scap_cfile_read(f, &(tinfo.sid), sizeof(uint64_t));
 			CHECK_READ_SIZE(readsize, sizeof(uint64_t));
 
 			subreadsize += readsize;
@@ -1321,7 +1612,7 @@ static int32_t scap_read_proclist(scap_t *handle, gzFile f, uint32_t block_lengt
 			break;
 		case PL_BLOCK_TYPE_V8:
 		case PL_BLOCK_TYPE_V9:
-			readsize = gzread(f, &(tinfo.vpgid), sizeof(uint64_t));
+			readsize = scap_cfile_read(f, &(tinfo.vpgid), sizeof(uint64_t));
 			CHECK_READ_SIZE(readsize, sizeof(uint64_t));
 
 			subreadsize += readsize;
@@ -1335,7 +1626,7 @@ static int32_t scap_read_proclist(scap_t *handle, gzFile f, uint32_t block_lengt
 		//
 		// comm
 		//
-		readsize = gzread(f, &(stlen), sizeof(uint16_t));
+		readsize = scap_cfile_read(f, &(stlen), sizeof(uint16_t));
 		CHECK_READ_SIZE(readsize, sizeof(uint16_t));
 
 		if(stlen > SCAP_MAX_PATH_SIZE)
@@ -1346,7 +1637,7 @@ static int32_t scap_read_proclist(scap_t *handle, gzFile f, uint32_t block_lengt
 
 		subreadsize += readsize;
 
-		readsize = gzread(f, tinfo.comm, stlen);
+		readsize = scap_cfile_read(f, tinfo.comm, stlen);
 		CHECK_READ_SIZE(readsize, stlen);
 
 		// the string is not null-terminated on file
@@ -1357,7 +1648,7 @@ static int32_t scap_read_proclist(scap_t *handle, gzFile f, uint32_t block_lengt
 		//
 		// exe
 		//
-		readsize = gzread(f, &(stlen), sizeof(uint16_t));
+		readsize = scap_cfile_read(f, &(stlen), sizeof(uint16_t));
 		CHECK_READ_SIZE(readsize, sizeof(uint16_t));
 
 		if(stlen > SCAP_MAX_PATH_SIZE)
@@ -1368,7 +1659,7 @@ static int32_t scap_read_proclist(scap_t *handle, gzFile f, uint32_t block_lengt
 
 		subreadsize += readsize;
 
-		readsize = gzread(f, tinfo.exe, stlen);
+		readsize = scap_cfile_read(f, tinfo.exe, stlen);
 		CHECK_READ_SIZE(readsize, stlen);
 
 		// the string is not null-terminated on file
@@ -1394,7 +1685,7 @@ static int32_t scap_read_proclist(scap_t *handle, gzFile f, uint32_t block_lengt
 			//
 			// exepath
 			//
-			readsize = gzread(f, &(stlen), sizeof(uint16_t));
+			readsize = scap_cfile_read(f, &(stlen), sizeof(uint16_t));
 			CHECK_READ_SIZE(readsize, sizeof(uint16_t));
 
 			if(stlen > SCAP_MAX_PATH_SIZE)
@@ -1405,7 +1696,7 @@ static int32_t scap_read_proclist(scap_t *handle, gzFile f, uint32_t block_lengt
 
 			subreadsize += readsize;
 
-			readsize = gzread(f, tinfo.exepath, stlen);
+			readsize = scap_cfile_read(f, tinfo.exepath, stlen);
 			CHECK_READ_SIZE(readsize, stlen);
 
 			// the string is not null-terminated on file
@@ -1423,7 +1714,7 @@ static int32_t scap_read_proclist(scap_t *handle, gzFile f, uint32_t block_lengt
 		//
 		// args
 		//
-		readsize = gzread(f, &(stlen), sizeof(uint16_t));
+		readsize = scap_cfile_read(f, &(stlen), sizeof(uint16_t));
 		CHECK_READ_SIZE(readsize, sizeof(uint16_t));
 
 		if(stlen > SCAP_MAX_ARGS_SIZE)
@@ -1434,7 +1725,7 @@ static int32_t scap_read_proclist(scap_t *handle, gzFile f, uint32_t block_lengt
 
 		subreadsize += readsize;
 
-		readsize = gzread(f, tinfo.args, stlen);
+		readsize = scap_cfile_read(f, tinfo.args, stlen);
 		CHECK_READ_SIZE(readsize, stlen);
 
 		// the string is not null-terminated on file
@@ -1446,7 +1737,7 @@ static int32_t scap_read_proclist(scap_t *handle, gzFile f, uint32_t block_lengt
 		//
 		// cwd
 		//
-		readsize = gzread(f, &(stlen), sizeof(uint16_t));
+		readsize = scap_cfile_read(f, &(stlen), sizeof(uint16_t));
 		CHECK_READ_SIZE(readsize, sizeof(uint16_t));
 
 		if(stlen > SCAP_MAX_PATH_SIZE)
@@ -1457,7 +1748,7 @@ static int32_t scap_read_proclist(scap_t *handle, gzFile f, uint32_t block_lengt
 
 		subreadsize += readsize;
 
-		readsize = gzread(f, tinfo.cwd, stlen);
+		readsize = scap_cfile_read(f, tinfo.cwd, stlen);
 		CHECK_READ_SIZE(readsize, stlen);
 
 		// the string is not null-terminated on file
@@ -1468,7 +1759,7 @@ static int32_t scap_read_proclist(scap_t *handle, gzFile f, uint32_t block_lengt
 		//
 		// fdlimit
 		//
-		readsize = gzread(f, &(tinfo.fdlimit), sizeof(uint64_t));
+		readsize = scap_cfile_read(f, &(tinfo.fdlimit), sizeof(uint64_t));
 		CHECK_READ_SIZE(readsize, sizeof(uint64_t));
 
 		subreadsize += readsize;
@@ -1476,7 +1767,7 @@ static int32_t scap_read_proclist(scap_t *handle, gzFile f, uint32_t block_lengt
 		//
 		// flags
 		//
-		readsize = gzread(f, &(tinfo.flags), sizeof(uint32_t));
+		readsize = scap_cfile_read(f, &(tinfo.flags), sizeof(uint32_t));
 		CHECK_READ_SIZE(readsize, sizeof(uint32_t));
 
 		subreadsize += readsize;
@@ -1484,7 +1775,7 @@ static int32_t scap_read_proclist(scap_t *handle, gzFile f, uint32_t block_lengt
 		//
 		// uid
 		//
-		readsize = gzread(f, &(tinfo.uid), sizeof(uint32_t));
+		readsize = scap_cfile_read(f, &(tinfo.uid), sizeof(uint32_t));
 		CHECK_READ_SIZE(readsize, sizeof(uint32_t));
 
 		subreadsize += readsize;
@@ -1492,7 +1783,7 @@ static int32_t scap_read_proclist(scap_t *handle, gzFile f, uint32_t block_lengt
 		//
 		// gid
 		//
-		readsize = gzread(f, &(tinfo.gid), sizeof(uint32_t));
+		readsize = scap_cfile_read(f, &(tinfo.gid), sizeof(uint32_t));
 		CHECK_READ_SIZE(readsize, sizeof(uint32_t));
 
 		subreadsize += readsize;
@@ -1515,7 +1806,7 @@ static int32_t scap_read_proclist(scap_t *handle, gzFile f, uint32_t block_lengt
 			//
 			// vmsize_kb
 			//
-			readsize = gzread(f, &(tinfo.vmsize_kb), sizeof(uint32_t));
+			readsize = scap_cfile_read(f, &(tinfo.vmsize_kb), sizeof(uint32_t));
 			CHECK_READ_SIZE(readsize, sizeof(uint32_t));
 
 			subreadsize += readsize;
@@ -1523,7 +1814,7 @@ static int32_t scap_read_proclist(scap_t *handle, gzFile f, uint32_t block_lengt
 			//
 			// vmrss_kb
 			//
-			readsize = gzread(f, &(tinfo.vmrss_kb), sizeof(uint32_t));
+			readsize = scap_cfile_read(f, &(tinfo.vmrss_kb), sizeof(uint32_t));
 			CHECK_READ_SIZE(readsize, sizeof(uint32_t));
 
 			subreadsize += readsize;
@@ -1531,7 +1822,7 @@ static int32_t scap_read_proclist(scap_t *handle, gzFile f, uint32_t block_lengt
 			//
 			// vmswap_kb
 			//
-			readsize = gzread(f, &(tinfo.vmswap_kb), sizeof(uint32_t));
+			readsize = scap_cfile_read(f, &(tinfo.vmswap_kb), sizeof(uint32_t));
 			CHECK_READ_SIZE(readsize, sizeof(uint32_t));
 
 			subreadsize += readsize;
@@ -1539,7 +1830,7 @@ static int32_t scap_read_proclist(scap_t *handle, gzFile f, uint32_t block_lengt
 			//
 			// pfmajor
 			//
-			readsize = gzread(f, &(tinfo.pfmajor), sizeof(uint64_t));
+			readsize = scap_cfile_read(f, &(tinfo.pfmajor), sizeof(uint64_t));
 			CHECK_READ_SIZE(readsize, sizeof(uint64_t));
 
 			subreadsize += readsize;
@@ -1547,7 +1838,7 @@ static int32_t scap_read_proclist(scap_t *handle, gzFile f, uint32_t block_lengt
 			//
 			// pfminor
 			//
-			readsize = gzread(f, &(tinfo.pfminor), sizeof(uint64_t));
+			readsize = scap_cfile_read(f, &(tinfo.pfminor), sizeof(uint64_t));
 			CHECK_READ_SIZE(readsize, sizeof(uint64_t));
 
 			subreadsize += readsize;
@@ -1564,7 +1855,7 @@ static int32_t scap_read_proclist(scap_t *handle, gzFile f, uint32_t block_lengt
 				//
 				// env
 				//
-				readsize = gzread(f, &(stlen), sizeof(uint16_t));
+				readsize = scap_cfile_read(f, &(stlen), sizeof(uint16_t));
 				CHECK_READ_SIZE(readsize, sizeof(uint16_t));
 
 				if(stlen > SCAP_MAX_ENV_SIZE)
@@ -1575,7 +1866,7 @@ static int32_t scap_read_proclist(scap_t *handle, gzFile f, uint32_t block_lengt
 
 				subreadsize += readsize;
 
-				readsize = gzread(f, tinfo.env, stlen);
+				readsize = scap_cfile_read(f, tinfo.env, stlen);
 				CHECK_READ_SIZE(readsize, stlen);
 
 				// the string is not null-terminated on file
@@ -1595,7 +1886,7 @@ static int32_t scap_read_proclist(scap_t *handle, gzFile f, uint32_t block_lengt
 				//
 				// vtid
 				//
-				readsize = gzread(f, &(tinfo.vtid), sizeof(int64_t));
+				readsize = scap_cfile_read(f, &(tinfo.vtid), sizeof(int64_t));
 				CHECK_READ_SIZE(readsize, sizeof(uint64_t));
 
 				subreadsize += readsize;
@@ -1603,7 +1894,7 @@ static int32_t scap_read_proclist(scap_t *handle, gzFile f, uint32_t block_lengt
 				//
 				// vpid
 				//
-				readsize = gzread(f, &(tinfo.vpid), sizeof(int64_t));
+				readsize = scap_cfile_read(f, &(tinfo.vpid), sizeof(int64_t));
 				CHECK_READ_SIZE(readsize, sizeof(uint64_t));
 
 				subreadsize += readsize;
@@ -1611,7 +1902,7 @@ static int32_t scap_read_proclist(scap_t *handle, gzFile f, uint32_t block_lengt
 				//
 				// cgroups
 				//
-				readsize = gzread(f, &(stlen), sizeof(uint16_t));
+				readsize = scap_cfile_read(f, &(stlen), sizeof(uint16_t));
 				CHECK_READ_SIZE(readsize, sizeof(uint16_t));
 
 				if(stlen > SCAP_MAX_CGROUPS_SIZE)
@@ -1623,7 +1914,7 @@ static int32_t scap_read_proclist(scap_t *handle, gzFile f, uint32_t block_lengt
 
 				subreadsize += readsize;
 
-				readsize = gzread(f, tinfo.cgroups, stlen);
+				readsize = scap_cfile_read(f, tinfo.cgroups, stlen);
 				CHECK_READ_SIZE(readsize, stlen);
 
 				subreadsize += readsize;
@@ -1634,7 +1925,7 @@ static int32_t scap_read_proclist(scap_t *handle, gzFile f, uint32_t block_lengt
 				   block_type == PL_BLOCK_TYPE_V8 ||
 				   block_type == PL_BLOCK_TYPE_V9)
 				{
-					readsize = gzread(f, &(stlen), sizeof(uint16_t));
+					readsize = scap_cfile_read(f, &(stlen), sizeof(uint16_t));
 					CHECK_READ_SIZE(readsize, sizeof(uint16_t));
 
 					if(stlen > SCAP_MAX_PATH_SIZE)
@@ -1645,7 +1936,7 @@ static int32_t scap_read_proclist(scap_t *handle, gzFile f, uint32_t block_lengt
 
 					subreadsize += readsize;
 
-					readsize = gzread(f, tinfo.root, stlen);
+					readsize = scap_cfile_read(f, tinfo.root, stlen);
 					CHECK_READ_SIZE(readsize, stlen);
 
 					// the string is not null-terminated on file
@@ -1675,7 +1966,7 @@ static int32_t scap_read_proclist(scap_t *handle, gzFile f, uint32_t block_lengt
 		//
 		if(sub_len && (subreadsize + sizeof(int32_t)) <= sub_len)
 		{
-			readsize = gzread(f, &(tinfo.loginuid), sizeof(int32_t));
+			readsize = scap_cfile_read(f, &(tinfo.loginuid), sizeof(int32_t));
 			CHECK_READ_SIZE(readsize, sizeof(uint32_t));
 			subreadsize += readsize;
 		}
@@ -1721,7 +2012,7 @@ static int32_t scap_read_proclist(scap_t *handle, gzFile f, uint32_t block_lengt
 				return SCAP_FAILURE;
 			}
 			toread = sub_len - subreadsize;
-			fseekres = (int)gzseek(f, (long)toread, SEEK_CUR);
+			fseekres = (int)scap_cfile_seek(f, toread, SEEK_CUR);
 			if(fseekres == -1)
 			{
 				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "corrupted input file. Can't skip %u bytes.",
@@ -1746,7 +2037,7 @@ static int32_t scap_read_proclist(scap_t *handle, gzFile f, uint32_t block_lengt
 	}
 	padding_len = block_length - totreadsize;
 
-	readsize = (size_t)gzread(f, &padding, (unsigned int)padding_len);
+	readsize = (size_t)scap_cfile_read(f, &padding, (unsigned int)padding_len);
 	CHECK_READ_SIZE(readsize, padding_len);
 
 	return SCAP_SUCCESS;
@@ -1755,7 +2046,7 @@ static int32_t scap_read_proclist(scap_t *handle, gzFile f, uint32_t block_lengt
 //
 // Parse an interface list block
 //
-static int32_t scap_read_iflist(scap_t *handle, gzFile f, uint32_t block_length, uint32_t block_type)
+static int32_t scap_read_iflist(scap_t *handle, scap_cfile* f, uint32_t block_length, uint32_t block_type)
 {
 	int32_t res = SCAP_SUCCESS;
 	size_t readsize;
@@ -1790,7 +2081,7 @@ static int32_t scap_read_iflist(scap_t *handle, gzFile f, uint32_t block_length,
 		return SCAP_FAILURE;
 	}
 
-	readsize = gzread(f, readbuf, block_length);
+	readsize = scap_cfile_read(f, readbuf, block_length);
 	CHECK_READ_SIZE_WITH_FREE(readbuf, readsize, block_length);
 
 	//
@@ -2118,7 +2409,7 @@ scap_read_iflist_error:
 //
 // Parse a user list block
 //
-static int32_t scap_read_userlist(scap_t *handle, gzFile f, uint32_t block_length, uint32_t block_type)
+static int32_t scap_read_userlist(scap_t *handle, scap_cfile* f, uint32_t block_length, uint32_t block_type)
 {
 	size_t readsize;
 	size_t totreadsize = 0;
@@ -2167,7 +2458,7 @@ static int32_t scap_read_userlist(scap_t *handle, gzFile f, uint32_t block_lengt
 			//
 			// len
 			//
-			readsize = gzread(f, &(sub_len), sizeof(uint32_t));
+			readsize = scap_cfile_read(f, &(sub_len), sizeof(uint32_t));
 			CHECK_READ_SIZE(readsize, sizeof(uint32_t));
 
 			subreadsize += readsize;
@@ -2176,7 +2467,7 @@ static int32_t scap_read_userlist(scap_t *handle, gzFile f, uint32_t block_lengt
 		//
 		// type
 		//
-		readsize = gzread(f, &(type), sizeof(type));
+		readsize = scap_cfile_read(f, &(type), sizeof(type));
 		CHECK_READ_SIZE(readsize, sizeof(type));
 
 		subreadsize += readsize;
@@ -2198,7 +2489,7 @@ static int32_t scap_read_userlist(scap_t *handle, gzFile f, uint32_t block_lengt
 			//
 			// uid
 			//
-			readsize = gzread(f, &(puser->uid), sizeof(uint32_t));
+			readsize = scap_cfile_read(f, &(puser->uid), sizeof(uint32_t));
 			CHECK_READ_SIZE(readsize, sizeof(uint32_t));
 
 			subreadsize += readsize;
@@ -2206,7 +2497,7 @@ static int32_t scap_read_userlist(scap_t *handle, gzFile f, uint32_t block_lengt
 			//
 			// gid
 			//
-			readsize = gzread(f, &(puser->gid), sizeof(uint32_t));
+			readsize = scap_cfile_read(f, &(puser->gid), sizeof(uint32_t));
 			CHECK_READ_SIZE(readsize, sizeof(uint32_t));
 
 			subreadsize += readsize;
@@ -2214,7 +2505,7 @@ static int32_t scap_read_userlist(scap_t *handle, gzFile f, uint32_t block_lengt
 			//
 			// name
 			//
-			readsize = gzread(f, &(stlen), sizeof(uint16_t));
+			readsize = scap_cfile_read(f, &(stlen), sizeof(uint16_t));
 			CHECK_READ_SIZE(readsize, sizeof(uint16_t));
 
 			if(stlen >= MAX_CREDENTIALS_STR_LEN)
@@ -2225,7 +2516,7 @@ static int32_t scap_read_userlist(scap_t *handle, gzFile f, uint32_t block_lengt
 
 			subreadsize += readsize;
 
-			readsize = gzread(f, puser->name, stlen);
+			readsize = scap_cfile_read(f, puser->name, stlen);
 			CHECK_READ_SIZE(readsize, stlen);
 
 			// the string is not null-terminated on file
@@ -2236,7 +2527,7 @@ static int32_t scap_read_userlist(scap_t *handle, gzFile f, uint32_t block_lengt
 			//
 			// homedir
 			//
-			readsize = gzread(f, &(stlen), sizeof(uint16_t));
+			readsize = scap_cfile_read(f, &(stlen), sizeof(uint16_t));
 			CHECK_READ_SIZE(readsize, sizeof(uint16_t));
 
 			if(stlen >= MAX_CREDENTIALS_STR_LEN)
@@ -2247,7 +2538,7 @@ static int32_t scap_read_userlist(scap_t *handle, gzFile f, uint32_t block_lengt
 
 			subreadsize += readsize;
 
-			readsize = gzread(f, puser->homedir, stlen);
+			readsize = scap_cfile_read(f, puser->homedir, stlen);
 			CHECK_READ_SIZE(readsize, stlen);
 
 			// the string is not null-terminated on file
@@ -2258,7 +2549,7 @@ static int32_t scap_read_userlist(scap_t *handle, gzFile f, uint32_t block_lengt
 			//
 			// shell
 			//
-			readsize = gzread(f, &(stlen), sizeof(uint16_t));
+			readsize = scap_cfile_read(f, &(stlen), sizeof(uint16_t));
 			CHECK_READ_SIZE(readsize, sizeof(uint16_t));
 
 			if(stlen >= MAX_CREDENTIALS_STR_LEN)
@@ -2269,7 +2560,7 @@ static int32_t scap_read_userlist(scap_t *handle, gzFile f, uint32_t block_lengt
 
 			subreadsize += readsize;
 
-			readsize = gzread(f, puser->shell, stlen);
+			readsize = scap_cfile_read(f, puser->shell, stlen);
 			CHECK_READ_SIZE(readsize, stlen);
 
 			// the string is not null-terminated on file
@@ -2303,7 +2594,7 @@ static int32_t scap_read_userlist(scap_t *handle, gzFile f, uint32_t block_lengt
 			//
 			// gid
 			//
-			readsize = gzread(f, &(pgroup->gid), sizeof(uint32_t));
+			readsize = scap_cfile_read(f, &(pgroup->gid), sizeof(uint32_t));
 			CHECK_READ_SIZE(readsize, sizeof(uint32_t));
 
 			subreadsize += readsize;
@@ -2311,7 +2602,7 @@ static int32_t scap_read_userlist(scap_t *handle, gzFile f, uint32_t block_lengt
 			//
 			// name
 			//
-			readsize = gzread(f, &(stlen), sizeof(uint16_t));
+			readsize = scap_cfile_read(f, &(stlen), sizeof(uint16_t));
 			CHECK_READ_SIZE(readsize, sizeof(uint16_t));
 
 			if(stlen >= MAX_CREDENTIALS_STR_LEN)
@@ -2322,7 +2613,7 @@ static int32_t scap_read_userlist(scap_t *handle, gzFile f, uint32_t block_lengt
 
 			subreadsize += readsize;
 
-			readsize = gzread(f, pgroup->name, stlen);
+			readsize = scap_cfile_read(f, pgroup->name, stlen);
 			CHECK_READ_SIZE(readsize, stlen);
 
 			// the string is not null-terminated on file
@@ -2349,7 +2640,7 @@ static int32_t scap_read_userlist(scap_t *handle, gzFile f, uint32_t block_lengt
 				return SCAP_FAILURE;
 			}
 			toread = sub_len - subreadsize;
-			fseekres = (int)gzseek(f, (long)toread, SEEK_CUR);
+			fseekres = (int)scap_cfile_seek(f, toread, SEEK_CUR);
 			if(fseekres == -1)
 			{
 				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "corrupted input file. Can't skip %u bytes.",
@@ -2374,7 +2665,7 @@ static int32_t scap_read_userlist(scap_t *handle, gzFile f, uint32_t block_lengt
 	}
 	padding_len = block_length - totreadsize;
 
-	readsize = gzread(f, &padding, (unsigned int)padding_len);
+	readsize = scap_cfile_read(f, &padding, (unsigned int)padding_len);
 	CHECK_READ_SIZE(readsize, padding_len);
 
 	return SCAP_SUCCESS;
@@ -2383,7 +2674,7 @@ static int32_t scap_read_userlist(scap_t *handle, gzFile f, uint32_t block_lengt
 //
 // Parse a process list block
 //
-static int32_t scap_read_fdlist(scap_t *handle, gzFile f, uint32_t block_length, uint32_t block_type)
+static int32_t scap_read_fdlist(scap_t *handle, scap_cfile* f, uint32_t block_length, uint32_t block_type)
 {
 	size_t readsize;
 	size_t totreadsize = 0;
@@ -2399,7 +2690,7 @@ static int32_t scap_read_fdlist(scap_t *handle, gzFile f, uint32_t block_length,
 	//
 	// Read the tid
 	//
-	readsize = gzread(f, &tid, sizeof(tid));
+	readsize = scap_cfile_read(f, &tid, sizeof(tid));
 	CHECK_READ_SIZE(readsize, sizeof(tid));
 	totreadsize += readsize;
 
@@ -2476,7 +2767,7 @@ static int32_t scap_read_fdlist(scap_t *handle, gzFile f, uint32_t block_length,
 	}
 	padding_len = block_length - totreadsize;
 
-	readsize = gzread(f, &padding, (unsigned int)padding_len);
+	readsize = scap_cfile_read(f, &padding, (unsigned int)padding_len);
 	CHECK_READ_SIZE(readsize, padding_len);
 
 	return SCAP_SUCCESS;
@@ -2485,7 +2776,7 @@ static int32_t scap_read_fdlist(scap_t *handle, gzFile f, uint32_t block_length,
 //
 // Parse the headers of a trace file and load the tables
 //
-int32_t scap_read_init(scap_t *handle, gzFile f)
+int32_t scap_read_init(scap_t *handle, scap_cfile* f)
 {
 	block_header bh;
 	section_header_block sh;
@@ -2503,9 +2794,9 @@ int32_t scap_read_init(scap_t *handle, gzFile f)
 	//
 	// Read the section header block
 	//
-	if(gzread(f, &bh, sizeof(bh)) != sizeof(bh) ||
-	        gzread(f, &sh, sizeof(sh)) != sizeof(sh) ||
-	        gzread(f, &bt, sizeof(bt)) != sizeof(bt))
+	if(scap_cfile_read(f, &bh, sizeof(bh)) != sizeof(bh) ||
+	        scap_cfile_read(f, &sh, sizeof(sh)) != sizeof(sh) ||
+	        scap_cfile_read(f, &bt, sizeof(bt)) != sizeof(bt))
 	{
 		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error reading from file (1)");
 		return SCAP_FAILURE;
@@ -2535,7 +2826,7 @@ int32_t scap_read_init(scap_t *handle, gzFile f)
 	//
 	while(true)
 	{
-		readsize = gzread(f, &bh, sizeof(bh));
+		readsize = scap_cfile_read(f, &bh, sizeof(bh));
 
 		//
 		// If we don't find the event block header,
@@ -2595,12 +2886,13 @@ int32_t scap_read_init(scap_t *handle, gzFile f)
 		case EV_BLOCK_TYPE_V2:
 		case EVF_BLOCK_TYPE:
 		case EVF_BLOCK_TYPE_V2:
+		case EVB_BLOCK_TYPE:
 			found_ev = 1;
 
 			//
 			// We're done with the metadata headers. Rewind the file position so we are aligned to start reading the events.
 			//
-			fseekres = gzseek(f, (long)0 - sizeof(bh), SEEK_CUR);
+			fseekres = (int)scap_cfile_seek(f, -(int64_t)sizeof(bh), SEEK_CUR);
 			if(fseekres != -1)
 			{
 				break;
@@ -2635,7 +2927,7 @@ int32_t scap_read_init(scap_t *handle, gzFile f)
 			// Unknown block type. Skip the block.
 			//
 			toread = bh.block_total_length - sizeof(block_header) - 4;
-			fseekres = (int)gzseek(f, (long)toread, SEEK_CUR);
+			fseekres = (int)scap_cfile_seek(f, toread, SEEK_CUR);
 			if(fseekres == -1)
 			{
 				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "corrupted input file. Can't skip block of type %x and size %u.",
@@ -2654,7 +2946,7 @@ int32_t scap_read_init(scap_t *handle, gzFile f)
 		//
 		// Read and validate the trailer
 		//
-		readsize = gzread(f, &bt, sizeof(bt));
+		readsize = scap_cfile_read(f, &bt, sizeof(bt));
 		CHECK_READ_SIZE(readsize, sizeof(bt));
 
 		if(bt != bh.block_total_length)
@@ -2687,6 +2979,75 @@ int32_t scap_read_init(scap_t *handle, gzFile f)
 	return SCAP_SUCCESS;
 }
 
+//
+// Read a whole event batch block, whose header has already been read
+//
+static int32_t scap_read_event_block(scap_t *handle, scap_cfile* f, block_header* bh)
+{
+	size_t readsize;
+	uint32_t readlen;
+
+	if(bh->block_total_length < sizeof(*bh) + sizeof(uint32_t) + 4 ||
+	   bh->block_total_length > EVB_MAX_BLOCK_SIZE)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "invalid event batch block length %u", (uint32_t)bh->block_total_length);
+		return SCAP_FAILURE;
+	}
+
+	readlen = bh->block_total_length - sizeof(*bh);
+
+	if(readlen > handle->m_file_evb_bufsize)
+	{
+		char* buf = (char*)realloc(handle->m_file_evb_buf, readlen);
+		if(buf == NULL)
+		{
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error allocating the event batch buffer");
+			return SCAP_FAILURE;
+		}
+
+		handle->m_file_evb_buf = buf;
+		handle->m_file_evb_bufsize = readlen;
+	}
+
+	readsize = scap_cfile_read(f, handle->m_file_evb_buf, readlen);
+	CHECK_READ_SIZE(readsize, readlen);
+
+	handle->m_file_evb_nevents = *(uint32_t*)handle->m_file_evb_buf;
+	handle->m_file_evb_pos = handle->m_file_evb_buf + sizeof(uint32_t);
+	// Without the trailer
+	handle->m_file_evb_end = handle->m_file_evb_buf + readlen - 4;
+
+	return SCAP_SUCCESS;
+}
+
+//
+// Return the next event of the event batch block being read
+//
+static int32_t scap_next_event_block_event(scap_t *handle, OUT scap_evt **pevent, OUT uint16_t *pcpuid)
+{
+	evb_event_header* eh = (evb_event_header*)handle->m_file_evb_pos;
+	scap_evt* evt = (scap_evt*)(handle->m_file_evb_pos + sizeof(evb_event_header));
+	size_t left = handle->m_file_evb_end - handle->m_file_evb_pos;
+
+	if(left < sizeof(evb_event_header) + sizeof(struct ppm_evt_hdr) ||
+	   evt->len < sizeof(struct ppm_evt_hdr) ||
+	   evt->len > left - sizeof(evb_event_header))
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "corrupted event batch block");
+		handle->m_file_evb_nevents = 0;
+		return SCAP_FAILURE;
+	}
+
+	handle->m_file_evb_pos += sizeof(evb_event_header) + evt->len;
+	handle->m_file_evb_nevents--;
+
+	*pcpuid = eh->cpuid;
+	handle->m_last_evt_dump_flags = eh->flags;
+	*pevent = evt;
+
+	return SCAP_SUCCESS;
+}
+
 //
 // Read an event from disk
 //
@@ -2696,7 +3057,7 @@ int32_t scap_next_offline(scap_t *handle, OUT scap_evt **pevent, OUT uint16_t *p
 	size_t readsize;
 	uint32_t readlen;
 	size_t hdr_len;
-	gzFile f = handle->m_file;
+	scap_cfile* f = handle->m_file;
 
 	ASSERT(f != NULL);
 
@@ -2706,10 +3067,28 @@ int32_t scap_next_offline(scap_t *handle, OUT scap_evt **pevent, OUT uint16_t *p
 	//
 	while(true)
 	{
+		//
+		// The events of a batch block are returned without reading the file
+		//
+		if(handle->m_file_evb_nevents != 0)
+		{
+			if(scap_next_event_block_event(handle, pevent, pcpuid) != SCAP_SUCCESS)
+			{
+				return SCAP_FAILURE;
+			}
+
+			if((*pevent)->type >= PPM_EVENT_MAX)
+			{
+				continue;
+			}
+
+			return SCAP_SUCCESS;
+		}
+
 		//
 		// Read the block header
 		//
-		readsize = gzread(f, &bh, sizeof(bh));
+		readsize = scap_cfile_read(f, &bh, sizeof(bh));
 
 		if(readsize != sizeof(bh))
 		{
@@ -2717,7 +3096,7 @@ int32_t scap_next_offline(scap_t *handle, OUT scap_evt **pevent, OUT uint16_t *p
 #ifdef WIN32
 			const char* err_str = "read error";
 #else
-			const char* err_str = gzerror(f, &err_no);
+			const char* err_str = scap_cfile_error(f, &err_no);
 #endif
 			if(err_no)
 			{
@@ -2738,6 +3117,33 @@ int32_t scap_next_offline(scap_t *handle, OUT scap_evt **pevent, OUT uint16_t *p
 			}
 		}
 
+		if(bh.block_type == EVB_BLOCK_TYPE)
+		{
+			if(scap_read_event_block(handle, f, &bh) != SCAP_SUCCESS)
+			{
+				return SCAP_FAILURE;
+			}
+
+			continue;
+		}
+
+		//
+		// The index is only read by scap_find_index_entry()
+		//
+		if(bh.block_type == IDX_BLOCK_TYPE)
+		{
+			handle->m_file_index_pos = scap_cfile_tell(f) - sizeof(bh);
+
+			if(bh.block_total_length < sizeof(bh) ||
+			   scap_cfile_seek(f, bh.block_total_length - sizeof(bh), SEEK_CUR) == -1)
+			{
+				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "corrupted index block");
+				return SCAP_FAILURE;
+			}
+
+			continue;
+		}
+
 		if(bh.block_type != EV_BLOCK_TYPE &&
 		   bh.block_type != EV_BLOCK_TYPE_V2 &&
 		   bh.block_type != EV_BLOCK_TYPE_INT &&
@@ -2772,7 +3178,7 @@ int32_t scap_next_offline(scap_t *handle, OUT scap_evt **pevent, OUT uint16_t *p
 			return SCAP_FAILURE;
 		}
 
-		readsize = gzread(f, handle->m_file_evt_buf, readlen);
+		readsize = scap_cfile_read(f, handle->m_file_evt_buf, readlen);
 		CHECK_READ_SIZE(readsize, readlen);
 
 		//
@@ -2875,16 +3281,260 @@ int32_t scap_next_offline(scap_t *handle, OUT scap_evt **pevent, OUT uint16_t *p
 
 uint64_t scap_ftell(scap_t *handle)
 {
-	gzFile f = handle->m_file;
+	scap_cfile* f = handle->m_file;
 	ASSERT(f != NULL);
 
-	return gztell(f);
+	return scap_cfile_tell(f);
 }
 
 void scap_fseek(scap_t *handle, uint64_t off)
 {
-	gzFile f = handle->m_file;
+	scap_cfile* f = handle->m_file;
 	ASSERT(f != NULL);
 
-	gzseek(f, off, SEEK_SET);
+	handle->m_file_evb_nevents = 0;
+	scap_cfile_seek(f, off, SEEK_SET);
+}
+
+//
+// Read the body of an index block, whose header has already been read at
+// position pos. The index is ignored unless it was written by a dumper that
+// started at or before start, i.e. it covers start.
+//
+static int32_t scap_read_index(scap_t *handle, scap_cfile* f, block_header* bh, uint64_t pos, uint64_t start)
+{
+	uint64_t dumper_pos;
+	uint32_t nentries;
+	uint32_t j;
+	uint64_t base;
+
+	if(bh->block_total_length < sizeof(*bh) + sizeof(dumper_pos) + sizeof(nentries) + 4 ||
+	   scap_cfile_read(f, &dumper_pos, sizeof(dumper_pos)) != sizeof(dumper_pos) ||
+	   scap_cfile_read(f, &nentries, sizeof(nentries)) != sizeof(nentries) ||
+	   (uint64_t)nentries * sizeof(scap_index_entry) > bh->block_total_length - sizeof(*bh) - sizeof(dumper_pos) - sizeof(nentries) - 4 ||
+	   dumper_pos > pos)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "corrupted index block");
+		return SCAP_FAILURE;
+	}
+
+	//
+	// The positions are relative to the stream written by the dumper,
+	// which may have been concatenated to other captures
+	//
+	base = pos - dumper_pos;
+
+	if(nentries == 0 || base > start)
+	{
+		return SCAP_NOTFOUND;
+	}
+
+	handle->m_file_index = (scap_index_entry*)malloc(nentries * sizeof(scap_index_entry));
+	if(handle->m_file_index == NULL)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error allocating the index");
+		return SCAP_FAILURE;
+	}
+
+	if(scap_cfile_read(f, handle->m_file_index, nentries * sizeof(scap_index_entry)) != (int)(nentries * sizeof(scap_index_entry)))
+	{
+		free(handle->m_file_index);
+		handle->m_file_index = NULL;
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error reading the index block");
+		return SCAP_FAILURE;
+	}
+
+	for(j = 0; j < nentries; j++)
+	{
+		handle->m_file_index[j].offset += base;
+		handle->m_file_index[j].checkpoint += base;
+	}
+
+	handle->m_file_index_nentries = nentries;
+
+	return SCAP_SUCCESS;
+}
+
+//
+// Find and load the index block, restoring the read position
+//
+static int32_t scap_load_index(scap_t *handle)
+{
+	scap_cfile* f = handle->m_file;
+	int64_t saved = scap_cfile_tell(f);
+	int64_t size = scap_cfile_size(f);
+	int32_t res = SCAP_NOTFOUND;
+	block_header bh;
+	uint32_t bt;
+	int64_t pos;
+
+	if(size >= 0)
+	{
+		//
+		// The trailer of the last block is at the end of the file
+		//
+		if(size >= (int64_t)(sizeof(bh) + sizeof(bt)) &&
+		   scap_cfile_seek(f, size - sizeof(bt), SEEK_SET) != -1 &&
+		   scap_cfile_read(f, &bt, sizeof(bt)) == sizeof(bt) &&
+		   bt >= sizeof(bh) + sizeof(bt) && bt <= size)
+		{
+			pos = size - bt;
+
+			if(scap_cfile_seek(f, pos, SEEK_SET) != -1 &&
+			   scap_cfile_read(f, &bh, sizeof(bh)) == sizeof(bh) &&
+			   bh.block_type == IDX_BLOCK_TYPE &&
+			   bh.block_total_length == bt)
+			{
+				res = scap_read_index(handle, f, &bh, pos, saved);
+			}
+		}
+	}
+	else
+	{
+		//
+		// Skip the blocks up to the index, which follows the checkpoints
+		// of its dumper. The first index found is the one of the current
+		// capture, unless it doesn't have one.
+		//
+		while(true)
+		{
+			pos = scap_cfile_tell(f);
+
+			if(scap_cfile_read(f, &bh, sizeof(bh)) != sizeof(bh) ||
+			   bh.block_total_length < sizeof(bh) + sizeof(bt))
+			{
+				break;
+			}
+
+			if(bh.block_type == IDX_BLOCK_TYPE)
+			{
+				res = scap_read_index(handle, f, &bh, pos, saved);
+				break;
+			}
+
+			if(scap_cfile_seek(f, bh.block_total_length - sizeof(bh), SEEK_CUR) == -1)
+			{
+				break;
+			}
+		}
+	}
+
+	//
+	// The reader may already be past the index
+	//
+	if(res == SCAP_NOTFOUND && handle->m_file_index_pos != 0 &&
+	   scap_cfile_seek(f, handle->m_file_index_pos, SEEK_SET) != -1 &&
+	   scap_cfile_read(f, &bh, sizeof(bh)) == sizeof(bh) &&
+	   bh.block_type == IDX_BLOCK_TYPE)
+	{
+		res = scap_read_index(handle, f, &bh, handle->m_file_index_pos, saved);
+	}
+
+	if(scap_cfile_seek(f, saved, SEEK_SET) != saved)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error seeking in file");
+		return SCAP_FAILURE;
+	}
+
+	if(res != SCAP_FAILURE)
+	{
+		handle->m_file_index_loaded = true;
+	}
+
+	return res;
+}
+
+int32_t scap_next_section(scap_t *handle, OUT uint64_t* pos)
+{
+	scap_cfile* f = handle->m_file;
+	block_header bh;
+	int64_t bpos;
+	int readsize;
+
+	if(handle->m_mode != SCAP_MODE_CAPTURE || f == NULL)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "scap_next_section only works on captures");
+		return SCAP_FAILURE;
+	}
+
+	handle->m_file_evb_nevents = 0;
+
+	while(true)
+	{
+		bpos = scap_cfile_tell(f);
+
+		readsize = scap_cfile_read(f, &bh, sizeof(bh));
+		if(readsize == 0)
+		{
+			return SCAP_EOF;
+		}
+
+		if(readsize != sizeof(bh) || bh.block_total_length < sizeof(bh) + 4)
+		{
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "corrupted block at position %" PRId64, bpos);
+			return SCAP_FAILURE;
+		}
+
+		if(scap_cfile_seek(f, bh.block_total_length - sizeof(bh), SEEK_CUR) == -1)
+		{
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error seeking in file");
+			return SCAP_FAILURE;
+		}
+
+		if(bh.block_type == SHB_BLOCK_TYPE)
+		{
+			*pos = bpos;
+			return SCAP_SUCCESS;
+		}
+	}
+}
+
+int32_t scap_find_index_entry(scap_t *handle, uint64_t ts, OUT const scap_index_entry** entry)
+{
+	uint32_t lo = 0;
+	uint32_t hi;
+
+	if(handle->m_mode != SCAP_MODE_CAPTURE || handle->m_file == NULL)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "scap_find_index_entry only works on captures");
+		return SCAP_FAILURE;
+	}
+
+	if(!handle->m_file_index_loaded)
+	{
+		int32_t res = scap_load_index(handle);
+
+		if(res != SCAP_SUCCESS && res != SCAP_NOTFOUND)
+		{
+			return res;
+		}
+	}
+
+	if(handle->m_file_index_nentries == 0)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "the capture doesn't have an index");
+		return SCAP_NOTFOUND;
+	}
+
+	//
+	// First entry with a timestamp greater than ts
+	//
+	hi = handle->m_file_index_nentries;
+	while(lo < hi)
+	{
+		uint32_t mid = lo + (hi - lo) / 2;
+
+		if(handle->m_file_index[mid].ts <= ts)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+
+	*entry = &handle->m_file_index[lo == 0 ? 0 : lo - 1];
+
+	return SCAP_SUCCESS;
 }
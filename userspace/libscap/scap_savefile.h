@@ -148,6 +148,34 @@ typedef struct _section_header_block
 
 #define EVF_BLOCK_TYPE_V2	0x217
 
+///////////////////////////////////////////////////////////////////////////////
+// EVENT BATCH BLOCK
+// Carries many events: the block header is followed by the number of events
+// in the block, then every event is preceded by an evb_event_header. Events
+// are in the EV_BLOCK_TYPE_V2 format. Written by the dumpers with an event
+// block size, see scap_dump_set_event_block_size().
+///////////////////////////////////////////////////////////////////////////////
+#define EVB_BLOCK_TYPE		0x221
+
+// Largest block a reader accepts, and a dumper buffers
+#define EVB_MAX_BLOCK_SIZE	(16 * 1024 * 1024)
+
+typedef struct _evb_event_header
+{
+	uint16_t cpuid;
+	uint32_t flags;
+}evb_event_header;
+
+///////////////////////////////////////////////////////////////////////////////
+// INDEX BLOCK
+// Last block of a file written with an index interval, see
+// scap_dump_set_index_interval(). The block header is followed by the
+// position of the block itself, as seen by the dumper, the number of
+// entries, then the entries as scap_index_entry. Readers find it from the
+// trailer at the end of uncompressed files, or by skipping the event blocks.
+///////////////////////////////////////////////////////////////////////////////
+#define IDX_BLOCK_TYPE		0x222
+
 #if defined __sun
 #pragma pack()
 #else
@@ -0,0 +1,149 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+//
+// Filter evaluation benchmark: replays a capture file and evaluates a filter
+// on every event, both by walking the expression tree and by running the
+// compiled program, reporting the evaluated events per second of each.
+// Every event is evaluated nrepeat times in a row by each path, so that the
+// timer overhead is amortized; the results of the two paths are compared.
+// The program reorders its operands as it goes, and the statistics of the
+// checks it collected are printed at the end.
+//
+// Usage: sinsp-filter-bench <file.scap> <filter> [nrepeat]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include <chrono>
+#include <memory>
+
+#include <sinsp.h>
+#include <filter.h>
+#include <filterchecks.h>
+
+using namespace std;
+
+static uint64_t now_ns()
+{
+	return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t nrepeat = 16;
+
+	if(argc < 3)
+	{
+		fprintf(stderr, "usage: %s <file.scap> <filter> [nrepeat]\n", argv[0]);
+		return 1;
+	}
+
+	if(argc > 3)
+	{
+		nrepeat = strtoul(argv[3], NULL, 10);
+	}
+
+	sinsp inspector;
+	unique_ptr<sinsp_filter> filter;
+	uint64_t nevts = 0;
+	uint64_t naccepted = 0;
+	uint64_t nmismatches = 0;
+	uint64_t tree_ns = 0;
+	uint64_t program_ns = 0;
+
+	try
+	{
+		inspector.open(argv[1]);
+		sinsp_filter_compiler compiler(&inspector, argv[2]);
+		filter.reset(compiler.compile());
+	}
+	catch(const sinsp_exception& e)
+	{
+		fprintf(stderr, "%s\n", e.what());
+		return 1;
+	}
+
+	printf("program: %zu instructions\n", filter->get_program().size());
+
+	while(true)
+	{
+		sinsp_evt* evt;
+		int32_t res = inspector.next(&evt);
+
+		if(res == SCAP_TIMEOUT)
+		{
+			continue;
+		}
+		else if(res != SCAP_SUCCESS)
+		{
+			break;
+		}
+
+		bool tree_res = false;
+		bool program_res = false;
+
+		uint64_t t0 = now_ns();
+		for(uint32_t j = 0; j < nrepeat; j++)
+		{
+			tree_res = filter->m_filter->compare(evt);
+		}
+
+		uint64_t t1 = now_ns();
+		for(uint32_t j = 0; j < nrepeat; j++)
+		{
+			program_res = filter->run(evt);
+		}
+
+		uint64_t t2 = now_ns();
+		tree_ns += t1 - t0;
+		program_ns += t2 - t1;
+
+		nevts++;
+		naccepted += program_res;
+		nmismatches += (tree_res != program_res);
+	}
+
+	inspector.close();
+
+	uint64_t nevals = nevts * nrepeat;
+
+	printf("%" PRIu64 " events, %" PRIu64 " accepted, %" PRIu64 " mismatches\n",
+	       nevts, naccepted, nmismatches);
+	printf("%-8s %12s %10s\n", "path", "evts/s", "ns/evt");
+	printf("%-8s %12.0f %10.1f\n", "tree",
+	       tree_ns ? (double)nevals * 1000000000 / tree_ns : 0,
+	       nevals ? (double)tree_ns / nevals : 0);
+	printf("%-8s %12.0f %10.1f\n", "program",
+	       program_ns ? (double)nevals * 1000000000 / program_ns : 0,
+	       nevals ? (double)program_ns / nevals : 0);
+
+	printf("\n%-32s %10s %8s %10s\n", "check", "samples", "pass %", "ns/eval");
+	for(const gen_event_filter_check_stats& stats : filter->get_check_stats())
+	{
+		sinsp_filter_check* chk = dynamic_cast<sinsp_filter_check*>(stats.m_check);
+
+		printf("%-32s %10" PRIu64 " %8.1f %10.1f\n",
+		       chk ? chk->get_field_info()->m_name : "?",
+		       stats.m_nevals,
+		       stats.pass_rate() * 100,
+		       stats.avg_ns());
+	}
+
+	return nmismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,186 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+//
+// Event formatter benchmark: replays a capture file and formats every event
+// both with sinsp_evt_formatter::tostring() and with the compiled output
+// plan of sinsp_evt_formatter::render(), reporting the formatted events per
+// second and the heap allocations per event of each. The text outputs of the
+// two paths are compared.
+//
+// Usage: sinsp-formatter-bench <file.scap> <format> [nrepeat] [json]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include <atomic>
+#include <chrono>
+#include <new>
+
+#include <sinsp.h>
+#include <eventformatter.h>
+
+using namespace std;
+
+//
+// Every allocation of the process goes through here, so that the ones done
+// by the two paths can be counted
+//
+static atomic<uint64_t> g_nallocs(0);
+
+void* operator new(size_t size)
+{
+	g_nallocs.fetch_add(1, memory_order_relaxed);
+
+	void* p = malloc(size ? size : 1);
+
+	if(p == NULL)
+	{
+		throw bad_alloc();
+	}
+
+	return p;
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+static uint64_t now_ns()
+{
+	return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t nrepeat = 16;
+	bool json = false;
+
+	if(argc < 3)
+	{
+		fprintf(stderr, "usage: %s <file.scap> <format> [nrepeat] [json]\n", argv[0]);
+		return 1;
+	}
+
+	if(argc > 3)
+	{
+		nrepeat = strtoul(argv[3], NULL, 10);
+	}
+
+	if(argc > 4)
+	{
+		json = (string(argv[4]) == "json");
+	}
+
+	sinsp inspector;
+	unique_ptr<sinsp_evt_formatter> formatter;
+	string tostring_res;
+	string render_res;
+	uint64_t nevts = 0;
+	uint64_t nmismatches = 0;
+	uint64_t tostring_ns = 0;
+	uint64_t render_ns = 0;
+	uint64_t tostring_allocs = 0;
+	uint64_t render_allocs = 0;
+
+	try
+	{
+		inspector.open(argv[1]);
+		inspector.set_buffer_format(json ? sinsp_evt::PF_JSON : sinsp_evt::PF_NORMAL);
+		formatter.reset(new sinsp_evt_formatter(&inspector, argv[2]));
+	}
+	catch(const sinsp_exception& e)
+	{
+		fprintf(stderr, "%s\n", e.what());
+		return 1;
+	}
+
+	while(true)
+	{
+		sinsp_evt* evt;
+		int32_t res = inspector.next(&evt);
+
+		if(res == SCAP_TIMEOUT)
+		{
+			continue;
+		}
+		else if(res != SCAP_SUCCESS)
+		{
+			break;
+		}
+
+		bool tostring_ok = false;
+		bool render_ok = false;
+
+		uint64_t a0 = g_nallocs.load(memory_order_relaxed);
+		uint64_t t0 = now_ns();
+		for(uint32_t j = 0; j < nrepeat; j++)
+		{
+			tostring_ok = formatter->tostring(evt, &tostring_res);
+		}
+
+		uint64_t a1 = g_nallocs.load(memory_order_relaxed);
+		uint64_t t1 = now_ns();
+		for(uint32_t j = 0; j < nrepeat; j++)
+		{
+			render_ok = formatter->render(evt, &render_res);
+		}
+
+		uint64_t a2 = g_nallocs.load(memory_order_relaxed);
+		uint64_t t2 = now_ns();
+		tostring_ns += t1 - t0;
+		render_ns += t2 - t1;
+		tostring_allocs += a1 - a0;
+		render_allocs += a2 - a1;
+
+		nevts++;
+
+		//
+		// The JSON strings aren't escaped by the same code, only the text
+		// output is expected to be identical
+		//
+		if(tostring_ok != render_ok || (!json && tostring_ok && tostring_res != render_res))
+		{
+			if(nmismatches == 0)
+			{
+				fprintf(stderr, "mismatch at event %" PRIu64 ":\n  %s\n  %s\n",
+					evt->get_num(), tostring_res.c_str(), render_res.c_str());
+			}
+
+			nmismatches++;
+		}
+	}
+
+	inspector.close();
+
+	uint64_t nformats = nevts * nrepeat;
+
+	printf("%" PRIu64 " events, %" PRIu64 " mismatches\n", nevts, nmismatches);
+	printf("%-8s %12s %10s %12s\n", "path", "evts/s", "ns/evt", "allocs/evt");
+	printf("%-8s %12.0f %10.1f %12.2f\n", "tostring",
+	       tostring_ns ? (double)nformats * 1000000000 / tostring_ns : 0,
+	       nformats ? (double)tostring_ns / nformats : 0,
+	       nformats ? (double)tostring_allocs / nformats : 0);
+	printf("%-8s %12.0f %10.1f %12.2f\n", "render",
+	       render_ns ? (double)nformats * 1000000000 / render_ns : 0,
+	       nformats ? (double)render_ns / nformats : 0,
+	       nformats ? (double)render_allocs / nformats : 0);
+
+	return nmismatches == 0 ? 0 : 1;
+}
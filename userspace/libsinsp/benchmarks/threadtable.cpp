@@ -0,0 +1,186 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+//
+// Microbenchmark of the thread table: insert, lookup (hit and miss) and
+// erase of 10k to 1M tids with threadinfo_map_t, compared with the
+// unordered_map of shared_ptrs it replaced. The threads are allocated up
+// front, so the memory column is the overhead of the table itself,
+// shared_ptr control blocks included.
+//
+// Usage: sinsp-threadtable-bench [max_tids]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <malloc.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include <sinsp.h>
+
+using namespace std;
+
+#define NLOOKUPS (4 * 1000 * 1000)
+
+//
+// The thread table before threadinfo_map_t
+//
+class node_threadtable
+{
+public:
+	void put(sinsp_threadinfo* tinfo)
+	{
+		m_threads[tinfo->m_tid] = threadinfo_map_t::ptr_t(tinfo);
+	}
+
+	sinsp_threadinfo* get(uint64_t tid)
+	{
+		auto it = m_threads.find(tid);
+		if(it == m_threads.end())
+		{
+			return nullptr;
+		}
+		return it->second.get();
+	}
+
+	void erase(uint64_t tid)
+	{
+		m_threads.erase(tid);
+	}
+
+private:
+	unordered_map<int64_t, threadinfo_map_t::ptr_t> m_threads;
+};
+
+static uint64_t now_ns()
+{
+	return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//
+// Bytes allocated on the heap, unlike the RSS it doesn't depend on what the
+// previous runs left in the allocator
+//
+static int64_t heap_bytes()
+{
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+	return (int64_t)mallinfo2().uordblks;
+#else
+	return (int64_t)mallinfo().uordblks;
+#endif
+}
+
+template<typename T>
+static void run(const char* name, const vector<int64_t>& tids, const vector<int64_t>& lookups)
+{
+	vector<sinsp_threadinfo*> threads(tids.size());
+	uint64_t sum = 0;
+
+	for(size_t j = 0; j < tids.size(); j++)
+	{
+		threads[j] = new sinsp_threadinfo(nullptr);
+		threads[j]->m_tid = tids[j];
+	}
+
+	int64_t heap = heap_bytes();
+	T* table = new T();
+
+	uint64_t t0 = now_ns();
+	for(sinsp_threadinfo* tinfo : threads)
+	{
+		table->put(tinfo);
+	}
+
+	uint64_t t1 = now_ns();
+	int64_t table_bytes = heap_bytes() - heap;
+
+	for(int64_t tid : lookups)
+	{
+		sum += table->get(tid)->m_tid;
+	}
+
+	uint64_t t2 = now_ns();
+	for(int64_t tid : lookups)
+	{
+		sum += (table->get(-tid - 1) != nullptr);
+	}
+
+	uint64_t t3 = now_ns();
+	for(int64_t tid : tids)
+	{
+		table->erase(tid);
+	}
+
+	uint64_t t4 = now_ns();
+	delete table;
+
+	printf("%-10s %8zu %10.1f %10.1f %10.1f %10.1f %12.1f (%" PRIu64 ")\n",
+	       name,
+	       tids.size(),
+	       (double)(t1 - t0) / tids.size(),
+	       (double)(t2 - t1) / lookups.size(),
+	       (double)(t3 - t2) / lookups.size(),
+	       (double)(t4 - t3) / tids.size(),
+	       (double)table_bytes / tids.size(),
+	       sum);
+}
+
+int main(int argc, char** argv)
+{
+	size_t max_tids = 1000 * 1000;
+	mt19937_64 rng(42);
+
+	if(argc > 1)
+	{
+		max_tids = strtoul(argv[1], NULL, 10);
+	}
+
+	printf("%-10s %8s %10s %10s %10s %10s %12s\n",
+	       "table", "tids", "insert ns", "lookup ns", "miss ns", "erase ns", "bytes/tid");
+
+	for(size_t ntids = 10 * 1000; ntids <= max_tids; ntids *= 10)
+	{
+		//
+		// Mostly consecutive tids, like the ones of a busy host, inserted
+		// and looked up in random order
+		//
+		vector<int64_t> tids(ntids);
+		for(size_t j = 0; j < ntids; j++)
+		{
+			tids[j] = 1000 + j + (rng() % 4 == 0 ? rng() % 64 : 0) * ntids;
+		}
+		sort(tids.begin(), tids.end());
+		tids.erase(unique(tids.begin(), tids.end()), tids.end());
+		shuffle(tids.begin(), tids.end(), rng);
+
+		vector<int64_t> lookups(NLOOKUPS);
+		for(size_t j = 0; j < lookups.size(); j++)
+		{
+			lookups[j] = tids[rng() % tids.size()];
+		}
+
+		run<threadinfo_map_t>("flat", tids, lookups);
+		run<node_threadtable>("node", tids, lookups);
+	}
+
+	return 0;
+}
@@ -0,0 +1,202 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#pragma once
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace libsinsp {
+
+/**
+ * \brief A std::vector whose contents are shared by all its copies
+ *
+ * @tparam T type of the elements
+ *
+ * Copying a cow_vector only takes a reference to the same storage. The
+ * storage is cloned the first time a copy that shares it is modified, so
+ * the other copies never see the change. assign() keeps the current
+ * storage if the new contents are equal to it, so that setting the same
+ * value on many objects doesn't break the sharing.
+ *
+ * The reference count is atomic, but a single cow_vector object must not be
+ * modified and read concurrently.
+ */
+template<typename T>
+class cow_vector {
+public:
+	typedef std::vector<T> vector_type;
+	typedef typename vector_type::size_type size_type;
+	typedef typename vector_type::const_iterator const_iterator;
+
+	cow_vector() {}
+
+	cow_vector(vector_type v) : m_data(std::make_shared<vector_type>(std::move(v))) {}
+
+	const vector_type& get() const
+	{
+		return m_data ? *m_data : empty_vector();
+	}
+
+	operator const vector_type&() const
+	{
+		return get();
+	}
+
+	size_type size() const
+	{
+		return m_data ? m_data->size() : 0;
+	}
+
+	bool empty() const
+	{
+		return size() == 0;
+	}
+
+	const T& operator[](size_type i) const
+	{
+		return (*m_data)[i];
+	}
+
+	const T& back() const
+	{
+		return m_data->back();
+	}
+
+	const_iterator begin() const
+	{
+		return get().begin();
+	}
+
+	const_iterator end() const
+	{
+		return get().end();
+	}
+
+	/**
+	 * Return the contents for modification, cloning them first if they
+	 * are shared with another cow_vector
+	 */
+	vector_type& mut()
+	{
+		if(!m_data)
+		{
+			m_data = std::make_shared<vector_type>();
+		}
+		else if(m_data.use_count() > 1)
+		{
+			m_data = std::make_shared<vector_type>(*m_data);
+		}
+		return *m_data;
+	}
+
+	void clear()
+	{
+		m_data.reset();
+	}
+
+	void push_back(const T& value)
+	{
+		mut().push_back(value);
+	}
+
+	template<typename... Args>
+	void emplace_back(Args&&... args)
+	{
+		mut().emplace_back(std::forward<Args>(args)...);
+	}
+
+	/**
+	 * Replace the contents with v, unless they are already equal to it
+	 */
+	void assign(vector_type&& v)
+	{
+		if(m_data && *m_data == v)
+		{
+			return;
+		}
+
+		if(v.empty())
+		{
+			m_data.reset();
+		}
+		else
+		{
+			m_data = std::make_shared<vector_type>(std::move(v));
+		}
+	}
+
+	/**
+	 * True if this and other share the same storage
+	 */
+	bool shares_with(const cow_vector& other) const
+	{
+		return m_data == other.m_data;
+	}
+
+private:
+	static const vector_type& empty_vector()
+	{
+		static const vector_type empty;
+		return empty;
+	}
+
+	std::shared_ptr<vector_type> m_data;
+};
+
+//
+// Compare the contents. Template argument deduction doesn't consider the
+// conversion to vector_type, so std::vector's operators don't apply.
+//
+template<typename T>
+bool operator==(const cow_vector<T>& a, const cow_vector<T>& b)
+{
+	return a.shares_with(b) || a.get() == b.get();
+}
+
+template<typename T>
+bool operator==(const cow_vector<T>& a, const std::vector<T>& b)
+{
+	return a.get() == b;
+}
+
+template<typename T>
+bool operator==(const std::vector<T>& a, const cow_vector<T>& b)
+{
+	return a == b.get();
+}
+
+template<typename T>
+bool operator!=(const cow_vector<T>& a, const cow_vector<T>& b)
+{
+	return !(a == b);
+}
+
+template<typename T>
+bool operator!=(const cow_vector<T>& a, const std::vector<T>& b)
+{
+	return !(a == b);
+}
+
+template<typename T>
+bool operator!=(const std::vector<T>& a, const cow_vector<T>& b)
+{
+	return !(a == b);
+}
+
+}
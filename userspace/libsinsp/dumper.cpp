@@ -19,6 +19,12 @@ limitations under the License.
 #include "sinsp_int.h"
 #include "scap.h"
 #include "dumper.h"
+#include "sharded_inspector.h"
+
+//
+// Number of events the writer thread writes before releasing the dumper
+//
+#define DUMPER_ASYNC_BATCH 256
 
 sinsp_dumper::sinsp_dumper(sinsp* inspector)
 {
@@ -27,6 +33,22 @@ sinsp_dumper::sinsp_dumper(sinsp* inspector)
 	m_target_memory_buffer = NULL;
 	m_target_memory_buffer_size = 0;
 	m_nevts = 0;
+	m_event_block_size = 0;
+	m_index_interval = 0;
+	m_checkpoint_interval = 0;
+	m_checkpoint_bytes = 0;
+	m_async_queue_size = 0;
+	m_async_policy = ASYNC_BLOCK;
+	m_async_running = false;
+	m_async_failed = false;
+	m_async_writer_waiting = false;
+	m_async_producers_waiting = 0;
+	m_async_written = 0;
+	m_async_dropped = 0;
+	m_async_full_waits = 0;
+	m_async_reported_written = 0;
+	m_async_reported_dropped = 0;
+	m_async_reported_full_waits = 0;
 }
 
 sinsp_dumper::sinsp_dumper(sinsp* inspector, uint8_t* target_memory_buffer, uint64_t target_memory_buffer_size)
@@ -35,17 +57,36 @@ sinsp_dumper::sinsp_dumper(sinsp* inspector, uint8_t* target_memory_buffer, uint
 	m_dumper = NULL;
 	m_target_memory_buffer = target_memory_buffer;
 	m_target_memory_buffer_size = target_memory_buffer_size;
+	m_nevts = 0;
+	m_event_block_size = 0;
+	m_index_interval = 0;
+	m_checkpoint_interval = 0;
+	m_checkpoint_bytes = 0;
+	m_async_queue_size = 0;
+	m_async_policy = ASYNC_BLOCK;
+	m_async_running = false;
+	m_async_failed = false;
+	m_async_writer_waiting = false;
+	m_async_producers_waiting = 0;
+	m_async_written = 0;
+	m_async_dropped = 0;
+	m_async_full_waits = 0;
+	m_async_reported_written = 0;
+	m_async_reported_dropped = 0;
+	m_async_reported_full_waits = 0;
 }
 
 sinsp_dumper::~sinsp_dumper()
 {
-	if(m_dumper != NULL)
-	{
-		scap_dump_close(m_dumper);
-	}
+	close();
 }
 
 void sinsp_dumper::open(const string& filename, bool compress, bool threads_from_sinsp)
+{
+	open(filename, compress ? SCAP_COMPRESSION_GZIP : SCAP_COMPRESSION_NONE, threads_from_sinsp);
+}
+
+void sinsp_dumper::open(const string& filename, compression_mode compress, bool threads_from_sinsp)
 {
 	if(m_inspector->m_h == NULL)
 	{
@@ -58,14 +99,7 @@ void sinsp_dumper::open(const string& filename, bool compress, bool threads_from
 	}
 	else
 	{
-		if(compress)
-		{
-			m_dumper = scap_dump_open(m_inspector->m_h, filename.c_str(), SCAP_COMPRESSION_GZIP, threads_from_sinsp);
-		}
-		else
-		{
-			m_dumper = scap_dump_open(m_inspector->m_h, filename.c_str(), SCAP_COMPRESSION_NONE, threads_from_sinsp);
-		}
+		m_dumper = scap_dump_open(m_inspector->m_h, filename.c_str(), compress, threads_from_sinsp);
 	}
 
 	if(m_dumper == NULL)
@@ -73,6 +107,8 @@ void sinsp_dumper::open(const string& filename, bool compress, bool threads_from
 		throw sinsp_exception(scap_getlasterr(m_inspector->m_h));
 	}
 
+	set_file_options(compress);
+
 	if(threads_from_sinsp)
 	{
 		m_inspector->m_thread_manager->dump_threads_to_file(m_dumper);
@@ -81,29 +117,32 @@ void sinsp_dumper::open(const string& filename, bool compress, bool threads_from
 	m_inspector->m_container_manager.dump_containers(m_dumper);
 
 	m_nevts = 0;
+	m_checkpoint_bytes = 0;
+
+	start_async();
 }
 
 void sinsp_dumper::fdopen(int fd, bool compress, bool threads_from_sinsp)
+{
+	fdopen(fd, compress ? SCAP_COMPRESSION_GZIP : SCAP_COMPRESSION_NONE, threads_from_sinsp);
+}
+
+void sinsp_dumper::fdopen(int fd, compression_mode compress, bool threads_from_sinsp)
 {
 	if(m_inspector->m_h == NULL)
 	{
 		throw sinsp_exception("can't start event dump, inspector not opened yet");
 	}
 
-	if(compress)
-	{
-		m_dumper = scap_dump_open_fd(m_inspector->m_h, fd, SCAP_COMPRESSION_GZIP, threads_from_sinsp);
-	}
-	else
-	{
-		m_dumper = scap_dump_open_fd(m_inspector->m_h, fd, SCAP_COMPRESSION_NONE, threads_from_sinsp);
-	}
+	m_dumper = scap_dump_open_fd(m_inspector->m_h, fd, compress, threads_from_sinsp);
 
 	if(m_dumper == NULL)
 	{
 		throw sinsp_exception(scap_getlasterr(m_inspector->m_h));
 	}
 
+	set_file_options(compress);
+
 	if(threads_from_sinsp)
 	{
 		m_inspector->m_thread_manager->dump_threads_to_file(m_dumper);
@@ -112,10 +151,241 @@ void sinsp_dumper::fdopen(int fd, bool compress, bool threads_from_sinsp)
 	m_inspector->m_container_manager.dump_containers(m_dumper);
 
 	m_nevts = 0;
+	m_checkpoint_bytes = 0;
+
+	start_async();
+}
+
+void sinsp_dumper::set_file_options(compression_mode compress)
+{
+	//
+	// Memory dumps are read as they are written, they never use blocks
+	// nor indexes
+	//
+	if(m_target_memory_buffer != NULL)
+	{
+		return;
+	}
+
+	if(m_event_block_size != 0 &&
+	   scap_dump_set_event_block_size(m_dumper, m_event_block_size) != SCAP_SUCCESS)
+	{
+		scap_dump_close(m_dumper);
+		m_dumper = NULL;
+		throw sinsp_exception("invalid event block size " + to_string(m_event_block_size));
+	}
+
+	if(m_checkpoint_interval != 0 && compress != SCAP_COMPRESSION_NONE)
+	{
+		scap_dump_close(m_dumper);
+		m_dumper = NULL;
+		throw sinsp_exception("checkpoints are not supported on compressed files");
+	}
+
+	if(m_index_interval != 0)
+	{
+		scap_dump_set_index_interval(m_dumper, m_index_interval);
+	}
+}
+
+void sinsp_dumper::checkpoint()
+{
+	if(m_dumper == NULL)
+	{
+		throw sinsp_exception("dumper not opened yet");
+	}
+
+	//
+	// The writer thread pops the events after writing them
+	//
+	if(m_async_queue)
+	{
+		async_wait([this] { return m_async_queue->empty(); });
+	}
+
+	std::lock_guard<std::mutex> lock(m_async_mutex);
+
+	//
+	// The process tables of the handle are stale, the ones of the
+	// inspector are written instead
+	//
+	if(scap_dump_checkpoint(m_inspector->m_h, m_dumper, false) != SCAP_SUCCESS)
+	{
+		throw sinsp_exception(scap_getlasterr(m_inspector->m_h));
+	}
+
+	m_inspector->m_thread_manager->dump_threads_to_file(m_dumper);
+	m_inspector->m_container_manager.dump_containers(m_dumper);
+
+	m_checkpoint_bytes = 0;
+}
+
+void sinsp_dumper::set_async(uint32_t queue_size, async_policy policy)
+{
+	if(queue_size != 0 && queue_size < MIN_ASYNC_QUEUE_SIZE)
+	{
+		throw sinsp_exception("dumper queue size too small");
+	}
+
+	m_async_queue_size = queue_size;
+	m_async_policy = policy;
+}
+
+void sinsp_dumper::start_async()
+{
+	stop_async();
+
+	if(m_async_queue_size == 0 || m_target_memory_buffer != NULL)
+	{
+		return;
+	}
+
+	m_async_queue.reset(new sinsp_event_queue(m_async_queue_size));
+	m_async_failed = false;
+	m_async_running = true;
+	m_async_thread = std::thread(&sinsp_dumper::async_loop, this);
+
+#ifdef GATHER_INTERNAL_STATS
+	m_inspector->add_async_dumper(this);
+#endif
+}
+
+void sinsp_dumper::stop_async()
+{
+	if(m_async_thread.joinable())
+	{
+		m_async_running.store(false, std::memory_order_release);
+
+		{
+			std::lock_guard<std::mutex> lock(m_async_wait_mutex);
+			m_async_data_cv.notify_one();
+		}
+
+		m_async_thread.join();
+
+#ifdef GATHER_INTERNAL_STATS
+		m_inspector->remove_async_dumper(this);
+#endif
+	}
+
+	m_async_queue.reset();
+}
+
+void sinsp_dumper::async_loop()
+{
+	scap_evt* evt;
+	uint16_t cpuid;
+	char error[SCAP_LASTERR_SIZE];
+
+	while(true)
+	{
+		//
+		// Sampled before draining, so that the events queued before
+		// stop_async() are all written
+		//
+		bool running = m_async_running.load(std::memory_order_acquire);
+		uint32_t n = 0;
+
+		{
+			std::lock_guard<std::mutex> lock(m_async_mutex);
+
+			while(n < DUMPER_ASYNC_BATCH && (evt = m_async_queue->front(&cpuid)) != NULL)
+			{
+				//
+				// After an error the events are discarded, so that
+				// dump() never waits forever
+				//
+				if(!m_async_failed.load(std::memory_order_relaxed))
+				{
+					if(scap_dump_errbuf(m_dumper, evt, cpuid, 0, error) == SCAP_SUCCESS)
+					{
+						m_async_written.fetch_add(1, std::memory_order_relaxed);
+					}
+					else
+					{
+						m_async_error = error;
+						m_async_failed.store(true, std::memory_order_release);
+					}
+				}
+
+				m_async_queue->pop();
+				n++;
+			}
+		}
+
+		if(n != 0)
+		{
+			//
+			// Pairs with the fence of async_wait(): either the waiting
+			// thread sees the popped events, or this one sees the flag
+			//
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+
+			if(m_async_producers_waiting.load(std::memory_order_relaxed) != 0)
+			{
+				std::lock_guard<std::mutex> lock(m_async_wait_mutex);
+				m_async_room_cv.notify_all();
+			}
+			continue;
+		}
+
+		if(!running)
+		{
+			break;
+		}
+
+		std::unique_lock<std::mutex> lock(m_async_wait_mutex);
+
+		m_async_writer_waiting.store(true, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		while(m_async_queue->empty() && m_async_running.load(std::memory_order_acquire))
+		{
+			m_async_data_cv.wait(lock);
+		}
+
+		m_async_writer_waiting.store(false, std::memory_order_relaxed);
+	}
+}
+
+void sinsp_dumper::async_wait(const std::function<bool()>& done)
+{
+	std::unique_lock<std::mutex> lock(m_async_wait_mutex);
+
+	m_async_producers_waiting.fetch_add(1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	//
+	// The writer thread notifies while holding the mutex, so it can't do it
+	// between the check and the wait
+	//
+	while(!done())
+	{
+		m_async_room_cv.wait(lock);
+	}
+
+	m_async_producers_waiting.fetch_sub(1, std::memory_order_relaxed);
+}
+
+uint64_t sinsp_dumper::get_num_async_written_events() const
+{
+	return m_async_written.load(std::memory_order_relaxed);
+}
+
+uint64_t sinsp_dumper::get_num_async_dropped_events() const
+{
+	return m_async_dropped.load(std::memory_order_relaxed);
+}
+
+uint64_t sinsp_dumper::get_num_async_queue_full_waits() const
+{
+	return m_async_full_waits.load(std::memory_order_relaxed);
 }
 
 void sinsp_dumper::close()
 {
+	stop_async();
+
 	if(m_dumper != NULL)
 	{
 		scap_dump_close(m_dumper);
@@ -142,15 +412,69 @@ void sinsp_dumper::dump(sinsp_evt* evt)
 
 	scap_evt* pdevt = (evt->m_poriginal_evt)? evt->m_poriginal_evt : evt->m_pevt;
 
-	int32_t res = scap_dump(m_inspector->m_h,
-		m_dumper, pdevt, evt->m_cpuid, 0);
+	if(m_async_queue)
+	{
+		if(m_async_failed.load(std::memory_order_acquire))
+		{
+			throw sinsp_exception(m_async_error);
+		}
+
+		//
+		// Events that could never find room in a fragmented queue are
+		// dropped whatever the policy
+		//
+		if(pdevt->len > m_async_queue_size / 2)
+		{
+			m_async_dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		if(!m_async_queue->push(pdevt, evt->m_cpuid))
+		{
+			m_async_full_waits.fetch_add(1, std::memory_order_relaxed);
+
+			if(m_async_policy == ASYNC_DROP)
+			{
+				m_async_dropped.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+
+			async_wait([this, pdevt, evt] { return m_async_queue->push(pdevt, evt->m_cpuid); });
+		}
+
+		//
+		// Pairs with the fence of the writer thread before it waits
+		//
+		std::atomic_thread_fence(std::memory_order_seq_cst);
 
-	if(res != SCAP_SUCCESS)
+		if(m_async_writer_waiting.load(std::memory_order_relaxed))
+		{
+			std::lock_guard<std::mutex> lock(m_async_wait_mutex);
+			m_async_data_cv.notify_one();
+		}
+	}
+	else
 	{
-		throw sinsp_exception(scap_getlasterr(m_inspector->m_h));
+		int32_t res = scap_dump(m_inspector->m_h,
+			m_dumper, pdevt, evt->m_cpuid, 0);
+
+		if(res != SCAP_SUCCESS)
+		{
+			throw sinsp_exception(scap_getlasterr(m_inspector->m_h));
+		}
 	}
 
 	m_nevts++;
+
+	if(m_checkpoint_interval != 0 && m_target_memory_buffer == NULL)
+	{
+		m_checkpoint_bytes += pdevt->len;
+
+		if(m_checkpoint_bytes >= m_checkpoint_interval)
+		{
+			checkpoint();
+		}
+	}
 }
 
 uint64_t sinsp_dumper::written_bytes()
@@ -160,6 +484,8 @@ uint64_t sinsp_dumper::written_bytes()
 		return 0;
 	}
 
+	std::lock_guard<std::mutex> lock(m_async_mutex);
+
 	int64_t written_bytes = scap_dump_get_offset(m_dumper);
 	if(written_bytes == -1)
 	{
@@ -176,6 +502,8 @@ uint64_t sinsp_dumper::next_write_position()
 		return 0;
 	}
 
+	std::lock_guard<std::mutex> lock(m_async_mutex);
+
 	int64_t position = scap_dump_ftell(m_dumper);
 	if(position == -1)
 	{
@@ -192,5 +520,14 @@ void sinsp_dumper::flush()
 		throw sinsp_exception("dumper not opened yet");
 	}
 
+	//
+	// The writer thread pops the events after writing them
+	//
+	if(m_async_queue)
+	{
+		async_wait([this] { return m_async_queue->empty(); });
+	}
+
+	std::lock_guard<std::mutex> lock(m_async_mutex);
 	scap_dump_flush(m_dumper);
 }
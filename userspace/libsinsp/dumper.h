@@ -17,8 +17,21 @@ limitations under the License.
 
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#ifndef VISIBILITY_PRIVATE
+#define VISIBILITY_PRIVATE private:
+#endif
+
 class sinsp;
 class sinsp_evt;
+class sinsp_event_queue;
 
 /** @defgroup dump Dumping events to disk
  * Classes to perform miscellaneous functionality
@@ -72,6 +85,18 @@ public:
 		    bool compress,
 		    bool threads_from_sinsp=false);
 
+	/*!
+	  \brief Same as open(), with the given compression codec. The zstd and
+	  lz4 codecs require libscap to be built with them.
+	*/
+	void open(const string& filename,
+		compression_mode compress,
+		bool threads_from_sinsp=false);
+
+	void fdopen(int fd,
+		    compression_mode compress,
+		    bool threads_from_sinsp=false);
+
 	/*!
 	  \brief Closes the dump file.
 	*/
@@ -126,12 +151,135 @@ public:
 		m_inspector = inspector;
 	}
 
-private:
+	/*!
+	  \brief Write the events in blocks of up to size bytes instead of one
+	  block per event, see scap_dump_set_event_block_size(). Applies to the
+	  files opened from now on. 0, the default, disables it.
+	*/
+	inline void set_event_block_size(uint32_t size)
+	{
+		m_event_block_size = size;
+	}
+
+	/*!
+	  \brief Write a timestamp index at the end of the file, with an entry
+	  every interval bytes, see scap_dump_set_index_interval() and
+	  sinsp::seek_ts(). Applies to the files opened from now on. 0, the
+	  default, disables it. Seeking is only cheap in uncompressed files.
+	*/
+	inline void set_index_interval(uint64_t interval)
+	{
+		m_index_interval = interval;
+	}
+
+	/*!
+	  \brief Write a checkpoint: a new section of the file with the current
+	  thread, fd and container tables of the inspector, from which the
+	  following events can be replayed without the previous part of the
+	  file, see scap_dump_checkpoint() and sinsp_parallel_replay. Not
+	  supported by memory dumps and compressed files.
+
+	  \note In async mode it waits for the queue to be drained, since the
+	   tables reflect the queued events.
+	*/
+	void checkpoint();
+
+	/*!
+	  \brief Make dump() write a checkpoint after every interval bytes of
+	  events. 0, the default, disables it. Memory dumps ignore it, and
+	  open() fails for compressed files.
+	*/
+	inline void set_checkpoint_interval(uint64_t interval)
+	{
+		m_checkpoint_interval = interval;
+	}
+
+	enum async_policy
+	{
+		ASYNC_BLOCK, ///< dump() waits for room in the queue.
+		ASYNC_DROP, ///< dump() drops the event.
+	};
+
+	/*!
+	  \brief Queue the events passed to dump() to a writer thread, which
+	  compresses and writes them, instead of writing them on the calling
+	  thread. policy tells what dump() does when the queue is full. Applies
+	  to the files opened from now on, except memory dumps. A queue_size of
+	  0, the default, disables it.
+
+	  \note In async mode written_bytes() and next_write_position() don't
+	   account for the queued events, and flush() waits for the queue to be
+	   drained. A write error is reported by the next dump() call.
+	*/
+	void set_async(uint32_t queue_size, async_policy policy = ASYNC_BLOCK);
+
+	//
+	// Async mode counters: events written by the writer thread, events
+	// dropped because the queue was full (or the event didn't fit in it),
+	// and number of times dump() found the queue full.
+	//
+	// With GATHER_INTERNAL_STATS they are also published, summed over the
+	// dumpers of the inspector, as the dumper_async_* counters of its
+	// internal_metrics registry. They are read on the capture thread when
+	// sinsp::get_stats() is called, and one last time when the writer thread
+	// is stopped, so an async dumper must be closed before its inspector is
+	// destroyed.
+	//
+	uint64_t get_num_async_written_events() const;
+	uint64_t get_num_async_dropped_events() const;
+	uint64_t get_num_async_queue_full_waits() const;
+
+	static const uint32_t MIN_ASYNC_QUEUE_SIZE = 1024 * 1024;
+
+VISIBILITY_PRIVATE
+	void set_file_options(compression_mode compress);
+	void start_async();
+	void stop_async();
+	void async_loop();
+	// Wait until done() is true, checking it again every time the writer
+	// thread pops events
+	void async_wait(const std::function<bool()>& done);
+
 	sinsp* m_inspector;
 	scap_dumper_t* m_dumper;
 	uint8_t* m_target_memory_buffer;
 	uint64_t m_target_memory_buffer_size;
 	uint64_t m_nevts;
+	uint32_t m_event_block_size;
+	uint64_t m_index_interval;
+	uint64_t m_checkpoint_interval;
+	// Bytes of events dumped since the latest checkpoint
+	uint64_t m_checkpoint_bytes;
+
+	uint32_t m_async_queue_size;
+	async_policy m_async_policy;
+	std::unique_ptr<sinsp_event_queue> m_async_queue;
+	std::thread m_async_thread;
+	std::atomic<bool> m_async_running;
+	// Held by the writer thread while it writes to m_dumper
+	std::mutex m_async_mutex;
+	std::atomic<bool> m_async_failed;
+	// Set by the writer thread, which has its own error buffer since the
+	// one of the handle belongs to the capture thread
+	std::string m_async_error;
+	// The writer thread waits for events on m_async_data_cv, dump(),
+	// flush() and checkpoint() wait for it to pop events on
+	// m_async_room_cv. The waiting flag and count tell the other side to
+	// notify.
+	std::mutex m_async_wait_mutex;
+	std::condition_variable m_async_data_cv;
+	std::condition_variable m_async_room_cv;
+	std::atomic<bool> m_async_writer_waiting;
+	std::atomic<uint32_t> m_async_producers_waiting;
+	std::atomic<uint64_t> m_async_written;
+	std::atomic<uint64_t> m_async_dropped;
+	std::atomic<uint64_t> m_async_full_waits;
+	// Values of the counters already added to the metrics of the inspector
+	uint64_t m_async_reported_written;
+	uint64_t m_async_reported_dropped;
+	uint64_t m_async_reported_full_waits;
+
+	friend class sinsp;
 };
 
 /*@}*/
@@ -157,6 +157,231 @@ void sinsp_evt_formatter::set_format(const string& fmt)
 		m_chks_to_free.push_back(chk);
 		m_tokenlens.push_back(0);
 	}
+
+	compile_plan();
+}
+
+static inline void append_uint(OUT string* res, uint64_t val)
+{
+	char buf[24];
+	char* p = buf + sizeof(buf);
+
+	do
+	{
+		*--p = (char)('0' + val % 10);
+		val /= 10;
+	} while(val != 0);
+
+	res->append(p, buf + sizeof(buf) - p);
+}
+
+static inline void append_int(OUT string* res, int64_t val)
+{
+	if(val < 0)
+	{
+		res->push_back('-');
+		append_uint(res, 0 - (uint64_t)val);
+	}
+	else
+	{
+		append_uint(res, (uint64_t)val);
+	}
+}
+
+static inline int64_t load_signed(const uint8_t* rawval, uint32_t size)
+{
+	switch(size)
+	{
+	case 1:
+		return *(int8_t*)rawval;
+	case 2:
+		return *(int16_t*)rawval;
+	case 4:
+		return *(int32_t*)rawval;
+	default:
+		return *(int64_t*)rawval;
+	}
+}
+
+static inline uint64_t load_unsigned(const uint8_t* rawval, uint32_t size)
+{
+	switch(size)
+	{
+	case 1:
+		return *(uint8_t*)rawval;
+	case 2:
+		return *(uint16_t*)rawval;
+	case 4:
+		return *(uint32_t*)rawval;
+	default:
+		return *(uint64_t*)rawval;
+	}
+}
+
+static void append_json_string(OUT string* res, const char* str)
+{
+	static const char hex[] = "0123456789abcdef";
+
+	res->push_back('"');
+
+	for(const char* p = str; *p != 0; p++)
+	{
+		unsigned char c = (unsigned char)*p;
+
+		switch(c)
+		{
+		case '"':
+			res->append("\\\"", 2);
+			break;
+		case '\\':
+			res->append("\\\\", 2);
+			break;
+		case '\b':
+			res->append("\\b", 2);
+			break;
+		case '\f':
+			res->append("\\f", 2);
+			break;
+		case '\n':
+			res->append("\\n", 2);
+			break;
+		case '\r':
+			res->append("\\r", 2);
+			break;
+		case '\t':
+			res->append("\\t", 2);
+			break;
+		default:
+			if(c < 0x20)
+			{
+				char esc[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf]};
+				res->append(esc, sizeof(esc));
+			}
+			else
+			{
+				res->push_back((char)c);
+			}
+			break;
+		}
+	}
+
+	res->push_back('"');
+}
+
+void sinsp_evt_formatter::compile_plan()
+{
+	uint32_t j;
+	vector<pair<string, plan_item>> fields;
+
+	m_text_plan.clear();
+	m_json_plan.clear();
+
+	for(j = 0; j < m_tokens.size(); j++)
+	{
+		plan_item item;
+		rawstring_check* raw = dynamic_cast<rawstring_check*>(m_tokens[j].second);
+
+		item.m_check = m_tokens[j].second;
+		item.m_width = m_tokenlens[j];
+		item.m_size = 0;
+
+		if(raw != NULL)
+		{
+			item.m_emitter = EM_LITERAL;
+			item.m_text = raw->m_text;
+			m_text_plan.push_back(item);
+			continue;
+		}
+
+		//
+		// The integers printed in decimal are written by the formatter in
+		// both outputs, the other representations are left to the check
+		//
+		const filtercheck_field_info* field = item.m_check->m_field;
+
+		item.m_emitter = EM_GENERIC;
+
+		switch(field->m_type)
+		{
+		case PT_INT8:
+			item.m_emitter = EM_SIGNED;
+			item.m_size = sizeof(int8_t);
+			break;
+		case PT_INT16:
+			item.m_emitter = EM_SIGNED;
+			item.m_size = sizeof(int16_t);
+			break;
+		case PT_INT32:
+			item.m_emitter = EM_SIGNED;
+			item.m_size = sizeof(int32_t);
+			break;
+		case PT_INT64:
+		case PT_PID:
+			item.m_emitter = EM_SIGNED;
+			item.m_size = sizeof(int64_t);
+			break;
+		case PT_L4PROTO:
+		case PT_UINT8:
+			item.m_emitter = EM_UNSIGNED;
+			item.m_size = sizeof(uint8_t);
+			break;
+		case PT_PORT:
+		case PT_UINT16:
+			item.m_emitter = EM_UNSIGNED;
+			item.m_size = sizeof(uint16_t);
+			break;
+		case PT_UINT32:
+			item.m_emitter = EM_UNSIGNED;
+			item.m_size = sizeof(uint32_t);
+			break;
+		case PT_UINT64:
+		case PT_RELTIME:
+		case PT_ABSTIME:
+			item.m_emitter = EM_UNSIGNED;
+			item.m_size = sizeof(uint64_t);
+			break;
+		case PT_CHARBUF:
+		case PT_FSPATH:
+		case PT_FSRELPATH:
+			item.m_emitter = EM_STRING;
+			break;
+		case PT_BOOL:
+			item.m_emitter = EM_BOOL;
+			break;
+		default:
+			break;
+		}
+
+		if((item.m_emitter == EM_SIGNED || item.m_emitter == EM_UNSIGNED) &&
+		   field->m_print_format != PF_DEC && field->m_print_format != PF_ID)
+		{
+			item.m_emitter = EM_GENERIC;
+			item.m_size = 0;
+		}
+
+		m_text_plan.push_back(item);
+		fields.push_back(make_pair(m_tokens[j].first, item));
+	}
+
+	//
+	// Json::Value keeps the keys of an object sorted, and every field
+	// appears only once
+	//
+	stable_sort(fields.begin(), fields.end(),
+		    [](const pair<string, plan_item>& a, const pair<string, plan_item>& b) { return a.first < b.first; });
+
+	for(j = 0; j < fields.size(); j++)
+	{
+		if(j > 0 && fields[j].first == fields[j - 1].first)
+		{
+			continue;
+		}
+
+		fields[j].second.m_text.clear();
+		append_json_string(&fields[j].second.m_text, fields[j].first.c_str());
+		fields[j].second.m_text.push_back(':');
+		m_json_plan.push_back(fields[j].second);
+	}
 }
 
 bool sinsp_evt_formatter::on_capture_end(OUT string* res)
@@ -290,6 +515,208 @@ bool sinsp_evt_formatter::tostring(sinsp_evt* evt, OUT string* res)
 	return retval;
 }
 
+void sinsp_evt_formatter::render_json_value(const Json::Value& val, OUT string* res)
+{
+	switch(val.type())
+	{
+	case Json::nullValue:
+		res->append("null");
+		break;
+	case Json::intValue:
+		append_int(res, val.asLargestInt());
+		break;
+	case Json::uintValue:
+		append_uint(res, val.asLargestUInt());
+		break;
+	case Json::booleanValue:
+		res->append(val.asBool() ? "true" : "false");
+		break;
+	case Json::stringValue:
+		append_json_string(res, val.asCString());
+		break;
+	default:
+	{
+		//
+		// Doubles, arrays and objects are rare enough to be left to jsoncpp
+		//
+		string str = m_writer.write(val);
+		res->append(str, 0, str.size() - 1);
+		break;
+	}
+	}
+}
+
+bool sinsp_evt_formatter::render_text(sinsp_evt* evt, const plan_item& item, OUT string* res)
+{
+	uint32_t len;
+	uint8_t* rawval = item.m_check->extract(evt, &len);
+
+	if(rawval == NULL)
+	{
+		return false;
+	}
+
+	switch(item.m_emitter)
+	{
+	case EM_SIGNED:
+		append_int(res, load_signed(rawval, item.m_size));
+		return true;
+	case EM_UNSIGNED:
+		append_uint(res, load_unsigned(rawval, item.m_size));
+		return true;
+	case EM_STRING:
+		res->append((char*)rawval);
+		return true;
+	case EM_BOOL:
+		res->append(*(uint32_t*)rawval != 0 ? "true" : "false");
+		return true;
+	default:
+	{
+		const filtercheck_field_info* field = item.m_check->m_field;
+		char* str = item.m_check->rawval_to_string(rawval, field->m_type, field->m_print_format, len);
+
+		if(str == NULL)
+		{
+			return false;
+		}
+
+		res->append(str);
+		return true;
+	}
+	}
+}
+
+bool sinsp_evt_formatter::render_json(sinsp_evt* evt, const plan_item& item, OUT string* res)
+{
+	uint32_t len;
+
+	//
+	// Same order as sinsp_filter_check::tojson(): the checks that have
+	// their own JSON representation first
+	//
+	Json::Value jsonval = item.m_check->extract_as_js(evt, &len);
+
+	if(jsonval != Json::nullValue)
+	{
+		render_json_value(jsonval, res);
+		return true;
+	}
+
+	uint8_t* rawval = item.m_check->extract(evt, &len);
+
+	if(rawval == NULL)
+	{
+		return false;
+	}
+
+	switch(item.m_emitter)
+	{
+	case EM_SIGNED:
+		append_int(res, load_signed(rawval, item.m_size));
+		return true;
+	case EM_UNSIGNED:
+		append_uint(res, load_unsigned(rawval, item.m_size));
+		return true;
+	case EM_STRING:
+		append_json_string(res, (char*)rawval);
+		return true;
+	case EM_BOOL:
+		res->append(*(uint32_t*)rawval != 0 ? "true" : "false");
+		return true;
+	default:
+	{
+		const filtercheck_field_info* field = item.m_check->m_field;
+		jsonval = item.m_check->rawval_to_json(rawval, field->m_type, field->m_print_format, len);
+
+		if(jsonval == Json::nullValue)
+		{
+			return false;
+		}
+
+		render_json_value(jsonval, res);
+		return true;
+	}
+	}
+}
+
+bool sinsp_evt_formatter::render(sinsp_evt* evt, OUT string* res)
+{
+	sinsp_evt::param_fmt fmt = m_inspector->get_buffer_format();
+
+	res->clear();
+
+	if(fmt == sinsp_evt::PF_JSON
+	   || fmt == sinsp_evt::PF_JSONEOLS
+	   || fmt == sinsp_evt::PF_JSONHEX
+	   || fmt == sinsp_evt::PF_JSONHEXASCII
+	   || fmt == sinsp_evt::PF_JSONBASE64)
+	{
+		//
+		// Like the empty Json::Value written by tostring()
+		//
+		if(m_json_plan.empty())
+		{
+			res->append("null");
+			return true;
+		}
+
+		res->push_back('{');
+
+		for(uint32_t j = 0; j < m_json_plan.size(); j++)
+		{
+			const plan_item& item = m_json_plan[j];
+
+			if(j != 0)
+			{
+				res->push_back(',');
+			}
+
+			res->append(item.m_text);
+
+			if(!render_json(evt, item, res))
+			{
+				if(m_require_all_values)
+				{
+					return false;
+				}
+
+				res->append("null");
+			}
+		}
+
+		res->push_back('}');
+		return true;
+	}
+
+	for(const plan_item& item : m_text_plan)
+	{
+		if(item.m_emitter == EM_LITERAL)
+		{
+			res->append(item.m_text);
+			continue;
+		}
+
+		size_t start = res->size();
+
+		if(!render_text(evt, item, res))
+		{
+			if(m_require_all_values)
+			{
+				return false;
+			}
+
+			res->append("<NA>");
+		}
+
+		if(item.m_width != 0)
+		{
+			res->resize(start + item.m_width, ' ');
+		}
+	}
+
+	return true;
+}
+
 #else  // HAS_FILTERING
 
 sinsp_evt_formatter::sinsp_evt_formatter(sinsp* inspector, const string& fmt)
@@ -310,37 +737,254 @@ bool sinsp_evt_formatter::tostring(sinsp_evt* evt, OUT string* res)
 {
 	throw sinsp_exception("sinsp_evt_formatter unavailable because it was not compiled in the library");
 }
+
+bool sinsp_evt_formatter::render(sinsp_evt* evt, OUT string* res)
+{
+	throw sinsp_exception("sinsp_evt_formatter unavailable because it was not compiled in the library");
+}
 #endif // HAS_FILTERING
 
-sinsp_evt_formatter_cache::sinsp_evt_formatter_cache(sinsp *inspector)
+sinsp_evt_formatter_cache::sinsp_evt_formatter_cache(sinsp *inspector, uint32_t nslots)
 	: m_inspector(inspector)
 {
+	m_nsets = (nslots + SLOT_WAYS - 1) / SLOT_WAYS;
+	if(m_nsets == 0)
+	{
+		m_nsets = 1;
+	}
+
+	m_slots.reset(new slot[m_nsets * SLOT_WAYS]);
+	m_lookup.reset(new std::atomic<const registered_format *>[LOOKUP_SIZE]);
+
+	for(uint32_t j = 0; j < m_nsets * SLOT_WAYS; j++)
+	{
+		m_slots[j].m_entry.store(NULL, std::memory_order_relaxed);
+		m_slots[j].m_id.store(0, std::memory_order_relaxed);
+	}
+
+	for(uint32_t j = 0; j < LOOKUP_SIZE; j++)
+	{
+		m_lookup[j].store(NULL, std::memory_order_relaxed);
+	}
 }
 
 sinsp_evt_formatter_cache::~sinsp_evt_formatter_cache()
 {
+	for(uint32_t j = 0; j < m_nsets * SLOT_WAYS; j++)
+	{
+		delete m_slots[j].m_entry.load(std::memory_order_relaxed);
+	}
+}
+
+sinsp_evt_formatter_cache::format_id sinsp_evt_formatter_cache::register_format(const string &format)
+{
+	std::lock_guard<std::mutex> lock(m_formats_mutex);
+
+	auto it = m_format_ids.find(format);
+	if(it != m_format_ids.end())
+	{
+		return it->second;
+	}
+
+	format_id id = (format_id)m_formats.size();
+
+	//
+	// Build the first formatter right away, so that an invalid format
+	// throws here and doesn't get an id
+	//
+	entry *e = new entry(m_inspector, id, format);
+
+	m_formats.emplace_back(new registered_format(format, id));
+	m_format_ids.emplace(format, id);
+
+	uint32_t pos = std::hash<std::string>()(format) % LOOKUP_SIZE;
+	for(uint32_t j = 0; j < LOOKUP_SIZE; j++)
+	{
+		if(m_lookup[pos].load(std::memory_order_relaxed) == NULL)
+		{
+			m_lookup[pos].store(m_formats.back().get(), std::memory_order_release);
+			break;
+		}
+		pos = (pos + 1) % LOOKUP_SIZE;
+	}
+
+	release(e);
+
+	return id;
+}
+
+sinsp_evt_formatter_cache::format_id sinsp_evt_formatter_cache::lookup_format(const string &format)
+{
+	uint32_t pos = std::hash<std::string>()(format) % LOOKUP_SIZE;
+
+	for(uint32_t j = 0; j < LOOKUP_SIZE; j++)
+	{
+		const registered_format *f = m_lookup[pos].load(std::memory_order_acquire);
+
+		if(f == NULL)
+		{
+			break;
+		}
+
+		if(f->m_format == format)
+		{
+			return f->m_id;
+		}
+		pos = (pos + 1) % LOOKUP_SIZE;
+	}
+
+	return register_format(format);
+}
+
+sinsp_evt_formatter_cache::entry *sinsp_evt_formatter_cache::acquire(format_id id)
+{
+	slot *set = slot_set(id);
+
+	for(uint32_t j = 0; j < SLOT_WAYS; j++)
+	{
+		if(set[j].m_id.load(std::memory_order_acquire) != id ||
+		   set[j].m_entry.load(std::memory_order_relaxed) == NULL)
+		{
+			continue;
+		}
+
+		entry *e = set[j].m_entry.exchange(NULL, std::memory_order_acq_rel);
+
+		if(e == NULL)
+		{
+			continue;
+		}
+
+		if(e->m_id == id)
+		{
+			return e;
+		}
+
+		//
+		// The slot was refilled with another id in the meantime
+		//
+		release(e);
+	}
+
+	//
+	// Evicted, or in use by other threads
+	//
+	std::lock_guard<std::mutex> lock(m_formats_mutex);
+
+	if(id >= m_formats.size())
+	{
+		throw sinsp_exception("unknown format id " + to_string(id));
+	}
+
+	return new entry(m_inspector, id, m_formats[id]->m_format);
+}
+
+void sinsp_evt_formatter_cache::release(entry *e)
+{
+	slot *set = slot_set(e->m_id);
+
+	//
+	// Prefer an empty slot, then evict the formatter of another id. The
+	// id is set once the slot is ours, acquire() checks it again anyway.
+	//
+	for(uint32_t j = 0; j < SLOT_WAYS; j++)
+	{
+		entry *expected = NULL;
+
+		if(set[j].m_entry.compare_exchange_strong(expected, e, std::memory_order_acq_rel))
+		{
+			set[j].m_id.store(e->m_id, std::memory_order_release);
+			return;
+		}
+	}
+
+	for(uint32_t j = 0; j < SLOT_WAYS; j++)
+	{
+		if(set[j].m_id.load(std::memory_order_acquire) == e->m_id)
+		{
+			continue;
+		}
+
+		entry *victim = set[j].m_entry.load(std::memory_order_acquire);
+
+		if(victim != NULL &&
+		   set[j].m_entry.compare_exchange_strong(victim, e, std::memory_order_acq_rel))
+		{
+			set[j].m_id.store(e->m_id, std::memory_order_release);
+			delete victim;
+			return;
+		}
+	}
+
+	//
+	// The set is full of formatters of this id already
+	//
+	delete e;
+}
+
+bool sinsp_evt_formatter_cache::resolve_tokens(sinsp_evt *evt, format_id id, map<string,string>& values)
+{
+	entry *e = acquire(id);
+	bool res;
+
+	try
+	{
+		res = e->m_formatter.resolve_tokens(evt, values);
+	}
+	catch(...)
+	{
+		release(e);
+		throw;
+	}
+
+	release(e);
+	return res;
 }
 
-std::shared_ptr<sinsp_evt_formatter>& sinsp_evt_formatter_cache::get_cached_formatter(string &format)
+bool sinsp_evt_formatter_cache::tostring(sinsp_evt *evt, format_id id, OUT string *res)
 {
-	auto it = m_formatter_cache.lower_bound(format);
+	entry *e = acquire(id);
+	bool ret;
 
-	if(it == m_formatter_cache.end() ||
-	   it->first != format)
+	try
+	{
+		ret = e->m_formatter.tostring(evt, res);
+	}
+	catch(...)
+	{
+		release(e);
+		throw;
+	}
+
+	release(e);
+	return ret;
+}
+
+bool sinsp_evt_formatter_cache::render(sinsp_evt *evt, format_id id, OUT string *res)
+{
+	entry *e = acquire(id);
+	bool ret;
+
+	try
+	{
+		ret = e->m_formatter.render(evt, res);
+	}
+	catch(...)
 	{
-		it = m_formatter_cache.emplace_hint(it,
-						    std::make_pair(format, make_shared<sinsp_evt_formatter>(m_inspector, format)));
+		release(e);
+		throw;
 	}
 
-	return it->second;
+	release(e);
+	return ret;
 }
 
 bool sinsp_evt_formatter_cache::resolve_tokens(sinsp_evt *evt, string &format, map<string,string>& values)
 {
-	return get_cached_formatter(format)->resolve_tokens(evt, values);
+	return resolve_tokens(evt, lookup_format(format), values);
 }
 
 bool sinsp_evt_formatter_cache::tostring(sinsp_evt *evt, string &format, OUT string *res)
 {
-	return get_cached_formatter(format)->tostring(evt, res);
+	return tostring(evt, lookup_format(format), res);
 }
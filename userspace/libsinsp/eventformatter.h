@@ -16,6 +16,10 @@ limitations under the License.
 */
 
 #pragma once
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <json/json.h>
 
 class sinsp_filter_check;
@@ -68,6 +72,25 @@ public:
 	*/
 	bool tostring(sinsp_evt* evt, OUT string* res);
 
+	/*!
+	  \brief Fills res with the rendering of the event, like tostring(), by
+	  running the output plan compiled when the format was set.
+
+	  Every field is extracted once and written straight into res, which is
+	  cleared but keeps its capacity: once it has grown to the size of the
+	  output, rendering an event doesn't allocate memory. The JSON output
+	  has the same keys, in the same order, and the same values as the one
+	  of tostring(), but the strings are escaped by the formatter rather
+	  than by jsoncpp.
+
+	  \param evt Pointer to the event to be converted into string.
+	  \param res Pointer to the string that will be filled with the result.
+
+	  \return true if the string should be shown (based on the initial *),
+	   false otherwise, in which case res is incomplete.
+	*/
+	bool render(sinsp_evt* evt, OUT string* res);
+
 	/*!
 	  \brief Fills res with end of capture string rendering of the event.
 	  \param res Pointer to the string that will be filled with the result.
@@ -78,7 +101,38 @@ public:
 	bool on_capture_end(OUT string* res);
 
 private:
+	//
+	// How an element of the output plan is written: a literal, or a field
+	// written according to its type, chosen when the format is parsed
+	//
+	enum emitter
+	{
+		EM_LITERAL,
+		EM_SIGNED,
+		EM_UNSIGNED,
+		EM_STRING,
+		EM_BOOL,
+		// Through rawval_to_string() and rawval_to_json()
+		EM_GENERIC,
+	};
+
+	struct plan_item
+	{
+		emitter m_emitter;
+		// Size of the value of EM_SIGNED and EM_UNSIGNED
+		uint32_t m_size;
+		// Width of the field in the text output, 0 if not set
+		uint32_t m_width;
+		// The literal, or the quoted key followed by ':' in the JSON plan
+		string m_text;
+		sinsp_filter_check* m_check;
+	};
+
 	void set_format(const string& fmt);
+	void compile_plan();
+	bool render_text(sinsp_evt* evt, const plan_item& item, OUT string* res);
+	bool render_json(sinsp_evt* evt, const plan_item& item, OUT string* res);
+	void render_json_value(const Json::Value& val, OUT string* res);
 
 	// vector of (full string of the token, filtercheck) pairs
 	// e.g. ("proc.aname[2], ptr to sinsp_filter_check_thread)
@@ -90,6 +144,11 @@ private:
 
 	Json::Value m_root;
 	Json::FastWriter m_writer;
+
+	// Every token in the order of the format
+	vector<plan_item> m_text_plan;
+	// The fields only, in the order of the keys of the JSON output
+	vector<plan_item> m_json_plan;
 };
 
 /*!
@@ -97,29 +156,119 @@ private:
   This class is a wrapper around sinsp_evt_formatter, maintaining a
   cache of previously seen formatters. It avoids the overhead of
   recreating sinsp_evt_formatter objects for each event.
+
+  A format is registered once with register_format(), which returns an
+  integer id, and the id is then used to format the events without
+  hashing or comparing the format string.
+
+  The formatters are kept in a fixed number of slots, organized in sets
+  of SLOT_WAYS: the formatters of an id live in the set the id maps to,
+  and when the set is full the formatter of another id is evicted. The
+  slots are accessed with atomic operations only, so the formatting
+  methods can be called concurrently by several threads. A formatter is
+  taken out of its slot while it's in use, so a thread never shares it
+  with another one: two threads formatting with the same id concurrently
+  use two formatters, which can both be kept in the set.
+
+  The cache doesn't make the rendering itself thread safe: the fields of
+  the threads go through sinsp::find_thread(), which updates the last
+  thread cache of the thread manager without locking. Concurrent calls
+  are only safe with formats that don't extract thread or fd fields, or
+  while no other thread looks up threads in the same inspector.
 */
 class SINSP_PUBLIC sinsp_evt_formatter_cache
 {
 public:
-	sinsp_evt_formatter_cache(sinsp *inspector);
+	typedef uint32_t format_id;
+
+	sinsp_evt_formatter_cache(sinsp *inspector, uint32_t nslots = DEFAULT_NUM_SLOTS);
 	virtual ~sinsp_evt_formatter_cache();
 
-	// Resolve the tokens inside format and return them as a key/value map.
-	// Creates a new sinsp_evt_formatter object if necessary.
-	bool resolve_tokens(sinsp_evt *evt, std::string &format, map<string,string>& values);
+	// Return the id of format, registering it if needed. Throws a
+	// sinsp_exception if the format is not valid. Thread safe.
+	format_id register_format(const std::string &format);
+
+	// Resolve the tokens of the format with the given id and return them
+	// as a key/value map.
+	bool resolve_tokens(sinsp_evt *evt, format_id id, map<string,string>& values);
+
+	// Fills in res with the event formatted according to the format
+	// with the given id, see sinsp_evt_formatter::tostring().
+	bool tostring(sinsp_evt *evt, format_id id, OUT std::string *res);
+
+	// Same as tostring(), with sinsp_evt_formatter::render().
+	bool render(sinsp_evt *evt, format_id id, OUT std::string *res);
 
-	// Fills in res with the event formatted according to
-	// format. Creates a new sinsp_evt_formatter object if
-	// necessary.
+	// Same as the methods above, registering format first. A format that
+	// is already registered is found without locking.
+	bool resolve_tokens(sinsp_evt *evt, std::string &format, map<string,string>& values);
 	bool tostring(sinsp_evt *evt, std::string &format, OUT std::string *res);
 
+	static const uint32_t DEFAULT_NUM_SLOTS = 256;
+	static const uint32_t SLOT_WAYS = 4;
+	static const uint32_t LOOKUP_SIZE = 1024;
+
 private:
+	struct registered_format
+	{
+		registered_format(const std::string &format, format_id id)
+			: m_format(format),
+			  m_id(id)
+		{
+		}
+
+		const std::string m_format;
+		const format_id m_id;
+	};
+
+	// Find the id of a registered format without locking, or register it.
+	format_id lookup_format(const std::string &format);
 
-	// Get the formatter for this format string. Creates a new
-	// sinsp_evt_formatter object if necessary.
-	std::shared_ptr<sinsp_evt_formatter>& get_cached_formatter(string &format);
+	struct entry
+	{
+		entry(sinsp *inspector, format_id id, const std::string &format)
+			: m_id(id),
+			  m_formatter(inspector, format)
+		{
+		}
+
+		format_id m_id;
+		sinsp_evt_formatter m_formatter;
+	};
+
+	// Take a formatter for the id out of its set, or create a new one.
+	entry *acquire(format_id id);
+
+	// Put a formatter taken by acquire() back in its set.
+	void release(entry *e);
+
+	struct slot
+	{
+		std::atomic<entry *> m_entry;
+		// Id of the formatter in m_entry. Only a hint, since the formatter
+		// can't be dereferenced before being taken out of the slot.
+		std::atomic<format_id> m_id;
+	};
+
+	slot *slot_set(format_id id)
+	{
+		return &m_slots[(id % m_nsets) * SLOT_WAYS];
+	}
 
-	std::map<std::string,std::shared_ptr<sinsp_evt_formatter>> m_formatter_cache;
 	sinsp *m_inspector;
+	uint32_t m_nsets;
+	std::unique_ptr<slot[]> m_slots;
+
+	// The registered formats. Only accessed to register a format or to
+	// create a formatter, both under m_formats_mutex.
+	std::mutex m_formats_mutex;
+	std::unordered_map<std::string, format_id> m_format_ids;
+	std::vector<std::unique_ptr<registered_format>> m_formats;
+
+	// Open addressing table of the registered formats, filled under
+	// m_formats_mutex and read without locking. The formats are never
+	// unregistered, so a published pointer stays valid. When the table is
+	// full the new formats are only in m_format_ids.
+	std::unique_ptr<std::atomic<const registered_format *>[]> m_lookup;
 };
 /*@}*/
@@ -298,27 +298,129 @@ template<> void sinsp_fdinfo_t::unregister_event_callback(sinsp_pd_callback_type
 ///////////////////////////////////////////////////////////////////////////////
 // sinsp_fdtable implementation
 ///////////////////////////////////////////////////////////////////////////////
+sinsp_fdtable::fd_chunk::fd_chunk():
+	m_used(0)
+{
+}
+
+sinsp_fdtable::fd_chunk::fd_chunk(const fd_chunk& other):
+	m_used(0)
+{
+	for(uint32_t j = 0; j < CHUNK_SIZE; j++)
+	{
+		if(other.m_used & (1u << j))
+		{
+			new (at(j)) sinsp_fdinfo_t(*reinterpret_cast<const sinsp_fdinfo_t*>(&other.m_fds[j]));
+			m_used |= (1u << j);
+		}
+	}
+}
+
+sinsp_fdtable::fd_chunk::~fd_chunk()
+{
+	for(uint32_t j = 0; j < CHUNK_SIZE; j++)
+	{
+		if(m_used & (1u << j))
+		{
+			at(j)->~sinsp_fdinfo_t();
+		}
+	}
+}
+
 sinsp_fdtable::sinsp_fdtable(sinsp* inspector)
 {
 	m_inspector = inspector;
+	m_tid = 0;
+	m_n_dense = 0;
 	reset_cache();
 }
 
+sinsp_fdtable::sinsp_fdtable(const sinsp_fdtable& other):
+	m_inspector(other.m_inspector),
+	m_tid(other.m_tid),
+	m_n_dense(0)
+{
+	reset_cache();
+	*this = other;
+}
+
+sinsp_fdtable::~sinsp_fdtable()
+{
+}
+
+sinsp_fdtable& sinsp_fdtable::operator=(const sinsp_fdtable& other)
+{
+	if(this == &other)
+	{
+		return *this;
+	}
+
+	m_inspector = other.m_inspector;
+	m_tid = other.m_tid;
+
+	m_chunks.clear();
+	m_chunks.resize(other.m_chunks.size());
+	for(size_t c = 0; c < other.m_chunks.size(); c++)
+	{
+		if(other.m_chunks[c])
+		{
+			m_chunks[c].reset(new fd_chunk(*other.m_chunks[c]));
+		}
+	}
+	m_n_dense = other.m_n_dense;
+	m_sparse = other.m_sparse;
+
+	//
+	// The cached pointer belongs to the other table
+	//
+	reset_cache();
+	return *this;
+}
+
+sinsp_fdinfo_t* sinsp_fdtable::insert(int64_t fd, const sinsp_fdinfo_t& fdinfo)
+{
+	if((uint64_t)fd < (uint64_t)DENSE_FD_LIMIT)
+	{
+		uint64_t c = (uint64_t)fd >> CHUNK_SHIFT;
+		uint32_t j = (uint32_t)fd & (CHUNK_SIZE - 1);
+
+		if(c >= m_chunks.size())
+		{
+			m_chunks.resize(c + 1);
+		}
+
+		if(!m_chunks[c])
+		{
+			m_chunks[c].reset(new fd_chunk());
+		}
+
+		fd_chunk* chunk = m_chunks[c].get();
+		ASSERT((chunk->m_used & (1u << j)) == 0);
+		new (chunk->at(j)) sinsp_fdinfo_t(fdinfo);
+		chunk->m_used |= (1u << j);
+		m_n_dense++;
+		return chunk->at(j);
+	}
+
+	pair<unordered_map<int64_t, sinsp_fdinfo_t>::iterator, bool> insert_res = m_sparse.emplace(fd, fdinfo);
+	return &(insert_res.first->second);
+}
+
 sinsp_fdinfo_t* sinsp_fdtable::add(int64_t fd, sinsp_fdinfo_t* fdinfo)
 {
 	//
 	// Look for the FD in the table
 	//
-	auto it = m_table.find(fd);
+	sinsp_fdinfo_t* existing = lookup(fd);
 
 	// Three possible exits here:
 	// 1. fd is not on the table
 	//   a. the table size is under the limit so create a new entry
 	//   b. table size is over the limit, discard the fd
 	// 2. fd is already in the table, replace it
-	if(it == m_table.end())
+	if(existing == NULL)
 	{
-		if(m_table.size() < m_inspector->m_max_fdtable_size)
+		if(size() < m_inspector->m_max_fdtable_size)
 		{
 			//
 			// No entry in the table, this is the normal case
@@ -327,8 +429,7 @@ sinsp_fdinfo_t* sinsp_fdtable::add(int64_t fd, sinsp_fdinfo_t* fdinfo)
 #ifdef GATHER_INTERNAL_STATS
 			m_inspector->m_stats.m_n_added_fds++;
 #endif
-			pair<unordered_map<int64_t, sinsp_fdinfo_t>::iterator, bool> insert_res = m_table.emplace(fd, *fdinfo);
-			return &(insert_res.first->second);
+			return insert(fd, *fdinfo);
 		}
 		else
 		{
@@ -340,7 +441,7 @@ sinsp_fdinfo_t* sinsp_fdtable::add(int64_t fd, sinsp_fdinfo_t* fdinfo)
 		//
 		// the fd is already in the table.
 		//
-		if(it->second.m_flags & sinsp_fdinfo_t::FLAGS_CLOSE_IN_PROGRESS)
+		if(existing->m_flags & sinsp_fdinfo_t::FLAGS_CLOSE_IN_PROGRESS)
 		{
 			//
 			// Sometimes an FD-creating syscall can be called on an FD that is being closed (i.e
@@ -351,7 +452,7 @@ sinsp_fdinfo_t* sinsp_fdtable::add(int64_t fd, sinsp_fdinfo_t* fdinfo)
 			fdinfo->m_flags &= ~sinsp_fdinfo_t::FLAGS_CLOSE_IN_PROGRESS;
 			fdinfo->m_flags |= sinsp_fdinfo_t::FLAGS_CLOSE_CANCELED;
 
-			m_table[CANCELED_FD_NUMBER] = it->second;
+			m_sparse[CANCELED_FD_NUMBER] = *existing;
 		}
 		else
 		{
@@ -371,21 +472,49 @@ sinsp_fdinfo_t* sinsp_fdtable::add(int64_t fd, sinsp_fdinfo_t* fdinfo)
 		//
 		// Replace the fd as a struct copy
 		//
-		it->second.copy(*fdinfo, true);
-		return &(it->second);
+		existing->copy(*fdinfo, true);
+		return existing;
 	}
 }
 
 void sinsp_fdtable::erase(int64_t fd)
 {
-	unordered_map<int64_t, sinsp_fdinfo_t>::iterator fdit = m_table.find(fd);
-
 	if(fd == m_last_accessed_fd)
 	{
 		m_last_accessed_fd = -1;
 	}
 
-	if(fdit == m_table.end())
+	bool found = false;
+
+	if((uint64_t)fd < (uint64_t)DENSE_FD_LIMIT)
+	{
+		uint64_t c = (uint64_t)fd >> CHUNK_SHIFT;
+		uint32_t j = (uint32_t)fd & (CHUNK_SIZE - 1);
+
+		if(c < m_chunks.size() && m_chunks[c] && (m_chunks[c]->m_used & (1u << j)))
+		{
+			//
+			// Clear the bit first, so that the table is consistent
+			// if the destructor ends up looking at it
+			//
+			m_chunks[c]->m_used &= ~(1u << j);
+			m_n_dense--;
+			m_chunks[c]->at(j)->~sinsp_fdinfo_t();
+			found = true;
+		}
+	}
+	else
+	{
+		unordered_map<int64_t, sinsp_fdinfo_t>::iterator fdit = m_sparse.find(fd);
+
+		if(fdit != m_sparse.end())
+		{
+			m_sparse.erase(fdit);
+			found = true;
+		}
+	}
+
+	if(!found)
 	{
 		//
 		// Looks like there's no fd to remove.
@@ -400,7 +529,6 @@ void sinsp_fdtable::erase(int64_t fd)
 	}
 	else
 	{
-		m_table.erase(fdit);
 #ifdef GATHER_INTERNAL_STATS
 		m_inspector->m_stats.m_n_noncached_fd_lookups++;
 		m_inspector->m_stats.m_n_removed_fds++;
@@ -410,12 +538,15 @@ void sinsp_fdtable::erase(int64_t fd)
 
 void sinsp_fdtable::clear()
 {
-	m_table.clear();
+	m_chunks.clear();
+	m_n_dense = 0;
+	m_sparse.clear();
+	m_last_accessed_fd = -1;
 }
 
 size_t sinsp_fdtable::size()
 {
-	return m_table.size();
+	return m_n_dense + m_sparse.size();
 }
 
 void sinsp_fdtable::reset_cache()
@@ -423,6 +554,40 @@ void sinsp_fdtable::reset_cache()
 	m_last_accessed_fd = -1;
 }
 
+bool sinsp_fdtable::loop(const fdtable_visitor_t& callback)
+{
+	for(size_t c = 0; c < m_chunks.size(); c++)
+	{
+		fd_chunk* chunk = m_chunks[c].get();
+
+		if(chunk == NULL)
+		{
+			continue;
+		}
+
+		for(uint32_t j = 0; j < CHUNK_SIZE; j++)
+		{
+			if(chunk->m_used & (1u << j))
+			{
+				if(!callback((int64_t)((c << CHUNK_SHIFT) + j), *chunk->at(j)))
+				{
+					return false;
+				}
+			}
+		}
+	}
+
+	for(auto& it : m_sparse)
+	{
+		if(!callback(it.first, it.second))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
 void sinsp_fdtable::lookup_device(sinsp_fdinfo_t* fdi, uint64_t fd)
 {
 #ifdef HAS_CAPTURE
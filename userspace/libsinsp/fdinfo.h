@@ -17,6 +17,9 @@ limitations under the License.
 
 #pragma once
 #include "sinsp_pd_callback_type.h"
+#include <functional>
+#include <memory>
+#include <type_traits>
 #include <unordered_map>
 #include <vector>
 
@@ -517,11 +520,16 @@ private:
 class sinsp_fdtable
 {
 public:
+	typedef std::function<bool(int64_t, sinsp_fdinfo_t&)> fdtable_visitor_t;
+
 	sinsp_fdtable(sinsp* inspector);
+	sinsp_fdtable(const sinsp_fdtable& other);
+	~sinsp_fdtable();
+	sinsp_fdtable& operator=(const sinsp_fdtable& other);
 
 	inline sinsp_fdinfo_t* find(int64_t fd)
 	{
-		std::unordered_map<int64_t, sinsp_fdinfo_t>::iterator fdit;
+		sinsp_fdinfo_t* fdinfo;
 
 		//
 		// Try looking up in our simple cache
@@ -537,9 +545,9 @@ public:
 		//
 		// Caching failed, do a real lookup
 		//
-		fdit = m_table.find(fd);
+		fdinfo = lookup(fd);
 
-		if(fdit == m_table.end())
+		if(fdinfo == NULL)
 		{
 	#ifdef GATHER_INTERNAL_STATS
 			m_inspector->m_stats.m_n_failed_fd_lookups++;
@@ -552,9 +560,9 @@ public:
 			m_inspector->m_stats.m_n_noncached_fd_lookups++;
 	#endif
 			m_last_accessed_fd = fd;
-			m_last_accessed_fdinfo = &(fdit->second);
-			lookup_device(&(fdit->second), fd);
-			return &(fdit->second);
+			m_last_accessed_fdinfo = fdinfo;
+			lookup_device(fdinfo, fd);
+			return fdinfo;
 		}
 	}
 	
@@ -566,8 +574,14 @@ public:
 	size_t size();
 	void reset_cache();
 
+	//
+	// Invoke the callback for every fd in the table, dense fds first in
+	// ascending order. Stops and returns false as soon as the callback
+	// returns false. The callback must not add or remove fds.
+	//
+	bool loop(const fdtable_visitor_t& callback);
+
 	sinsp* m_inspector;
-	std::unordered_map<int64_t, sinsp_fdinfo_t> m_table;
 
 	//
 	// Simple fd cache
@@ -576,6 +590,64 @@ public:
 	sinsp_fdinfo_t *m_last_accessed_fdinfo;
 	uint64_t m_tid;
 
+	//
+	// fds below this limit live in the dense part of the table, the others
+	// (and CANCELED_FD_NUMBER) in a hash map.
+	//
+	static const int64_t DENSE_FD_LIMIT = 1024;
+
 private:
+	//
+	// The dense part is a directory of fixed size chunks, allocated the
+	// first time one of their fds is added. Chunks never move, so the
+	// pointers returned by find() and add() stay valid until the fd is
+	// erased, like the ones pointing into the hash map.
+	//
+	static const uint32_t CHUNK_SHIFT = 4;
+	static const uint32_t CHUNK_SIZE = 1 << CHUNK_SHIFT;
+
+	struct fd_chunk
+	{
+		fd_chunk();
+		fd_chunk(const fd_chunk& other);
+		~fd_chunk();
+
+		inline sinsp_fdinfo_t* at(uint32_t j)
+		{
+			return reinterpret_cast<sinsp_fdinfo_t*>(&m_fds[j]);
+		}
+
+		// Bit j is set if m_fds[j] holds a constructed sinsp_fdinfo_t
+		uint32_t m_used;
+		std::aligned_storage<sizeof(sinsp_fdinfo_t), alignof(sinsp_fdinfo_t)>::type m_fds[CHUNK_SIZE];
+
+	private:
+		fd_chunk& operator=(const fd_chunk&);
+	};
+
+	inline sinsp_fdinfo_t* lookup(int64_t fd)
+	{
+		if((uint64_t)fd < (uint64_t)DENSE_FD_LIMIT)
+		{
+			uint64_t c = (uint64_t)fd >> CHUNK_SHIFT;
+			uint32_t j = (uint32_t)fd & (CHUNK_SIZE - 1);
+
+			if(c < m_chunks.size() && m_chunks[c] && (m_chunks[c]->m_used & (1u << j)))
+			{
+				return m_chunks[c]->at(j);
+			}
+
+			return NULL;
+		}
+
+		auto it = m_sparse.find(fd);
+		return it == m_sparse.end() ? NULL : &(it->second);
+	}
+
+	sinsp_fdinfo_t* insert(int64_t fd, const sinsp_fdinfo_t& fdinfo);
 	void lookup_device(sinsp_fdinfo_t* fdi, uint64_t fd);
+
+	std::vector<std::unique_ptr<fd_chunk>> m_chunks;
+	size_t m_n_dense;
+	std::unordered_map<int64_t, sinsp_fdinfo_t> m_sparse;
 };
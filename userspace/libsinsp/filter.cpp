@@ -1231,6 +1231,19 @@ void sinsp_filter_check::add_filter_value(const char* str, uint32_t len, uint32_
 	{
 		m_val_storages_paths.add_search_path(item);
 	}
+
+	// For the string operators, also add the value to the patterns, that
+	// are searched all at once when the check has several values
+	if(m_field->m_type == PT_CHARBUF &&
+	   (m_cmpop == CO_CONTAINS || m_cmpop == CO_ICONTAINS ||
+	    m_cmpop == CO_STARTSWITH || m_cmpop == CO_ENDSWITH))
+	{
+		if(m_val_storages_patterns.size() == 0)
+		{
+			m_val_storages_patterns.set_case_insensitive(m_cmpop == CO_ICONTAINS);
+		}
+		m_val_storages_patterns.add_pattern(item);
+	}
 }
 
 size_t sinsp_filter_check::parse_filter_value(const char* str, uint32_t len, uint8_t *storage, uint32_t storage_len)
@@ -1328,6 +1341,11 @@ bool sinsp_filter_check::flt_compare(cmpop op, ppm_param_type type, void* operan
 			break;
 		}
 	}
+	else if(type == PT_CHARBUF && m_val_storages.size() > 1 &&
+		(op == CO_CONTAINS || op == CO_ICONTAINS || op == CO_STARTSWITH || op == CO_ENDSWITH))
+	{
+		return match_patterns(op, (char*)operand1);
+	}
 	else
 	{
 		return (::flt_compare(op,
@@ -1340,6 +1358,41 @@ bool sinsp_filter_check::flt_compare(cmpop op, ppm_param_type type, void* operan
 	}
 }
 
+//
+// A string operator applied to several values passes if any of them matches
+//
+bool sinsp_filter_check::match_patterns(cmpop op, const char* str)
+{
+	if(m_val_storages.size() < MULTI_PATTERN_MIN_VALUES)
+	{
+		for(uint16_t i = 0; i < m_val_storages.size(); i++)
+		{
+			if(::flt_compare(op, PT_CHARBUF, (void*)str, filter_value_p(i)))
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	uint32_t len = (uint32_t)strlen(str);
+
+	switch(op)
+	{
+	case CO_CONTAINS:
+	case CO_ICONTAINS:
+		return m_val_storages_patterns.contains((const uint8_t*)str, len);
+	case CO_STARTSWITH:
+		return m_val_storages_patterns.starts_with((const uint8_t*)str, len);
+	case CO_ENDSWITH:
+		return m_val_storages_patterns.ends_with((const uint8_t*)str, len);
+	default:
+		ASSERT(false);
+		return false;
+	}
+}
+
 uint8_t* sinsp_filter_check::extract(gen_event *evt, OUT uint32_t* len, bool sanitize_strings)
 {
 	return extract((sinsp_evt *) evt, len, sanitize_strings);
@@ -1355,8 +1408,10 @@ uint8_t* sinsp_filter_check::extract_cached(sinsp_evt *evt, OUT uint32_t* len, b
 		{
 			m_extraction_cache_entry->m_evtnum = en;
 			m_extraction_cache_entry->m_res = extract(evt, len, sanitize_strings);
+			m_extraction_cache_entry->m_len = *len;
 		}
 
+		*len = m_extraction_cache_entry->m_len;
 		return m_extraction_cache_entry->m_res;
 	}
 	else
@@ -1403,6 +1458,280 @@ bool sinsp_filter_check::compare(sinsp_evt *evt)
 			   m_val_storage_len);
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// Specialized comparators
+// Every one of them returns the same result as sinsp_filter_check::compare()
+// for a given field type and operator, without the switches of flt_compare().
+// The eval_* functions do the comparison, wrapped by cached<>() which goes
+// through the evaluation cache of the check when it has one.
+///////////////////////////////////////////////////////////////////////////////
+template<bool (*eval)(sinsp_filter_check*, sinsp_evt*)>
+bool sinsp_filter_check::cached(gen_event_filter_check* c, gen_event* e)
+{
+	sinsp_filter_check* chk = (sinsp_filter_check*)c;
+	sinsp_evt* evt = (sinsp_evt*)e;
+	check_eval_cache_entry* cache = chk->m_eval_cache_entry;
+
+	if(cache == NULL)
+	{
+		return eval(chk, evt);
+	}
+
+	uint64_t en = evt->get_num();
+
+	if(en != cache->m_evtnum)
+	{
+		cache->m_evtnum = en;
+		cache->m_res = eval(chk, evt);
+	}
+
+	return cache->m_res;
+}
+
+template<typename T, cmpop op>
+bool sinsp_filter_check::eval_numeric(sinsp_filter_check* chk, sinsp_evt* evt)
+{
+	uint32_t len = 0;
+	uint8_t* val = chk->extract_cached(evt, &len, false);
+
+	if(val == NULL)
+	{
+		return false;
+	}
+
+	T operand1 = *(T*)val;
+	T operand2 = *(T*)chk->filter_value_p();
+
+	switch(op)
+	{
+	case CO_EQ:
+		return operand1 == operand2;
+	case CO_NE:
+		return operand1 != operand2;
+	case CO_LT:
+		return operand1 < operand2;
+	case CO_LE:
+		return operand1 <= operand2;
+	case CO_GT:
+		return operand1 > operand2;
+	case CO_GE:
+		return operand1 >= operand2;
+	default:
+		ASSERT(false);
+		return false;
+	}
+}
+
+template<typename T>
+gen_event_filter_check::compare_fn sinsp_filter_check::numeric_compare_fn(cmpop op)
+{
+	switch(op)
+	{
+	case CO_EQ:
+		return cached<eval_numeric<T, CO_EQ>>;
+	case CO_NE:
+		return cached<eval_numeric<T, CO_NE>>;
+	case CO_LT:
+		return cached<eval_numeric<T, CO_LT>>;
+	case CO_LE:
+		return cached<eval_numeric<T, CO_LE>>;
+	case CO_GT:
+		return cached<eval_numeric<T, CO_GT>>;
+	case CO_GE:
+		return cached<eval_numeric<T, CO_GE>>;
+	default:
+		// Unsupported operators throw from flt_compare()
+		return NULL;
+	}
+}
+
+template<cmpop op>
+bool sinsp_filter_check::eval_string(sinsp_filter_check* chk, sinsp_evt* evt)
+{
+	uint32_t len = 0;
+	char* operand1 = (char*)chk->extract_cached(evt, &len, false);
+
+	if(operand1 == NULL)
+	{
+		return false;
+	}
+
+	char* operand2 = (char*)chk->filter_value_p();
+
+	switch(op)
+	{
+	case CO_EQ:
+		return strcmp(operand1, operand2) == 0;
+	case CO_NE:
+		return strcmp(operand1, operand2) != 0;
+	case CO_CONTAINS:
+		return strstr(operand1, operand2) != NULL;
+	case CO_STARTSWITH:
+		return strncmp(operand1, operand2, strlen(operand2)) == 0;
+	case CO_ENDSWITH:
+		return sinsp_utils::endswith(operand1, operand2);
+	default:
+		ASSERT(false);
+		return false;
+	}
+}
+
+bool sinsp_filter_check::eval_exists(sinsp_filter_check* chk, sinsp_evt* evt)
+{
+	uint32_t len = 0;
+	return chk->extract_cached(evt, &len, false) != NULL;
+}
+
+bool sinsp_filter_check::eval_in(sinsp_filter_check* chk, sinsp_evt* evt)
+{
+	uint32_t len = 0;
+	uint8_t* val = chk->extract_cached(evt, &len, false);
+
+	if(val == NULL)
+	{
+		return false;
+	}
+
+	if(len == 0 && chk->m_info.m_fields[chk->m_field_id].m_type == PT_CHARBUF)
+	{
+		len = strlen((char*)val);
+	}
+
+	return len >= chk->m_val_storages_min_size &&
+		len <= chk->m_val_storages_max_size &&
+		chk->m_val_storages_members.find(filter_value_t(val, len)) != chk->m_val_storages_members.end();
+}
+
+bool sinsp_filter_check::eval_pmatch(sinsp_filter_check* chk, sinsp_evt* evt)
+{
+	uint32_t len = 0;
+	uint8_t* val = chk->extract_cached(evt, &len, false);
+
+	if(val == NULL)
+	{
+		return false;
+	}
+
+	if(len == 0 && chk->m_info.m_fields[chk->m_field_id].m_type == PT_CHARBUF)
+	{
+		len = strlen((char*)val);
+	}
+
+	return chk->m_val_storages_paths.match(filter_value_t(val, len));
+}
+
+bool sinsp_filter_check::eval_patterns(sinsp_filter_check* chk, sinsp_evt* evt)
+{
+	uint32_t len = 0;
+	char* val = (char*)chk->extract_cached(evt, &len, false);
+
+	if(val == NULL)
+	{
+		return false;
+	}
+
+	return chk->match_patterns(chk->m_cmpop, val);
+}
+
+gen_event_filter_check::compare_fn sinsp_filter_check::get_compare_fn()
+{
+	ppm_param_type type = m_info.m_fields[m_field_id].m_type;
+
+	switch(m_cmpop)
+	{
+	case CO_EXISTS:
+		return cached<eval_exists>;
+	case CO_IN:
+	case CO_INTERSECTS:
+	case CO_PMATCH:
+		switch(type)
+		{
+		case PT_IPV4NET:
+		case PT_IPV6NET:
+		case PT_IPNET:
+		case PT_SOCKADDR:
+		case PT_SOCKTUPLE:
+		case PT_FDLIST:
+		case PT_FSPATH:
+		case PT_SIGSET:
+		case PT_FSRELPATH:
+			return NULL;
+		default:
+			return m_cmpop == CO_PMATCH ? cached<eval_pmatch> : cached<eval_in>;
+		}
+	default:
+		break;
+	}
+
+	switch(type)
+	{
+	case PT_INT8:
+		return numeric_compare_fn<int8_t>(m_cmpop);
+	case PT_INT16:
+		return numeric_compare_fn<int16_t>(m_cmpop);
+	case PT_INT32:
+		return numeric_compare_fn<int32_t>(m_cmpop);
+	case PT_INT64:
+	case PT_FD:
+	case PT_PID:
+	case PT_ERRNO:
+		return numeric_compare_fn<int64_t>(m_cmpop);
+	case PT_FLAGS8:
+	case PT_UINT8:
+	case PT_SIGTYPE:
+		return numeric_compare_fn<uint8_t>(m_cmpop);
+	case PT_FLAGS16:
+	case PT_UINT16:
+	case PT_PORT:
+	case PT_SYSCALLID:
+		return numeric_compare_fn<uint16_t>(m_cmpop);
+	case PT_UINT32:
+	case PT_FLAGS32:
+	case PT_MODE:
+	case PT_BOOL:
+	case PT_IPV4ADDR:
+		return numeric_compare_fn<uint32_t>(m_cmpop);
+	case PT_UINT64:
+	case PT_RELTIME:
+	case PT_ABSTIME:
+		return numeric_compare_fn<uint64_t>(m_cmpop);
+	case PT_DOUBLE:
+		return numeric_compare_fn<double>(m_cmpop);
+	case PT_CHARBUF:
+		if(m_val_storages.size() > 1 || m_cmpop == CO_ICONTAINS)
+		{
+			switch(m_cmpop)
+			{
+			case CO_CONTAINS:
+			case CO_ICONTAINS:
+			case CO_STARTSWITH:
+			case CO_ENDSWITH:
+				return cached<eval_patterns>;
+			default:
+				break;
+			}
+		}
+
+		switch(m_cmpop)
+		{
+		case CO_EQ:
+			return cached<eval_string<CO_EQ>>;
+		case CO_NE:
+			return cached<eval_string<CO_NE>>;
+		case CO_CONTAINS:
+			return cached<eval_string<CO_CONTAINS>>;
+		case CO_STARTSWITH:
+			return cached<eval_string<CO_STARTSWITH>>;
+		case CO_ENDSWITH:
+			return cached<eval_string<CO_ENDSWITH>>;
+		default:
+			return NULL;
+		}
+	default:
+		return NULL;
+	}
+}
+
 sinsp_filter::sinsp_filter(sinsp *inspector)
 {
 	m_inspector = inspector;
@@ -1425,6 +1754,7 @@ sinsp_filter_compiler::sinsp_filter_compiler(sinsp* inspector, const string& flt
 	m_filter = new sinsp_filter(m_inspector);
 	m_last_boolop = BO_NONE;
 	m_nest_level = 0;
+	m_last_check = NULL;
 	m_fltstr = fltstr;
 }
 
@@ -1757,6 +2087,51 @@ cmpop sinsp_filter_compiler::next_comparison_operator()
 	}
 }
 
+//
+// A string check or'ed to the previous check of the same expression, with the
+// same field and operator, can become one more value of it, so that all the
+// values are searched in a single pass, e.g.
+// "fd.name contains a or fd.name contains b" is "fd.name contains (a, b)".
+//
+bool sinsp_filter_compiler::can_merge_check(sinsp_filter_check* chk, const string& field, boolop op)
+{
+	const vector<gen_event_filter_check*>& checks = m_filter->m_curexpr->m_checks;
+
+	if(op != BO_OR || m_last_check == NULL || field != m_last_field ||
+	   checks.empty() || checks.back() != m_last_check)
+	{
+		return false;
+	}
+
+	if(chk->m_cmpop != m_last_check->m_cmpop ||
+	   (m_last_check->m_boolop != BO_NONE && m_last_check->m_boolop != BO_OR))
+	{
+		return false;
+	}
+
+	if(chk->get_field_info()->m_type != PT_CHARBUF)
+	{
+		return false;
+	}
+
+	switch(chk->m_cmpop)
+	{
+	case CO_CONTAINS:
+	case CO_ICONTAINS:
+	case CO_STARTSWITH:
+	case CO_ENDSWITH:
+		break;
+	default:
+		return false;
+	}
+
+	//
+	// The checks comparing a field in their own way only support one value,
+	// and don't have a specialized comparator
+	//
+	return m_last_check->get_compare_fn() != NULL;
+}
+
 void sinsp_filter_compiler::parse_check()
 {
 	uint32_t startpos = m_scanpos;
@@ -1794,6 +2169,7 @@ void sinsp_filter_compiler::parse_check()
 	chk->m_cmpop = co;
 
 	chk->parse_field_name((char *)&operand1[0], true, true);
+	chk->m_field_str = str_operand1;
 
 	if(co == CO_IN || co == CO_INTERSECTS || co == CO_PMATCH)
 	{
@@ -1939,7 +2315,19 @@ void sinsp_filter_compiler::parse_check()
 		else
 		{
 			vector<char> operand2 = next_operand(false, false);
+
+			if(can_merge_check(chk, str_operand1, op))
+			{
+				m_last_check->add_filter_value((char *)&operand2[0],
+							       (uint32_t)operand2.size() - 1,
+							       m_last_check->get_num_filter_values());
+				delete chk;
+				return;
+			}
+
 			chk->add_filter_value((char *)&operand2[0], (uint32_t)operand2.size() - 1);
+			m_last_check = chk;
+			m_last_field = str_operand1;
 		}
 
 		m_filter->add_check(chk);
@@ -1994,8 +2382,9 @@ sinsp_filter* sinsp_filter_compiler::compile_()
 			}
 
 			//
-			// Good filter
+			// Good filter, lower it into the program executed by run()
 			//
+			m_filter->compile();
 			return m_filter;
 
 			break;
@@ -2104,6 +2493,125 @@ sinsp_filter* sinsp_filter_compiler::compile_()
 	return m_filter;
 }
 
+sinsp_filter_optimizer::sinsp_filter_optimizer()
+	: m_nchecks(0),
+	  m_nshared_evals(0),
+	  m_nshared_extractions(0)
+{
+}
+
+sinsp_filter_optimizer::~sinsp_filter_optimizer()
+{
+	for(auto &it : m_evals)
+	{
+		delete it.second.m_cache;
+	}
+
+	for(auto &it : m_extractions)
+	{
+		delete it.second.m_cache;
+	}
+}
+
+void sinsp_filter_optimizer::add_filter(sinsp_filter* filter)
+{
+	if(filter->m_filter != NULL)
+	{
+		add_expression(filter->m_filter);
+	}
+}
+
+void sinsp_filter_optimizer::add_expression(gen_event_filter_expression* expr)
+{
+	for(auto chk : expr->m_checks)
+	{
+		gen_event_filter_expression* child = dynamic_cast<gen_event_filter_expression*>(chk);
+
+		if(child != NULL)
+		{
+			add_expression(child);
+		}
+		else
+		{
+			add_check((sinsp_filter_check*)chk);
+		}
+	}
+}
+
+//
+// The checks are grouped by the work they do: the ones with the same field,
+// operator and values by the comparison, the ones with the same field by the
+// extraction. A cache is created as soon as a group has two checks, the
+// checks that are alone don't pay for it.
+//
+template<typename E>
+static bool share_cache(std::vector<sinsp_filter_check*> &checks,
+			E* &cache,
+			E* sinsp_filter_check::*entry,
+			uint64_t &nshared)
+{
+	if(checks.size() < 2)
+	{
+		return false;
+	}
+
+	if(cache == NULL)
+	{
+		cache = new E();
+
+		for(auto chk : checks)
+		{
+			chk->*entry = cache;
+			nshared++;
+		}
+	}
+	else
+	{
+		checks.back()->*entry = cache;
+		nshared++;
+	}
+
+	return true;
+}
+
+void sinsp_filter_optimizer::add_check(sinsp_filter_check* chk)
+{
+	m_nchecks++;
+
+	//
+	// Only the checks created by the compiler have a field string, and only
+	// the ones with a specialized comparator go through the caches the same
+	// way compare() does
+	//
+	if(chk->m_field_str.empty() ||
+	   chk->get_compare_fn() == NULL ||
+	   chk->m_eval_cache_entry != NULL ||
+	   chk->m_extraction_cache_entry != NULL)
+	{
+		return;
+	}
+
+	string key = chk->m_field_str;
+	key.push_back('\0');
+	key.append(to_string(chk->m_cmpop));
+	key.push_back('\0');
+	key.append(to_string(chk->m_val_storage_len));
+
+	for(auto &val : chk->m_val_storages)
+	{
+		key.push_back('\0');
+		key.append((const char*)val.data(), val.size());
+	}
+
+	auto &eval = m_evals.emplace(key, group<check_eval_cache_entry>{{}, NULL}).first->second;
+	eval.m_checks.push_back(chk);
+	share_cache(eval.m_checks, eval.m_cache, &sinsp_filter_check::m_eval_cache_entry, m_nshared_evals);
+
+	auto &extraction = m_extractions.emplace(chk->m_field_str, group<check_extraction_cache_entry>{{}, NULL}).first->second;
+	extraction.m_checks.push_back(chk);
+	share_cache(extraction.m_checks, extraction.m_cache, &sinsp_filter_check::m_extraction_cache_entry, m_nshared_extractions);
+}
+
 sinsp_evttype_filter::sinsp_evttype_filter()
 {
 }
@@ -2223,10 +2731,8 @@ void sinsp_evttype_filter::ruleset_filters::remove_filter(filter_wrapper *wrap)
 }
 
 
-bool sinsp_evttype_filter::ruleset_filters::run(sinsp_evt *evt)
+list<sinsp_evttype_filter::filter_wrapper *> *sinsp_evttype_filter::ruleset_filters::filters_for_event(sinsp_evt *evt)
 {
-	list<filter_wrapper *> *filters;
-
  	uint16_t etype = evt->m_pevt->type;
 
 	if(etype == PPME_GENERIC_E || etype == PPME_GENERIC_X)
@@ -2235,12 +2741,17 @@ bool sinsp_evttype_filter::ruleset_filters::run(sinsp_evt *evt)
 		ASSERT(parinfo->m_len == sizeof(uint16_t));
 		uint16_t evid = *(uint16_t *)parinfo->m_val;
 
-		filters = m_filter_by_syscall[evid];
+		return m_filter_by_syscall[evid];
 	}
 	else
 	{
-		filters = m_filter_by_evttype[etype];
+		return m_filter_by_evttype[etype];
 	}
+}
+
+bool sinsp_evttype_filter::ruleset_filters::run(sinsp_evt *evt)
+{
+	list<filter_wrapper *> *filters = filters_for_event(evt);
 
 	if (!filters) {
 		return false;
@@ -2257,6 +2768,23 @@ bool sinsp_evttype_filter::ruleset_filters::run(sinsp_evt *evt)
 	return false;
 }
 
+void sinsp_evttype_filter::ruleset_filters::run_all(sinsp_evt *evt, std::vector<std::string> &matching)
+{
+	list<filter_wrapper *> *filters = filters_for_event(evt);
+
+	if (!filters) {
+		return;
+	}
+
+	for (auto &wrap : *filters)
+	{
+		if(wrap->filter->run(evt))
+		{
+			matching.push_back(wrap->name);
+		}
+	}
+}
+
 void sinsp_evttype_filter::ruleset_filters::evttypes_for_ruleset(std::vector<bool> &evttypes)
 {
 	evttypes.assign(PPM_EVENT_MAX+1, false);
@@ -2293,8 +2821,11 @@ void sinsp_evttype_filter::add(string &name,
 			       sinsp_filter *filter)
 {
 	filter_wrapper *wrap = new filter_wrapper();
+	wrap->name = name;
 	wrap->filter = filter;
 
+	m_optimizer.add_filter(filter);
+
 	// If no evttypes or syscalls are specified, the filter is
 	// enabled for all evttypes/syscalls.
 	bool def = ((evttypes.size() == 0 && syscalls.size() == 0) ? true : false);
@@ -2386,6 +2917,16 @@ bool sinsp_evttype_filter::run(sinsp_evt *evt, uint16_t ruleset)
 	return m_rulesets[ruleset]->run(evt);
 }
 
+void sinsp_evttype_filter::run_all(sinsp_evt *evt, std::vector<std::string> &matching, uint16_t ruleset)
+{
+	if(m_rulesets.size() < (size_t) ruleset + 1)
+	{
+		return;
+	}
+
+	m_rulesets[ruleset]->run_all(evt, matching);
+}
+
 void sinsp_evttype_filter::evttypes_for_ruleset(std::vector<bool> &evttypes, uint16_t ruleset)
 {
 	return m_rulesets[ruleset]->evttypes_for_ruleset(evttypes);
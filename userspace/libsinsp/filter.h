@@ -18,12 +18,17 @@ limitations under the License.
 #pragma once
 
 #include <set>
+#include <unordered_map>
 #include <vector>
 
 #ifdef HAS_FILTERING
 
 #include "gen_filter.h"
 
+class sinsp_filter_check;
+class check_eval_cache_entry;
+class check_extraction_cache_entry;
+
 /** @defgroup filter Filtering events
  * Filtering infrastructure.
  *  @{
@@ -82,6 +87,7 @@ private:
 	vector<char> next_operand(bool expecting_first_operand, bool in_clause);
 	cmpop next_comparison_operator();
 	void parse_check();
+	bool can_merge_check(sinsp_filter_check* chk, const string& field, boolop op);
 
 	static bool isblank(char c);
 	static bool is_special_char(char c);
@@ -97,11 +103,69 @@ private:
 	boolop m_last_boolop;
 	int32_t m_nest_level;
 
+	// Last check added by parse_check() with a single value, and its field
+	sinsp_filter_check* m_last_check;
+	string m_last_field;
+
 	sinsp_filter* m_filter;
 
 	friend class sinsp_evt_formatter;
 };
 
+/*!
+  \brief Shares the work of the checks that appear in several filters.
+
+  The checks with the same field, operator and values share the result of
+  their comparison, and the checks with the same field share the extracted
+  value, through the evaluation and extraction caches of sinsp_filter_check.
+  Both are keyed by the event number, so with many filters using the same
+  fields every one of them is extracted and compared once per event.
+
+  Only the checks created by sinsp_filter_compiler that don't compare their
+  field in a special way are shared.
+*/
+class SINSP_PUBLIC sinsp_filter_optimizer
+{
+public:
+	sinsp_filter_optimizer();
+	~sinsp_filter_optimizer();
+
+	void add_filter(sinsp_filter* filter);
+
+	// Number of checks seen by add_filter()
+	uint64_t get_num_checks() const
+	{
+		return m_nchecks;
+	}
+
+	// Number of checks sharing their comparison or extraction with another one
+	uint64_t get_num_shared_evals() const
+	{
+		return m_nshared_evals;
+	}
+
+	uint64_t get_num_shared_extractions() const
+	{
+		return m_nshared_extractions;
+	}
+
+private:
+	void add_expression(gen_event_filter_expression* expr);
+	void add_check(sinsp_filter_check* chk);
+
+	template<typename E> struct group
+	{
+		std::vector<sinsp_filter_check*> m_checks;
+		E* m_cache;
+	};
+
+	std::unordered_map<std::string, group<check_eval_cache_entry>> m_evals;
+	std::unordered_map<std::string, group<check_extraction_cache_entry>> m_extractions;
+	uint64_t m_nchecks;
+	uint64_t m_nshared_evals;
+	uint64_t m_nshared_extractions;
+};
+
 /*!
   \brief This class represents a filter optimized using event
   types. It actually consists of collections of sinsp_filter objects
@@ -141,6 +205,16 @@ public:
 	// Match all filters against the provided event.
 	bool run(sinsp_evt *evt, uint16_t ruleset = 0);
 
+	// Match all filters against the provided event, and append the names
+	// of the ones that match to matching. The checks shared by the filters
+	// are evaluated once, see sinsp_filter_optimizer.
+	void run_all(sinsp_evt *evt, std::vector<std::string> &matching, uint16_t ruleset = 0);
+
+	const sinsp_filter_optimizer &get_optimizer() const
+	{
+		return m_optimizer;
+	}
+
 	// Populate the provided vector, indexed by event type, of the
 	// event types associated with the given ruleset id. For
 	// example, evttypes[10] = true would mean that this ruleset
@@ -156,6 +230,7 @@ public:
 private:
 
 	struct filter_wrapper {
+		std::string name;
 		sinsp_filter *filter;
 
 		// Indexes from event type to enabled/disabled.
@@ -176,12 +251,15 @@ private:
 		void remove_filter(filter_wrapper *wrap);
 
 		bool run(sinsp_evt *evt);
+		void run_all(sinsp_evt *evt, std::vector<std::string> &matching);
 
 		void evttypes_for_ruleset(std::vector<bool> &evttypes);
 
 		void syscalls_for_ruleset(std::vector<bool> &syscalls);
 
 	private:
+		std::list<filter_wrapper *> *filters_for_event(sinsp_evt *evt);
+
 		// Maps from event type to filter. There can be multiple
 		// filters per event type.
 		std::list<filter_wrapper *> *m_filter_by_evttype[PPM_EVENT_MAX];
@@ -199,6 +277,9 @@ private:
 	// This holds all the filters passed to add(), so they can
 	// be cleaned up.
 	map<std::string,filter_wrapper *> m_filters;
+
+	// Shares the checks of all the filters passed to add()
+	sinsp_filter_optimizer m_optimizer;
 };
 
 /*@}*/
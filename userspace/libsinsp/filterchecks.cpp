@@ -1800,6 +1800,24 @@ bool sinsp_filter_check_fd::compare(sinsp_evt *evt)
 			   len);
 }
 
+gen_event_filter_check::compare_fn sinsp_filter_check_fd::get_compare_fn()
+{
+	switch(m_field_id)
+	{
+	case TYPE_IP:
+	case TYPE_PORT:
+	case TYPE_PROTO:
+	case TYPE_NET:
+	case TYPE_CLIENTIP_NAME:
+	case TYPE_SERVERIP_NAME:
+	case TYPE_LIP_NAME:
+	case TYPE_RIP_NAME:
+		return NULL;
+	default:
+		return sinsp_filter_check::get_compare_fn();
+	}
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // sinsp_filter_check_thread implementation
 ///////////////////////////////////////////////////////////////////////////////
@@ -2783,6 +2801,16 @@ bool sinsp_filter_check_thread::compare(sinsp_evt *evt)
 	return sinsp_filter_check::compare(evt);
 }
 
+gen_event_filter_check::compare_fn sinsp_filter_check_thread::get_compare_fn()
+{
+	if((m_field_id == TYPE_APID || m_field_id == TYPE_ANAME) && m_argid == -1)
+	{
+		return NULL;
+	}
+
+	return sinsp_filter_check::get_compare_fn();
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // sinsp_filter_check_event implementation
 ///////////////////////////////////////////////////////////////////////////////
@@ -4575,6 +4603,19 @@ bool sinsp_filter_check_event::compare(sinsp_evt *evt)
 	return res;
 }
 
+gen_event_filter_check::compare_fn sinsp_filter_check_event::get_compare_fn()
+{
+	//
+	// evt.buffer is extracted differently when comparing, see m_is_compare
+	//
+	if(m_field_id == TYPE_ARGRAW || m_field_id == TYPE_AROUND || m_field_id == TYPE_BUFFER)
+	{
+		return NULL;
+	}
+
+	return sinsp_filter_check::get_compare_fn();
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // sinsp_filter_check_user implementation
 ///////////////////////////////////////////////////////////////////////////////
@@ -20,6 +20,7 @@ limitations under the License.
 #include <json/json.h>
 #include "filter_value.h"
 #include "prefix_search.h"
+#include "multi_search.h"
 #if !defined(CYGWING_AGENT) && !defined(MINIMAL_BUILD)
 #include "k8s.h"
 #include "mesos.h"
@@ -52,6 +53,7 @@ class check_extraction_cache_entry
 public:
 	uint64_t m_evtnum = UINT64_MAX;
 	uint8_t* m_res;
+	uint32_t m_len = 0;
 };
 
 class check_eval_cache_entry
@@ -102,6 +104,15 @@ public:
 	// Doesn't return the field length because the filtering engine can calculate it.
 	//
 	void add_filter_value(const char* str, uint32_t len, uint32_t i = 0 );
+
+	//
+	// Number of values added with add_filter_value()
+	//
+	uint32_t get_num_filter_values() const
+	{
+		return (uint32_t)m_val_storages.size();
+	}
+
 	virtual size_t parse_filter_value(const char* str, uint32_t len, uint8_t *storage, uint32_t storage_len);
 
 	//
@@ -142,6 +153,13 @@ public:
 	bool compare(gen_event *evt);
 	virtual bool compare(sinsp_evt *evt);
 
+	//
+	// Return a comparator specialized for the type of the field and the
+	// operator. Subclasses overriding compare() must override this too, and
+	// return NULL for the fields they compare in a special way.
+	//
+	virtual compare_fn get_compare_fn();
+
 	//
 	// Extract the value from the event and convert it into a string
 	//
@@ -154,6 +172,9 @@ public:
 	virtual Json::Value tojson(sinsp_evt* evt);
 
 	sinsp* m_inspector;
+	// The field as written in the filter, argument included (e.g.
+	// "proc.aname[2]"). Set by sinsp_filter_compiler, empty otherwise.
+	string m_field_str;
 	bool m_needs_state_tracking = false;
 	sinsp_field_aggregation m_aggregation;
 	sinsp_field_aggregation m_merge_aggregation;
@@ -162,6 +183,7 @@ public:
 
 protected:
 	bool flt_compare(cmpop op, ppm_param_type type, void* operand1, uint32_t op1_len = 0, uint32_t op2_len = 0);
+	bool match_patterns(cmpop op, const char* str);
 
 	char* rawval_to_string(uint8_t* rawval,
 			       ppm_param_type ptype,
@@ -181,6 +203,9 @@ protected:
 
 	path_prefix_search m_val_storages_paths;
 
+	// For the string operators, used when there are several values
+	multi_pattern_search m_val_storages_patterns;
+
 	uint32_t m_val_storages_min_size;
 	uint32_t m_val_storages_max_size;
 
@@ -193,9 +218,25 @@ protected:
 private:
 	void set_inspector(sinsp* inspector);
 
+	template<bool (*eval)(sinsp_filter_check*, sinsp_evt*)> static bool cached(gen_event_filter_check* chk, gen_event* evt);
+	template<typename T> static compare_fn numeric_compare_fn(cmpop op);
+	template<typename T, cmpop op> static bool eval_numeric(sinsp_filter_check* chk, sinsp_evt* evt);
+	template<cmpop op> static bool eval_string(sinsp_filter_check* chk, sinsp_evt* evt);
+	static bool eval_exists(sinsp_filter_check* chk, sinsp_evt* evt);
+	static bool eval_in(sinsp_filter_check* chk, sinsp_evt* evt);
+	static bool eval_pmatch(sinsp_filter_check* chk, sinsp_evt* evt);
+	static bool eval_patterns(sinsp_filter_check* chk, sinsp_evt* evt);
+
+	//
+	// Below this number of values, the string operators just try them one
+	// after the other
+	//
+	static const uint32_t MULTI_PATTERN_MIN_VALUES = 4;
+
 friend class sinsp_filter_check_list;
 friend class sinsp_filter_optimizer;
 friend class chk_compare_helper;
+friend class sinsp_evt_formatter;
 };
 
 //
@@ -295,6 +336,7 @@ public:
 	bool compare_port(sinsp_evt *evt);
 	bool compare_domain(sinsp_evt *evt);
 	bool compare(sinsp_evt *evt);
+	compare_fn get_compare_fn();
 
 	sinsp_threadinfo* m_tinfo;
 	sinsp_fdinfo_t* m_fdinfo;
@@ -373,6 +415,7 @@ public:
 	int32_t parse_field_name(const char* str, bool alloc_state, bool needed_for_filtering);
 	uint8_t* extract(sinsp_evt *evt, OUT uint32_t* len, bool sanitize_strings = true);
 	bool compare(sinsp_evt *evt);
+	compare_fn get_compare_fn();
 
 private:
 	uint64_t extract_exectime(sinsp_evt *evt);
@@ -481,6 +524,7 @@ public:
 	uint8_t* extract(sinsp_evt *evt, OUT uint32_t* len, bool sanitize_strings = true);
 	Json::Value extract_as_js(sinsp_evt *evt, OUT uint32_t* len);
 	bool compare(sinsp_evt *evt);
+	compare_fn get_compare_fn();
 
 	uint64_t m_u64val;
 	uint64_t m_tsdelta;
@@ -655,6 +699,10 @@ public:
 	sinsp_filter_check* allocate_new();
 	uint8_t* extract(sinsp_evt *evt, OUT uint32_t* len, bool sanitize_strings = true);
 	bool compare(sinsp_evt *evt);
+	compare_fn get_compare_fn()
+	{
+		return NULL;
+	}
 
 	uint64_t m_u64val;
 	uint64_t m_tsdelta;
@@ -15,6 +15,8 @@ along with Falco.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include <cstddef>
+#include <algorithm>
+#include <chrono>
 #include "stdint.h"
 #include "gen_filter.h"
 #include "sinsp.h"
@@ -206,7 +208,12 @@ gen_event_filter::gen_event_filter()
 {
 	m_filter = new gen_event_filter_expression();
 	m_curexpr = m_filter;
-
+	m_program_valid = false;
+	// Profiling is opt-in, see set_profiling()
+	m_sample_period = 0;
+	m_reorder_period = DEFAULT_REORDER_PERIOD;
+	m_nruns = 0;
+	m_nsamples = 0;
 }
 
 gen_event_filter::~gen_event_filter()
@@ -237,14 +244,583 @@ void gen_event_filter::pop_expression()
 	}
 
 	m_curexpr = m_curexpr->m_parent;
+	invalidate();
 }
 
 bool gen_event_filter::run(gen_event *evt)
 {
-	return m_filter->compare(evt);
+	if(!m_program_valid)
+	{
+		compile();
+	}
+
+	if(m_sample_period != 0 && ++m_nruns >= m_sample_period)
+	{
+		m_nruns = 0;
+		bool res = run_program<true>(evt);
+
+		if(++m_nsamples >= m_reorder_period)
+		{
+			m_nsamples = 0;
+			reorder();
+		}
+
+		return res;
+	}
+
+	return run_program<false>(evt);
+}
+
+static inline uint64_t profile_now_ns()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+template<bool profile>
+bool gen_event_filter::run_program(gen_event *evt)
+{
+	const gen_event_filter_insn* program = m_program.data();
+	uint32_t size = (uint32_t)m_program.size();
+	uint32_t pc = 0;
+	bool res = true;
+
+	while(pc < size)
+	{
+		const gen_event_filter_insn& insn = program[pc];
+
+		switch(insn.m_op)
+		{
+		case gen_event_filter_insn::FI_CHECK:
+			if(profile)
+			{
+				uint64_t t0 = profile_now_ns();
+				res = insn.m_compare(insn.m_check, evt);
+				gen_event_filter_check_stats& stats = m_check_stats[insn.m_stats_id];
+				stats.m_total_ns += profile_now_ns() - t0;
+				stats.m_nevals++;
+				stats.m_npassed += res;
+				res = res != insn.m_negate;
+			}
+			else
+			{
+				res = insn.m_compare(insn.m_check, evt) != insn.m_negate;
+			}
+			if(res && insn.m_set_id)
+			{
+				evt->set_check_id(insn.m_check->get_check_id());
+			}
+			pc++;
+			break;
+		case gen_event_filter_insn::FI_CONST:
+			res = insn.m_value;
+			pc++;
+			break;
+		case gen_event_filter_insn::FI_NOT:
+			res = !res;
+			pc++;
+			break;
+		case gen_event_filter_insn::FI_SET_ID:
+			if(res)
+			{
+				evt->set_check_id(insn.m_check->get_check_id());
+			}
+			pc++;
+			break;
+		case gen_event_filter_insn::FI_JUMP_IF_TRUE:
+			pc = res ? insn.m_target : pc + 1;
+			break;
+		case gen_event_filter_insn::FI_JUMP_IF_FALSE:
+			pc = res ? pc + 1 : insn.m_target;
+			break;
+		default:
+			ASSERT(false);
+			pc++;
+			break;
+		}
+	}
+
+	return res;
 }
 
 void gen_event_filter::add_check(gen_event_filter_check* chk)
 {
 	m_curexpr->add_check((gen_event_filter_check *) chk);
+	invalidate();
+}
+
+void gen_event_filter::set_profiling(uint32_t sample_period, uint32_t reorder_period)
+{
+	m_sample_period = sample_period;
+	m_reorder_period = reorder_period;
+	m_nruns = 0;
+	m_nsamples = 0;
+}
+
+void gen_event_filter::invalidate()
+{
+	m_program_valid = false;
+	m_orders.clear();
+}
+
+//
+// Comparator of the checks that don't provide a specialized one
+//
+static bool compare_generic(gen_event_filter_check* chk, gen_event* evt)
+{
+	return chk->compare(evt);
+}
+
+void gen_event_filter::compile()
+{
+	m_program.clear();
+	lower_expression(m_filter);
+	thread_jumps();
+	m_program_valid = true;
+}
+
+uint32_t gen_event_filter::emit(gen_event_filter_insn::opcode op, gen_event_filter_check* chk)
+{
+	gen_event_filter_insn insn;
+
+	insn.m_op = op;
+	insn.m_negate = false;
+	insn.m_set_id = false;
+	insn.m_value = true;
+	insn.m_target = 0;
+	insn.m_stats_id = 0;
+	insn.m_check = chk;
+	insn.m_compare = NULL;
+
+	m_program.push_back(insn);
+	return (uint32_t)m_program.size() - 1;
+}
+
+//
+// Emit the code of an expression, leaving its value in the result. This
+// mirrors gen_event_filter_expression::compare(): the operator of every check
+// after the first one becomes a jump to the end of the expression, taken when
+// the result so far already decides it. The operands of a reordered expression
+// are emitted in their new order, all joined by the operator of the expression.
+//
+void gen_event_filter::lower_expression(gen_event_filter_expression* expr)
+{
+	uint32_t size = (uint32_t)expr->m_checks.size();
+	std::vector<uint32_t> exits;
+	// Index of the previous operand if its code is a single constant
+	int64_t prev_const = -1;
+	const std::vector<uint32_t>* order = NULL;
+	uint32_t expr_op = BO_NONE;
+
+	if(size == 0)
+	{
+		emit(gen_event_filter_insn::FI_CONST);
+		return;
+	}
+
+	auto it = m_orders.find(expr);
+	if(it != m_orders.end())
+	{
+		order = &it->second;
+		expr_op = expr->m_checks[1]->m_boolop & ~BO_NOT;
+	}
+
+	for(uint32_t j = 0; j < size; j++)
+	{
+		gen_event_filter_check* chk;
+		uint32_t op;
+
+		if(order == NULL)
+		{
+			chk = expr->m_checks[j];
+			op = chk->m_boolop;
+		}
+		else
+		{
+			chk = expr->m_checks[(*order)[j]];
+			op = (chk->m_boolop & BO_NOT) | (j == 0 ? BO_NONE : expr_op);
+		}
+		ASSERT(chk != NULL);
+
+		bool negate = (op & BO_NOT) != 0;
+		bool set_id;
+
+		if(j == 0)
+		{
+			if(op != BO_NONE && op != BO_NOT)
+			{
+				ASSERT(false);
+				emit(gen_event_filter_insn::FI_CONST);
+				continue;
+			}
+
+			set_id = !negate;
+		}
+		else
+		{
+			gen_event_filter_insn::opcode jump;
+
+			if(op & BO_OR)
+			{
+				jump = gen_event_filter_insn::FI_JUMP_IF_TRUE;
+			}
+			else if(op & BO_AND)
+			{
+				jump = gen_event_filter_insn::FI_JUMP_IF_FALSE;
+			}
+			else
+			{
+				ASSERT(false);
+				continue;
+			}
+
+			if(prev_const != -1)
+			{
+				//
+				// The result is known here: either the jump is always taken,
+				// and nothing after it is reachable, or the constant is
+				// overwritten by this operand.
+				//
+				bool value = m_program[prev_const].m_value;
+
+				if(value == (jump == gen_event_filter_insn::FI_JUMP_IF_TRUE))
+				{
+					break;
+				}
+
+				m_program.pop_back();
+			}
+			else
+			{
+				exits.push_back(emit(jump));
+			}
+
+			set_id = true;
+		}
+
+		uint32_t start = (uint32_t)m_program.size();
+		lower_operand(chk, negate, set_id);
+
+		prev_const = -1;
+		if(m_program.size() == start + 1 &&
+		   m_program[start].m_op == gen_event_filter_insn::FI_CONST)
+		{
+			prev_const = start;
+		}
+	}
+
+	for(uint32_t j = 0; j < exits.size(); j++)
+	{
+		m_program[exits[j]].m_target = (uint32_t)m_program.size();
+	}
+}
+
+void gen_event_filter::lower_operand(gen_event_filter_check* chk, bool negate, bool set_id)
+{
+	gen_event_filter_expression* expr = dynamic_cast<gen_event_filter_expression*>(chk);
+
+	if(expr == NULL)
+	{
+		uint32_t pc = emit(gen_event_filter_insn::FI_CHECK, chk);
+		gen_event_filter_insn& insn = m_program[pc];
+
+		insn.m_negate = negate;
+		insn.m_set_id = set_id;
+		insn.m_compare = chk->get_compare_fn();
+		if(insn.m_compare == NULL)
+		{
+			insn.m_compare = compare_generic;
+		}
+
+		auto it = m_check_stats_ids.find(chk);
+		if(it == m_check_stats_ids.end())
+		{
+			gen_event_filter_check_stats stats = {chk, 0, 0, 0};
+			it = m_check_stats_ids.insert({chk, (uint32_t)m_check_stats.size()}).first;
+			m_check_stats.push_back(stats);
+		}
+		insn.m_stats_id = it->second;
+		return;
+	}
+
+	uint32_t start = (uint32_t)m_program.size();
+	lower_expression(expr);
+	bool is_const = (m_program.size() == start + 1 &&
+			 m_program[start].m_op == gen_event_filter_insn::FI_CONST);
+
+	if(negate)
+	{
+		if(is_const)
+		{
+			m_program[start].m_value = !m_program[start].m_value;
+		}
+		else
+		{
+			emit(gen_event_filter_insn::FI_NOT);
+		}
+	}
+
+	if(set_id && !(is_const && !m_program[start].m_value))
+	{
+		emit(gen_event_filter_insn::FI_SET_ID, chk);
+	}
+}
+
+//
+// Retarget the jumps landing on another jump whose outcome is known, so that
+// a short-circuit inside a nested expression goes straight to the end of the
+// outermost expression it decides.
+//
+void gen_event_filter::thread_jumps()
+{
+	uint32_t size = (uint32_t)m_program.size();
+
+	for(uint32_t j = 0; j < size; j++)
+	{
+		gen_event_filter_insn& insn = m_program[j];
+
+		if(insn.m_op != gen_event_filter_insn::FI_JUMP_IF_TRUE &&
+		   insn.m_op != gen_event_filter_insn::FI_JUMP_IF_FALSE)
+		{
+			continue;
+		}
+
+		// Targets only move forward, so this terminates
+		while(insn.m_target < size)
+		{
+			const gen_event_filter_insn& target = m_program[insn.m_target];
+
+			if(target.m_op == insn.m_op)
+			{
+				insn.m_target = target.m_target;
+			}
+			else if(target.m_op == gen_event_filter_insn::FI_JUMP_IF_TRUE ||
+				target.m_op == gen_event_filter_insn::FI_JUMP_IF_FALSE ||
+				(target.m_op == gen_event_filter_insn::FI_SET_ID &&
+				 insn.m_op == gen_event_filter_insn::FI_JUMP_IF_FALSE))
+			{
+				insn.m_target++;
+			}
+			else
+			{
+				break;
+			}
+		}
+	}
+}
+
+//
+// Minimum number of sampled evaluations of a check before its statistics are
+// used to move it
+//
+#define REORDER_MIN_SAMPLES 16
+
+//
+// A new order is applied only if it lowers the expected cost of the
+// expression by at least this factor, so that noise in the measurements
+// doesn't make the operands flip back and forth
+//
+#define REORDER_MIN_GAIN 0.9
+
+void gen_event_filter::reorder()
+{
+	bool changed = false;
+	estimate est;
+
+	estimate_expression(m_filter, &changed, &est);
+
+	if(changed)
+	{
+		compile();
+	}
+}
+
+//
+// The operands of an expression can be evaluated in any order if they are all
+// joined by the same operator, and if no check id can be set, since the id
+// set on the event is the one of the last check that passed.
+//
+bool gen_event_filter::is_reorderable(gen_event_filter_expression* expr)
+{
+	uint32_t size = (uint32_t)expr->m_checks.size();
+
+	if(size < 2 || expr->get_expr_boolop() == -1)
+	{
+		return false;
+	}
+
+	if(expr->m_checks[0]->m_boolop != BO_NONE && expr->m_checks[0]->m_boolop != BO_NOT)
+	{
+		return false;
+	}
+
+	for(uint32_t j = 0; j < size; j++)
+	{
+		gen_event_filter_check* chk = expr->m_checks[j];
+		gen_event_filter_expression* subexpr = dynamic_cast<gen_event_filter_expression*>(chk);
+
+		if(chk->get_check_id() != 0)
+		{
+			return false;
+		}
+
+		if(subexpr != NULL)
+		{
+			std::vector<gen_event_filter_expression*> stack(1, subexpr);
+
+			while(!stack.empty())
+			{
+				gen_event_filter_expression* e = stack.back();
+				stack.pop_back();
+
+				for(gen_event_filter_check* c : e->m_checks)
+				{
+					if(c->get_check_id() != 0)
+					{
+						return false;
+					}
+
+					gen_event_filter_expression* s = dynamic_cast<gen_event_filter_expression*>(c);
+					if(s != NULL)
+					{
+						stack.push_back(s);
+					}
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+//
+// Compute the expected cost and pass rate of an expression from the
+// statistics of its checks, assuming they are independent, and reorder the
+// operands of the reorderable expressions in it. For 'and' the operands are
+// sorted by cost / (1 - pass rate), for 'or' by cost / pass rate, which
+// minimizes the expected cost of the short-circuit evaluation.
+// Returns false if there aren't enough samples to estimate the expression.
+//
+bool gen_event_filter::estimate_expression(gen_event_filter_expression* expr, bool* changed, estimate* est)
+{
+	uint32_t size = (uint32_t)expr->m_checks.size();
+	std::vector<estimate> operands(size);
+	bool valid = true;
+
+	for(uint32_t j = 0; j < size; j++)
+	{
+		gen_event_filter_check* chk = expr->m_checks[j];
+		gen_event_filter_expression* subexpr = dynamic_cast<gen_event_filter_expression*>(chk);
+
+		if(subexpr != NULL)
+		{
+			valid &= estimate_expression(subexpr, changed, &operands[j]);
+		}
+		else
+		{
+			auto it = m_check_stats_ids.find(chk);
+
+			if(it == m_check_stats_ids.end() ||
+			   m_check_stats[it->second].m_nevals < REORDER_MIN_SAMPLES)
+			{
+				valid = false;
+				continue;
+			}
+
+			operands[j].m_cost = m_check_stats[it->second].avg_ns();
+			operands[j].m_pass = m_check_stats[it->second].pass_rate();
+		}
+
+		// Keep the sort keys well defined for checks below the clock resolution
+		operands[j].m_cost = std::max(operands[j].m_cost, 1.0);
+
+		if(chk->m_boolop & BO_NOT)
+		{
+			operands[j].m_pass = 1 - operands[j].m_pass;
+		}
+	}
+
+	if(size == 0)
+	{
+		est->m_cost = 0;
+		est->m_pass = 1;
+		return true;
+	}
+
+	if(!valid || (size > 1 && !is_reorderable(expr)))
+	{
+		return false;
+	}
+
+	//
+	// Probability of going on to the next operand after evaluating each one
+	//
+	bool is_or = size > 1 && (expr->m_checks[1]->m_boolop & BO_OR);
+	std::vector<double> cont(size);
+
+	for(uint32_t j = 0; j < size; j++)
+	{
+		cont[j] = is_or ? 1 - operands[j].m_pass : operands[j].m_pass;
+	}
+
+	auto expected_cost = [&] (const std::vector<uint32_t>& order)
+	{
+		double cost = 0;
+		double reach = 1;
+
+		for(uint32_t j : order)
+		{
+			cost += reach * operands[j].m_cost;
+			reach *= cont[j];
+		}
+
+		return cost;
+	};
+
+	std::vector<uint32_t> cur_order;
+	auto it = m_orders.find(expr);
+
+	if(it != m_orders.end())
+	{
+		cur_order = it->second;
+	}
+	else
+	{
+		for(uint32_t j = 0; j < size; j++)
+		{
+			cur_order.push_back(j);
+		}
+	}
+
+	double cur_cost = expected_cost(cur_order);
+	double reach = 1;
+
+	for(uint32_t j = 0; j < size; j++)
+	{
+		reach *= cont[j];
+	}
+
+	est->m_cost = cur_cost;
+	est->m_pass = is_or ? 1 - reach : reach;
+
+	if(size < 2)
+	{
+		return true;
+	}
+
+	std::vector<uint32_t> new_order = cur_order;
+	std::stable_sort(new_order.begin(), new_order.end(), [&] (uint32_t a, uint32_t b)
+	{
+		return operands[a].m_cost * (1 - cont[b]) < operands[b].m_cost * (1 - cont[a]);
+	});
+
+	double new_cost = expected_cost(new_order);
+
+	if(new_order != cur_order && new_cost < cur_cost * REORDER_MIN_GAIN)
+	{
+		m_orders[expr] = new_order;
+		est->m_cost = new_cost;
+		*changed = true;
+	}
+
+	return true;
 }
@@ -16,6 +16,7 @@ along with Falco.  If not, see <http://www.gnu.org/licenses/>.
 
 #pragma once
 
+#include <unordered_map>
 #include <vector>
 
 /*
@@ -109,6 +110,22 @@ public:
 	virtual bool compare(gen_event *evt) = 0;
 	virtual uint8_t* extract(gen_event *evt, uint32_t* len, bool sanitize_strings = true) = 0;
 
+	//
+	// A function returning the same result as compare() for a given check
+	//
+	typedef bool (*compare_fn)(gen_event_filter_check* chk, gen_event* evt);
+
+	//
+	// Return a comparator specialized for the field type and the operator of
+	// this check, chosen once when the filter is compiled, or NULL if the
+	// check must be evaluated through compare(). Must be called after the
+	// field and the values have been parsed.
+	//
+	virtual compare_fn get_compare_fn()
+	{
+		return NULL;
+	}
+
 	//
 	// Configure numeric id to be set on events that match this filter
 	//
@@ -164,7 +181,56 @@ public:
 	std::vector<gen_event_filter_check*> m_checks;
 };
 
+///////////////////////////////////////////////////////////////////////////////
+// Filter program
+// The expression tree of a filter is lowered into a flat list of instructions
+// operating on a single boolean result, where the short-circuit of and/or is
+// a forward jump. Leaf checks are bound to the comparator returned by their
+// get_compare_fn(), so that evaluating a check costs one indirect call.
+///////////////////////////////////////////////////////////////////////////////
+struct gen_event_filter_insn
+{
+	enum opcode
+	{
+		FI_CHECK = 0,         // res = compare(check), negated if m_negate
+		FI_CONST = 1,         // res = m_value
+		FI_NOT = 2,           // res = !res
+		FI_SET_ID = 3,        // if res, set the check id of m_check on the event
+		FI_JUMP_IF_TRUE = 4,  // if res, continue at m_target
+		FI_JUMP_IF_FALSE = 5, // if !res, continue at m_target
+	};
+
+	opcode m_op;
+	bool m_negate;
+	bool m_set_id;
+	bool m_value;
+	uint32_t m_target;
+	// Index of the check in the statistics of the filter
+	uint32_t m_stats_id;
+	gen_event_filter_check* m_check;
+	gen_event_filter_check::compare_fn m_compare;
+};
+
+//
+// Statistics of a leaf check, collected on a sample of the evaluations
+//
+struct gen_event_filter_check_stats
+{
+	gen_event_filter_check* m_check;
+	uint64_t m_nevals;   // Sampled evaluations
+	uint64_t m_npassed;  // Sampled evaluations that returned true, before any 'not'
+	uint64_t m_total_ns; // Time spent in the sampled evaluations
 
+	double pass_rate() const
+	{
+		return m_nevals ? (double)m_npassed / m_nevals : 0;
+	}
+
+	double avg_ns() const
+	{
+		return m_nevals ? (double)m_total_ns / m_nevals : 0;
+	}
+};
 
 class gen_event_filter
 {
@@ -184,11 +250,83 @@ public:
 	void pop_expression();
 	void add_check(gen_event_filter_check* chk);
 
+	/*!
+	  \brief Lower the expression tree into the program executed by run().
+	  This is done automatically by the first run() after the filter is
+	  modified.
+	*/
+	void compile();
+
+	/*!
+	  \brief Return the program executed by run(), for debugging purposes.
+	*/
+	const std::vector<gen_event_filter_insn>& get_program()
+	{
+		return m_program;
+	}
+
+	/*!
+	  \brief Configure the profiling of the checks. One run() every
+	  sample_period measures the cost and the pass rate of the checks it
+	  evaluates, and every reorder_period samples the operands of the and/or
+	  expressions are reordered to minimize the expected cost of the filter.
+	  A sample_period of 0, the default, disables both.
+	  DEFAULT_SAMPLE_PERIOD is a good starting point to enable them.
+
+	  Only the operands of expressions that use a single operator and don't
+	  set check ids are moved, so the result of the filter doesn't change.
+	*/
+	void set_profiling(uint32_t sample_period, uint32_t reorder_period = DEFAULT_REORDER_PERIOD);
+
+	/*!
+	  \brief Return the statistics of the leaf checks of the filter, in the
+	  order in which they were first compiled.
+	*/
+	const std::vector<gen_event_filter_check_stats>& get_check_stats() const
+	{
+		return m_check_stats;
+	}
+
+	static const uint32_t DEFAULT_SAMPLE_PERIOD = 64;
+	static const uint32_t DEFAULT_REORDER_PERIOD = 1024;
+
 	gen_event_filter_expression* m_filter;
 
 protected:
 	gen_event_filter_expression* m_curexpr;
 
+private:
+	//
+	// Estimated cost and pass rate of an operand
+	//
+	struct estimate
+	{
+		double m_cost;
+		double m_pass;
+	};
+
+	template<bool profile> bool run_program(gen_event *evt);
+	void invalidate();
+	void lower_expression(gen_event_filter_expression* expr);
+	void lower_operand(gen_event_filter_check* chk, bool negate, bool set_id);
+	uint32_t emit(gen_event_filter_insn::opcode op, gen_event_filter_check* chk = NULL);
+	void thread_jumps();
+	void reorder();
+	bool is_reorderable(gen_event_filter_expression* expr);
+	bool estimate_expression(gen_event_filter_expression* expr, bool* changed, estimate* est);
+
+	std::vector<gen_event_filter_insn> m_program;
+	bool m_program_valid;
+
+	uint32_t m_sample_period;
+	uint32_t m_reorder_period;
+	uint32_t m_nruns;
+	uint32_t m_nsamples;
+	std::vector<gen_event_filter_check_stats> m_check_stats;
+	std::unordered_map<gen_event_filter_check*, uint32_t> m_check_stats_ids;
+	// Order of the operands of the reordered expressions
+	std::unordered_map<gen_event_filter_expression*, std::vector<uint32_t>> m_orders;
+
 	friend class sinsp_filter_compiler;
 	friend class sinsp_filter_optimizer;
 };
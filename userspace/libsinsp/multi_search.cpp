@@ -0,0 +1,257 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include <string.h>
+
+#include "multi_search.h"
+
+using namespace std;
+
+#define NO_STATE 0xffffffff
+
+multi_pattern_search::multi_pattern_search():
+	m_case_insensitive(false),
+	m_built(false),
+	m_has_empty(false),
+	m_nsymbols(0)
+{
+	memset(m_symbols, 0, sizeof(m_symbols));
+}
+
+void multi_pattern_search::set_case_insensitive(bool case_insensitive)
+{
+	m_case_insensitive = case_insensitive;
+	m_built = false;
+}
+
+void multi_pattern_search::add_pattern(const filter_value_t& pattern)
+{
+	add_pattern(string((const char*)pattern.first, pattern.second));
+}
+
+void multi_pattern_search::add_pattern(const string& pattern)
+{
+	m_patterns.push_back(pattern);
+	m_built = false;
+}
+
+void multi_pattern_search::build()
+{
+	//
+	// Assign a symbol to every byte used by the patterns
+	//
+	memset(m_symbols, 0, sizeof(m_symbols));
+	m_nsymbols = 1;
+	m_has_empty = false;
+
+	for(const string& pattern : m_patterns)
+	{
+		for(unsigned char c : pattern)
+		{
+			uint8_t f = fold(c);
+			if(m_symbols[f] == 0)
+			{
+				m_symbols[f] = (uint16_t)m_nsymbols++;
+			}
+		}
+	}
+
+	if(m_case_insensitive)
+	{
+		for(uint32_t c = 'A'; c <= 'Z'; c++)
+		{
+			m_symbols[c] = m_symbols[c - 'A' + 'a'];
+		}
+	}
+
+	//
+	// Build the trie
+	//
+	m_delta.assign(m_nsymbols, NO_STATE);
+	m_depth.assign(1, 0);
+	m_flags.assign(1, 0);
+
+	for(const string& pattern : m_patterns)
+	{
+		uint32_t state = 0;
+
+		if(pattern.empty())
+		{
+			m_has_empty = true;
+			continue;
+		}
+
+		for(unsigned char c : pattern)
+		{
+			uint32_t* t = &m_delta[state * m_nsymbols + m_symbols[c]];
+
+			if(*t == NO_STATE)
+			{
+				*t = (uint32_t)m_depth.size();
+				m_depth.push_back(m_depth[state] + 1);
+				m_flags.push_back(0);
+				m_delta.resize(m_delta.size() + m_nsymbols, NO_STATE);
+				// m_delta may have been reallocated
+				t = &m_delta[state * m_nsymbols + m_symbols[c]];
+			}
+
+			state = *t;
+		}
+
+		m_flags[state] |= SF_PATTERN_END | SF_MATCH;
+	}
+
+	//
+	// Breadth first, compute the failure link of every state and replace
+	// the missing transitions with the ones of the failure state, which has
+	// already been completed since it's less deep
+	//
+	uint32_t nstates = (uint32_t)m_depth.size();
+	vector<uint32_t> fail(nstates, 0);
+	vector<uint32_t> queue;
+	queue.reserve(nstates);
+
+	for(uint32_t s = 0; s < m_nsymbols; s++)
+	{
+		uint32_t& t = m_delta[s];
+
+		if(t == NO_STATE)
+		{
+			t = 0;
+		}
+		else
+		{
+			fail[t] = 0;
+			queue.push_back(t);
+		}
+	}
+
+	for(size_t j = 0; j < queue.size(); j++)
+	{
+		uint32_t state = queue[j];
+
+		m_flags[state] |= (m_flags[fail[state]] & SF_MATCH);
+
+		for(uint32_t s = 0; s < m_nsymbols; s++)
+		{
+			uint32_t& t = m_delta[state * m_nsymbols + s];
+			uint32_t ft = m_delta[fail[state] * m_nsymbols + s];
+
+			if(t == NO_STATE)
+			{
+				t = ft;
+			}
+			else
+			{
+				fail[t] = ft;
+				queue.push_back(t);
+			}
+		}
+	}
+
+	m_built = true;
+}
+
+bool multi_pattern_search::contains(const uint8_t* str, uint32_t len)
+{
+	if(!m_built)
+	{
+		build();
+	}
+
+	if(m_has_empty)
+	{
+		return true;
+	}
+
+	uint32_t state = 0;
+
+	for(uint32_t j = 0; j < len; j++)
+	{
+		state = next(state, str[j]);
+
+		if(m_flags[state] & SF_MATCH)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool multi_pattern_search::starts_with(const uint8_t* str, uint32_t len)
+{
+	if(!m_built)
+	{
+		build();
+	}
+
+	if(m_has_empty)
+	{
+		return true;
+	}
+
+	uint32_t state = 0;
+
+	//
+	// Follow the trie as long as the string is a prefix of a pattern, i.e.
+	// as long as no failure link is taken
+	//
+	for(uint32_t j = 0; j < len; j++)
+	{
+		state = next(state, str[j]);
+
+		if(m_depth[state] != j + 1)
+		{
+			return false;
+		}
+
+		if(m_flags[state] & SF_PATTERN_END)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool multi_pattern_search::ends_with(const uint8_t* str, uint32_t len)
+{
+	if(!m_built)
+	{
+		build();
+	}
+
+	if(m_has_empty)
+	{
+		return true;
+	}
+
+	uint32_t state = 0;
+
+	for(uint32_t j = 0; j < len; j++)
+	{
+		state = next(state, str[j]);
+	}
+
+	//
+	// The final state is the longest suffix of the string that is a prefix
+	// of a pattern, so a pattern is a suffix of the string if it ends there
+	// or at one of its failure states
+	//
+	return (m_flags[state] & SF_MATCH) != 0;
+}
@@ -0,0 +1,98 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "filter_value.h"
+
+//
+// A data structure that tests a string against a set of patterns at once,
+// looking for any pattern contained in it, or being a prefix or a suffix of
+// it. The cost of a search is linear in the length of the string, whatever
+// the number of patterns.
+//
+// This is an Aho-Corasick automaton turned into a DFA: every state has a
+// transition for every symbol, so searching is a single table lookup per
+// byte. To keep the table small, the bytes that don't appear in any pattern
+// share the same symbol.
+//
+// The automaton is built by the first search after a pattern is added.
+//
+class multi_pattern_search
+{
+public:
+	multi_pattern_search();
+
+	//
+	// With case_insensitive set, the ASCII letters match regardless of their
+	// case, like strcasestr(). Must be called before adding patterns.
+	//
+	void set_case_insensitive(bool case_insensitive);
+
+	// The pattern is copied
+	void add_pattern(const filter_value_t& pattern);
+	void add_pattern(const std::string& pattern);
+
+	size_t size() const
+	{
+		return m_patterns.size();
+	}
+
+	bool contains(const uint8_t* str, uint32_t len);
+	bool starts_with(const uint8_t* str, uint32_t len);
+	bool ends_with(const uint8_t* str, uint32_t len);
+
+private:
+	void build();
+
+	uint8_t fold(uint8_t c) const
+	{
+		return (m_case_insensitive && c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+	}
+
+	uint32_t next(uint32_t state, uint8_t c) const
+	{
+		return m_delta[state * m_nsymbols + m_symbols[c]];
+	}
+
+	bool m_case_insensitive;
+	bool m_built;
+	// An empty pattern matches any string
+	bool m_has_empty;
+	std::vector<std::string> m_patterns;
+
+	// Symbol of every byte, 0 for the bytes not in any pattern
+	uint16_t m_symbols[256];
+	uint32_t m_nsymbols;
+	// Transitions, m_nsymbols per state. State 0 is the root.
+	std::vector<uint32_t> m_delta;
+	// Length of the prefix of a pattern reached by every state
+	std::vector<uint32_t> m_depth;
+	// Flags of every state
+	std::vector<uint8_t> m_flags;
+
+	enum state_flags
+	{
+		SF_PATTERN_END = 1, // A pattern ends exactly at this state
+		SF_MATCH = 2,       // This state or one of its suffixes is a pattern end
+	};
+};
@@ -0,0 +1,227 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include <memory>
+#include <thread>
+
+#include "parallel_replay.h"
+#include "scap_open_exception.h"
+#include "sinsp_int.h"
+
+sinsp_parallel_replay::sinsp_parallel_replay(const std::string& filename, uint32_t nworkers):
+	m_filename(filename),
+	m_nworkers(nworkers),
+	m_next_chunk(0),
+	m_failed(false),
+	m_num_events(0),
+	m_num_matched_events(0)
+{
+	if(nworkers == 0)
+	{
+		throw sinsp_exception("parallel replay needs at least one worker");
+	}
+}
+
+sinsp_parallel_replay::~sinsp_parallel_replay()
+{
+}
+
+void sinsp_parallel_replay::set_filter(const std::string& filter)
+{
+	m_filter = filter;
+}
+
+void sinsp_parallel_replay::set_setup_handler(const setup_handler& handler)
+{
+	m_setup = handler;
+}
+
+void sinsp_parallel_replay::set_end_handler(const setup_handler& handler)
+{
+	m_end = handler;
+}
+
+void sinsp_parallel_replay::open()
+{
+	char error[SCAP_LASTERR_SIZE];
+	int32_t scap_rc;
+	uint64_t pos;
+	int32_t res;
+
+	scap_t* h = scap_open_offline(m_filename.c_str(), error, &scap_rc);
+	if(h == NULL)
+	{
+		throw scap_open_exception(error, scap_rc);
+	}
+
+	//
+	// Every chunk would decompress the file from the beginning to reach
+	// its section
+	//
+	if(scap_is_compressed_capture(h))
+	{
+		scap_close(h);
+		m_chunks.clear();
+		throw sinsp_exception("parallel replay is not supported on compressed files");
+	}
+
+	//
+	// The first chunk starts with the file
+	//
+	m_chunks.clear();
+	m_chunks.push_back(0);
+
+	while((res = scap_next_section(h, &pos)) == SCAP_SUCCESS)
+	{
+		m_chunks.push_back(pos);
+	}
+
+	if(res != SCAP_EOF)
+	{
+		std::string err = scap_getlasterr(h);
+		scap_close(h);
+		m_chunks.clear();
+		throw sinsp_exception(err);
+	}
+
+	scap_close(h);
+}
+
+void sinsp_parallel_replay::run(const event_handler& handler)
+{
+	std::vector<std::thread> threads;
+	uint32_t nworkers = m_nworkers < m_chunks.size() ? m_nworkers : (uint32_t)m_chunks.size();
+
+	if(m_chunks.empty())
+	{
+		throw sinsp_exception("parallel replay not open");
+	}
+
+	m_next_chunk = 0;
+	m_failed = false;
+	m_error = nullptr;
+
+	for(uint32_t j = 0; j < nworkers; j++)
+	{
+		threads.emplace_back(&sinsp_parallel_replay::worker_loop, this, handler);
+	}
+
+	for(auto& thread : threads)
+	{
+		thread.join();
+	}
+
+	if(m_error)
+	{
+		std::rethrow_exception(m_error);
+	}
+}
+
+uint64_t sinsp_parallel_replay::get_num_events() const
+{
+	return m_num_events.load(std::memory_order_relaxed);
+}
+
+uint64_t sinsp_parallel_replay::get_num_matched_events() const
+{
+	return m_num_matched_events.load(std::memory_order_relaxed);
+}
+
+void sinsp_parallel_replay::worker_loop(const event_handler& handler)
+{
+	while(!m_failed.load(std::memory_order_relaxed))
+	{
+		uint32_t chunk = m_next_chunk.fetch_add(1, std::memory_order_relaxed);
+
+		if(chunk >= m_chunks.size())
+		{
+			break;
+		}
+
+		try
+		{
+			replay_chunk(chunk, handler);
+		}
+		catch(...)
+		{
+			std::lock_guard<std::mutex> lock(m_error_mutex);
+
+			if(!m_error)
+			{
+				m_error = std::current_exception();
+			}
+			m_failed = true;
+		}
+	}
+}
+
+void sinsp_parallel_replay::replay_chunk(uint32_t chunk, const event_handler& handler)
+{
+	std::unique_ptr<sinsp> inspector(new sinsp());
+	uint64_t end = chunk + 1 < m_chunks.size() ? m_chunks[chunk + 1] : 0;
+	uint64_t nmatched = 0;
+	sinsp_evt* evt;
+	int32_t res;
+
+	inspector->set_file_range(m_chunks[chunk], end);
+
+	if(m_setup)
+	{
+		m_setup(chunk, inspector.get());
+	}
+
+	inspector->open(m_filename);
+
+	//
+	// sinsp::close() deletes the filter, so it's set on the open inspector
+	//
+	if(!m_filter.empty())
+	{
+		inspector->set_filter(m_filter);
+	}
+
+	while(!m_failed.load(std::memory_order_relaxed))
+	{
+		res = inspector->next(&evt);
+
+		if(res == SCAP_TIMEOUT)
+		{
+			continue;
+		}
+		else if(res == SCAP_EOF)
+		{
+			break;
+		}
+		else if(res != SCAP_SUCCESS)
+		{
+			throw sinsp_exception(inspector->getlasterr());
+		}
+
+		handler(chunk, evt);
+		nmatched++;
+	}
+
+	if(m_end && !m_failed.load(std::memory_order_relaxed))
+	{
+		m_end(chunk, inspector.get());
+	}
+
+	m_num_events.fetch_add(inspector->get_num_events(), std::memory_order_relaxed);
+	m_num_matched_events.fetch_add(nmatched, std::memory_order_relaxed);
+
+	inspector->close();
+}
@@ -0,0 +1,136 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+//
+// parallel_replay.h
+//
+// multi-threaded offline replay: a trace file is split at its sections
+// (checkpoints written by sinsp_dumper::checkpoint() or merged captures) and
+// every chunk is parsed by its own inspector on a pool of worker threads
+//
+
+#pragma once
+
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "sinsp.h"
+
+//
+// Trace file replayed by nworkers threads in parallel.
+//
+// A chunk goes from a section of the file to the next one. Since every
+// section holds the thread, fd and container tables saved by the writer, a
+// chunk can be parsed by a fresh inspector without the previous part of the
+// file. The workers pick the chunks in file order, every chunk with a new
+// inspector, and run the filter and the event handler on its events.
+//
+// The events of a chunk are delivered in file order, but the handler is
+// invoked concurrently for different chunks: results collected per chunk and
+// merged in chunk order are the ones of a sequential replay.
+//
+// Limitations:
+//  - the state known at the start of a chunk is the one saved in its
+//    section: the events before it aren't parsed, so e.g. a syscall whose
+//    enter event is in the previous chunk is seen without it.
+//  - files without checkpoints are a single chunk.
+//  - compressed files are refused by open(): every chunk would decompress
+//    the file from the beginning to reach its section.
+//  - a chisel fed from the handler sees the events of all the chunks out of
+//    order: sinsp_chisel_parallel_replay (WITH_CHISEL) runs an instance of
+//    the chisel per chunk instead, and merges their output in chunk order.
+//
+class SINSP_PUBLIC sinsp_parallel_replay
+{
+public:
+	typedef std::function<void(uint32_t chunk, sinsp_evt* evt)> event_handler;
+	typedef std::function<void(uint32_t chunk, sinsp* inspector)> setup_handler;
+
+	sinsp_parallel_replay(const std::string& filename, uint32_t nworkers);
+	~sinsp_parallel_replay();
+
+	/*!
+	  \brief Filter applied by the inspector of every chunk, see
+	  sinsp::set_filter().
+	*/
+	void set_filter(const std::string& filter);
+
+	/*!
+	  \brief Called on the worker thread with the inspector of every chunk
+	  before it's opened, to configure it (snaplen, callbacks, ...).
+	*/
+	void set_setup_handler(const setup_handler& handler);
+
+	/*!
+	  \brief Called on the worker thread with the inspector of every chunk
+	  after its last event, before it's closed. Not called for the chunks
+	  interrupted by the failure of another one.
+	*/
+	void set_end_handler(const setup_handler& handler);
+
+	/*!
+	  \brief Find the sections of the file, which is split in
+	  get_num_chunks() chunks.
+
+	  @throws a sinsp_exception containing the error string is thrown in case
+	   of failure, or if the file is compressed.
+	*/
+	void open();
+
+	uint32_t get_num_chunks() const
+	{
+		return (uint32_t)m_chunks.size();
+	}
+
+	/*!
+	  \brief Replay the chunks and return when all of them are done.
+	  handler is invoked from the worker threads for every event accepted
+	  by the filter.
+
+	  @throws the first exception thrown by a worker, after the other ones
+	   stopped.
+	*/
+	void run(const event_handler& handler);
+
+	//
+	// Number of events read by the inspectors and number of events passed
+	// to the handler, over all the chunks replayed so far.
+	//
+	uint64_t get_num_events() const;
+	uint64_t get_num_matched_events() const;
+
+private:
+	void worker_loop(const event_handler& handler);
+	void replay_chunk(uint32_t chunk, const event_handler& handler);
+
+	std::string m_filename;
+	uint32_t m_nworkers;
+	std::string m_filter;
+	setup_handler m_setup;
+	setup_handler m_end;
+	// Position of the section starting every chunk
+	std::vector<uint64_t> m_chunks;
+	std::atomic<uint32_t> m_next_chunk;
+	std::atomic<bool> m_failed;
+	std::mutex m_error_mutex;
+	std::exception_ptr m_error;
+	std::atomic<uint64_t> m_num_events;
+	std::atomic<uint64_t> m_num_matched_events;
+};
@@ -1166,6 +1166,10 @@ void sinsp_parser::parse_clone_exit(sinsp_evt *evt)
 		// Copy the command arguments from the parent
 		tinfo->m_args = ptinfo->m_args;
 
+		// Start from the cgroups of the parent, so that they stay shared
+		// if the event reports the same ones
+		tinfo->m_cgroups = ptinfo->m_cgroups;
+
 		// Copy the root from the parent
 		tinfo->m_root = ptinfo->m_root;
 
@@ -1214,6 +1218,7 @@ void sinsp_parser::parse_clone_exit(sinsp_evt *evt)
 			tinfo->m_exe = ptinfo->m_exe;
 			tinfo->m_exepath = ptinfo->m_exepath;
 			tinfo->m_args = ptinfo->m_args;
+			tinfo->m_cgroups = ptinfo->m_cgroups;
 			tinfo->m_root = ptinfo->m_root;
 			tinfo->m_sid = ptinfo->m_sid;
 			tinfo->m_vpgid = ptinfo->m_vpgid;
@@ -1304,10 +1309,10 @@ void sinsp_parser::parse_clone_exit(sinsp_evt *evt)
 		//
 		// Track down that those are cloned fds
 		//
-		for(auto fdit = tinfo->m_fdtable.m_table.begin(); fdit != tinfo->m_fdtable.m_table.end(); ++fdit)
-		{
-			fdit->second.set_is_cloned();
-		}
+		tinfo->m_fdtable.loop([] (int64_t fd, sinsp_fdinfo_t& fdinfo) {
+			fdinfo.set_is_cloned();
+			return true;
+		});
 
 		//
 		// It's important to reset the cache of the child thread, to prevent it from
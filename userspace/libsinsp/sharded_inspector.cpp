@@ -0,0 +1,601 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include <chrono>
+#include <cstring>
+
+#include "sharded_inspector.h"
+#include "scap_open_exception.h"
+#include "sinsp_int.h"
+
+//
+// Number of events fetched from a scap_reader at a time
+//
+#define SHARDED_READER_BATCH 64
+
+//
+// When a reader finds its buffers empty, it assumes that events it will read
+// in the future were generated at most this long ago. Only used to let the
+// other readers proceed in ordered mode. The buffers don't tell how far the
+// producers got, so an event written later than this after its timestamp is
+// delivered out of order, see get_num_out_of_order_events().
+//
+#define SHARDED_READER_IDLE_DELAY_NS 10000000ULL
+
+//
+// Events bigger than half of a queue are dropped, since they could never
+// find room in it if the queue is fragmented
+//
+#define SHARDED_MIN_QUEUE_SIZE (1024 * 1024)
+
+//
+// How long a shard sleeps when none of its queues has an event it can return
+//
+#define SHARDED_SHARD_IDLE_SLEEP_US 100
+
+static inline uint32_t record_len(uint32_t evt_len)
+{
+	return 8 + ((evt_len + 7) & ~7U);
+}
+
+static inline uint64_t now_ns()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// sinsp_event_queue implementation
+///////////////////////////////////////////////////////////////////////////////
+sinsp_event_queue::sinsp_event_queue(uint32_t size):
+	m_size(size & ~7U),
+	m_head(0),
+	m_tail(0)
+{
+	m_buf = new uint8_t[m_size];
+}
+
+sinsp_event_queue::~sinsp_event_queue()
+{
+	delete[] m_buf;
+}
+
+bool sinsp_event_queue::push(scap_evt* evt, uint16_t cpuid)
+{
+	uint32_t len = evt->len;
+	uint32_t rec = record_len(len);
+	uint64_t head = m_head.load(std::memory_order_relaxed);
+	uint64_t tail = m_tail.load(std::memory_order_acquire);
+	uint32_t off = (uint32_t)(head % m_size);
+	uint32_t needed = rec;
+
+	if(off + rec > m_size)
+	{
+		needed += m_size - off;
+	}
+
+	if(head + needed - tail > m_size)
+	{
+		return false;
+	}
+
+	if(off + rec > m_size)
+	{
+		record_hdr* filler = (record_hdr*)(m_buf + off);
+		filler->m_len = 0;
+		filler->m_cpuid = FILLER_CPUID;
+		head += m_size - off;
+		off = 0;
+	}
+
+	record_hdr* hdr = (record_hdr*)(m_buf + off);
+	hdr->m_len = len;
+	hdr->m_cpuid = cpuid;
+	memcpy(m_buf + off + sizeof(record_hdr), evt, len);
+
+	m_head.store(head + rec, std::memory_order_release);
+	return true;
+}
+
+scap_evt* sinsp_event_queue::front(OUT uint16_t* pcpuid)
+{
+	uint64_t tail = m_tail.load(std::memory_order_relaxed);
+
+	if(tail == m_head.load(std::memory_order_acquire))
+	{
+		return NULL;
+	}
+
+	uint32_t off = (uint32_t)(tail % m_size);
+	record_hdr* hdr = (record_hdr*)(m_buf + off);
+
+	if(hdr->m_cpuid == FILLER_CPUID)
+	{
+		//
+		// The record following a filler is published together with it
+		//
+		m_tail.store(tail + m_size - off, std::memory_order_release);
+		hdr = (record_hdr*)m_buf;
+		off = 0;
+	}
+
+	*pcpuid = hdr->m_cpuid;
+	return (scap_evt*)(m_buf + off + sizeof(record_hdr));
+}
+
+void sinsp_event_queue::pop()
+{
+	uint64_t tail = m_tail.load(std::memory_order_relaxed);
+	record_hdr* hdr = (record_hdr*)(m_buf + tail % m_size);
+
+	m_tail.store(tail + record_len(hdr->m_len), std::memory_order_release);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// sinsp_sharded_inspector implementation
+///////////////////////////////////////////////////////////////////////////////
+sinsp_sharded_inspector::sinsp_sharded_inspector(uint32_t nshards, uint32_t nreaders, uint32_t queue_size):
+	m_nreaders(nreaders),
+	m_queue_size(queue_size),
+	m_ordered(false),
+	m_wakeup_watermark(0),
+	m_ring_buf_size(0),
+	m_h(NULL),
+	m_out_of_order(0),
+	m_running(false)
+{
+	if(nshards == 0 || nreaders == 0)
+	{
+		throw sinsp_exception("sharded inspector needs at least one shard and one reader");
+	}
+
+	if(queue_size < SHARDED_MIN_QUEUE_SIZE)
+	{
+		throw sinsp_exception("sharded inspector queue size too small");
+	}
+
+	for(uint32_t j = 0; j < nshards; j++)
+	{
+		m_shards.emplace_back(new sinsp());
+	}
+}
+
+sinsp_sharded_inspector::~sinsp_sharded_inspector()
+{
+	close();
+}
+
+sinsp* sinsp_sharded_inspector::get_shard(uint32_t shard)
+{
+	return m_shards.at(shard).get();
+}
+
+void sinsp_sharded_inspector::set_ordered(bool ordered)
+{
+	m_ordered = ordered;
+}
+
+void sinsp_sharded_inspector::set_wakeup_watermark(uint32_t watermark)
+{
+	m_wakeup_watermark = watermark;
+}
+
+void sinsp_sharded_inspector::set_ring_buf_size(uint32_t size)
+{
+	m_ring_buf_size = size;
+}
+
+void sinsp_sharded_inspector::open(const std::string& bpf_probe)
+{
+	char error[SCAP_LASTERR_SIZE];
+	int32_t scap_rc;
+	scap_open_args oargs;
+
+	if(m_h != NULL)
+	{
+		throw sinsp_exception("sharded inspector already open");
+	}
+
+	oargs.mode = SCAP_MODE_LIVE;
+	oargs.fd = 0;
+	oargs.fname = NULL;
+	oargs.proc_callback = NULL;
+	oargs.proc_callback_context = NULL;
+	oargs.import_users = false;
+	oargs.start_offset = 0;
+	oargs.bpf_probe = bpf_probe.empty() ? NULL : bpf_probe.c_str();
+	oargs.suppressed_comms[0] = NULL;
+	oargs.udig = false;
+	oargs.debug_log_fn = NULL;
+	oargs.proc_scan_timeout_ms = SCAP_PROC_SCAN_TIMEOUT_NONE;
+	oargs.proc_scan_log_interval_ms = SCAP_PROC_SCAN_LOG_NONE;
+	oargs.relaxed_ordering = false;
+	oargs.wakeup_watermark = m_wakeup_watermark;
+	oargs.bpf_ringbuf_groups = 0;
+	oargs.ring_buf_size = m_ring_buf_size;
+
+	m_h = scap_open(oargs, error, &scap_rc);
+	if(m_h == NULL)
+	{
+		throw scap_open_exception(error, scap_rc);
+	}
+
+	try
+	{
+		//
+		// Split the devices in contiguous groups, one per reader
+		//
+		uint32_t ndevs = scap_get_ndevs(m_h);
+		uint32_t nreaders = m_nreaders < ndevs ? m_nreaders : ndevs;
+		uint32_t first_dev = 0;
+
+		for(uint32_t j = 0; j < nreaders; j++)
+		{
+			uint32_t reader_ndevs = ndevs / nreaders + (j < ndevs % nreaders ? 1 : 0);
+			std::unique_ptr<reader_state> state(new reader_state());
+
+			scap_reader* reader = scap_reader_open(m_h, first_dev, reader_ndevs, error, &scap_rc);
+			if(reader == NULL)
+			{
+				throw scap_open_exception(error, scap_rc);
+			}
+
+			add_reader(reader);
+			first_dev += reader_ndevs;
+		}
+
+		open_shards();
+	}
+	catch(...)
+	{
+		close();
+		throw;
+	}
+}
+
+void sinsp_sharded_inspector::add_reader(scap_reader* reader)
+{
+	std::unique_ptr<reader_state> state(new reader_state());
+
+	state->m_reader = reader;
+	state->m_low_watermark = 0;
+	state->m_routed = 0;
+	state->m_full_waits = 0;
+	state->m_dropped = 0;
+
+	m_readers.push_back(std::move(state));
+}
+
+void sinsp_sharded_inspector::open_shards()
+{
+	for(uint32_t j = 0; j < m_readers.size() * m_shards.size(); j++)
+	{
+		m_queues.emplace_back(new sinsp_event_queue(m_queue_size));
+	}
+
+	m_pending_pop.assign(m_shards.size(), NULL);
+	m_next_reader.assign(m_shards.size(), 0);
+	m_last_ts.assign(m_shards.size(), 0);
+	m_out_of_order = 0;
+
+	for(uint32_t j = 0; j < m_shards.size(); j++)
+	{
+		m_shards[j]->open_shard([this, j](scap_evt** pevent, uint16_t* pcpuid)
+		{
+			return next_shard_event(j, pevent, pcpuid);
+		});
+	}
+}
+
+void sinsp_sharded_inspector::start(const event_handler& handler)
+{
+	if(m_h == NULL || m_running)
+	{
+		throw sinsp_exception("sharded inspector not open or already started");
+	}
+
+	m_running = true;
+
+	for(uint32_t j = 0; j < m_readers.size(); j++)
+	{
+		m_threads.emplace_back(&sinsp_sharded_inspector::reader_loop, this, j);
+	}
+
+	for(uint32_t j = 0; j < m_shards.size(); j++)
+	{
+		m_threads.emplace_back(&sinsp_sharded_inspector::shard_loop, this, j, handler);
+	}
+}
+
+void sinsp_sharded_inspector::stop()
+{
+	m_running = false;
+
+	for(auto& thread : m_threads)
+	{
+		thread.join();
+	}
+	m_threads.clear();
+}
+
+void sinsp_sharded_inspector::close()
+{
+	stop();
+
+	for(auto& shard : m_shards)
+	{
+		shard->close();
+	}
+
+	//
+	// The readers must be closed before the handle they belong to
+	//
+	for(auto& state : m_readers)
+	{
+		if(state->m_reader != NULL)
+		{
+			scap_reader_close(state->m_reader);
+		}
+	}
+	m_readers.clear();
+	m_queues.clear();
+	m_pending_pop.clear();
+	m_next_reader.clear();
+	m_last_ts.clear();
+
+	if(m_h != NULL)
+	{
+		scap_close(m_h);
+		m_h = NULL;
+	}
+}
+
+uint64_t sinsp_sharded_inspector::get_num_routed_events() const
+{
+	uint64_t res = 0;
+
+	for(auto& state : m_readers)
+	{
+		res += state->m_routed.load(std::memory_order_relaxed);
+	}
+
+	return res;
+}
+
+uint64_t sinsp_sharded_inspector::get_num_queue_full_waits() const
+{
+	uint64_t res = 0;
+
+	for(auto& state : m_readers)
+	{
+		res += state->m_full_waits.load(std::memory_order_relaxed);
+	}
+
+	return res;
+}
+
+uint64_t sinsp_sharded_inspector::get_num_dropped_events() const
+{
+	uint64_t res = 0;
+
+	for(auto& state : m_readers)
+	{
+		res += state->m_dropped.load(std::memory_order_relaxed);
+	}
+
+	return res;
+}
+
+uint64_t sinsp_sharded_inspector::get_num_out_of_order_events() const
+{
+	return m_out_of_order.load(std::memory_order_relaxed);
+}
+
+void sinsp_sharded_inspector::reader_loop(uint32_t reader)
+{
+	reader_state* state = m_readers[reader].get();
+	scap_evt* evts[SHARDED_READER_BATCH];
+	uint16_t cpuids[SHARDED_READER_BATCH];
+	uint32_t nevts;
+
+	while(m_running.load(std::memory_order_relaxed))
+	{
+		int32_t res = scap_reader_next_batch(state->m_reader, SHARDED_READER_BATCH, evts, cpuids, &nevts);
+
+		if(res == SCAP_TIMEOUT)
+		{
+			//
+			// Nothing buffered, let the shards know that whatever comes
+			// next is recent
+			//
+			uint64_t idle_ts = now_ns() - SHARDED_READER_IDLE_DELAY_NS;
+			if(idle_ts > state->m_low_watermark.load(std::memory_order_relaxed))
+			{
+				state->m_low_watermark.store(idle_ts, std::memory_order_release);
+			}
+			continue;
+		}
+		else if(res != SCAP_SUCCESS)
+		{
+			g_logger.format(sinsp_logger::SEV_ERROR, "sharded inspector reader %u failed: %s",
+					reader, scap_reader_getlasterr(state->m_reader));
+			return;
+		}
+
+		if(!route_events(reader, evts, cpuids, nevts))
+		{
+			return;
+		}
+	}
+}
+
+bool sinsp_sharded_inspector::route_events(uint32_t reader, scap_evt** evts, uint16_t* cpuids, uint32_t nevts)
+{
+	reader_state* state = m_readers[reader].get();
+	uint32_t nshards = (uint32_t)m_shards.size();
+
+	for(uint32_t j = 0; j < nevts; j++)
+	{
+		int64_t tid = (int64_t)evts[j]->tid;
+		uint32_t shard = tid >= 0 ? (uint32_t)(tid % nshards) : cpuids[j] % nshards;
+		sinsp_event_queue* q = queue(reader, shard);
+
+		if(record_len(evts[j]->len) > m_queue_size / 2)
+		{
+			state->m_dropped.fetch_add(1, std::memory_order_relaxed);
+			continue;
+		}
+
+		while(!q->push(evts[j], cpuids[j]))
+		{
+			if(!m_running.load(std::memory_order_relaxed))
+			{
+				return false;
+			}
+
+			//
+			// The shard is behind: stop draining the buffers, so that
+			// the driver drops the events instead of us
+			//
+			state->m_full_waits.fetch_add(1, std::memory_order_relaxed);
+			std::this_thread::yield();
+		}
+	}
+
+	if(nevts != 0)
+	{
+		uint64_t ts = evts[nevts - 1]->ts;
+		if(ts > state->m_low_watermark.load(std::memory_order_relaxed))
+		{
+			state->m_low_watermark.store(ts, std::memory_order_release);
+		}
+		state->m_routed.fetch_add(nevts, std::memory_order_relaxed);
+	}
+
+	return true;
+}
+
+void sinsp_sharded_inspector::shard_loop(uint32_t shard, const event_handler& handler)
+{
+	sinsp* inspector = m_shards[shard].get();
+	sinsp_evt* evt;
+
+	while(m_running.load(std::memory_order_relaxed))
+	{
+		int32_t res = inspector->next(&evt);
+
+		if(res == SCAP_SUCCESS)
+		{
+			handler(shard, evt);
+		}
+		else if(res != SCAP_TIMEOUT)
+		{
+			g_logger.format(sinsp_logger::SEV_ERROR, "sharded inspector shard %u failed: %s",
+					shard, inspector->getlasterr().c_str());
+			return;
+		}
+	}
+}
+
+int32_t sinsp_sharded_inspector::next_shard_event(uint32_t shard, OUT scap_evt** pevent, OUT uint16_t* pcpuid)
+{
+	uint32_t nreaders = (uint32_t)m_readers.size();
+
+	//
+	// The event returned by the previous call has been parsed
+	//
+	if(m_pending_pop[shard] != NULL)
+	{
+		m_pending_pop[shard]->pop();
+		m_pending_pop[shard] = NULL;
+	}
+
+	if(!m_ordered)
+	{
+		for(uint32_t j = 0; j < nreaders; j++)
+		{
+			uint32_t reader = (m_next_reader[shard] + j) % nreaders;
+			sinsp_event_queue* q = queue(reader, shard);
+			scap_evt* evt = q->front(pcpuid);
+
+			if(evt != NULL)
+			{
+				m_next_reader[shard] = (reader + 1) % nreaders;
+				m_pending_pop[shard] = q;
+				*pevent = evt;
+				return SCAP_SUCCESS;
+			}
+		}
+	}
+	else
+	{
+		sinsp_event_queue* min_q = NULL;
+		scap_evt* min_evt = NULL;
+		uint16_t min_cpuid = 0;
+		uint64_t min_empty_watermark = UINT64_MAX;
+
+		//
+		// Every reader routes its events in timestamp order, so a reader
+		// with an empty queue can only hold back the oldest event if it
+		// hasn't gone past its timestamp yet. The watermark must be loaded
+		// before probing the queue: the reader raises it after pushing the
+		// events, so an empty queue seen after the load can't be hiding
+		// events older than the watermark.
+		//
+		for(uint32_t j = 0; j < nreaders; j++)
+		{
+			sinsp_event_queue* q = queue(j, shard);
+			uint64_t watermark = m_readers[j]->m_low_watermark.load(std::memory_order_acquire);
+			uint16_t cpuid;
+			scap_evt* evt = q->front(&cpuid);
+
+			if(evt == NULL)
+			{
+				if(watermark < min_empty_watermark)
+				{
+					min_empty_watermark = watermark;
+				}
+			}
+			else if(min_evt == NULL || evt->ts < min_evt->ts)
+			{
+				min_q = q;
+				min_evt = evt;
+				min_cpuid = cpuid;
+			}
+		}
+
+		if(min_evt != NULL && min_evt->ts <= min_empty_watermark)
+		{
+			if(min_evt->ts < m_last_ts[shard])
+			{
+				m_out_of_order.fetch_add(1, std::memory_order_relaxed);
+			}
+			else
+			{
+				m_last_ts[shard] = min_evt->ts;
+			}
+
+			m_pending_pop[shard] = min_q;
+			*pevent = min_evt;
+			*pcpuid = min_cpuid;
+			return SCAP_SUCCESS;
+		}
+	}
+
+	std::this_thread::sleep_for(std::chrono::microseconds(SHARDED_SHARD_IDLE_SLEEP_US));
+	return SCAP_TIMEOUT;
+}
@@ -0,0 +1,250 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+//
+// sharded_inspector.h
+//
+// multi-threaded live capture: the ring buffers are drained by a pool of
+// reader threads and the events are parsed by a set of independent
+// inspectors, each one owning the threads whose tid maps to it
+//
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "sinsp.h"
+
+#ifndef VISIBILITY_PRIVATE
+#define VISIBILITY_PRIVATE private:
+#endif
+
+#define SINSP_CACHE_LINE_SIZE 64
+
+//
+// Single producer, single consumer queue of events. Every record is an
+// 8 byte header followed by a copy of the event, padded to 8 bytes. A record
+// never wraps around the end of the buffer: when it doesn't fit the producer
+// writes a filler header and starts again from offset 0.
+//
+class sinsp_event_queue
+{
+public:
+	sinsp_event_queue(uint32_t size);
+	~sinsp_event_queue();
+
+	//
+	// Producer side. Returns false if the queue doesn't have room for the event.
+	//
+	bool push(scap_evt* evt, uint16_t cpuid);
+
+	//
+	// Consumer side. front() returns NULL if the queue is empty, the returned
+	// event stays valid until pop() is called.
+	//
+	scap_evt* front(OUT uint16_t* pcpuid);
+	void pop();
+
+	bool empty() const
+	{
+		return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_relaxed);
+	}
+
+private:
+	struct record_hdr
+	{
+		uint32_t m_len;
+		uint16_t m_cpuid;
+		uint16_t m_pad;
+	};
+
+	static const uint16_t FILLER_CPUID = 0xffff;
+
+	uint8_t* m_buf;
+	uint32_t m_size;
+	//
+	// m_head and m_tail are padded to separate cache lines. alignas() would
+	// be ignored by operator new before C++17, so the queue would need a
+	// custom allocator.
+	//
+	char m_pad_head[SINSP_CACHE_LINE_SIZE];
+	// Written by the producer
+	std::atomic<uint64_t> m_head;
+	char m_pad_tail[SINSP_CACHE_LINE_SIZE - sizeof(std::atomic<uint64_t>)];
+	// Written by the consumer
+	std::atomic<uint64_t> m_tail;
+	char m_pad_end[SINSP_CACHE_LINE_SIZE - sizeof(std::atomic<uint64_t>)];
+};
+
+//
+// Live capture parsed by nshards inspectors in parallel.
+//
+// The per-CPU buffers of the driver are split in nreaders contiguous groups,
+// each one drained by its own thread through a scap_reader. Every event is
+// copied to the queue of the shard owning its tid (events without a thread go
+// to the shard of their CPU), and every shard runs its own sinsp on its own
+// thread, fed with sinsp::open_shard().
+//
+// Limitations:
+//  - the state of a process is split among the shards owning its threads, so
+//    a file descriptor opened by a thread isn't known to the shard of a
+//    sibling thread, and a child whose tid maps to another shard only sees
+//    the state inherited through /proc.
+//  - every shard scans /proc and keeps its own copy of the thread table.
+//  - the event handler is invoked concurrently by the shard threads.
+//  - container metadata is not fetched, since the shards run in nodriver mode.
+//
+class SINSP_PUBLIC sinsp_sharded_inspector
+{
+public:
+	typedef std::function<void(uint32_t shard, sinsp_evt* evt)> event_handler;
+
+	sinsp_sharded_inspector(uint32_t nshards, uint32_t nreaders, uint32_t queue_size = DEFAULT_QUEUE_SIZE);
+	~sinsp_sharded_inspector();
+
+	/*!
+	  \brief Return the inspector of the given shard, which can be configured
+	  (filters, snaplen, callbacks, ...) before open() is called.
+	*/
+	sinsp* get_shard(uint32_t shard);
+
+	uint32_t get_num_shards() const
+	{
+		return (uint32_t)m_shards.size();
+	}
+
+	/*!
+	  \brief If true, the events of every shard are delivered in timestamp
+	  order, which requires waiting for the slowest reader. If false (the
+	  default), each shard only keeps the order of the events of every reader.
+
+	  The order is best-effort: a reader with empty buffers can't know
+	  whether the driver still has to write older events, and after a while
+	  it lets the shards go past them. Such events, e.g. written by a
+	  preempted producer, are still delivered, and counted by
+	  get_num_out_of_order_events().
+	*/
+	void set_ordered(bool ordered);
+
+	/*!
+	  \brief Wakeup watermark of the readers, see
+	  sinsp::set_wakeup_watermark(). Must be called before open().
+	*/
+	void set_wakeup_watermark(uint32_t watermark);
+
+	/*!
+	  \brief Size of the buffer of every device, see
+	  sinsp::set_ring_buf_size(). Must be called before open().
+	*/
+	void set_ring_buf_size(uint32_t size);
+
+	/*!
+	  \brief Open the driver (or the BPF probe at bpf_probe if not empty),
+	  attach the readers and open the shards.
+
+	  @throws a sinsp_exception containing the error string is thrown in case
+	   of failure.
+	*/
+	void open(const std::string& bpf_probe = "");
+
+	/*!
+	  \brief Start the reader and shard threads. handler is invoked from the
+	  thread of the shard for every event it parses.
+	*/
+	void start(const event_handler& handler);
+
+	/*!
+	  \brief Stop and join the threads started by start().
+	*/
+	void stop();
+
+	void close();
+
+	//
+	// Number of events routed to the shards, number of times a reader
+	// found the queue of a shard full and had to wait for it, and number of
+	// events too big for the queues.
+	//
+	uint64_t get_num_routed_events() const;
+	uint64_t get_num_queue_full_waits() const;
+	uint64_t get_num_dropped_events() const;
+
+	//
+	// Number of events delivered in ordered mode with a timestamp lower than
+	// an event already delivered by the same shard.
+	//
+	uint64_t get_num_out_of_order_events() const;
+
+	static const uint32_t DEFAULT_QUEUE_SIZE = 8 * 1024 * 1024;
+
+VISIBILITY_PRIVATE
+	struct reader_state
+	{
+		scap_reader* m_reader;
+		// Keeps the fields written by the reader thread off the cache line
+		// of m_reader and of the neighbouring allocations
+		char m_pad[SINSP_CACHE_LINE_SIZE];
+		// Every event this reader will route from now on has a timestamp
+		// greater or equal than this
+		std::atomic<uint64_t> m_low_watermark;
+		std::atomic<uint64_t> m_routed;
+		std::atomic<uint64_t> m_full_waits;
+		std::atomic<uint64_t> m_dropped;
+		char m_pad_end[SINSP_CACHE_LINE_SIZE];
+	};
+
+	void add_reader(scap_reader* reader);
+	void open_shards();
+	void reader_loop(uint32_t reader);
+	//
+	// Copy a batch of events to the queues of their shards and raise the
+	// watermark of the reader. Returns false if stopped while waiting for a
+	// full queue.
+	//
+	bool route_events(uint32_t reader, scap_evt** evts, uint16_t* cpuids, uint32_t nevts);
+	void shard_loop(uint32_t shard, const event_handler& handler);
+	int32_t next_shard_event(uint32_t shard, OUT scap_evt** pevent, OUT uint16_t* pcpuid);
+
+	sinsp_event_queue* queue(uint32_t reader, uint32_t shard)
+	{
+		return m_queues[reader * m_shards.size() + shard].get();
+	}
+
+	uint32_t m_nreaders;
+	uint32_t m_queue_size;
+	bool m_ordered;
+	uint32_t m_wakeup_watermark;
+	uint32_t m_ring_buf_size;
+	scap_t* m_h;
+	std::vector<std::unique_ptr<sinsp>> m_shards;
+	std::vector<std::unique_ptr<reader_state>> m_readers;
+	// nreaders * nshards queues, indexed by reader then shard
+	std::vector<std::unique_ptr<sinsp_event_queue>> m_queues;
+	// For every shard, the queue whose front was returned by the last
+	// next_shard_event() call and must be popped by the next one, or NULL
+	std::vector<sinsp_event_queue*> m_pending_pop;
+	// Round robin position of every shard in unordered mode
+	std::vector<uint32_t> m_next_reader;
+	// Timestamp of the last event delivered by every shard in ordered mode
+	std::vector<uint64_t> m_last_ts;
+	std::atomic<uint64_t> m_out_of_order;
+	std::vector<std::thread> m_threads;
+	std::atomic<bool> m_running;
+};
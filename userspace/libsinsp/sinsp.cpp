@@ -103,6 +103,10 @@ sinsp::sinsp(bool static_container, const std::string static_id, const std::stri
 	m_input_fd = 0;
 	m_bpf = false;
 	m_udig = false;
+	m_relaxed_ordering = false;
+	m_wakeup_watermark = 0;
+	m_bpf_ringbuf_groups = 0;
+	m_ring_buf_size = 0;
 	m_isdebug_enabled = false;
 	m_isfatfile_enabled = false;
 	m_isinternal_events_enabled = false;
@@ -117,8 +121,11 @@ sinsp::sinsp(bool static_container, const std::string static_id, const std::stri
 	m_get_procs_cpu_from_driver = false;
 	m_is_tracers_capture_enabled = false;
 	m_file_start_offset = 0;
+	m_file_end_offset = 0;
 	m_flush_memory_dump = false;
 	m_next_stats_print_time_ns = 0;
+	m_rtt_interval_ns = SCAP_RTT_DEFAULT_INTERVAL_NS;
+	m_next_rtt_read_time_ns = 0;
 	m_large_envs_enabled = false;
 	m_increased_snaplen_port_range = DEFAULT_INCREASE_SNAPLEN_PORT_RANGE;
 	m_statsd_port = -1;
@@ -153,6 +160,15 @@ sinsp::sinsp(bool static_container, const std::string static_id, const std::stri
 	m_meinfo.m_n_procinfo_evts = 0;
 	m_meta_event_callback = NULL;
 	m_meta_event_callback_data = NULL;
+	m_scap_batch_nevts = 0;
+	m_scap_batch_pos = 0;
+	m_scap_batch_max = 0;
+	m_seek_ts = 0;
+#ifdef GATHER_INTERNAL_STATS
+	m_async_dumper_written = NULL;
+	m_async_dumper_dropped = NULL;
+	m_async_dumper_full_waits = NULL;
+#endif
 #if !defined(CYGWING_AGENT) && !defined(MINIMAL_BUILD)
 	m_k8s_client = NULL;
 	m_k8s_last_watch_time_ns = 0;
@@ -449,6 +465,26 @@ void sinsp::set_import_users(bool import_users)
 	m_import_users = import_users;
 }
 
+void sinsp::set_relaxed_ordering(bool relaxed_ordering)
+{
+	m_relaxed_ordering = relaxed_ordering;
+}
+
+void sinsp::set_wakeup_watermark(uint32_t wakeup_watermark)
+{
+	m_wakeup_watermark = wakeup_watermark;
+}
+
+void sinsp::set_bpf_ringbuf_groups(uint32_t ngroups)
+{
+	m_bpf_ringbuf_groups = ngroups;
+}
+
+void sinsp::set_ring_buf_size(uint32_t size)
+{
+	m_ring_buf_size = size;
+}
+
 void sinsp::open_live_common(uint32_t timeout_ms, scap_mode_t mode)
 {
 	char error[SCAP_LASTERR_SIZE];
@@ -470,6 +506,10 @@ void sinsp::open_live_common(uint32_t timeout_ms, scap_mode_t mode)
 	oargs.proc_callback = NULL;
 	oargs.proc_callback_context = NULL;
 	oargs.udig = m_udig;
+	oargs.relaxed_ordering = m_relaxed_ordering;
+	oargs.wakeup_watermark = m_wakeup_watermark;
+	oargs.bpf_ringbuf_groups = m_bpf_ringbuf_groups;
+	oargs.ring_buf_size = m_ring_buf_size;
 	oargs.debug_log_fn = &sinsp_scap_debug_log_fn;
 	oargs.proc_scan_timeout_ms = m_proc_scan_timeout_ms;
 	oargs.proc_scan_log_interval_ms = m_proc_scan_log_interval_ms;
@@ -544,6 +584,10 @@ void sinsp::open_nodriver()
 		oargs.proc_callback_context = this;
 	}
 	oargs.import_users = m_import_users;
+	oargs.relaxed_ordering = false;
+	oargs.wakeup_watermark = 0;
+	oargs.bpf_ringbuf_groups = 0;
+	oargs.ring_buf_size = 0;
 	oargs.debug_log_fn = &sinsp_scap_debug_log_fn;
 	oargs.proc_scan_timeout_ms = m_proc_scan_timeout_ms;
 	oargs.proc_scan_log_interval_ms = m_proc_scan_log_interval_ms;
@@ -561,6 +605,12 @@ void sinsp::open_nodriver()
 	init();
 }
 
+void sinsp::open_shard(const event_source& source)
+{
+	open_nodriver();
+	m_event_source = source;
+}
+
 int64_t sinsp::get_file_size(const std::string& fname, char *error)
 {
 	static string err_str = "Could not determine capture file size: ";
@@ -689,6 +739,10 @@ void sinsp::open_int()
 
 	add_suppressed_comms(oargs);
 
+	oargs.relaxed_ordering = false;
+	oargs.wakeup_watermark = 0;
+	oargs.bpf_ringbuf_groups = 0;
+	oargs.ring_buf_size = 0;
 	oargs.debug_log_fn = &sinsp_scap_debug_log_fn;
 	oargs.proc_scan_timeout_ms = m_proc_scan_timeout_ms;
 	oargs.proc_scan_log_interval_ms = m_proc_scan_log_interval_ms;
@@ -751,6 +805,14 @@ void sinsp::close()
 		m_h = NULL;
 	}
 
+	//
+	// The batched events pointed into the buffers of the handle
+	//
+	m_scap_batch_nevts = 0;
+	m_scap_batch_pos = 0;
+	m_event_source = nullptr;
+	m_seek_ts = 0;
+
 	if(NULL != m_dumper)
 	{
 		scap_dump_close(m_dumper);
@@ -1036,10 +1098,32 @@ void schedule_next_threadinfo_evt(sinsp* _this, void* data)
 void sinsp::restart_capture_at_filepos(uint64_t filepos)
 {
 	//
-	// Backup a couple of settings
+	// Backup a couple of settings. close() deletes the filters and closes
+	// the autodump file, but none of them depends on the handle: keep them
+	// instead of compiling the filter again and starting a new dump file.
 	//
 	uint64_t evtnum = m_nevts;
-	string filterstring = m_filterstring;
+	uint64_t seek_ts = m_seek_ts;
+#ifdef HAS_FILTERING
+	sinsp_filter* filter = m_filter;
+	sinsp_evttype_filter* evttype_filter = m_evttype_filter;
+	m_filter = NULL;
+	m_evttype_filter = NULL;
+#endif
+	scap_dumper_t* dumper = m_dumper;
+	bool is_dumping = m_is_dumping;
+	m_dumper = NULL;
+
+	auto restore = [&]()
+	{
+#ifdef HAS_FILTERING
+		m_filter = filter;
+		m_evttype_filter = evttype_filter;
+#endif
+		m_dumper = dumper;
+		m_is_dumping = is_dumping;
+		m_seek_ts = seek_ts;
+	};
 
 	//
 	// Close and reopen the capture
@@ -1057,17 +1141,50 @@ void sinsp::restart_capture_at_filepos(uint64_t filepos)
 	close();
 	m_input_fd = fd;
 	lseek(fd, 0, SEEK_SET);
-	open_int();
+
+	try
+	{
+		open_int();
+	}
+	catch(...)
+	{
+		// close() releases them later
+		restore();
+		throw;
+	}
 
 	//
 	// Set again the backuped settings
 	//
+	restore();
 	m_evt.m_evtnum = evtnum;
 	m_nevts = evtnum;
-	if(filterstring != "")
+}
+
+void sinsp::seek_ts(uint64_t ts)
+{
+	const scap_index_entry* pentry;
+
+	if(m_h == NULL || !is_capture())
 	{
-		set_filter(filterstring);
+		throw sinsp_exception("seek_ts only works on captures");
 	}
+
+	if(scap_find_index_entry(m_h, ts, &pentry) != SCAP_SUCCESS)
+	{
+		throw sinsp_exception(scap_getlasterr(m_h));
+	}
+
+	//
+	// The events between the checkpoint and ts are parsed by next(), so
+	// the index only tells where to start from. The entry is freed when the
+	// capture is reopened.
+	//
+	uint64_t checkpoint = pentry->checkpoint;
+
+	m_seek_ts = 0;
+	restart_capture_at_filepos(checkpoint);
+	m_seek_ts = ts;
 }
 
 uint64_t sinsp::max_buf_used()
@@ -1169,9 +1286,48 @@ int32_t sinsp::next(OUT sinsp_evt **puevt)
 		}
 
 		//
-		// Get the event from libscap
+		// Get the event from libscap (or from the open_shard() source),
+		// serving the events left over by the last scap_next_batch() call
+		// first
 		//
-		res = scap_next(m_h, &(evt->m_pevt), &(evt->m_cpuid));
+		if(m_scap_batch_pos < m_scap_batch_nevts)
+		{
+			res = SCAP_SUCCESS;
+		}
+		else if(m_event_source)
+		{
+			res = m_event_source(&(evt->m_pevt), &(evt->m_cpuid));
+		}
+		else if(m_scap_batch_max != 0)
+		{
+			if(m_scap_batch_evts.size() < m_scap_batch_max)
+			{
+				m_scap_batch_evts.resize(m_scap_batch_max);
+				m_scap_batch_cpuids.resize(m_scap_batch_max);
+			}
+
+			m_scap_batch_pos = 0;
+			m_scap_batch_nevts = 0;
+			res = scap_next_batch(m_h, m_scap_batch_max, m_scap_batch_evts.data(), m_scap_batch_cpuids.data(), &m_scap_batch_nevts);
+		}
+		else
+		{
+			res = scap_next(m_h, &(evt->m_pevt), &(evt->m_cpuid));
+		}
+
+		if(res == SCAP_SUCCESS && m_scap_batch_pos < m_scap_batch_nevts)
+		{
+			evt->m_pevt = m_scap_batch_evts[m_scap_batch_pos];
+			evt->m_cpuid = m_scap_batch_cpuids[m_scap_batch_pos];
+			m_scap_batch_pos++;
+
+#ifdef __GNUC__
+			if(m_scap_batch_pos < m_scap_batch_nevts)
+			{
+				__builtin_prefetch(m_scap_batch_evts[m_scap_batch_pos]);
+			}
+#endif
+		}
 
 		if(res != SCAP_SUCCESS)
 		{
@@ -1194,6 +1350,16 @@ int32_t sinsp::next(OUT sinsp_evt **puevt)
 			else if(res == SCAP_UNEXPECTED_BLOCK)
 			{
 				uint64_t filepos = scap_ftell(m_h) - scap_get_unexpected_block_readsize(m_h);
+
+				if(m_file_end_offset != 0 && filepos >= m_file_end_offset)
+				{
+					if (m_external_event_processor)
+					{
+						m_external_event_processor->process_event(NULL, libsinsp::EVENT_RETURN_EOF);
+					}
+					return SCAP_EOF;
+				}
+
 				restart_capture_at_filepos(filepos);
 				return SCAP_TIMEOUT;
 
@@ -1229,6 +1395,19 @@ int32_t sinsp::next(OUT sinsp_evt **puevt)
 	evt->m_evtnum = m_nevts;
 	m_lastevent_ts = ts;
 
+	//
+	// Hand the RTT aggregates of the BPF probe to their consumer
+	//
+	if(m_rtt_stats_callback && ts > m_next_rtt_read_time_ns)
+	{
+		if(m_next_rtt_read_time_ns)
+		{
+			read_rtt_stats();
+		}
+
+		m_next_rtt_read_time_ns = ts + m_rtt_interval_ns;
+	}
+
 	if (m_automatic_threadtable_purging)
 	{
 		//
@@ -1346,6 +1525,30 @@ int32_t sinsp::next(OUT sinsp_evt **puevt)
 	m_parser->process_event(evt);
 #endif
 
+	//
+	// Events before the target of seek_ts() only update the state
+	//
+	if(m_seek_ts != 0)
+	{
+		if(ts < m_seek_ts)
+		{
+			m_parser->event_cleanup(evt);
+
+			if(evt->m_tinfo &&
+				evt->get_type() != PPME_SCHEDSWITCH_1_E &&
+				evt->get_type() != PPME_SCHEDSWITCH_6_E)
+			{
+				evt->m_tinfo->m_prevevent_ts = evt->m_tinfo->m_lastevent_ts;
+				evt->m_tinfo->m_lastevent_ts = m_lastevent_ts;
+			}
+
+			*puevt = NULL;
+			return SCAP_TIMEOUT;
+		}
+
+		m_seek_ts = 0;
+	}
+
 	//
 	// If needed, dump the event to file
 	//
@@ -1437,6 +1640,57 @@ int32_t sinsp::next(OUT sinsp_evt **puevt)
 	return res;
 }
 
+int32_t sinsp::next_batch(uint32_t max_events, const std::function<void(sinsp_evt*)>& handler, OUT uint32_t* nevts)
+{
+	sinsp_evt* evt;
+	int32_t res;
+
+	*nevts = 0;
+
+	if(max_events == 0)
+	{
+		return SCAP_TIMEOUT;
+	}
+
+	//
+	// With m_scap_batch_max set, next() refills its queue with
+	// scap_next_batch() and then serves the events one by one. The
+	// events are handed to the handler as soon as they are parsed, since
+	// the next one can invalidate the state (e.g. delayed thread
+	// removal) the previous one refers to.
+	//
+	m_scap_batch_max = max_events;
+
+	do
+	{
+		evt = NULL;
+		res = next(&evt);
+
+		if(res == SCAP_SUCCESS)
+		{
+			handler(evt);
+			(*nevts)++;
+		}
+		else if(res != SCAP_TIMEOUT || evt == NULL)
+		{
+			//
+			// No more data for now, or an error/EOF
+			//
+			break;
+		}
+	}
+	while(*nevts < max_events && (m_scap_batch_pos < m_scap_batch_nevts || !is_live()));
+
+	m_scap_batch_max = 0;
+
+	if(*nevts != 0 && (res == SCAP_SUCCESS || res == SCAP_TIMEOUT))
+	{
+		return SCAP_SUCCESS;
+	}
+
+	return res;
+}
+
 uint64_t sinsp::get_num_events()
 {
 	if(m_h)
@@ -1785,6 +2039,92 @@ void sinsp::get_capture_stats(scap_stats* stats) const
 	}
 }
 
+void sinsp::get_buffer_stats(std::vector<scap_buffer_stats>& stats) const
+{
+	uint32_t ndevs = scap_get_ndevs(m_h);
+
+	stats.resize(ndevs);
+
+	for(uint32_t j = 0; j < ndevs; j++)
+	{
+		if(scap_get_buffer_stats(m_h, j, &stats[j]) != SCAP_SUCCESS)
+		{
+			throw sinsp_exception(scap_getlasterr(m_h));
+		}
+	}
+}
+
+int sinsp::set_rtt_aggregation(uint64_t interval_ns, const rtt_stats_callback& callback)
+{
+	int res = scap_set_rtt_aggregation(m_h, callback != nullptr, interval_ns);
+	if(res != SCAP_SUCCESS)
+	{
+		return res;
+	}
+
+	m_rtt_stats_callback = callback;
+	m_rtt_interval_ns = interval_ns ? interval_ns : SCAP_RTT_DEFAULT_INTERVAL_NS;
+	m_next_rtt_read_time_ns = 0;
+	return SCAP_SUCCESS;
+}
+
+void sinsp::get_rtt_map_stats(scap_rtt_map_stats* stats) const
+{
+	if(scap_get_rtt_map_stats(m_h, stats) != SCAP_SUCCESS)
+	{
+		throw sinsp_exception(scap_getlasterr(m_h));
+	}
+}
+
+void sinsp::read_rtt_stats()
+{
+	const uint32_t chunk = 1024;
+	uint32_t nstats;
+
+	if(m_rtt_stats.size() < chunk)
+	{
+		m_rtt_stats.resize(chunk);
+	}
+
+	//
+	// Read until the map is empty. The buffer grows when a bucket of the
+	// map doesn't fit in it, and keeps its size for the next reads.
+	//
+	while(true)
+	{
+		int32_t res = scap_read_rtt_stats(m_h, m_rtt_stats.data(), m_rtt_stats.size(), &nstats);
+
+		if(res == SCAP_INPUT_TOO_SMALL)
+		{
+			m_rtt_stats.resize(m_rtt_stats.size() * 2);
+			continue;
+		}
+		else if(res != SCAP_SUCCESS)
+		{
+			g_logger.format(sinsp_logger::SEV_WARNING,
+					"cannot read the RTT statistics: %s", scap_getlasterr(m_h));
+			return;
+		}
+
+		if(nstats == 0)
+		{
+			return;
+		}
+
+		m_rtt_stats_callback(m_rtt_stats.data(), nstats);
+	}
+}
+
+void sinsp::get_evt_type_stats(std::vector<scap_evt_type_stats>& stats) const
+{
+	stats.resize(PPM_EVENT_MAX);
+
+	if(scap_get_evt_type_stats(m_h, stats.data()) != SCAP_SUCCESS)
+	{
+		throw sinsp_exception(scap_getlasterr(m_h));
+	}
+}
+
 #ifdef GATHER_INTERNAL_STATS
 sinsp_stats sinsp::get_stats()
 {
@@ -1800,6 +2140,11 @@ sinsp_stats sinsp::get_stats()
 		m_stats.m_n_seen_evts = stats.n_evts;
 		m_stats.m_n_drops = stats.n_drops;
 		m_stats.m_n_preemptions = stats.n_preemptions;
+
+		if(is_live())
+		{
+			update_evt_type_metrics();
+		}
 	}
 	else
 	{
@@ -1808,6 +2153,11 @@ sinsp_stats sinsp::get_stats()
 		m_stats.m_n_preemptions = 0;
 	}
 
+	for(sinsp_dumper* dumper : m_async_dumpers)
+	{
+		update_async_dumper_metrics(dumper);
+	}
+
 	//
 	// Count the number of threads and fds by scanning the tables,
 	// and update the thread-related stats.
@@ -1823,6 +2173,91 @@ sinsp_stats sinsp::get_stats()
 
 	return m_stats;
 }
+
+void sinsp::update_evt_type_metrics()
+{
+	std::vector<scap_evt_type_stats> stats(PPM_EVENT_MAX);
+
+	if(scap_get_evt_type_stats(m_h, stats.data()) != SCAP_SUCCESS)
+	{
+		return;
+	}
+
+	m_evt_type_metrics.resize(PPM_EVENT_MAX);
+
+	for(uint32_t j = 0; j < PPM_EVENT_MAX; j++)
+	{
+		evt_type_metrics& metrics = m_evt_type_metrics[j];
+
+		if(metrics.m_evts == NULL)
+		{
+			if(stats[j].n_evts == 0 && stats[j].n_drops == 0)
+			{
+				continue;
+			}
+
+			//
+			// Enter and exit events share the name, the direction tells
+			// them apart
+			//
+			std::string name = std::string("evt_") + g_infotables.m_event_info[j].name +
+				(PPME_IS_ENTER(j) ? "_e" : "_x");
+			std::string desc = std::string(g_infotables.m_event_info[j].name) +
+				(PPME_IS_ENTER(j) ? " enter" : " exit");
+			internal_metrics::registry& registry = m_stats.get_metrics_registry();
+
+			metrics.m_evts = &registry.register_counter(internal_metrics::metric_name(name + "_evts", desc + " events written by the driver"));
+			metrics.m_drops = &registry.register_counter(internal_metrics::metric_name(name + "_drops", desc + " events dropped by the driver"));
+			metrics.m_bytes = &registry.register_counter(internal_metrics::metric_name(name + "_bytes", desc + " bytes written by the driver"));
+			metrics.m_ns = &registry.register_counter(internal_metrics::metric_name(name + "_ns", desc + " nanoseconds spent in the driver"));
+		}
+
+		metrics.m_evts->set(stats[j].n_evts);
+		metrics.m_drops->set(stats[j].n_drops);
+		metrics.m_bytes->set(stats[j].n_bytes);
+		metrics.m_ns->set(stats[j].n_ns);
+	}
+}
+
+void sinsp::add_async_dumper(sinsp_dumper* dumper)
+{
+	if(m_async_dumper_written == NULL)
+	{
+		internal_metrics::registry& registry = m_stats.get_metrics_registry();
+
+		m_async_dumper_written = &registry.register_counter(internal_metrics::metric_name("dumper_async_written_events", "Events written by the async dumpers"));
+		m_async_dumper_dropped = &registry.register_counter(internal_metrics::metric_name("dumper_async_dropped_events", "Events dropped by the async dumpers"));
+		m_async_dumper_full_waits = &registry.register_counter(internal_metrics::metric_name("dumper_async_queue_full_waits", "Times an async dumper found its queue full"));
+	}
+
+	m_async_dumpers.insert(dumper);
+}
+
+void sinsp::remove_async_dumper(sinsp_dumper* dumper)
+{
+	//
+	// What it counted since the last get_stats() call is kept
+	//
+	if(m_async_dumpers.erase(dumper) != 0)
+	{
+		update_async_dumper_metrics(dumper);
+	}
+}
+
+void sinsp::update_async_dumper_metrics(sinsp_dumper* dumper)
+{
+	uint64_t written = dumper->get_num_async_written_events();
+	uint64_t dropped = dumper->get_num_async_dropped_events();
+	uint64_t full_waits = dumper->get_num_async_queue_full_waits();
+
+	m_async_dumper_written->set(m_async_dumper_written->get_value() + written - dumper->m_async_reported_written);
+	m_async_dumper_dropped->set(m_async_dumper_dropped->get_value() + dropped - dumper->m_async_reported_dropped);
+	m_async_dumper_full_waits->set(m_async_dumper_full_waits->get_value() + full_waits - dumper->m_async_reported_full_waits);
+
+	dumper->m_async_reported_written = written;
+	dumper->m_async_reported_dropped = dropped;
+	dumper->m_async_reported_full_waits = full_waits;
+}
 #endif // GATHER_INTERNAL_STATS
 
 void sinsp::set_log_callback(sinsp_logger_callback cb)
@@ -2423,75 +2858,123 @@ void sinsp::set_proc_scan_log_interval_ms(uint64_t val)
 ///////////////////////////////////////////////////////////////////////////////
 bool sinsp_thread_manager::remove_inactive_threads()
 {
-	bool res = false;
+	uint64_t now = m_inspector->m_lastevent_ts;
 
-	if(m_last_flush_time_ns == 0)
+	if(m_rebuild_phase != REBUILD_IDLE)
 	{
 		//
-		// Set the first table scan for 30 seconds in, so that we can spot bugs in the logic without having
-		// to wait for tens of minutes
+		// A child count rebuild is in progress, advance it by a bounded
+		// number of threads at every call
 		//
-		if(m_inspector->m_inactive_thread_scan_time_ns > 30 * ONE_SECOND_IN_NS)
-		{
-			m_last_flush_time_ns =
-				(m_inspector->m_lastevent_ts - m_inspector->m_inactive_thread_scan_time_ns + 30 * ONE_SECOND_IN_NS);
-		}
-		else
+		uint64_t start_ns = sinsp_utils::get_current_time_ns();
+
+		step_child_dependencies_rebuild(CHILD_REBUILD_BUDGET);
+
+		uint64_t pause_ns = sinsp_utils::get_current_time_ns() - start_ns;
+		if(pause_ns > m_max_maintenance_pause_ns)
 		{
-			m_last_flush_time_ns =
-				(m_inspector->m_lastevent_ts - m_inspector->m_inactive_thread_scan_time_ns);
+			m_max_maintenance_pause_ns = pause_ns;
+#ifdef GATHER_INTERNAL_STATS
+			m_max_pause->set(pause_ns);
+#endif
 		}
+
+		return true;
 	}
 
-	if(m_inspector->m_lastevent_ts >
-		m_last_flush_time_ns + m_inspector->m_inactive_thread_scan_time_ns)
+	if(m_expiry_cur_slot == 0)
 	{
-		std::unordered_map<uint64_t, bool> to_delete;
+		//
+		// Start the wheel. Check the threads we already have 30 seconds in,
+		// so that we can spot bugs in the logic without having to wait for
+		// tens of minutes
+		//
+		uint64_t delay = std::min<uint64_t>(m_inspector->m_inactive_thread_scan_time_ns, 30 * ONE_SECOND_IN_NS);
 
-		res = true;
+		m_expiry_cur_slot = (now + delay) / EXPIRY_SLOT_NS + 1;
+		m_last_flush_time_ns = now + delay - m_inspector->m_inactive_thread_scan_time_ns;
 
-		m_last_flush_time_ns = m_inspector->m_lastevent_ts;
+		auto& bucket = m_expiry_wheel[m_expiry_cur_slot % EXPIRY_WHEEL_SIZE];
+		for(int64_t tid : m_expiry_pending)
+		{
+			sinsp_threadinfo* tinfo = m_threadtable.get(tid);
+			if(tinfo != nullptr && tinfo->m_expiry_slot == 0)
+			{
+				tinfo->m_expiry_slot = m_expiry_cur_slot;
+				bucket.push_back({tid, m_expiry_cur_slot});
+			}
+		}
+		m_expiry_pending.clear();
+		m_expiry_pending.shrink_to_fit();
 
-		g_logger.format(sinsp_logger::SEV_INFO, "Flushing thread table");
+		return false;
+	}
+
+	if(now < m_expiry_cur_slot * EXPIRY_SLOT_NS)
+	{
+		return false;
+	}
 
+	//
+	// Process the slots that are due, up to EXPIRY_BUDGET threads or empty
+	// slots per call, so that the work is spread over the following events
+	// rather than stalling this one
+	//
+	uint64_t start_ns = sinsp_utils::get_current_time_ns();
+	uint64_t now_slot = now / EXPIRY_SLOT_NS;
+	uint32_t budget = EXPIRY_BUDGET;
+
+	if(now_slot >= m_expiry_cur_slot + EXPIRY_WHEEL_SIZE)
+	{
 		//
-		// Go through the table and remove dead entries.
+		// More than a turn behind, every bucket is due
 		//
-		m_threadtable.loop([&] (sinsp_threadinfo& tinfo) {
-			bool closed = (tinfo.m_flags & PPM_CL_CLOSED) != 0;
-
-			if(closed ||
-				((m_inspector->m_lastevent_ts > tinfo.m_lastaccess_ts + m_inspector->m_thread_timeout_ns) &&
-					!scap_is_thread_alive(m_inspector->m_h, tinfo.m_pid, tinfo.m_tid, tinfo.m_comm.c_str()))
-					)
-			{
-				//
-				// Reset the cache
-				//
-				m_last_tid = 0;
-				m_last_tinfo.reset();
+		m_expiry_cur_slot = now_slot - EXPIRY_WHEEL_SIZE + 1;
+	}
 
-#ifdef GATHER_INTERNAL_STATS
-				m_removed_threads->increment();
-#endif
-				to_delete[tinfo.m_tid] = closed;
-			}
-			return true;
-		});
+	while(budget > 0 && m_expiry_cur_slot <= now_slot)
+	{
+		auto& bucket = m_expiry_wheel[m_expiry_cur_slot % EXPIRY_WHEEL_SIZE];
+		budget--;
 
-		for (auto& it : to_delete)
+		if(bucket.empty())
 		{
-			remove_thread(it.first, it.second);
+			m_expiry_cur_slot++;
+			continue;
 		}
 
-		//
-		// Rebalance the thread table dependency tree, so we free up threads that
-		// exited but that are stuck because of reference counting.
-		//
-		recreate_child_dependencies();
+		expiry_entry entry = bucket.back();
+		bucket.pop_back();
+		ASSERT(entry.m_slot <= m_expiry_cur_slot);
+		expire_thread(entry.m_tid, entry.m_slot);
 	}
 
-	return res;
+	//
+	// Every m_inactive_thread_scan_time_ns, once the due threads have been
+	// handled, rebalance the thread table dependency tree, so we free up
+	// threads that exited but that are stuck because of reference counting.
+	// The rebuild is done by the next calls.
+	//
+	if(m_expiry_cur_slot > now_slot &&
+		now > m_last_flush_time_ns + m_inspector->m_inactive_thread_scan_time_ns)
+	{
+		m_last_flush_time_ns = now;
+
+		g_logger.format(sinsp_logger::SEV_INFO, "Flushing thread table");
+
+		start_child_dependencies_rebuild();
+	}
+
+	uint64_t pause_ns = sinsp_utils::get_current_time_ns() - start_ns;
+	if(pause_ns > m_max_maintenance_pause_ns)
+	{
+		m_max_maintenance_pause_ns = pause_ns;
+#ifdef GATHER_INTERNAL_STATS
+		m_max_pause->set(pause_ns);
+#endif
+	}
+
+	return true;
 }
 
 #if defined(HAS_CAPTURE) && !defined(_WIN32)
@@ -64,6 +64,7 @@ limitations under the License.
 #include <set>
 #include <list>
 #include <memory>
+#include <functional>
 
 using namespace std;
 
@@ -240,9 +241,41 @@ public:
 	*/
 	void fdopen(int fd);
 
+	/*!
+	  \brief Restrict the next open(filename) or fdopen() to a part of the
+	  trace file: the capture starts at the section at position start, and
+	  the first section found at or after position end is its end of file.
+	  Section positions are returned by scap_next_section(). An end of 0
+	  reads up to the end of the file. Used by sinsp_parallel_replay.
+	*/
+	void set_file_range(uint64_t start, uint64_t end)
+	{
+		m_file_start_offset = start;
+		m_file_end_offset = end;
+	}
+
 	void open_udig(uint32_t timeout_ms = SCAP_TIMEOUT_MS);
 	void open_nodriver();
 
+	/*!
+	  \brief Source of events for open_shard(). Sets the event and the CPU
+	  it was captured on and returns SCAP_SUCCESS, or returns SCAP_TIMEOUT
+	  if no event is available. The event must stay valid until the next
+	  call.
+	*/
+	typedef std::function<int32_t(OUT scap_evt** pevent, OUT uint16_t* pcpuid)> event_source;
+
+	/*!
+	  \brief Start parsing the events returned by source instead of the ones
+	  of a driver or of a file. The thread table is initialized from /proc,
+	  as done by open_nodriver(), and like in that mode the inspector doesn't
+	  control any driver. Used by sinsp_sharded_inspector to feed its shards.
+
+	  @throws a sinsp_exception containing the error string is thrown in case
+	   of failure.
+	*/
+	void open_shard(const event_source& source);
+
 	/*!
 	  \brief Ends a capture and release all resources.
 	*/
@@ -265,6 +298,29 @@ public:
 	*/
 	virtual int32_t next(OUT sinsp_evt **evt);
 
+	/*!
+	  \brief Get and process up to max_events events from the open capture
+	  source, fetching them from libscap with a single call.
+
+	  \param max_events the maximum number of events to process.
+	  \param handler function invoked with every event, after the state
+	  engine ran on it. The event is valid only during the call.
+	  \param nevts will be set to the number of events passed to handler.
+
+	  \return SCAP_SUCCESS if at least one event was processed. SCAP_TIMEOUT
+	   if no event is available. SCAP_EOF when the end of an offline capture
+	   is reached. On Failure, SCAP_FAILURE is returned and getlasterr() can
+	   be used to obtain the cause of the error. In case of EOF or failure,
+	   the events processed before it have already been passed to handler.
+
+	  \note For live captures the events are not copied out of the driver
+	   buffers, and the call stops short of max_events when the data already
+	   read from the buffers is exhausted. Filtered out events are not passed
+	   to handler. Events fetched but not processed because of max_events
+	   are returned by the following calls to next() or next_batch().
+	*/
+	int32_t next_batch(uint32_t max_events, const std::function<void(sinsp_evt*)>& handler, OUT uint32_t* nevts);
+
 	/*!
 	  \brief Get the maximum number of bytes currently in use by any CPU buffer
      */
@@ -315,6 +371,84 @@ public:
 	*/
 	void set_import_users(bool import_users);
 
+	/*!
+	  \brief Trade the global timestamp ordering of the events for
+	  throughput. When enabled, libscap returns all the buffered events of
+	  a CPU before moving to the next one, instead of merging the CPU
+	  buffers by timestamp.
+
+	  \param relaxed_ordering if true, events are only guaranteed to be
+	  ordered within the same CPU.
+
+	  \note This function must be called before open() and only affects
+	  live captures. Since a thread can migrate between CPUs, even the
+	  events of a single thread can be returned out of order when that
+	  happens inside the buffered window. With respect to the parsers:
+	  - Per-event parsing (event fields, socket tuples, I/O sizes and
+	    payloads, the tcp/netif events) remains correct.
+	  - Enter/exit pairing remains correct unless the thread migrated
+	    while inside the syscall (typically blocking calls), in which case
+	    the exit can be parsed before its enter and loses the enter
+	    parameters, the same way it would after a drop.
+	  - Thread and fd table updates (clone, execve, procexit, socket,
+	    connect, accept, close, dup...) can be applied out of order across
+	    threads, so a thread can be looked up before the clone that
+	    created it has been parsed (it will then be read from /proc), or
+	    observe an fd that another thread already closed.
+	  - sinsp_evt::get_ts() and the inspector's last event timestamp are
+	    not monotonic, so anything based on elapsed time (inactive
+	    thread/container purging, latencies computed across events,
+	    capture files written with -w) is only approximate.
+	  \note default behavior is relaxed_ordering=false.
+	*/
+	void set_relaxed_ordering(bool relaxed_ordering);
+
+	/*!
+	  \brief Make next() wait for the driver to signal new data when the
+	  buffers are empty, instead of polling them with an exponentially
+	  growing sleep.
+
+	  \param wakeup_watermark number of bytes that must be buffered for a
+	  CPU before the driver wakes up the inspector. Lower values reduce the
+	  latency, higher values reduce the number of wakeups. 0 disables the
+	  event driven wait.
+
+	  \note This function must be called before open() and only affects
+	  live captures with the kernel module or the BPF probe. A kernel module
+	  that doesn't support it silently falls back to the sleep based wait.
+	  \note default behavior is wakeup_watermark=0.
+	*/
+	void set_wakeup_watermark(uint32_t wakeup_watermark);
+
+	/*!
+	  \brief Make the BPF probe write the events to BPF ring buffers, each
+	  one shared by a group of CPUs, instead of one perf buffer per CPU.
+	  This saves memory and the perf header of every event on kernels >= 5.8.
+
+	  \param ngroups number of ring buffers. 0 selects the perf buffers.
+
+	  \note This function must be called before open() and only affects
+	  live captures with the BPF probe. The cpuid of the events is the one of
+	  their group, and the events of a group are only approximately ordered
+	  by timestamp.
+	  \note default behavior is ngroups=0.
+	*/
+	void set_bpf_ringbuf_groups(uint32_t ngroups);
+
+	/*!
+	  \brief Set the size of the buffer of every device.
+
+	  \param size size in bytes, a power of two multiple of the page size.
+	  0 keeps the size the kernel module is configured with, or the default
+	  size of the BPF probe.
+
+	  \note This function must be called before open() and only affects
+	  live captures. With the kernel module the size is a module parameter,
+	  so it also applies to the captures started later by other processes.
+	  \note default behavior is size=0.
+	*/
+	void set_ring_buf_size(uint32_t size);
+
 	/*!
 	  \brief temporarily pauses event capture.
 
@@ -400,8 +534,9 @@ public:
 	void disable_automatic_threadtable_purging();
 
 	/*!
-	 * \brief sets the interval at which the thread purge code runs. This does
-	 *        not run every event as it's mildly expensive if there are lots of threads
+	 * \brief sets the interval of the thread table scans: exited threads still
+	 *        referenced by their children are purged and the child counts are
+	 *        rebuilt. The scan work is spread over the following events.
 	 */
 	void set_thread_purge_interval_s(uint32_t val);
 
@@ -541,6 +676,25 @@ public:
 	*/
 	void get_capture_stats(scap_stats* stats) const override;
 
+	/*!
+	  \brief Fill the given vector with the statistics of the buffer of
+	   every device of the currently open capture, including the high water
+	   mark that tells how close the device got to dropping events.
+
+	  \note this call only works on live captures.
+	*/
+	void get_buffer_stats(std::vector<scap_buffer_stats>& stats) const;
+
+	/*!
+	  \brief Fill the given vector, indexed by event type, with the number
+	   of events, drops and bytes the driver generated for every event type
+	   and, with the BPF probe, the time it spent on them. Useful to tell
+	   which events cause the buffer pressure when tuning the event mask.
+
+	  \note this call only works on live captures.
+	*/
+	void get_evt_type_stats(std::vector<scap_evt_type_stats>& stats) const;
+
 #ifdef GATHER_INTERNAL_STATS
 	sinsp_stats get_stats();
 #endif
@@ -791,6 +945,23 @@ public:
 	*/
 	double get_read_progress();
 
+	/*!
+	  \brief Move a capture to the first event with a timestamp greater or
+	  equal than ts, using the index written by a dumper with
+	  sinsp_dumper::set_index_interval(). The capture is reopened at the
+	  checkpoint of the closest index entry, and the following events up to
+	  ts are parsed by next() without being returned, so that the thread and
+	  fd tables are the ones of a sequential read.
+
+	  \note The cost is the replay from the checkpoint: write checkpoints
+	   with sinsp_dumper::set_checkpoint_interval(), otherwise the capture
+	   is parsed from its beginning. On compressed captures the file is
+	   decompressed up to ts anyway.
+
+	  @throws a sinsp_exception if the capture doesn't have an index.
+	*/
+	void seek_ts(uint64_t ts);
+
 	/*!
 	  \brief Make the amount of data gathered for a syscall to be
 	  determined by the number of parameters.
@@ -832,6 +1003,33 @@ public:
 		}
 	}
 
+	typedef std::function<void(const scap_rtt_stats* stats, uint32_t nstats)> rtt_stats_callback;
+
+	/*!
+	  \brief Control how the BPF probe reports the RTT of the TCP connections.
+
+	  \param interval_ns if callback is set, the period of the aggregation:
+	   the probe accumulates the samples of every connection in kernel and,
+	   every interval_ns, the aggregates are read, reset and passed to the
+	   callback from next(). Otherwise the minimum time between two
+	   tcp_rcv_established events of the same connection. 0 means the
+	   default of 5 seconds.
+	  \param callback the consumer of the aggregates, or nullptr to go back
+	   to per-connection events.
+
+	  \note only supported by the BPF probe.
+	*/
+	int /*SCAP_X*/ set_rtt_aggregation(uint64_t interval_ns, const rtt_stats_callback& callback = nullptr);
+
+	/*!
+	  \brief Fill the given structure with the occupancy and the insert,
+	   delete and eviction counters of the connection table the BPF probe
+	   uses to track the RTT.
+
+	  \note only supported by the BPF probe. This walks the whole table.
+	*/
+	void get_rtt_map_stats(scap_rtt_map_stats* stats) const;
+
 
 #if !defined(CYGWING_AGENT) && !defined(MINIMAL_BUILD)
 	void init_k8s_ssl(const std::string *ssl_cert);
@@ -1022,6 +1220,7 @@ private:
 	}
 
 	void get_procs_cpu_from_driver(uint64_t ts);
+	void read_rtt_stats();
 
 	scap_t* m_h;
 	uint32_t m_nevts;
@@ -1035,6 +1234,10 @@ private:
 	std::string m_input_filename;
 	bool m_bpf;
 	bool m_udig;
+	bool m_relaxed_ordering;
+	uint32_t m_wakeup_watermark;
+	uint32_t m_bpf_ringbuf_groups;
+	uint32_t m_ring_buf_size;
 	bool m_is_windows;
 	std::string m_bpf_probe;
 	bool m_isdebug_enabled;
@@ -1063,6 +1266,9 @@ private:
 	// This is used to support reading merged files, where the capture needs to
 	// restart in the middle of the file.
 	uint64_t m_file_start_offset;
+	// If non-zero, the sections starting from this position are not read,
+	// see set_file_range()
+	uint64_t m_file_end_offset;
 	bool m_flush_memory_dump;
 	bool m_large_envs_enabled;
 
@@ -1129,6 +1335,26 @@ public:
 	//
 #ifdef GATHER_INTERNAL_STATS
 	sinsp_stats m_stats;
+	// Per event type driver counters, registered the first time the
+	// event type shows up in the driver statistics
+	struct evt_type_metrics
+	{
+		internal_metrics::counter* m_evts;
+		internal_metrics::counter* m_drops;
+		internal_metrics::counter* m_bytes;
+		internal_metrics::counter* m_ns;
+	};
+	std::vector<evt_type_metrics> m_evt_type_metrics;
+	void update_evt_type_metrics();
+	// Counters of the dumpers in async mode, registered when the first one
+	// starts. The dumpers add what they counted since the previous update.
+	std::set<sinsp_dumper*> m_async_dumpers;
+	internal_metrics::counter* m_async_dumper_written;
+	internal_metrics::counter* m_async_dumper_dropped;
+	internal_metrics::counter* m_async_dumper_full_waits;
+	void add_async_dumper(sinsp_dumper* dumper);
+	void remove_async_dumper(sinsp_dumper* dumper);
+	void update_async_dumper_metrics(sinsp_dumper* dumper);
 #endif
 #ifdef HAS_ANALYZER
 	std::vector<uint64_t> m_tid_collisions;
@@ -1207,6 +1433,25 @@ public:
 	meta_event_callback m_meta_event_callback;
 	void* m_meta_event_callback_data;
 
+	//
+	// Set by open_shard(), replaces libscap as the source of the events
+	//
+	event_source m_event_source;
+
+	//
+	// Events fetched from libscap by next_batch() and not yet processed
+	//
+	std::vector<scap_evt*> m_scap_batch_evts;
+	std::vector<uint16_t> m_scap_batch_cpuids;
+	uint32_t m_scap_batch_nevts;
+	uint32_t m_scap_batch_pos;
+	uint32_t m_scap_batch_max;
+
+	//
+	// Set by seek_ts(): the events before it only update the state
+	//
+	uint64_t m_seek_ts;
+
 	// A queue of pending container events. Written from async
 	// callbacks that occur after looking up container
 	// information, read from sinsp::next().
@@ -1225,6 +1470,10 @@ public:
 	uint64_t m_last_procrequest_tod;
 	sinsp_proc_metainfo m_meinfo;
 	uint64_t m_next_stats_print_time_ns;
+	rtt_stats_callback m_rtt_stats_callback;
+	uint64_t m_rtt_interval_ns;
+	uint64_t m_next_rtt_read_time_ns;
+	std::vector<scap_rtt_stats> m_rtt_stats;
 
 	static unsigned int m_num_possible_cpus;
 #if defined(HAS_CAPTURE)
@@ -0,0 +1,97 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include "cow_vector.h"
+#include <gtest.h>
+
+#include <string>
+
+using libsinsp::cow_vector;
+
+TEST(cow_vector, copies_share_until_modified)
+{
+	cow_vector<std::string> a;
+	a.push_back("one");
+	a.push_back("two");
+
+	cow_vector<std::string> b = a;
+	EXPECT_TRUE(b.shares_with(a));
+	EXPECT_EQ(b.size(), 2u);
+	EXPECT_EQ(b[1], "two");
+
+	b.push_back("three");
+	EXPECT_FALSE(b.shares_with(a));
+	EXPECT_EQ(a.size(), 2u);
+	EXPECT_EQ(b.size(), 3u);
+	EXPECT_EQ(b.back(), "three");
+}
+
+TEST(cow_vector, assign_keeps_equal_contents)
+{
+	cow_vector<std::string> a;
+	a.assign({"ls", "-l"});
+	cow_vector<std::string> b = a;
+
+	b.assign({"ls", "-l"});
+	EXPECT_TRUE(b.shares_with(a));
+
+	b.assign({"ls", "-la"});
+	EXPECT_FALSE(b.shares_with(a));
+	EXPECT_EQ(a[1], "-l");
+	EXPECT_EQ(b[1], "-la");
+
+	b.assign({});
+	EXPECT_TRUE(b.empty());
+	EXPECT_EQ(b.begin(), b.end());
+}
+
+TEST(cow_vector, clear_does_not_affect_copies)
+{
+	cow_vector<std::string> a;
+	a.emplace_back("x");
+	cow_vector<std::string> b = a;
+
+	a.clear();
+	EXPECT_TRUE(a.empty());
+	EXPECT_EQ(b.size(), 1u);
+
+	const std::vector<std::string>& v = b;
+	EXPECT_EQ(v[0], "x");
+}
+
+TEST(cow_vector, compare)
+{
+	cow_vector<std::string> a;
+	cow_vector<std::string> b;
+	std::vector<std::string> v = {"ls", "-l"};
+
+	EXPECT_TRUE(a == b);
+	EXPECT_TRUE(a == std::vector<std::string>());
+
+	a.assign({"ls", "-l"});
+	EXPECT_TRUE(a != b);
+	EXPECT_TRUE(a == v);
+	EXPECT_TRUE(v == a);
+
+	b.push_back("ls");
+	EXPECT_TRUE(b != v);
+	EXPECT_TRUE(v != b);
+	b.push_back("-l");
+	EXPECT_FALSE(b.shares_with(a));
+	EXPECT_TRUE(a == b);
+	EXPECT_FALSE(a != b);
+}
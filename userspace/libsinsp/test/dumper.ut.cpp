@@ -0,0 +1,283 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+// Gives access to the writer thread mutex
+#define VISIBILITY_PRIVATE public:
+
+#include "sinsp.h"
+#include "test_events.h"
+#include <gtest.h>
+
+#include <signal.h>
+#include <stdio.h>
+#include <sys/resource.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+
+using namespace test_events;
+
+static std::vector<std::vector<uint8_t>> make_events(uint32_t n, uint32_t name_len)
+{
+	std::vector<std::vector<uint8_t>> res;
+
+	for(uint32_t j = 0; j < n; j++)
+	{
+		res.push_back(make_open_x(1000 + j, 1 + j % 10, j, std::string(name_len, (char)('a' + j % 26))));
+	}
+	return res;
+}
+
+static void dump_event(sinsp& inspector, sinsp_dumper& dumper, std::vector<uint8_t>& buf)
+{
+	sinsp_evt evt(&inspector);
+
+	evt.init(buf.data(), 1);
+	dumper.dump(&evt);
+}
+
+//
+// The file must hold the first n events, in order
+//
+static void check_file(const std::string& fname, const std::vector<std::vector<uint8_t>>& events, uint32_t n)
+{
+	char error[SCAP_LASTERR_SIZE];
+	int32_t rc;
+	scap_evt* evt;
+	uint16_t cpuid;
+
+	scap_t* h = scap_open_offline(fname.c_str(), error, &rc);
+	ASSERT_NE(h, nullptr) << error;
+
+	for(uint32_t j = 0; j < n; j++)
+	{
+		ASSERT_EQ(scap_next(h, &evt, &cpuid), SCAP_SUCCESS) << "event " << j << ": " << scap_getlasterr(h);
+		ASSERT_EQ(evt->len, events[j].size()) << "event " << j;
+		ASSERT_EQ(memcmp(evt, events[j].data(), evt->len), 0) << "event " << j;
+	}
+
+	scap_close(h);
+}
+
+static bool wait_for(const std::function<bool()>& done)
+{
+	for(uint32_t j = 0; j < 10000; j++)
+	{
+		if(done())
+		{
+			return true;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	return false;
+}
+
+TEST(dumper, async_block)
+{
+	std::string fname = testing::TempDir() + "dumper_async_block.scap";
+	// Three times the queue
+	std::vector<std::vector<uint8_t>> events = make_events(3000, 1000);
+	sinsp inspector;
+	inspector.open_nodriver();
+
+	sinsp_dumper dumper(&inspector);
+	dumper.set_async(sinsp_dumper::MIN_ASYNC_QUEUE_SIZE, sinsp_dumper::ASYNC_BLOCK);
+	dumper.open(fname, false);
+
+	//
+	// An event that could never fit is dropped whatever the policy
+	//
+	std::vector<std::string> params;
+	for(uint32_t j = 0; j < 10; j++)
+	{
+		params.push_back(std::string(60000, 'x'));
+	}
+	std::vector<uint8_t> huge = make_event(PPME_SYSCALL_OPEN_X, 999, 1, params);
+	dump_event(inspector, dumper, huge);
+	EXPECT_EQ(dumper.get_num_async_dropped_events(), 1u);
+
+	//
+	// With the writer thread stuck, dump() must wait for room
+	//
+	std::unique_lock<std::mutex> writer_lock(dumper.m_async_mutex);
+	std::atomic<bool> done(false);
+	std::thread producer([&]
+	{
+		for(auto& buf : events)
+		{
+			dump_event(inspector, dumper, buf);
+		}
+		done = true;
+	});
+
+	EXPECT_TRUE(wait_for([&] { return dumper.get_num_async_queue_full_waits() > 0; }));
+	EXPECT_FALSE(done);
+	EXPECT_EQ(dumper.get_num_async_written_events(), 0u);
+
+	writer_lock.unlock();
+	producer.join();
+	dumper.close();
+
+	EXPECT_EQ(dumper.get_num_async_written_events(), events.size());
+	EXPECT_EQ(dumper.get_num_async_dropped_events(), 1u);
+	check_file(fname, events, events.size());
+
+	remove(fname.c_str());
+}
+
+TEST(dumper, async_drop)
+{
+	std::string fname = testing::TempDir() + "dumper_async_drop.scap";
+	std::vector<std::vector<uint8_t>> events = make_events(3000, 1000);
+	sinsp inspector;
+	inspector.open_nodriver();
+
+	sinsp_dumper dumper(&inspector);
+	dumper.set_async(sinsp_dumper::MIN_ASYNC_QUEUE_SIZE, sinsp_dumper::ASYNC_DROP);
+	dumper.open(fname, false);
+
+	//
+	// With the writer thread stuck, the events after the first full queue
+	// are all dropped
+	//
+	{
+		std::lock_guard<std::mutex> writer_lock(dumper.m_async_mutex);
+
+		for(auto& buf : events)
+		{
+			dump_event(inspector, dumper, buf);
+		}
+
+		EXPECT_GT(dumper.get_num_async_dropped_events(), 0u);
+		EXPECT_EQ(dumper.get_num_async_queue_full_waits(), dumper.get_num_async_dropped_events());
+	}
+
+	dumper.close();
+
+	uint64_t written = dumper.get_num_async_written_events();
+	EXPECT_EQ(written + dumper.get_num_async_dropped_events(), events.size());
+	check_file(fname, events, written);
+
+	remove(fname.c_str());
+}
+
+TEST(dumper, async_error)
+{
+	std::string fname = testing::TempDir() + "dumper_async_error.scap";
+	std::vector<std::vector<uint8_t>> events = make_events(1000, 1000);
+	sinsp inspector;
+	inspector.open_nodriver();
+	std::string lasterr = scap_getlasterr(inspector.m_h);
+
+	sinsp_dumper dumper(&inspector);
+	dumper.set_async(sinsp_dumper::MIN_ASYNC_QUEUE_SIZE, sinsp_dumper::ASYNC_BLOCK);
+	dumper.open(fname, false);
+
+	//
+	// Make the writes fail once the file grows by a few events
+	//
+	struct rlimit saved_limit;
+	ASSERT_EQ(getrlimit(RLIMIT_FSIZE, &saved_limit), 0);
+	struct rlimit limit = saved_limit;
+	limit.rlim_cur = dumper.written_bytes() + 64 * 1024;
+	void (*saved_handler)(int) = signal(SIGXFSZ, SIG_IGN);
+	ASSERT_EQ(setrlimit(RLIMIT_FSIZE, &limit), 0);
+
+	std::string error;
+	for(uint32_t j = 0; j < 100 && error.empty(); j++)
+	{
+		try
+		{
+			for(auto& buf : events)
+			{
+				dump_event(inspector, dumper, buf);
+			}
+			dumper.flush();
+		}
+		catch(const sinsp_exception& e)
+		{
+			error = e.what();
+		}
+	}
+
+	setrlimit(RLIMIT_FSIZE, &saved_limit);
+	signal(SIGXFSZ, saved_handler);
+
+	EXPECT_NE(error.find("error writing to file"), std::string::npos) << error;
+	EXPECT_LT(dumper.get_num_async_written_events(), 100u * events.size());
+
+	// The error of the writer thread doesn't go through the handle
+	EXPECT_EQ(scap_getlasterr(inspector.m_h), lasterr);
+
+	// Every later dump() fails
+	EXPECT_THROW(dump_event(inspector, dumper, events[0]), sinsp_exception);
+
+	dumper.close();
+	remove(fname.c_str());
+}
+
+TEST(dumper, async_flush_and_close)
+{
+	std::string fname = testing::TempDir() + "dumper_async_flush.scap";
+	std::vector<std::vector<uint8_t>> events = make_events(5000, 100);
+	sinsp inspector;
+	inspector.open_nodriver();
+
+	sinsp_dumper dumper(&inspector);
+	dumper.set_async(sinsp_dumper::MIN_ASYNC_QUEUE_SIZE, sinsp_dumper::ASYNC_BLOCK);
+	dumper.open(fname, false);
+
+	//
+	// flush() waits for the queued events to be written
+	//
+	std::unique_lock<std::mutex> writer_lock(dumper.m_async_mutex);
+	for(uint32_t j = 0; j < 100; j++)
+	{
+		dump_event(inspector, dumper, events[j]);
+	}
+
+	std::atomic<bool> flushed(false);
+	std::thread flusher([&]
+	{
+		dumper.flush();
+		flushed = true;
+	});
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	EXPECT_FALSE(flushed);
+	writer_lock.unlock();
+	flusher.join();
+
+	EXPECT_EQ(dumper.get_num_async_written_events(), 100u);
+	check_file(fname, events, 100);
+
+	//
+	// close() writes the queued events before closing the file
+	//
+	for(uint32_t j = 100; j < events.size(); j++)
+	{
+		dump_event(inspector, dumper, events[j]);
+	}
+	dumper.close();
+
+	EXPECT_EQ(dumper.get_num_async_written_events(), events.size());
+	check_file(fname, events, events.size());
+
+	remove(fname.c_str());
+}
@@ -0,0 +1,245 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+// Gives access to the event number
+#define VISIBILITY_PRIVATE public:
+
+#include "sinsp.h"
+#include "eventformatter.h"
+#include "test_events.h"
+#include <gtest.h>
+#include <json/json.h>
+
+#include <atomic>
+#include <thread>
+
+using namespace test_events;
+
+static const char* formats[] = {
+	"%evt.num %evt.cpu %evt.type %evt.dir %evt.rawres %evt.arg.name",
+	"*%evt.num %evt.rawtime %evt.rawtime.s %evt.rawtime.ns %evt.category %evt.failed %evt.is_open_read %evt.is_open_write",
+	"%12evt.num|%12evt.type|%4evt.cpu|%30evt.arg.name|%6evt.rawres|",
+	"literal only, no fields",
+	"[%evt.arg.flags] [%evt.arg.mode] [%evt.res] [%evt.arg.fd]",
+	"%proc.name %thread.tid %fd.name %evt.arg.name",
+	"%evt.time %evt.type.is.3 %evt.count %evt.count.exit %evt.io_dir",
+};
+
+static const char* names[] = {
+	"/etc/passwd",
+	"",
+	"with \"quotes\" and \\backslashes\\",
+	"control\x01\x1f chars\tand\nnewlines",
+	"utf-8 \xc3\xa8\xe2\x82\xac",
+	"a very long path name that is longer than every padding used in the formats",
+};
+
+//
+// render() must produce the same text as tostring(), and the same JSON
+// document
+//
+static void check_formats(sinsp& inspector, bool json)
+{
+	sinsp_evt evt(&inspector);
+	Json::Reader reader;
+	std::string render_res;
+	std::string tostring_res;
+
+	for(const char* fmt : formats)
+	{
+		sinsp_evt_formatter formatter(&inspector, fmt);
+		uint64_t num = 1;
+
+		for(const char* name : names)
+		{
+			for(int64_t fd : {-2, 0, 3})
+			{
+				std::vector<uint8_t> buf = make_open_x(1500000000123456789ULL + num, 1, fd, name, PPM_O_RDWR | PPM_O_CREAT, 0644);
+				evt.init(buf.data(), 1);
+				evt.m_evtnum = num++;
+
+				bool render_ret = formatter.render(&evt, &render_res);
+				bool tostring_ret = formatter.tostring(&evt, &tostring_res);
+				ASSERT_EQ(render_ret, tostring_ret) << fmt;
+				if(!tostring_ret)
+				{
+					continue;
+				}
+
+				if(!json)
+				{
+					ASSERT_EQ(render_res, tostring_res) << fmt;
+					continue;
+				}
+
+				Json::Value render_val;
+				Json::Value tostring_val;
+				ASSERT_TRUE(reader.parse(render_res, render_val)) << render_res;
+				ASSERT_TRUE(reader.parse(tostring_res, tostring_val)) << tostring_res;
+				ASSERT_EQ(render_val, tostring_val) << fmt << "\n" << render_res << "\n" << tostring_res;
+				ASSERT_EQ(render_val.getMemberNames(), tostring_val.getMemberNames()) << fmt;
+			}
+		}
+	}
+}
+
+TEST(eventformatter, render_matches_tostring_text)
+{
+	sinsp inspector;
+
+	check_formats(inspector, false);
+}
+
+TEST(eventformatter, render_matches_tostring_json)
+{
+	sinsp inspector;
+
+	inspector.set_buffer_format(sinsp_evt::PF_JSON);
+	check_formats(inspector, true);
+}
+
+//
+// Formats that don't extract thread fields, so that the cache can be used
+// from several threads at once
+//
+static std::vector<std::string> cache_formats(uint32_t n)
+{
+	std::vector<std::string> res;
+
+	for(uint32_t j = 0; j < n; j++)
+	{
+		res.push_back("%evt.num %evt.type %evt.rawres format " + std::to_string(j));
+	}
+	return res;
+}
+
+TEST(eventformatter_cache, register_format)
+{
+	sinsp inspector;
+	sinsp_evt_formatter_cache cache(&inspector);
+	std::vector<std::string> formats = cache_formats(3);
+
+	sinsp_evt_formatter_cache::format_id id0 = cache.register_format(formats[0]);
+	sinsp_evt_formatter_cache::format_id id1 = cache.register_format(formats[1]);
+	EXPECT_NE(id0, id1);
+	EXPECT_EQ(cache.register_format(formats[0]), id0);
+	EXPECT_EQ(cache.register_format(formats[1]), id1);
+
+	// An invalid format doesn't take an id
+	EXPECT_THROW(cache.register_format("%not.a.field"), sinsp_exception);
+	sinsp_evt_formatter_cache::format_id id2 = cache.register_format(formats[2]);
+	EXPECT_EQ(id2, id1 + 1);
+
+	// The string overloads find the same ids
+	std::vector<uint8_t> buf = make_open_x(1, 1, 3, "/etc/passwd");
+	sinsp_evt evt(&inspector);
+	evt.init(buf.data(), 0);
+	evt.m_evtnum = 7;
+
+	std::string by_id;
+	std::string by_format;
+	ASSERT_TRUE(cache.tostring(&evt, id2, &by_id));
+	ASSERT_TRUE(cache.tostring(&evt, formats[2], &by_format));
+	EXPECT_EQ(by_id, by_format);
+	EXPECT_EQ(by_id, "7 open 3 format 2");
+	EXPECT_EQ(cache.register_format(formats[2]), id2);
+
+	EXPECT_THROW(cache.tostring(&evt, id2 + 1, &by_id), sinsp_exception);
+}
+
+TEST(eventformatter_cache, eviction)
+{
+	sinsp inspector;
+	// A single set
+	sinsp_evt_formatter_cache cache(&inspector, sinsp_evt_formatter_cache::SLOT_WAYS);
+	std::vector<std::string> formats = cache_formats(4 * sinsp_evt_formatter_cache::SLOT_WAYS);
+	std::vector<sinsp_evt_formatter_cache::format_id> ids;
+
+	for(const auto& format : formats)
+	{
+		ids.push_back(cache.register_format(format));
+	}
+
+	std::vector<uint8_t> buf = make_open_x(1, 1, 5, "/etc/passwd");
+	sinsp_evt evt(&inspector);
+	evt.init(buf.data(), 0);
+	std::string res;
+
+	//
+	// Every format evicts another one, they are recreated when they are
+	// used again
+	//
+	for(uint32_t round = 0; round < 3; round++)
+	{
+		for(uint32_t j = 0; j < ids.size(); j++)
+		{
+			evt.m_evtnum = round * 100 + j;
+			ASSERT_TRUE(cache.render(&evt, ids[j], &res));
+			EXPECT_EQ(res, std::to_string(evt.m_evtnum) + " open 5 format " + std::to_string(j));
+		}
+	}
+}
+
+TEST(eventformatter_cache, concurrent)
+{
+	sinsp inspector;
+	// Fewer slots than formats, to evict while formatters are in use
+	sinsp_evt_formatter_cache cache(&inspector, 2 * sinsp_evt_formatter_cache::SLOT_WAYS);
+	std::vector<std::string> formats = cache_formats(12);
+	std::vector<sinsp_evt_formatter_cache::format_id> ids;
+	std::atomic<uint32_t> nerrors(0);
+
+	for(const auto& format : formats)
+	{
+		ids.push_back(cache.register_format(format));
+	}
+
+	std::vector<std::thread> threads;
+	for(uint32_t t = 0; t < 8; t++)
+	{
+		threads.emplace_back([&, t] ()
+		{
+			std::vector<uint8_t> buf = make_open_x(1, 1, t, "/etc/passwd");
+			sinsp_evt evt(&inspector);
+			evt.init(buf.data(), 0);
+			std::string res;
+
+			for(uint32_t j = 0; j < 5000; j++)
+			{
+				uint32_t n = (j * 7 + t) % ids.size();
+				evt.m_evtnum = j;
+
+				std::string expected = std::to_string(j) + " open " + std::to_string(t) + " format " + std::to_string(n);
+				bool ok = (j % 2) ?
+					cache.render(&evt, ids[n], &res) :
+					cache.tostring(&evt, formats[n], &res);
+
+				if(!ok || res != expected)
+				{
+					nerrors++;
+				}
+			}
+		});
+	}
+
+	for(auto& thread : threads)
+	{
+		thread.join();
+	}
+
+	EXPECT_EQ(nerrors.load(), 0u);
+}
@@ -0,0 +1,123 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+// Gives access to the event number
+#define VISIBILITY_PRIVATE public:
+
+#include "sinsp.h"
+#include "filter.h"
+#include "test_events.h"
+#include <gtest.h>
+
+#include <algorithm>
+#include <memory>
+#include <random>
+
+using namespace test_events;
+
+//
+// Overlapping rules: the same fields with different operators, and
+// or-chains that the compiler merges in a single multi value check
+//
+static const std::vector<std::pair<std::string, std::string>> rules = {
+	{"etc_contains", "evt.type = open and evt.arg.name contains /etc"},
+	{"etc_startswith", "evt.type = open and evt.arg.name startswith /etc"},
+	{"etc_not_endswith", "evt.arg.name startswith /etc and not evt.arg.name endswith passwd"},
+	{"sensitive_eq", "evt.arg.name = /etc/passwd or evt.arg.name = /etc/shadow"},
+	{"sensitive_ne", "evt.arg.name != /etc/passwd and evt.arg.name != /etc/shadow"},
+	{"merged_many", "evt.arg.name contains pass or evt.arg.name contains shad or evt.arg.name contains host or evt.arg.name contains bin"},
+	{"merged_two", "evt.arg.name contains pass or evt.arg.name contains tmp"},
+	{"merged_endswith", "evt.arg.name endswith ls or evt.arg.name endswith wd or evt.arg.name endswith ts or evt.arg.name endswith .so"},
+	{"merged_icontains", "evt.arg.name icontains ETC or evt.arg.name icontains BIN or evt.arg.name icontains LIB or evt.arg.name icontains TMP"},
+	{"res_range", "evt.rawres >= 3 and evt.rawres < 10"},
+	{"res_high", "evt.rawres > 5 and not evt.arg.name endswith ls"},
+	{"res_eq", "evt.rawres = 7 or evt.rawres = 3"},
+	{"cpu", "evt.cpu = 1 and evt.arg.name contains etc"},
+	{"in_list", "evt.arg.name in (/etc/passwd, /bin/ls) and evt.rawres != 0"},
+	{"pmatch", "evt.arg.name pmatch (/etc, /usr/bin)"},
+	{"nested", "(evt.arg.name contains etc or evt.rawres = 4) and (evt.cpu != 0 or evt.arg.name startswith /usr)"},
+};
+
+static const char* names[] = {
+	"/etc/passwd", "/etc/shadow", "/etc/hosts", "/bin/ls", "/usr/bin/ls",
+	"/usr/lib/libc.so", "/tmp/x", "/home/user/.ETC", "/etcetera", "relative/path",
+};
+
+TEST(evttype_filter, run_all_matches_run)
+{
+	sinsp inspector;
+	sinsp_evttype_filter evttype_filter;
+	std::vector<std::unique_ptr<sinsp_filter>> reference;
+	std::set<uint32_t> evttypes;
+	std::set<uint32_t> syscalls;
+	std::set<std::string> tags;
+
+	for(const auto& rule : rules)
+	{
+		std::string name = rule.first;
+		sinsp_filter_compiler shared(&inspector, rule.second);
+		sinsp_filter_compiler alone(&inspector, rule.second);
+
+		evttype_filter.add(name, evttypes, syscalls, tags, shared.compile());
+		reference.emplace_back(alone.compile());
+	}
+	evttype_filter.enable(".*", true);
+
+	const sinsp_filter_optimizer& optimizer = evttype_filter.get_optimizer();
+	EXPECT_GT(optimizer.get_num_shared_evals(), 0u);
+	EXPECT_GT(optimizer.get_num_shared_extractions(), 0u);
+
+	// The or-chains are merged
+	sinsp_filter_compiler merged(&inspector, rules[5].second);
+	std::unique_ptr<sinsp_filter> merged_filter(merged.compile());
+	sinsp_filter_optimizer merged_optimizer;
+	merged_optimizer.add_filter(merged_filter.get());
+	EXPECT_EQ(merged_optimizer.get_num_checks(), 1u);
+
+	std::mt19937 rng(1);
+	sinsp_evt evt(&inspector);
+	uint32_t nmatches = 0;
+
+	for(uint64_t num = 1; num <= 2000; num++)
+	{
+		std::vector<uint8_t> buf = make_open_x(num, 1, rng() % 12, names[rng() % (sizeof(names) / sizeof(names[0]))]);
+		evt.init(buf.data(), rng() % 3);
+		evt.m_evtnum = num;
+
+		std::vector<std::string> expected;
+		for(uint32_t j = 0; j < rules.size(); j++)
+		{
+			if(reference[j]->run(&evt))
+			{
+				expected.push_back(rules[j].first);
+			}
+		}
+
+		std::vector<std::string> matching;
+		evttype_filter.run_all(&evt, matching);
+
+		std::sort(expected.begin(), expected.end());
+		std::sort(matching.begin(), matching.end());
+		ASSERT_EQ(matching, expected) << "event " << num << " " << evt.get_param_value_str("name");
+		ASSERT_EQ(evttype_filter.run(&evt), !expected.empty());
+
+		nmatches += matching.size();
+	}
+
+	// The events must exercise the rules
+	EXPECT_GT(nmatches, 2000u);
+}
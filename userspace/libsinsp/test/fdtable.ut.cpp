@@ -0,0 +1,124 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include "sinsp.h"
+#include <gtest.h>
+
+#include <map>
+
+static sinsp_fdinfo_t make_fd(const std::string& name)
+{
+	sinsp_fdinfo_t fdinfo;
+	fdinfo.m_name = name;
+	return fdinfo;
+}
+
+TEST(sinsp_fdtable, dense_and_sparse)
+{
+	sinsp inspector;
+	sinsp_fdtable table(&inspector);
+	const int64_t fds[] = {0, 1, 15, 16, sinsp_fdtable::DENSE_FD_LIMIT - 1,
+			       sinsp_fdtable::DENSE_FD_LIMIT, 100000, -1};
+
+	for(int64_t fd : fds)
+	{
+		sinsp_fdinfo_t fdinfo = make_fd(std::to_string(fd));
+		ASSERT_NE(table.add(fd, &fdinfo), nullptr);
+	}
+
+	EXPECT_EQ(table.size(), sizeof(fds) / sizeof(fds[0]));
+
+	for(int64_t fd : fds)
+	{
+		sinsp_fdinfo_t* fdinfo = table.find(fd);
+		ASSERT_NE(fdinfo, nullptr);
+		EXPECT_EQ(fdinfo->m_name, std::to_string(fd));
+	}
+
+	EXPECT_EQ(table.find(2), nullptr);
+	EXPECT_EQ(table.find(200000), nullptr);
+
+	table.erase(15);
+	table.erase(100000);
+	EXPECT_EQ(table.find(15), nullptr);
+	EXPECT_EQ(table.find(100000), nullptr);
+	EXPECT_EQ(table.size(), sizeof(fds) / sizeof(fds[0]) - 2);
+
+	table.clear();
+	EXPECT_EQ(table.size(), 0u);
+	EXPECT_EQ(table.find(0), nullptr);
+}
+
+TEST(sinsp_fdtable, stable_pointers)
+{
+	sinsp inspector;
+	sinsp_fdtable table(&inspector);
+	sinsp_fdinfo_t fdinfo = make_fd("first");
+
+	sinsp_fdinfo_t* first = table.add(3, &fdinfo);
+	ASSERT_NE(first, nullptr);
+
+	for(int64_t fd = 4; fd < 2 * sinsp_fdtable::DENSE_FD_LIMIT; fd++)
+	{
+		table.add(fd, &fdinfo);
+	}
+
+	EXPECT_EQ(table.find(3), first);
+
+	fdinfo.m_name = "second";
+	EXPECT_EQ(table.add(3, &fdinfo), first);
+	EXPECT_EQ(first->m_name, "second");
+}
+
+TEST(sinsp_fdtable, copy_and_loop)
+{
+	sinsp inspector;
+	sinsp_fdtable table(&inspector);
+	std::map<int64_t, std::string> expected;
+
+	for(int64_t fd : {7, 0, 5000, 42})
+	{
+		sinsp_fdinfo_t fdinfo = make_fd(std::to_string(fd));
+		table.add(fd, &fdinfo);
+		expected[fd] = fdinfo.m_name;
+	}
+
+	sinsp_fdtable copy(&inspector);
+	copy = table;
+	table.erase(42);
+
+	std::map<int64_t, std::string> visited;
+	std::vector<int64_t> order;
+	copy.loop([&] (int64_t fd, sinsp_fdinfo_t& fdinfo) {
+		visited[fd] = fdinfo.m_name;
+		order.push_back(fd);
+		return true;
+	});
+
+	EXPECT_EQ(visited, expected);
+	// Dense fds come first, in ascending order
+	EXPECT_EQ(order[0], 0);
+	EXPECT_EQ(order[1], 7);
+	EXPECT_EQ(order[2], 42);
+	EXPECT_NE(copy.find(42), nullptr);
+
+	uint32_t n = 0;
+	EXPECT_FALSE(copy.loop([&] (int64_t fd, sinsp_fdinfo_t& fdinfo) {
+		return ++n < 2;
+	}));
+	EXPECT_EQ(n, 2u);
+}
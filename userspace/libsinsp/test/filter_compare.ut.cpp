@@ -0,0 +1,205 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include "sinsp.h"
+#include "filterchecks.h"
+#include "value_parser.h"
+#include <gtest.h>
+
+#include <string>
+#include <vector>
+
+//
+// A check with a single field of the given type, extracting a value set by
+// the test
+//
+class mock_field_check : public sinsp_filter_check
+{
+public:
+	mock_field_check(ppm_param_type type, cmpop op, const std::vector<std::string>& values)
+	{
+		memset(&m_field_info, 0, sizeof(m_field_info));
+		m_field_info.m_type = type;
+		strcpy(m_field_info.m_name, "mock.field");
+		m_info.m_fields = &m_field_info;
+		m_info.m_nfields = 1;
+		m_field_id = 0;
+		m_field = &m_field_info;
+		m_cmpop = op;
+		m_null = false;
+		m_len = 0;
+
+		for(uint32_t j = 0; j < values.size(); j++)
+		{
+			add_filter_value(values[j].c_str(), (uint32_t)values[j].size(), j);
+		}
+	}
+
+	sinsp_filter_check* allocate_new()
+	{
+		return NULL;
+	}
+
+	uint8_t* extract(sinsp_evt *evt, OUT uint32_t* len, bool sanitize_strings = true)
+	{
+		if(m_null)
+		{
+			return NULL;
+		}
+		*len = m_len;
+		return m_val;
+	}
+
+	void set_value(const std::string& str)
+	{
+		m_null = false;
+		if(m_field_info.m_type == PT_CHARBUF)
+		{
+			// Strings are extracted without their length, like most fields do
+			strcpy((char*)m_val, str.c_str());
+			m_len = 0;
+		}
+		else
+		{
+			m_len = (uint32_t)sinsp_filter_value_parser::string_to_rawval(str.c_str(), (uint32_t)str.size(), m_val, sizeof(m_val), m_field_info.m_type);
+		}
+	}
+
+	void set_null()
+	{
+		m_null = true;
+	}
+
+private:
+	filtercheck_field_info m_field_info;
+	uint8_t m_val[256];
+	uint32_t m_len;
+	bool m_null;
+};
+
+static std::string describe(ppm_param_type type, cmpop op, const std::vector<std::string>& values, const std::string& value)
+{
+	std::string res = "type " + std::to_string(type) + " op " + std::to_string(op) + " value '" + value + "' filter values";
+	for(const auto& v : values)
+	{
+		res += " '" + v + "'";
+	}
+	return res;
+}
+
+//
+// The specialized comparator must return the same result as compare(),
+// which goes through flt_compare(), for every extracted value
+//
+static void check_equivalent(ppm_param_type type, cmpop op, const std::vector<std::string>& values, const std::vector<std::string>& extracted)
+{
+	mock_field_check chk(type, op, values);
+	gen_event_filter_check::compare_fn fn = chk.get_compare_fn();
+	sinsp_evt evt;
+
+	ASSERT_NE(fn, nullptr) << describe(type, op, values, "");
+
+	for(const auto& value : extracted)
+	{
+		chk.set_value(value);
+		EXPECT_EQ(fn(&chk, &evt), chk.compare(&evt)) << describe(type, op, values, value);
+	}
+
+	chk.set_null();
+	EXPECT_FALSE(fn(&chk, &evt)) << describe(type, op, values, "NULL");
+	EXPECT_FALSE(chk.compare(&evt)) << describe(type, op, values, "NULL");
+}
+
+static const cmpop numeric_ops[] = {CO_EQ, CO_NE, CO_LT, CO_LE, CO_GT, CO_GE};
+
+TEST(filter_compare, numeric)
+{
+	const ppm_param_type signed_types[] = {PT_INT8, PT_INT16, PT_INT32, PT_INT64, PT_FD, PT_ERRNO};
+	const ppm_param_type unsigned_types[] = {
+		PT_UINT8, PT_FLAGS8, PT_UINT16, PT_FLAGS16, PT_PORT,
+		PT_UINT32, PT_FLAGS32, PT_MODE, PT_UINT64, PT_RELTIME, PT_ABSTIME};
+	const std::vector<std::string> signed_values = {"-100", "-1", "0", "1", "7", "100"};
+	const std::vector<std::string> unsigned_values = {"0", "1", "7", "100", "255"};
+
+	for(ppm_param_type type : signed_types)
+	{
+		for(cmpop op : numeric_ops)
+		{
+			for(const auto& v : signed_values)
+			{
+				check_equivalent(type, op, {v}, signed_values);
+			}
+		}
+		check_equivalent(type, CO_EXISTS, {}, signed_values);
+		check_equivalent(type, CO_IN, {"-1", "7"}, signed_values);
+		check_equivalent(type, CO_IN, {"100"}, signed_values);
+	}
+
+	for(ppm_param_type type : unsigned_types)
+	{
+		for(cmpop op : numeric_ops)
+		{
+			for(const auto& v : unsigned_values)
+			{
+				check_equivalent(type, op, {v}, unsigned_values);
+			}
+		}
+		check_equivalent(type, CO_EXISTS, {}, unsigned_values);
+		check_equivalent(type, CO_IN, {"0", "7", "255"}, unsigned_values);
+	}
+
+	check_equivalent(PT_BOOL, CO_EQ, {"true"}, {"true", "false"});
+	check_equivalent(PT_BOOL, CO_NE, {"false"}, {"true", "false"});
+	check_equivalent(PT_BOOL, CO_IN, {"false"}, {"true", "false"});
+}
+
+TEST(filter_compare, string)
+{
+	const cmpop ops[] = {CO_EQ, CO_NE, CO_CONTAINS, CO_STARTSWITH, CO_ENDSWITH};
+	const std::vector<std::string> values = {"/usr/bin/ls", "/usr/bin", "ls", "", "/etc/passwd", "/usr/bin/lsof"};
+
+	for(cmpop op : ops)
+	{
+		for(const auto& v : values)
+		{
+			if(v.empty())
+			{
+				continue;
+			}
+			check_equivalent(PT_CHARBUF, op, {v}, values);
+		}
+	}
+
+	//
+	// Several values go through the pattern matching, with and without the
+	// multi pattern search
+	//
+	const cmpop multi_ops[] = {CO_CONTAINS, CO_ICONTAINS, CO_STARTSWITH, CO_ENDSWITH};
+	for(cmpop op : multi_ops)
+	{
+		check_equivalent(PT_CHARBUF, op, {"bin", "passwd"}, values);
+		check_equivalent(PT_CHARBUF, op, {"/usr", "LS", "sof", "etc", "/nothing"}, values);
+	}
+	check_equivalent(PT_CHARBUF, CO_ICONTAINS, {"BIN"}, values);
+
+	check_equivalent(PT_CHARBUF, CO_EXISTS, {}, values);
+	check_equivalent(PT_CHARBUF, CO_IN, {"ls", "/etc/passwd"}, values);
+	check_equivalent(PT_CHARBUF, CO_IN, {"", "/usr/bin"}, values);
+	check_equivalent(PT_CHARBUF, CO_INTERSECTS, {"ls", "/usr/bin/lsof"}, values);
+	check_equivalent(PT_CHARBUF, CO_PMATCH, {"/usr/bin", "/etc"}, values);
+	check_equivalent(PT_CHARBUF, CO_PMATCH, {"/usr/bin/ls"}, values);
+}
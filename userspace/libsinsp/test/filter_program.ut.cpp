@@ -0,0 +1,288 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include "sinsp.h"
+#include "gen_filter.h"
+#include <gtest.h>
+
+#include <random>
+
+static const uint32_t NUM_INPUTS = 6;
+
+class mock_event : public gen_event
+{
+public:
+	mock_event(uint32_t inputs): m_inputs(inputs) {}
+
+	uint64_t get_ts() const { return 0; }
+	uint16_t get_source() const { return ESRC_NONE; }
+	uint16_t get_type() const { return 0; }
+
+	uint32_t m_inputs;
+};
+
+//
+// A check whose result is one of the bits of the event, counting how many
+// times it gets evaluated
+//
+class mock_check : public gen_event_filter_check
+{
+public:
+	mock_check(uint32_t input, uint32_t spin = 0): m_input(input), m_spin(spin), m_ncalls(0)
+	{
+		m_boolop = BO_NONE;
+		m_cmpop = CO_NONE;
+	}
+
+	int32_t parse_field_name(const char* str, bool alloc_state, bool needed_for_filtering) { return 0; }
+	void add_filter_value(const char* str, uint32_t len, uint32_t i = 0) {}
+	uint8_t* extract(gen_event *evt, uint32_t* len, bool sanitize_strings = true) { return NULL; }
+
+	bool compare(gen_event *evt)
+	{
+		m_ncalls++;
+		for(volatile uint32_t j = 0; j < m_spin; j++)
+		{
+		}
+		return (((mock_event*)evt)->m_inputs & (1 << m_input)) != 0;
+	}
+
+	uint32_t m_input;
+	uint32_t m_spin;
+	uint64_t m_ncalls;
+};
+
+static void build_expression(gen_event_filter& filter, std::mt19937& rng, uint32_t depth, std::vector<mock_check*>& checks, bool set_ids)
+{
+	uint32_t size = 1 + rng() % 4;
+	boolop op = (rng() % 2) ? BO_AND : BO_OR;
+
+	for(uint32_t j = 0; j < size; j++)
+	{
+		boolop bop = (j == 0) ? BO_NONE : op;
+		if(rng() % 3 == 0)
+		{
+			bop = (boolop)(bop | BO_NOT);
+		}
+
+		uint32_t kind = rng() % 8;
+		if(depth < 3 && kind < 2)
+		{
+			filter.push_expression(bop);
+			// kind 1 leaves the nested expression empty
+			if(kind == 0)
+			{
+				build_expression(filter, rng, depth + 1, checks, set_ids);
+			}
+			filter.pop_expression();
+		}
+		else
+		{
+			mock_check* chk = new mock_check(rng() % NUM_INPUTS);
+			chk->m_boolop = bop;
+			if(set_ids)
+			{
+				chk->set_check_id((int32_t)checks.size() + 1);
+			}
+			checks.push_back(chk);
+			filter.add_check(chk);
+		}
+	}
+}
+
+// The program must match the tree walk in result, check id and evaluated checks
+TEST(filter_program, matches_tree)
+{
+	std::mt19937 rng(1);
+
+	for(uint32_t n = 0; n < 500; n++)
+	{
+		gen_event_filter filter;
+		std::vector<mock_check*> checks;
+		filter.set_profiling(0);
+		build_expression(filter, rng, 0, checks, true);
+
+		for(uint32_t inputs = 0; inputs < (1 << NUM_INPUTS); inputs++)
+		{
+			mock_event evt_tree(inputs);
+			bool res_tree = filter.m_filter->compare(&evt_tree);
+			std::vector<uint64_t> ncalls;
+			for(auto chk : checks)
+			{
+				ncalls.push_back(chk->m_ncalls);
+				chk->m_ncalls = 0;
+			}
+
+			mock_event evt_program(inputs);
+			ASSERT_EQ(res_tree, filter.run(&evt_program));
+			ASSERT_EQ(evt_tree.get_check_id(), evt_program.get_check_id());
+			for(uint32_t j = 0; j < checks.size(); j++)
+			{
+				ASSERT_EQ(ncalls[j], checks[j]->m_ncalls);
+				checks[j]->m_ncalls = 0;
+			}
+		}
+	}
+}
+
+TEST(filter_program, folding_and_threading)
+{
+	// Empty filters accept everything
+	gen_event_filter empty;
+	mock_event evt(0);
+	EXPECT_TRUE(empty.run(&evt));
+	ASSERT_EQ(empty.get_program().size(), 1u);
+	EXPECT_EQ(empty.get_program()[0].m_op, gen_event_filter_insn::FI_CONST);
+
+	// (a and b) and c: a failing a goes straight to the end
+	gen_event_filter filter;
+	filter.push_expression(BO_NONE);
+	filter.add_check(new mock_check(0));
+	mock_check* b = new mock_check(1);
+	b->m_boolop = BO_AND;
+	filter.add_check(b);
+	filter.pop_expression();
+	mock_check* c = new mock_check(2);
+	c->m_boolop = BO_AND;
+	filter.add_check(c);
+	filter.compile();
+
+	const std::vector<gen_event_filter_insn>& program = filter.get_program();
+	for(const auto& insn : program)
+	{
+		if(insn.m_op == gen_event_filter_insn::FI_JUMP_IF_FALSE)
+		{
+			EXPECT_EQ(insn.m_target, program.size());
+		}
+	}
+
+	mock_event evt_abc(7);
+	EXPECT_TRUE(filter.run(&evt_abc));
+	mock_event evt_ab(3);
+	EXPECT_FALSE(filter.run(&evt_ab));
+
+	// Adding a check invalidates the program
+	mock_check* d = new mock_check(3);
+	d->m_boolop = BO_AND;
+	filter.add_check(d);
+	mock_event evt_abc2(7);
+	EXPECT_FALSE(filter.run(&evt_abc2));
+	mock_event evt_abcd(15);
+	EXPECT_TRUE(filter.run(&evt_abcd));
+}
+
+// Reordering must not change the result of the filter
+TEST(filter_program, reorder_keeps_results)
+{
+	std::mt19937 rng(2);
+
+	for(uint32_t n = 0; n < 200; n++)
+	{
+		gen_event_filter filter;
+		std::vector<mock_check*> checks;
+		build_expression(filter, rng, 0, checks, n % 4 == 0);
+		for(auto chk : checks)
+		{
+			chk->m_spin = rng() % 64;
+		}
+		filter.set_profiling(1, 16);
+
+		for(uint32_t round = 0; round < 8; round++)
+		{
+			for(uint32_t inputs = 0; inputs < (1 << NUM_INPUTS); inputs++)
+			{
+				mock_event evt_tree(inputs);
+				mock_event evt_program(inputs);
+				ASSERT_EQ(filter.m_filter->compare(&evt_tree), filter.run(&evt_program));
+				ASSERT_EQ(evt_tree.get_check_id(), evt_program.get_check_id());
+			}
+		}
+	}
+}
+
+TEST(filter_program, reorder_by_cost_and_pass_rate)
+{
+	// a is slow and always passes, b is fast and never does
+	gen_event_filter filter;
+	mock_check* a = new mock_check(0, 2000);
+	mock_check* b = new mock_check(1);
+	b->m_boolop = BO_AND;
+	filter.add_check(a);
+	filter.add_check(b);
+	filter.set_profiling(1, 32);
+
+	mock_event evt(1);
+	for(uint32_t j = 0; j < 256; j++)
+	{
+		EXPECT_FALSE(filter.run(&evt));
+	}
+
+	ASSERT_EQ(filter.get_program()[0].m_op, gen_event_filter_insn::FI_CHECK);
+	EXPECT_EQ(filter.get_program()[0].m_check, b);
+
+	const std::vector<gen_event_filter_check_stats>& stats = filter.get_check_stats();
+	ASSERT_EQ(stats.size(), 2u);
+	EXPECT_EQ(stats[0].m_check, a);
+	EXPECT_EQ(stats[0].pass_rate(), 1.0);
+	EXPECT_EQ(stats[1].pass_rate(), 0.0);
+
+	a->m_ncalls = 0;
+	for(uint32_t j = 0; j < 256; j++)
+	{
+		EXPECT_FALSE(filter.run(&evt));
+	}
+	EXPECT_EQ(a->m_ncalls, 0u);
+
+	// Checks with an id are never moved
+	gen_event_filter with_ids;
+	a = new mock_check(0, 2000);
+	b = new mock_check(1);
+	b->m_boolop = BO_AND;
+	b->set_check_id(1);
+	with_ids.add_check(a);
+	with_ids.add_check(b);
+	with_ids.set_profiling(1, 32);
+
+	for(uint32_t j = 0; j < 256; j++)
+	{
+		EXPECT_FALSE(with_ids.run(&evt));
+	}
+	EXPECT_EQ(with_ids.get_program()[0].m_check, a);
+}
+
+// Without set_profiling() nothing is sampled nor reordered
+TEST(filter_program, profiling_disabled_by_default)
+{
+	gen_event_filter filter;
+	mock_check* a = new mock_check(0, 100);
+	mock_check* b = new mock_check(1);
+	b->m_boolop = BO_AND;
+	filter.add_check(a);
+	filter.add_check(b);
+
+	mock_event evt(1);
+	for(uint32_t j = 0; j < 2 * gen_event_filter::DEFAULT_SAMPLE_PERIOD * gen_event_filter::DEFAULT_REORDER_PERIOD; j++)
+	{
+		EXPECT_FALSE(filter.run(&evt));
+	}
+
+	EXPECT_EQ(filter.get_program()[0].m_check, a);
+	for(const auto& stats : filter.get_check_stats())
+	{
+		EXPECT_EQ(stats.m_nevals, 0u);
+	}
+}
@@ -0,0 +1,108 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include "multi_search.h"
+#include <gtest.h>
+
+#include <algorithm>
+#include <random>
+
+static std::string lower(std::string s)
+{
+	std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c; });
+	return s;
+}
+
+static std::string random_string(std::mt19937& rng, uint32_t maxlen)
+{
+	static const char alphabet[] = "abAB/.";
+	std::string s(rng() % (maxlen + 1), ' ');
+	for(auto& c : s)
+	{
+		c = alphabet[rng() % (sizeof(alphabet) - 1)];
+	}
+	return s;
+}
+
+TEST(multi_search, basic)
+{
+	multi_pattern_search search;
+	search.add_pattern(std::string("/etc/"));
+	search.add_pattern(std::string("passwd"));
+	search.add_pattern(std::string(".ssh"));
+
+	std::string s = "/home/user/.ssh/id_rsa";
+	EXPECT_TRUE(search.contains((const uint8_t*)s.c_str(), s.size()));
+	EXPECT_FALSE(search.starts_with((const uint8_t*)s.c_str(), s.size()));
+	EXPECT_FALSE(search.ends_with((const uint8_t*)s.c_str(), s.size()));
+
+	s = "/etc/shadow";
+	EXPECT_TRUE(search.starts_with((const uint8_t*)s.c_str(), s.size()));
+	s = "/etc/passwd";
+	EXPECT_TRUE(search.ends_with((const uint8_t*)s.c_str(), s.size()));
+	s = "/usr/bin/PASSWD";
+	EXPECT_FALSE(search.contains((const uint8_t*)s.c_str(), s.size()));
+
+	multi_pattern_search isearch;
+	isearch.set_case_insensitive(true);
+	isearch.add_pattern(std::string("PassWD"));
+	EXPECT_TRUE(isearch.contains((const uint8_t*)s.c_str(), s.size()));
+	EXPECT_TRUE(isearch.ends_with((const uint8_t*)s.c_str(), s.size()));
+}
+
+// Compare with the naive search on random patterns over a small alphabet
+TEST(multi_search, matches_naive)
+{
+	std::mt19937 rng(3);
+
+	for(uint32_t n = 0; n < 300; n++)
+	{
+		bool icase = (n % 2) != 0;
+		multi_pattern_search search;
+		search.set_case_insensitive(icase);
+		std::vector<std::string> patterns;
+
+		uint32_t npatterns = 1 + rng() % 20;
+		for(uint32_t j = 0; j < npatterns; j++)
+		{
+			patterns.push_back(random_string(rng, 5));
+			search.add_pattern(patterns.back());
+		}
+
+		for(uint32_t k = 0; k < 100; k++)
+		{
+			std::string s = random_string(rng, 16);
+			std::string ls = icase ? lower(s) : s;
+			bool contains = false, starts = false, ends = false;
+
+			for(auto p : patterns)
+			{
+				if(icase)
+				{
+					p = lower(p);
+				}
+				contains |= ls.find(p) != std::string::npos;
+				starts |= ls.compare(0, p.size(), p) == 0 && ls.size() >= p.size();
+				ends |= ls.size() >= p.size() && ls.compare(ls.size() - p.size(), p.size(), p) == 0;
+			}
+
+			ASSERT_EQ(contains, search.contains((const uint8_t*)s.data(), s.size())) << s;
+			ASSERT_EQ(starts, search.starts_with((const uint8_t*)s.data(), s.size())) << s;
+			ASSERT_EQ(ends, search.ends_with((const uint8_t*)s.data(), s.size())) << s;
+		}
+	}
+}
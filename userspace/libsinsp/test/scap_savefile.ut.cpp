@@ -0,0 +1,632 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include "sinsp.h"
+#include "parallel_replay.h"
+#include "test_events.h"
+#include <gtest.h>
+
+#include <stdio.h>
+
+#include <map>
+#include <memory>
+#include <random>
+
+using namespace test_events;
+
+//
+// A handle without a driver, to open dumpers
+//
+static scap_t* open_nodriver()
+{
+	char error[SCAP_LASTERR_SIZE];
+	int32_t rc;
+	scap_open_args oargs;
+
+	memset(&oargs, 0, sizeof(oargs));
+	oargs.mode = SCAP_MODE_NODRIVER;
+	// The dump files need a user list
+	oargs.import_users = true;
+
+	scap_t* h = scap_open(oargs, error, &rc);
+	EXPECT_NE(h, nullptr) << error;
+	return h;
+}
+
+static scap_t* open_offline(const std::string& fname)
+{
+	char error[SCAP_LASTERR_SIZE];
+	int32_t rc;
+
+	scap_t* h = scap_open_offline(fname.c_str(), error, &rc);
+	EXPECT_NE(h, nullptr) << error;
+	return h;
+}
+
+static uint64_t event_ts(uint32_t num)
+{
+	return 1000 + 10 * (uint64_t)num;
+}
+
+struct written_event
+{
+	std::vector<uint8_t> m_buf;
+	uint16_t m_cpuid;
+	uint32_t m_flags;
+};
+
+//
+// Open events with random names, some of them longer than big_len, 10ns
+// apart
+//
+static std::vector<written_event> make_events(uint32_t n, uint32_t big_len)
+{
+	std::mt19937 rng(n);
+	std::vector<written_event> res;
+
+	for(uint32_t j = 0; j < n; j++)
+	{
+		uint32_t len = (j % 97 == 0) ? big_len + rng() % 100 : rng() % 64;
+		std::string name(len, (char)('a' + j % 26));
+
+		written_event e;
+		e.m_buf = make_open_x(event_ts(j), 1 + rng() % 10, j, name);
+		e.m_cpuid = rng() % 16;
+		e.m_flags = (j % 3 == 0) ? SCAP_DF_STATE_ONLY : SCAP_DF_NONE;
+		res.push_back(e);
+	}
+
+	return res;
+}
+
+//
+// Write the events, with a checkpoint before every checkpoint_every events
+//
+static void write_events(const std::string& fname, compression_mode compress, uint32_t block_size, const std::vector<written_event>& events, uint64_t index_interval = 0, uint32_t checkpoint_every = 0)
+{
+	scap_t* h = open_nodriver();
+	ASSERT_NE(h, nullptr);
+
+	scap_dumper_t* d = scap_dump_open(h, fname.c_str(), compress, true);
+	ASSERT_NE(d, nullptr) << scap_getlasterr(h);
+	ASSERT_EQ(scap_dump_set_event_block_size(d, block_size), SCAP_SUCCESS);
+	ASSERT_EQ(scap_dump_set_index_interval(d, index_interval), SCAP_SUCCESS);
+
+	for(uint32_t j = 0; j < events.size(); j++)
+	{
+		const written_event& e = events[j];
+
+		if(checkpoint_every != 0 && j != 0 && j % checkpoint_every == 0)
+		{
+			ASSERT_EQ(scap_dump_checkpoint(h, d, true), SCAP_SUCCESS) << scap_getlasterr(h);
+		}
+		ASSERT_EQ(scap_dump(h, d, (scap_evt*)e.m_buf.data(), e.m_cpuid, e.m_flags), SCAP_SUCCESS);
+	}
+
+	scap_dump_close(d);
+	scap_close(h);
+}
+
+static void expect_event(scap_t* h, const written_event& expected, uint32_t num)
+{
+	scap_evt* evt;
+	uint16_t cpuid;
+
+	ASSERT_EQ(scap_next(h, &evt, &cpuid), SCAP_SUCCESS) << "event " << num << ": " << scap_getlasterr(h);
+	ASSERT_EQ(evt->len, expected.m_buf.size()) << "event " << num;
+	ASSERT_EQ(memcmp(evt, expected.m_buf.data(), evt->len), 0) << "event " << num;
+	ASSERT_EQ(cpuid, expected.m_cpuid) << "event " << num;
+	ASSERT_EQ(scap_event_get_dump_flags(h), expected.m_flags) << "event " << num;
+}
+
+TEST(scap_savefile, event_block_roundtrip)
+{
+	std::string fname = testing::TempDir() + "scap_savefile_evb.scap";
+	const compression_mode modes[] = {SCAP_COMPRESSION_NONE, SCAP_COMPRESSION_GZIP};
+	const uint32_t block_sizes[] = {200, 4096, 1024 * 1024};
+
+	for(compression_mode compress : modes)
+	{
+		for(uint32_t block_size : block_sizes)
+		{
+			// Some events don't fit in the smaller blocks
+			std::vector<written_event> events = make_events(5000, 1000);
+			write_events(fname, compress, block_size, events);
+
+			scap_t* h = open_offline(fname);
+			ASSERT_NE(h, nullptr);
+
+			for(uint32_t j = 0; j < events.size(); j++)
+			{
+				expect_event(h, events[j], j);
+			}
+
+			scap_evt* evt;
+			uint16_t cpuid;
+			EXPECT_EQ(scap_next(h, &evt, &cpuid), SCAP_EOF) << "block size " << block_size;
+
+			scap_close(h);
+		}
+	}
+
+	remove(fname.c_str());
+}
+
+TEST(scap_savefile, event_block_seek)
+{
+	std::string fname = testing::TempDir() + "scap_savefile_evb_seek.scap";
+	std::vector<written_event> events = make_events(5000, 1000);
+	std::map<uint64_t, uint32_t> block_starts;
+
+	write_events(fname, SCAP_COMPRESSION_NONE, 4096, events);
+
+	scap_t* h = open_offline(fname);
+	ASSERT_NE(h, nullptr);
+
+	//
+	// The position only moves when a block is read, the events returned
+	// from the block buffer don't change it
+	//
+	for(uint32_t j = 0; j < events.size(); j++)
+	{
+		uint64_t pos = scap_ftell(h);
+		expect_event(h, events[j], j);
+		if(scap_ftell(h) != pos)
+		{
+			block_starts[pos] = j;
+		}
+	}
+	ASSERT_GT(block_starts.size(), 10u);
+
+	//
+	// Seek back while in the middle of a block: the rest of that block must
+	// not be returned
+	//
+	uint32_t nseeks = 0;
+	for(auto it = block_starts.begin(); it != block_starts.end(); ++it)
+	{
+		auto next = std::next(it);
+		if(next == block_starts.end() || next->second - it->second < 3)
+		{
+			continue;
+		}
+
+		uint32_t first = it->second;
+		scap_fseek(h, it->first);
+		expect_event(h, events[first], first);
+		expect_event(h, events[first + 1], first + 1);
+
+		// Somewhere else, from the middle of this block
+		auto target = block_starts.begin();
+		std::advance(target, nseeks % block_starts.size());
+		scap_fseek(h, target->first);
+		expect_event(h, events[target->second], target->second);
+
+		nseeks++;
+	}
+	EXPECT_GT(nseeks, 0u);
+
+	scap_close(h);
+	remove(fname.c_str());
+}
+
+//
+// Uncompressed files are seekable, the index is read from the end of the
+// file. Compressed files are scanned up to the index.
+//
+static const compression_mode index_modes[] = {SCAP_COMPRESSION_NONE, SCAP_COMPRESSION_GZIP};
+
+TEST(scap_savefile, find_index_entry)
+{
+	std::string fname = testing::TempDir() + "scap_savefile_index.scap";
+	std::vector<written_event> events = make_events(5000, 1000);
+	const uint64_t targets[] = {0, event_ts(0), event_ts(1) - 5, event_ts(777), event_ts(2500) + 3, event_ts(4999), event_ts(6000)};
+
+	for(compression_mode compress : index_modes)
+	{
+		write_events(fname, compress, 4096, events, 16 * 1024);
+
+		scap_t* h = open_offline(fname);
+		ASSERT_NE(h, nullptr);
+
+		// Read a few events first, the position must be restored
+		for(uint32_t j = 0; j < 10; j++)
+		{
+			expect_event(h, events[j], j);
+		}
+
+		const scap_index_entry* entry;
+		ASSERT_EQ(scap_find_index_entry(h, 0, &entry), SCAP_SUCCESS) << scap_getlasterr(h);
+		expect_event(h, events[10], 10);
+
+		for(uint64_t ts : targets)
+		{
+			ASSERT_EQ(scap_find_index_entry(h, ts, &entry), SCAP_SUCCESS) << scap_getlasterr(h);
+			EXPECT_TRUE(entry->ts <= ts || entry->ts == event_ts(0)) << "compression " << compress << " ts " << ts;
+
+			//
+			// The entry points to the block starting with the event of
+			// its timestamp, and the following ones lead to ts
+			//
+			scap_fseek(h, entry->offset);
+			uint32_t first = (uint32_t)((entry->ts - event_ts(0)) / 10);
+			expect_event(h, events[first], first);
+
+			for(uint32_t j = first + 1; j < events.size() && event_ts(j) <= ts; j++)
+			{
+				expect_event(h, events[j], j);
+			}
+		}
+
+		scap_close(h);
+	}
+
+	// The entries are spread over the whole file
+	scap_t* h = open_offline(fname);
+	ASSERT_NE(h, nullptr);
+	const scap_index_entry* first_entry;
+	const scap_index_entry* last_entry;
+	ASSERT_EQ(scap_find_index_entry(h, 0, &first_entry), SCAP_SUCCESS);
+	ASSERT_EQ(scap_find_index_entry(h, event_ts(5000), &last_entry), SCAP_SUCCESS);
+	EXPECT_EQ(first_entry->ts, event_ts(0));
+	EXPECT_GT(last_entry - first_entry, 5);
+	scap_close(h);
+
+	remove(fname.c_str());
+}
+
+TEST(scap_savefile, find_index_entry_without_index)
+{
+	std::string fname = testing::TempDir() + "scap_savefile_noindex.scap";
+	std::vector<written_event> events = make_events(100, 1000);
+
+	for(compression_mode compress : index_modes)
+	{
+		write_events(fname, compress, 4096, events);
+
+		scap_t* h = open_offline(fname);
+		ASSERT_NE(h, nullptr);
+
+		const scap_index_entry* entry;
+		EXPECT_EQ(scap_find_index_entry(h, 0, &entry), SCAP_NOTFOUND);
+		expect_event(h, events[0], 0);
+
+		scap_close(h);
+	}
+
+	remove(fname.c_str());
+}
+
+TEST(scap_savefile, seek_ts)
+{
+	std::string fname = testing::TempDir() + "scap_savefile_seek_ts.scap";
+	std::vector<written_event> events = make_events(5000, 1000);
+	// Exact timestamps, and timestamps between two events
+	const uint64_t targets[] = {event_ts(4000), event_ts(3) + 1, event_ts(0), event_ts(1234) + 9, 0, event_ts(4999)};
+
+	// The state only events are not returned by sinsp
+	for(auto& e : events)
+	{
+		e.m_flags = SCAP_DF_NONE;
+	}
+
+	for(compression_mode compress : index_modes)
+	{
+		write_events(fname, compress, 4096, events, 16 * 1024);
+
+		sinsp inspector;
+		inspector.open(fname);
+
+		for(uint64_t ts : targets)
+		{
+			sinsp_evt* evt;
+			int32_t res;
+
+			inspector.seek_ts(ts);
+			while((res = inspector.next(&evt)) == SCAP_TIMEOUT)
+			{
+			}
+			ASSERT_EQ(res, SCAP_SUCCESS) << inspector.getlasterr();
+
+			uint64_t expected = ts <= event_ts(0) ? event_ts(0) : event_ts((uint32_t)((ts - event_ts(0) + 9) / 10));
+			EXPECT_EQ(evt->get_ts(), expected) << "compression " << compress << " ts " << ts;
+
+			// The following events come in order
+			if(expected != event_ts(4999))
+			{
+				ASSERT_EQ(inspector.next(&evt), SCAP_SUCCESS);
+				EXPECT_EQ(evt->get_ts(), expected + 10);
+			}
+		}
+
+		inspector.close();
+	}
+
+	remove(fname.c_str());
+}
+
+//
+// The events between the checkpoint and the target are parsed: the files
+// they open are in the fd table
+//
+TEST(scap_savefile, seek_ts_parses_state)
+{
+	std::string fname = testing::TempDir() + "scap_savefile_seek_ts_state.scap";
+	std::vector<written_event> events;
+
+	//
+	// The exit event of open() is only parsed after its enter event: event
+	// 2 * j + 1 opens fd j
+	//
+	for(uint32_t j = 0; j < 5000; j++)
+	{
+		uint64_t tid = 1 + j % 10;
+		uint16_t cpuid = (uint16_t)(j % 4);
+
+		events.push_back({make_event(PPME_SYSCALL_OPEN_E, event_ts(2 * j), tid, {}), cpuid, SCAP_DF_NONE});
+		events.push_back({make_open_x(event_ts(2 * j + 1), tid, j, "/tmp/file" + std::to_string(j)), cpuid, SCAP_DF_NONE});
+	}
+
+	write_events(fname, SCAP_COMPRESSION_NONE, 4096, events, 16 * 1024, 2000);
+
+	sinsp inspector;
+	inspector.open(fname);
+	inspector.seek_ts(event_ts(7000));
+
+	sinsp_evt* evt;
+	int32_t res;
+	while((res = inspector.next(&evt)) == SCAP_TIMEOUT)
+	{
+	}
+	ASSERT_EQ(res, SCAP_SUCCESS) << inspector.getlasterr();
+	EXPECT_EQ(evt->get_ts(), event_ts(7000));
+
+	// Right after the checkpoint, and right before the target
+	for(uint32_t j : {3000, 3001, 3499})
+	{
+		sinsp_threadinfo* tinfo = inspector.get_thread_ref(1 + j % 10, false).get();
+		ASSERT_NE(tinfo, nullptr) << "fd " << j;
+		sinsp_fdinfo_t* fdinfo = tinfo->get_fd(j);
+		ASSERT_NE(fdinfo, nullptr) << "fd " << j;
+		EXPECT_EQ(fdinfo->m_name, "/tmp/file" + std::to_string(j));
+	}
+
+	inspector.close();
+	remove(fname.c_str());
+}
+
+static scap_t* open_offline_at(const std::string& fname, uint64_t pos)
+{
+	char error[SCAP_LASTERR_SIZE];
+	int32_t rc;
+	scap_open_args oargs;
+
+	memset(&oargs, 0, sizeof(oargs));
+	oargs.mode = SCAP_MODE_CAPTURE;
+	oargs.fname = fname.c_str();
+	oargs.start_offset = pos;
+
+	scap_t* h = scap_open(oargs, error, &rc);
+	EXPECT_NE(h, nullptr) << error;
+	return h;
+}
+
+TEST(scap_savefile, checkpoint_sections)
+{
+	std::string fname = testing::TempDir() + "scap_savefile_checkpoint.scap";
+	std::vector<written_event> events = make_events(5000, 1000);
+
+	write_events(fname, SCAP_COMPRESSION_NONE, 4096, events, 16 * 1024, 1000);
+
+	scap_t* h = open_offline(fname);
+	ASSERT_NE(h, nullptr);
+
+	std::vector<uint64_t> sections;
+	uint64_t pos;
+	int32_t res;
+	while((res = scap_next_section(h, &pos)) == SCAP_SUCCESS)
+	{
+		EXPECT_TRUE(sections.empty() || pos > sections.back());
+		sections.push_back(pos);
+	}
+	ASSERT_EQ(res, SCAP_EOF) << scap_getlasterr(h);
+	ASSERT_EQ(sections.size(), 4u);
+	scap_close(h);
+
+	//
+	// Every section can be read without the previous part of the file,
+	// and its events end at the next section
+	//
+	sections.insert(sections.begin(), 0);
+	for(uint32_t k = 0; k < sections.size(); k++)
+	{
+		h = open_offline_at(fname, sections[k]);
+		ASSERT_NE(h, nullptr);
+
+		for(uint32_t j = k * 1000; j < (k + 1) * 1000; j++)
+		{
+			expect_event(h, events[j], j);
+		}
+
+		scap_evt* evt;
+		uint16_t cpuid;
+		res = scap_next(h, &evt, &cpuid);
+		if(k + 1 < sections.size())
+		{
+			ASSERT_EQ(res, SCAP_UNEXPECTED_BLOCK) << "section " << k;
+			EXPECT_EQ(scap_ftell(h) - scap_get_unexpected_block_readsize(h), sections[k + 1]);
+		}
+		else
+		{
+			EXPECT_EQ(res, SCAP_EOF);
+		}
+
+		scap_close(h);
+	}
+
+	// The index entries point to the section before them
+	h = open_offline(fname);
+	ASSERT_NE(h, nullptr);
+	const scap_index_entry* entry;
+	ASSERT_EQ(scap_find_index_entry(h, event_ts(3500), &entry), SCAP_SUCCESS) << scap_getlasterr(h);
+	EXPECT_EQ(entry->checkpoint, sections[3]);
+	scap_close(h);
+
+	remove(fname.c_str());
+}
+
+TEST(scap_savefile, checkpoint_compressed)
+{
+	std::string fname = testing::TempDir() + "scap_savefile_checkpoint.scap.gz";
+	std::vector<written_event> events = make_events(10, 0);
+
+	scap_t* h = open_nodriver();
+	ASSERT_NE(h, nullptr);
+	scap_dumper_t* d = scap_dump_open(h, fname.c_str(), SCAP_COMPRESSION_GZIP, true);
+	ASSERT_NE(d, nullptr) << scap_getlasterr(h);
+	ASSERT_EQ(scap_dump(h, d, (scap_evt*)events[0].m_buf.data(), events[0].m_cpuid, events[0].m_flags), SCAP_SUCCESS);
+	int32_t res = scap_dump_checkpoint(h, d, true);
+	scap_dump_close(d);
+	scap_close(h);
+
+	//
+	// Without zlib the file is written uncompressed
+	//
+	h = open_offline(fname);
+	ASSERT_NE(h, nullptr);
+	bool compressed = scap_is_compressed_capture(h);
+	scap_close(h);
+
+	if(!compressed)
+	{
+		EXPECT_EQ(res, SCAP_SUCCESS);
+		remove(fname.c_str());
+		return;
+	}
+
+	EXPECT_EQ(res, SCAP_NOT_SUPPORTED);
+
+	sinsp_parallel_replay parallel(fname, 4);
+	EXPECT_THROW(parallel.open(), sinsp_exception);
+
+	sinsp inspector;
+	inspector.open_nodriver();
+	sinsp_dumper dumper(&inspector);
+	dumper.set_checkpoint_interval(1024);
+	EXPECT_THROW(dumper.open(fname, true), sinsp_exception);
+
+	remove(fname.c_str());
+}
+
+//
+// Timestamps of the events returned by a sequential replay
+//
+static std::vector<uint64_t> replay(const std::string& fname, const std::string& filter, const std::string& dump_fname)
+{
+	sinsp inspector;
+	std::vector<uint64_t> res;
+	sinsp_evt* evt;
+	int32_t rc;
+
+	inspector.open(fname);
+	if(!filter.empty())
+	{
+		inspector.set_filter(filter);
+	}
+	if(!dump_fname.empty())
+	{
+		inspector.autodump_start(dump_fname, false);
+	}
+
+	while((rc = inspector.next(&evt)) != SCAP_EOF)
+	{
+		if(rc == SCAP_TIMEOUT)
+		{
+			continue;
+		}
+		EXPECT_EQ(rc, SCAP_SUCCESS) << inspector.getlasterr();
+		if(rc != SCAP_SUCCESS)
+		{
+			break;
+		}
+		res.push_back(evt->get_ts());
+	}
+
+	inspector.close();
+	return res;
+}
+
+TEST(scap_savefile, parallel_replay)
+{
+	std::string fname = testing::TempDir() + "scap_savefile_parallel.scap";
+	std::string dump_fname = testing::TempDir() + "scap_savefile_parallel_dump.scap";
+	std::string filter = "evt.rawres >= 100 and evt.rawres < 4900";
+	std::vector<written_event> events = make_events(5000, 1000);
+
+	// The state only events are not returned by sinsp
+	for(auto& e : events)
+	{
+		e.m_flags = SCAP_DF_NONE;
+	}
+
+	write_events(fname, SCAP_COMPRESSION_NONE, 4096, events, 0, 500);
+
+	//
+	// The sequential replay keeps the filter and the autodump file
+	// when it reloads the tables at every section
+	//
+	std::vector<uint64_t> sequential = replay(fname, filter, dump_fname);
+	ASSERT_EQ(sequential.size(), 4800u);
+	for(uint32_t j = 0; j < sequential.size(); j++)
+	{
+		ASSERT_EQ(sequential[j], event_ts(j + 100)) << "event " << j;
+	}
+	EXPECT_EQ(replay(dump_fname, "", ""), sequential);
+
+	sinsp_parallel_replay parallel(fname, 4);
+	parallel.set_filter(filter);
+	parallel.open();
+	ASSERT_EQ(parallel.get_num_chunks(), 10u);
+
+	// Every chunk is replayed by a single worker, the end handler is called
+	// after its last event
+	std::vector<std::vector<uint64_t>> chunks(parallel.get_num_chunks());
+	std::vector<int64_t> ended(parallel.get_num_chunks(), -1);
+	parallel.set_end_handler([&](uint32_t chunk, sinsp* inspector)
+	{
+		ended[chunk] = (int64_t)chunks[chunk].size();
+	});
+	parallel.run([&](uint32_t chunk, sinsp_evt* evt)
+	{
+		chunks[chunk].push_back(evt->get_ts());
+	});
+
+	std::vector<uint64_t> merged;
+	for(uint32_t j = 0; j < chunks.size(); j++)
+	{
+		EXPECT_FALSE(chunks[j].empty());
+		EXPECT_EQ(ended[j], (int64_t)chunks[j].size()) << "chunk " << j;
+		merged.insert(merged.end(), chunks[j].begin(), chunks[j].end());
+	}
+
+	EXPECT_EQ(merged, sequential);
+	EXPECT_EQ(parallel.get_num_matched_events(), sequential.size());
+	EXPECT_GE(parallel.get_num_events(), events.size());
+
+	remove(fname.c_str());
+	remove(dump_fname.c_str());
+}
@@ -0,0 +1,189 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+// Gives access to the readers, so that the test can route the events itself
+#define VISIBILITY_PRIVATE public:
+
+#include "sinsp.h"
+#include "sharded_inspector.h"
+#include "test_events.h"
+#include <gtest.h>
+
+#include <chrono>
+#include <random>
+#include <thread>
+
+using namespace test_events;
+
+//
+// Every reader routes events with interleaved timestamps, in batches of
+// random size, while the shards consume them: every shard must see its events
+// in timestamp order.
+//
+TEST(sharded_inspector, ordered_interleaved_readers)
+{
+	const uint32_t nshards = 2;
+	const uint32_t nreaders = 3;
+	const uint32_t nevents = 20000;
+
+	sinsp_sharded_inspector inspector(nshards, nreaders, 1024 * 1024);
+	inspector.set_ordered(true);
+
+	for(uint32_t j = 0; j < nreaders; j++)
+	{
+		inspector.add_reader(NULL);
+	}
+	inspector.open_shards();
+	inspector.m_running = true;
+
+	//
+	// Event k of reader r has timestamp 1000 + nreaders * k + r
+	//
+	std::vector<std::vector<std::vector<uint8_t>>> events(nreaders);
+	uint32_t expected[nshards] = {};
+	for(uint32_t r = 0; r < nreaders; r++)
+	{
+		for(uint32_t k = 0; k < nevents; k++)
+		{
+			uint64_t tid = 1 + (k + r) % 4;
+			events[r].push_back(make_open_x(1000 + nreaders * k + r, tid, k, "/tmp/f"));
+			expected[tid % nshards]++;
+		}
+	}
+
+	std::vector<std::thread> producers;
+	for(uint32_t r = 0; r < nreaders; r++)
+	{
+		producers.emplace_back([&inspector, &events, r]
+		{
+			std::mt19937 rng(r);
+			scap_evt* evts[64];
+			uint16_t cpuids[64];
+			uint32_t k = 0;
+
+			while(k < events[r].size())
+			{
+				uint32_t nevts = std::min((uint32_t)(1 + rng() % 64), (uint32_t)events[r].size() - k);
+				for(uint32_t j = 0; j < nevts; j++)
+				{
+					evts[j] = (scap_evt*)events[r][k + j].data();
+					cpuids[j] = (uint16_t)r;
+				}
+				ASSERT_TRUE(inspector.route_events(r, evts, cpuids, nevts));
+				k += nevts;
+
+				if(rng() % 8 == 0)
+				{
+					std::this_thread::sleep_for(std::chrono::microseconds(rng() % 200));
+				}
+			}
+
+			//
+			// Nothing else will come from this reader
+			//
+			inspector.m_readers[r]->m_low_watermark.store(UINT64_MAX, std::memory_order_release);
+		});
+	}
+
+	std::vector<std::thread> consumers;
+	uint32_t received[nshards] = {};
+	uint32_t unordered[nshards] = {};
+	for(uint32_t s = 0; s < nshards; s++)
+	{
+		consumers.emplace_back([&inspector, &expected, &received, &unordered, s]
+		{
+			sinsp* shard = inspector.get_shard(s);
+			auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(60);
+			uint64_t last_ts = 0;
+			sinsp_evt* evt;
+
+			while(received[s] < expected[s] && std::chrono::steady_clock::now() < deadline)
+			{
+				int32_t res = shard->next(&evt);
+				if(res == SCAP_TIMEOUT)
+				{
+					continue;
+				}
+				ASSERT_EQ(res, SCAP_SUCCESS);
+
+				if(evt->get_ts() < last_ts)
+				{
+					unordered[s]++;
+				}
+				last_ts = evt->get_ts();
+				received[s]++;
+			}
+		});
+	}
+
+	for(auto& t : producers)
+	{
+		t.join();
+	}
+	for(auto& t : consumers)
+	{
+		t.join();
+	}
+
+	for(uint32_t s = 0; s < nshards; s++)
+	{
+		EXPECT_EQ(received[s], expected[s]) << "shard " << s;
+		EXPECT_EQ(unordered[s], 0u) << "shard " << s;
+	}
+	EXPECT_EQ(inspector.get_num_routed_events(), nreaders * nevents);
+	EXPECT_EQ(inspector.get_num_dropped_events(), 0u);
+	EXPECT_EQ(inspector.get_num_out_of_order_events(), 0u);
+}
+
+//
+// An event routed after the other readers went past its timestamp is still
+// delivered, and counted
+//
+TEST(sharded_inspector, ordered_late_event)
+{
+	sinsp_sharded_inspector inspector(1, 2, 1024 * 1024);
+	inspector.set_ordered(true);
+	inspector.add_reader(NULL);
+	inspector.add_reader(NULL);
+	inspector.open_shards();
+	inspector.m_running = true;
+
+	std::vector<uint8_t> early = make_open_x(2000, 1, 3, "/tmp/f");
+	std::vector<uint8_t> late = make_open_x(1000, 1, 4, "/tmp/f");
+	scap_evt* evt = (scap_evt*)early.data();
+	uint16_t cpuid = 0;
+	uint16_t pcpuid;
+
+	//
+	// Reader 1 went idle past the timestamp of its late event
+	//
+	inspector.m_readers[1]->m_low_watermark = 3000;
+	ASSERT_TRUE(inspector.route_events(0, &evt, &cpuid, 1));
+	inspector.m_readers[0]->m_low_watermark = UINT64_MAX;
+
+	scap_evt* pevent;
+	ASSERT_EQ(inspector.next_shard_event(0, &pevent, &pcpuid), SCAP_SUCCESS);
+	EXPECT_EQ(pevent->ts, 2000u);
+
+	evt = (scap_evt*)late.data();
+	ASSERT_TRUE(inspector.route_events(1, &evt, &cpuid, 1));
+	ASSERT_EQ(inspector.next_shard_event(0, &pevent, &pcpuid), SCAP_SUCCESS);
+	EXPECT_EQ(pevent->ts, 1000u);
+	EXPECT_EQ(inspector.get_num_out_of_order_events(), 1u);
+
+	EXPECT_EQ(inspector.next_shard_event(0, &pevent, &pcpuid), SCAP_TIMEOUT);
+}
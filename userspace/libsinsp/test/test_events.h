@@ -0,0 +1,92 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+//
+// Helpers building raw events for the unit tests
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "scap.h"
+
+namespace test_events {
+
+template<typename T>
+inline std::string param(T val)
+{
+	return std::string((const char*)&val, sizeof(val));
+}
+
+// A string parameter, with its terminator
+inline std::string param_str(const std::string& str)
+{
+	return std::string(str.c_str(), str.size() + 1);
+}
+
+//
+// An event of the given type, with the parameters encoded by param() and
+// param_str()
+//
+inline std::vector<uint8_t> make_event(uint16_t type, uint64_t ts, uint64_t tid, const std::vector<std::string>& params)
+{
+	uint32_t len = sizeof(scap_evt) + params.size() * sizeof(uint16_t);
+
+	for(const auto& p : params)
+	{
+		len += p.size();
+	}
+
+	std::vector<uint8_t> buf(len);
+	scap_evt* evt = (scap_evt*)buf.data();
+	evt->ts = ts;
+	evt->tid = tid;
+	evt->len = len;
+	evt->type = type;
+	evt->nparams = (uint32_t)params.size();
+
+	uint16_t* lens = (uint16_t*)(buf.data() + sizeof(scap_evt));
+	uint8_t* valptr = (uint8_t*)(lens + params.size());
+	for(const auto& p : params)
+	{
+		*lens++ = (uint16_t)p.size();
+		memcpy(valptr, p.data(), p.size());
+		valptr += p.size();
+	}
+
+	return buf;
+}
+
+//
+// open() exit event
+//
+inline std::vector<uint8_t> make_open_x(uint64_t ts, uint64_t tid, int64_t fd, const std::string& name, uint32_t flags = 0, uint32_t mode = 0)
+{
+	return make_event(PPME_SYSCALL_OPEN_X, ts, tid, {
+		param<int64_t>(fd),
+		param_str(name),
+		param<uint32_t>(flags),
+		param<uint32_t>(mode),
+		param<uint32_t>(0)});
+}
+
+}
@@ -0,0 +1,220 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+// Gives access to the inspector clock and remove_inactive_threads()
+#define VISIBILITY_PRIVATE public:
+
+#include "sinsp.h"
+#include <gtest.h>
+
+static const uint64_t T0 = 1000 * ONE_SECOND_IN_NS;
+
+static sinsp_threadinfo* add_thread(sinsp& inspector, int64_t tid, int64_t pid, uint32_t flags)
+{
+	sinsp_threadinfo* tinfo = new sinsp_threadinfo(&inspector);
+	tinfo->m_tid = tid;
+	tinfo->m_pid = pid;
+	tinfo->m_flags = flags;
+	tinfo->m_lastaccess_ts = inspector.m_lastevent_ts;
+	EXPECT_TRUE(inspector.m_thread_manager->add_thread(tinfo, false));
+	return tinfo;
+}
+
+//
+// Call remove_inactive_threads() until there's nothing left to do at the
+// current time, return the number of calls that did some work
+//
+static uint32_t run_expiry(sinsp& inspector)
+{
+	uint32_t ncalls = 0;
+
+	while(inspector.remove_inactive_threads())
+	{
+		ncalls++;
+		if(ncalls > 100000)
+		{
+			ADD_FAILURE() << "remove_inactive_threads() never settles";
+			break;
+		}
+	}
+	return ncalls;
+}
+
+TEST(thread_manager, expiry_wheel)
+{
+	sinsp inspector;
+	sinsp_thread_manager* manager = inspector.m_thread_manager;
+	threadinfo_map_t* threads = manager->get_threads();
+
+	inspector.set_thread_timeout_s(10);
+	inspector.set_thread_purge_interval_s(20);
+	inspector.m_lastevent_ts = T0;
+
+	sinsp_threadinfo* active = add_thread(inspector, 1, 1, 0);
+	add_thread(inspector, 2, 2, PPM_CL_CLOSED);
+
+	// The first call starts the wheel, the threads are checked 20s later
+	EXPECT_FALSE(inspector.remove_inactive_threads());
+	inspector.m_lastevent_ts = T0 + 19 * ONE_SECOND_IN_NS;
+	EXPECT_EQ(run_expiry(inspector), 0u);
+	EXPECT_NE(threads->get(2), nullptr);
+
+	inspector.m_lastevent_ts = T0 + 21 * ONE_SECOND_IN_NS;
+	active->m_lastaccess_ts = inspector.m_lastevent_ts;
+	EXPECT_GT(run_expiry(inspector), 0u);
+	EXPECT_EQ(threads->get(2), nullptr);
+	EXPECT_EQ(threads->get(1), active);
+
+	// Accessed again before its deadline, rescheduled again
+	inspector.m_lastevent_ts = T0 + 40 * ONE_SECOND_IN_NS;
+	active->m_lastaccess_ts = T0 + 35 * ONE_SECOND_IN_NS;
+	run_expiry(inspector);
+	EXPECT_EQ(threads->get(1), active);
+
+	active->m_flags |= PPM_CL_CLOSED;
+	inspector.m_lastevent_ts = T0 + 60 * ONE_SECOND_IN_NS;
+	run_expiry(inspector);
+	EXPECT_EQ(threads->get(1), nullptr);
+	EXPECT_EQ(threads->size(), 0u);
+}
+
+TEST(thread_manager, expiry_budget)
+{
+	sinsp inspector;
+	sinsp_thread_manager* manager = inspector.m_thread_manager;
+	threadinfo_map_t* threads = manager->get_threads();
+	const uint32_t budget = sinsp_thread_manager::EXPIRY_BUDGET;
+
+	inspector.set_thread_timeout_s(10);
+	inspector.set_thread_purge_interval_s(20);
+	inspector.m_lastevent_ts = T0;
+
+	for(uint32_t j = 0; j < 3 * budget; j++)
+	{
+		add_thread(inspector, 100 + j, 100 + j, PPM_CL_CLOSED);
+	}
+	EXPECT_FALSE(inspector.remove_inactive_threads());
+
+	//
+	// All the threads are due in the same slot, every call removes at most
+	// EXPIRY_BUDGET of them
+	//
+	inspector.m_lastevent_ts = T0 + 21 * ONE_SECOND_IN_NS;
+	EXPECT_TRUE(inspector.remove_inactive_threads());
+	EXPECT_EQ(threads->size(), 2 * budget);
+	EXPECT_TRUE(inspector.remove_inactive_threads());
+	EXPECT_EQ(threads->size(), budget);
+
+	run_expiry(inspector);
+	EXPECT_EQ(threads->size(), 0u);
+}
+
+TEST(thread_manager, incremental_child_rebuild)
+{
+	sinsp inspector;
+	sinsp_thread_manager* manager = inspector.m_thread_manager;
+	threadinfo_map_t* threads = manager->get_threads();
+	const int64_t mains[] = {1000, 2000, 3000};
+	const int64_t nchilds = 400;
+	int64_t next_removed[] = {1001, 2001, 3001};
+	int64_t next_added = 10000;
+
+	inspector.m_lastevent_ts = T0;
+
+	for(int64_t main_tid : mains)
+	{
+		add_thread(inspector, main_tid, main_tid, 0);
+		for(int64_t j = 1; j <= nchilds; j++)
+		{
+			add_thread(inspector, main_tid + j, main_tid, PPM_CL_CLONE_THREAD);
+		}
+		EXPECT_EQ(threads->get(main_tid)->m_nchilds, (uint64_t)nchilds);
+	}
+
+	// Counts gone off, e.g. because of a dropped exit event
+	threads->get(1000)->m_nchilds = 5000;
+	threads->get(2000)->m_nchilds += 50;
+
+	//
+	// Keep removing and adding threads while the rebuild is in progress
+	//
+	manager->start_child_dependencies_rebuild();
+	uint32_t npasses = 0;
+	while(manager->is_child_dependencies_rebuild_pending())
+	{
+		ASSERT_TRUE(inspector.remove_inactive_threads());
+		npasses++;
+
+		uint32_t m = npasses % 3;
+		manager->remove_thread(next_removed[m]++, false);
+		add_thread(inspector, next_added++, mains[(npasses + 1) % 3], PPM_CL_CLONE_THREAD);
+	}
+	EXPECT_GT(npasses, 2 * (3 * nchilds) / sinsp_thread_manager::CHILD_REBUILD_BUDGET);
+
+	for(int64_t main_tid : mains)
+	{
+		uint64_t actual = 0;
+
+		threads->loop([&] (sinsp_threadinfo& tinfo) {
+			if((tinfo.m_flags & PPM_CL_CLONE_THREAD) && tinfo.m_pid == main_tid)
+			{
+				actual++;
+			}
+			return true;
+		});
+		EXPECT_EQ(threads->get(main_tid)->m_nchilds, actual) << "main thread " << main_tid;
+	}
+}
+
+//
+// An exited main thread whose removal is refused because of its child
+// threads goes at the next table scan, which also fixes the child counts
+//
+TEST(thread_manager, closed_thread_next_scan)
+{
+	sinsp inspector;
+	sinsp_thread_manager* manager = inspector.m_thread_manager;
+	threadinfo_map_t* threads = manager->get_threads();
+
+	inspector.set_thread_timeout_s(1000);
+	inspector.set_thread_purge_interval_s(20);
+	inspector.m_lastevent_ts = T0;
+
+	sinsp_threadinfo* main_thread = add_thread(inspector, 1, 1, 0);
+	add_thread(inspector, 2, 1, PPM_CL_CLONE_THREAD);
+	add_thread(inspector, 3, 3, 0);
+	EXPECT_FALSE(inspector.remove_inactive_threads());
+
+	// Counts gone off, e.g. because of a dropped exit event
+	threads->get(3)->m_nchilds = 7;
+
+	inspector.m_lastevent_ts = T0 + 5 * ONE_SECOND_IN_NS;
+	main_thread->m_flags |= PPM_CL_CLOSED;
+	manager->remove_thread(1, false);
+	EXPECT_EQ(threads->get(1), main_thread);
+
+	inspector.m_lastevent_ts = T0 + 19 * ONE_SECOND_IN_NS;
+	run_expiry(inspector);
+	EXPECT_EQ(threads->get(1), main_thread);
+	EXPECT_EQ(threads->get(3)->m_nchilds, 7u);
+
+	inspector.m_lastevent_ts = T0 + 21 * ONE_SECOND_IN_NS;
+	run_expiry(inspector);
+	EXPECT_EQ(threads->get(1), nullptr);
+	EXPECT_NE(threads->get(2), nullptr);
+	EXPECT_EQ(threads->get(3)->m_nchilds, 0u);
+}
@@ -0,0 +1,106 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include "sinsp.h"
+#include <gtest.h>
+
+#include <random>
+#include <unordered_map>
+
+static sinsp_threadinfo* make_thread(int64_t tid)
+{
+	sinsp_threadinfo* tinfo = new sinsp_threadinfo(nullptr);
+	tinfo->m_tid = tid;
+	return tinfo;
+}
+
+TEST(threadinfo_map, put_get_erase)
+{
+	threadinfo_map_t threads;
+
+	EXPECT_EQ(threads.get(1), nullptr);
+
+	sinsp_threadinfo* t1 = make_thread(1);
+	threads.put(t1);
+	threads.put(make_thread(2));
+
+	EXPECT_EQ(threads.size(), 2u);
+	EXPECT_EQ(threads.get(1), t1);
+	EXPECT_EQ(threads.get_ref(2)->m_tid, 2);
+	EXPECT_EQ(threads.get(3), nullptr);
+
+	//
+	// A reference keeps the thread alive after it's erased
+	//
+	threadinfo_map_t::ptr_t ref = threads.get_ref(1);
+	threads.erase(1);
+	threads.erase(1);
+	EXPECT_EQ(threads.get(1), nullptr);
+	EXPECT_EQ(ref.get(), t1);
+	EXPECT_EQ(threads.size(), 1u);
+
+	//
+	// put() replaces the thread with the same tid
+	//
+	sinsp_threadinfo* t2 = make_thread(2);
+	threads.put(t2);
+	EXPECT_EQ(threads.size(), 1u);
+	EXPECT_EQ(threads.get(2), t2);
+
+	threads.clear();
+	EXPECT_EQ(threads.size(), 0u);
+	EXPECT_EQ(threads.get(2), nullptr);
+}
+
+TEST(threadinfo_map, random_operations)
+{
+	threadinfo_map_t threads;
+	std::unordered_map<int64_t, sinsp_threadinfo*> expected;
+	std::mt19937_64 rng(1);
+
+	for(uint32_t j = 0; j < 200000; j++)
+	{
+		int64_t tid = rng() % 10000;
+
+		if(rng() % 3 != 0)
+		{
+			sinsp_threadinfo* tinfo = make_thread(tid);
+			threads.put(tinfo);
+			expected[tid] = tinfo;
+		}
+		else
+		{
+			threads.erase(tid);
+			expected.erase(tid);
+		}
+	}
+
+	ASSERT_EQ(threads.size(), expected.size());
+
+	for(const auto& it : expected)
+	{
+		EXPECT_EQ(threads.get(it.first), it.second);
+	}
+
+	size_t nthreads = 0;
+	threads.loop([&](sinsp_threadinfo& tinfo) {
+		EXPECT_EQ(expected[tinfo.m_tid], &tinfo);
+		nthreads++;
+		return true;
+	});
+	EXPECT_EQ(nthreads, expected.size());
+}
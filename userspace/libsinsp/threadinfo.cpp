@@ -64,6 +64,7 @@ void sinsp_threadinfo::init()
 	m_prevevent_ts = 0;
 	m_lastaccess_ts = 0;
 	m_clone_ts = 0;
+	m_expiry_slot = 0;
 	m_lastevent_category.m_category = EC_UNKNOWN;
 	m_flags = PPM_CL_NAME_CHANGED;
 	m_nchilds = 0;
@@ -114,36 +115,34 @@ sinsp_threadinfo::~sinsp_threadinfo()
 
 void sinsp_threadinfo::fix_sockets_coming_from_proc()
 {
-	unordered_map<int64_t, sinsp_fdinfo_t>::iterator it;
-
-	for(it = m_fdtable.m_table.begin(); it != m_fdtable.m_table.end(); it++)
-	{
-		if(it->second.m_type == SCAP_FD_IPV4_SOCK)
+	m_fdtable.loop([&] (int64_t fd, sinsp_fdinfo_t& fdi) {
+		if(fdi.m_type == SCAP_FD_IPV4_SOCK)
 		{
-			if(m_inspector->m_thread_manager->m_server_ports.find(it->second.m_sockinfo.m_ipv4info.m_fields.m_sport) !=
+			if(m_inspector->m_thread_manager->m_server_ports.find(fdi.m_sockinfo.m_ipv4info.m_fields.m_sport) !=
 				m_inspector->m_thread_manager->m_server_ports.end())
 			{
 				uint32_t tip;
 				uint16_t tport;
 
-				tip = it->second.m_sockinfo.m_ipv4info.m_fields.m_sip;
-				tport = it->second.m_sockinfo.m_ipv4info.m_fields.m_sport;
+				tip = fdi.m_sockinfo.m_ipv4info.m_fields.m_sip;
+				tport = fdi.m_sockinfo.m_ipv4info.m_fields.m_sport;
 
-				it->second.m_sockinfo.m_ipv4info.m_fields.m_sip = it->second.m_sockinfo.m_ipv4info.m_fields.m_dip;
-				it->second.m_sockinfo.m_ipv4info.m_fields.m_dip = tip;
-				it->second.m_sockinfo.m_ipv4info.m_fields.m_sport = it->second.m_sockinfo.m_ipv4info.m_fields.m_dport;
-				it->second.m_sockinfo.m_ipv4info.m_fields.m_dport = tport;
+				fdi.m_sockinfo.m_ipv4info.m_fields.m_sip = fdi.m_sockinfo.m_ipv4info.m_fields.m_dip;
+				fdi.m_sockinfo.m_ipv4info.m_fields.m_dip = tip;
+				fdi.m_sockinfo.m_ipv4info.m_fields.m_sport = fdi.m_sockinfo.m_ipv4info.m_fields.m_dport;
+				fdi.m_sockinfo.m_ipv4info.m_fields.m_dport = tport;
 
-				it->second.m_name = ipv4tuple_to_string(&it->second.m_sockinfo.m_ipv4info, m_inspector->m_hostname_and_port_resolution_enabled);
+				fdi.m_name = ipv4tuple_to_string(&fdi.m_sockinfo.m_ipv4info, m_inspector->m_hostname_and_port_resolution_enabled);
 
-				it->second.set_role_server();
+				fdi.set_role_server();
 			}
 			else
 			{
-				it->second.set_role_client();
+				fdi.set_role_client();
 			}
 		}
-	}
+		return true;
+	});
 }
 
 #define STR_AS_NUM_JAVA 0x6176616a
@@ -392,6 +391,20 @@ void sinsp_threadinfo::init(scap_threadinfo* pi)
 	m_comm = pi->comm;
 	m_exe = pi->exe;
 	m_exepath = pi->exepath;
+	if(!is_main_thread() && m_inspector != NULL)
+	{
+		//
+		// Start from the args and cgroups of the main thread, if it's
+		// already in the table: set_args() and set_cgroups() keep
+		// sharing them when they're the same.
+		//
+		auto main_thread = m_inspector->get_thread_ref(m_pid, false, true);
+		if(main_thread)
+		{
+			m_args = main_thread->m_args;
+			m_cgroups = main_thread->m_cgroups;
+		}
+	}
 	set_args(pi->args, pi->args_len);
 	if(is_main_thread())
 	{
@@ -501,14 +514,16 @@ std::string sinsp_threadinfo::get_exepath() const
 
 void sinsp_threadinfo::set_args(const char* args, size_t len)
 {
-	m_args.clear();
+	vector<string> argv;
 
 	size_t offset = 0;
 	while(offset < len)
 	{
-		m_args.push_back(args + offset);
-		offset += m_args.back().length() + 1;
+		argv.push_back(args + offset);
+		offset += argv.back().length() + 1;
 	}
+
+	m_args.assign(std::move(argv));
 }
 
 void sinsp_threadinfo::set_env(const char* env, size_t len)
@@ -526,7 +541,7 @@ void sinsp_threadinfo::set_env(const char* env, size_t len)
 		}
 	}
 
-	m_env.clear();
+	vector<string> envv;
 	size_t offset = 0;
 	while(offset < len)
 	{
@@ -540,14 +555,16 @@ void sinsp_threadinfo::set_env(const char* env, size_t len)
 			if(!memcmp(left, zero, sz))
 			{
 				free(zero);
-				return;
+				break;
 			}
 			free(zero);
 		}
-		m_env.push_back(left);
+		envv.push_back(left);
 
-		offset += m_env.back().length() + 1;
+		offset += envv.back().length() + 1;
 	}
+
+	m_env.assign(std::move(envv));
 }
 
 bool sinsp_threadinfo::set_env_from_proc() {
@@ -560,16 +577,17 @@ bool sinsp_threadinfo::set_env_from_proc() {
 		return false;
 	}
 
-	m_env.clear();
+	vector<string> envv;
 	while (environment) {
 		string env;
 		getline(environment, env, '\0');
 		if (!env.empty())
 		{
-			m_env.emplace_back(env);
+			envv.emplace_back(env);
 		}
 	}
 
+	m_env.assign(std::move(envv));
 	return true;
 }
 
@@ -620,7 +638,7 @@ string sinsp_threadinfo::get_env(const string& name)
 
 void sinsp_threadinfo::set_cgroups(const char* cgroups, size_t len)
 {
-	m_cgroups.clear();
+	vector<pair<string, string>> cg;
 
 	size_t offset = 0;
 	while(offset < len)
@@ -630,7 +648,7 @@ void sinsp_threadinfo::set_cgroups(const char* cgroups, size_t len)
 		if(sep == NULL)
 		{
 			ASSERT(false);
-			return;
+			break;
 		}
 
 		string subsys(str, sep - str);
@@ -659,9 +677,11 @@ void sinsp_threadinfo::set_cgroups(const char* cgroups, size_t len)
 			subsys = "blkio";
 		}
 
-		m_cgroups.push_back(std::make_pair(subsys, cgroup));
+		cg.push_back(std::make_pair(subsys, cgroup));
 		offset += subsys_length + 1 + cgroup.length() + 1;
 	}
+
+	m_cgroups.assign(std::move(cg));
 }
 
 sinsp_threadinfo* sinsp_threadinfo::get_parent_thread()
@@ -688,50 +708,41 @@ void sinsp_threadinfo::remove_fd(int64_t fd)
 
 bool sinsp_threadinfo::is_bound_to_port(uint16_t number)
 {
-	unordered_map<int64_t, sinsp_fdinfo_t>::iterator it;
-
 	sinsp_fdtable* fdt = get_fd_table();
 
-	for(it = fdt->m_table.begin(); it != fdt->m_table.end(); ++it)
-	{
-		if(it->second.m_type == SCAP_FD_IPV4_SOCK)
+	return !fdt->loop([&] (int64_t fd, sinsp_fdinfo_t& fdi) {
+		if(fdi.m_type == SCAP_FD_IPV4_SOCK)
 		{
-			if(it->second.m_sockinfo.m_ipv4info.m_fields.m_dport == number)
+			if(fdi.m_sockinfo.m_ipv4info.m_fields.m_dport == number)
 			{
-				return true;
+				return false;
 			}
 		}
-		else if(it->second.m_type == SCAP_FD_IPV4_SERVSOCK)
+		else if(fdi.m_type == SCAP_FD_IPV4_SERVSOCK)
 		{
-			if(it->second.m_sockinfo.m_ipv4serverinfo.m_port == number)
+			if(fdi.m_sockinfo.m_ipv4serverinfo.m_port == number)
 			{
-				return true;
+				return false;
 			}
 		}
-	}
-
-	return false;
+		return true;
+	});
 }
 
 bool sinsp_threadinfo::uses_client_port(uint16_t number)
 {
-	unordered_map<int64_t, sinsp_fdinfo_t>::iterator it;
-
 	sinsp_fdtable* fdt = get_fd_table();
 
-	for(it = fdt->m_table.begin();
-		it != fdt->m_table.end(); ++it)
-	{
-		if(it->second.m_type == SCAP_FD_IPV4_SOCK)
+	return !fdt->loop([&] (int64_t fd, sinsp_fdinfo_t& fdi) {
+		if(fdi.m_type == SCAP_FD_IPV4_SOCK)
 		{
-			if(it->second.m_sockinfo.m_ipv4info.m_fields.m_sport == number)
+			if(fdi.m_sockinfo.m_ipv4info.m_fields.m_sport == number)
 			{
-				return true;
+				return false;
 			}
 		}
-	}
-
-	return false;
+		return true;
+	});
 }
 
 bool sinsp_threadinfo::is_lastevent_data_valid()
@@ -1224,6 +1235,14 @@ void sinsp_thread_manager::clear()
 	m_last_tinfo.reset();
 	m_last_flush_time_ns = 0;
 	m_n_drops = 0;
+	m_expiry_wheel.clear();
+	m_expiry_wheel.resize(EXPIRY_WHEEL_SIZE);
+	m_expiry_pending.clear();
+	m_expiry_cur_slot = 0;
+	m_rebuild_phase = REBUILD_IDLE;
+	m_rebuild_pos = 0;
+	m_rebuild_nchilds.clear();
+	m_max_maintenance_pause_ns = 0;
 
 #ifdef GATHER_INTERNAL_STATS
 	m_failed_lookups = &m_inspector->m_stats.get_metrics_registry().register_counter(internal_metrics::metric_name("thread_failed_lookups","Failed thread lookups"));
@@ -1231,6 +1250,7 @@ void sinsp_thread_manager::clear()
 	m_non_cached_lookups = &m_inspector->m_stats.get_metrics_registry().register_counter(internal_metrics::metric_name("thread_non_cached_lookups","Non cached thread lookups"));
 	m_added_threads = &m_inspector->m_stats.get_metrics_registry().register_counter(internal_metrics::metric_name("thread_added","Number of added threads"));
 	m_removed_threads = &m_inspector->m_stats.get_metrics_registry().register_counter(internal_metrics::metric_name("thread_removed","Removed threads"));
+	m_max_pause = &m_inspector->m_stats.get_metrics_registry().register_counter(internal_metrics::metric_name("thread_max_maintenance_pause_ns","Longest thread table maintenance pause (ns)"));
 #endif
 }
 
@@ -1248,6 +1268,14 @@ void sinsp_thread_manager::increment_mainthread_childcount(sinsp_threadinfo* thr
 		if(main_thread)
 		{
 			++main_thread->m_nchilds;
+
+			//
+			// Main threads not assigned yet will get the rebuilt count
+			//
+			if(m_rebuild_phase == REBUILD_ASSIGN)
+			{
+				++m_rebuild_nchilds[threadinfo->m_pid];
+			}
 		}
 		else
 		{
@@ -1288,10 +1316,90 @@ bool sinsp_thread_manager::add_thread(sinsp_threadinfo *threadinfo, bool from_sc
 	threadinfo->compute_program_hash();
 	threadinfo->allocate_private_state();
 	m_threadtable.put(threadinfo);
+	schedule_expiry(threadinfo, threadinfo->m_lastaccess_ts + m_inspector->m_thread_timeout_ns);
 
 	return true;
 }
 
+void sinsp_thread_manager::schedule_expiry(sinsp_threadinfo* tinfo, uint64_t ts)
+{
+	if(m_expiry_cur_slot == 0)
+	{
+		tinfo->m_expiry_slot = 0;
+		m_expiry_pending.push_back(tinfo->m_tid);
+		return;
+	}
+
+	//
+	// Round up, so that the thread is never checked before ts. Keep the
+	// slot within one turn of the wheel: threads scheduled further away are
+	// just checked and rescheduled again
+	//
+	uint64_t slot = ts / EXPIRY_SLOT_NS + 1;
+	if(slot < m_expiry_cur_slot)
+	{
+		slot = m_expiry_cur_slot;
+	}
+	else if(slot >= m_expiry_cur_slot + EXPIRY_WHEEL_SIZE)
+	{
+		slot = m_expiry_cur_slot + EXPIRY_WHEEL_SIZE - 1;
+	}
+
+	tinfo->m_expiry_slot = slot;
+	m_expiry_wheel[slot % EXPIRY_WHEEL_SIZE].push_back({tinfo->m_tid, slot});
+}
+
+void sinsp_thread_manager::expire_thread(int64_t tid, uint64_t slot)
+{
+	sinsp_threadinfo* tinfo = m_threadtable.get(tid);
+
+	if(tinfo == nullptr || tinfo->m_expiry_slot != slot)
+	{
+		//
+		// The thread is gone or has been rescheduled since
+		//
+		return;
+	}
+
+	uint64_t now = m_inspector->m_lastevent_ts;
+	bool closed = (tinfo->m_flags & PPM_CL_CLOSED) != 0;
+
+	if(!closed)
+	{
+		uint64_t deadline = tinfo->m_lastaccess_ts + m_inspector->m_thread_timeout_ns;
+
+		if(now <= deadline)
+		{
+			schedule_expiry(tinfo, deadline);
+			return;
+		}
+
+		if(scap_is_thread_alive(m_inspector->m_h, tinfo->m_pid, tinfo->m_tid, tinfo->m_comm.c_str()))
+		{
+			schedule_expiry(tinfo, now + m_inspector->m_inactive_thread_scan_time_ns);
+			return;
+		}
+	}
+
+	//
+	// Reset the cache
+	//
+	m_last_tid = 0;
+	m_last_tinfo.reset();
+
+	remove_thread(tid, closed);
+
+	tinfo = m_threadtable.get(tid);
+	if(tinfo != nullptr)
+	{
+		//
+		// Still referenced by its child threads, try again later. The
+		// periodic child count rebuild fixes the counts that went off.
+		//
+		schedule_expiry(tinfo, now + m_inspector->m_inactive_thread_scan_time_ns);
+	}
+}
+
 void sinsp_thread_manager::remove_thread(int64_t tid, bool force)
 {
 	uint64_t nchilds;
@@ -1342,27 +1450,24 @@ void sinsp_thread_manager::remove_thread(int64_t tid, bool force)
 		//
 		if((tinfo->m_pid == tinfo->m_tid) || tinfo->m_flags & PPM_CL_IS_MAIN_THREAD)
 		{
-			unordered_map<int64_t, sinsp_fdinfo_t>* fdtable = &(tinfo->get_fd_table()->m_table);
-			unordered_map<int64_t, sinsp_fdinfo_t>::iterator fdit;
-
 			erase_fd_params eparams;
 			eparams.m_remove_from_table = false;
 			eparams.m_tinfo = tinfo;
 			eparams.m_ts = m_inspector->m_lastevent_ts;
 
-			for(fdit = fdtable->begin(); fdit != fdtable->end(); ++fdit)
-			{
-				eparams.m_fd = fdit->first;
+			tinfo->get_fd_table()->loop([&] (int64_t fd, sinsp_fdinfo_t& fdinfo) {
+				eparams.m_fd = fd;
 
 				//
 				// The canceled fd should always be deleted immediately, so if it appears
 				// here it means we have a problem.
 				//
 				ASSERT(eparams.m_fd != CANCELED_FD_NUMBER);
-				eparams.m_fdinfo = &(fdit->second);
+				eparams.m_fdinfo = &fdinfo;
 
 				m_inspector->m_parser->erase_fd(&eparams);
-			}
+				return true;
+			});
 		}
 
 		//
@@ -1375,6 +1480,7 @@ void sinsp_thread_manager::remove_thread(int64_t tid, bool force)
 		m_removed_threads->increment();
 #endif
 
+		rebuild_erase_thread(tinfo);
 		m_threadtable.erase(tid);
 
 		//
@@ -1388,6 +1494,14 @@ void sinsp_thread_manager::remove_thread(int64_t tid, bool force)
 			recreate_child_dependencies();
 		}
 	}
+	else if(tinfo->m_flags & PPM_CL_CLOSED)
+	{
+		//
+		// An exited thread still referenced by its child threads: force
+		// its removal at the next table scan rather than when it times out
+		//
+		schedule_expiry(tinfo, m_last_flush_time_ns + m_inspector->m_inactive_thread_scan_time_ns);
+	}
 }
 
 void sinsp_thread_manager::fix_sockets_coming_from_proc()
@@ -1441,20 +1555,174 @@ void sinsp_thread_manager::create_child_dependencies()
 
 void sinsp_thread_manager::recreate_child_dependencies()
 {
+	//
+	// This supersedes an incremental rebuild in progress
+	//
+	m_rebuild_phase = REBUILD_IDLE;
+	m_rebuild_nchilds.clear();
+
 	reset_child_dependencies();
 	create_child_dependencies();
 }
 
+void sinsp_thread_manager::start_child_dependencies_rebuild()
+{
+	if(m_rebuild_phase != REBUILD_IDLE)
+	{
+		return;
+	}
+
+	m_last_tinfo.reset();
+	m_last_tid = 0;
+
+	m_rebuild_phase = REBUILD_COUNT;
+	m_rebuild_pos = 0;
+	m_rebuild_nchilds.clear();
+}
+
+//
+// Process up to budget threads of the rebuild. Returns true if the rebuild
+// is complete.
+//
+bool sinsp_thread_manager::step_child_dependencies_rebuild(uint32_t budget)
+{
+	if(m_rebuild_phase == REBUILD_COUNT)
+	{
+		while(budget > 0 && m_rebuild_pos < m_threadtable.size())
+		{
+			rebuild_count_thread(m_threadtable.at(m_rebuild_pos));
+			m_rebuild_pos++;
+			budget--;
+		}
+
+		if(m_rebuild_pos < m_threadtable.size())
+		{
+			return false;
+		}
+
+		m_rebuild_phase = REBUILD_ASSIGN;
+		m_rebuild_pos = 0;
+	}
+
+	if(m_rebuild_phase == REBUILD_ASSIGN)
+	{
+		while(budget > 0 && m_rebuild_pos < m_threadtable.size())
+		{
+			rebuild_assign_thread(m_threadtable.at(m_rebuild_pos));
+			m_rebuild_pos++;
+			budget--;
+		}
+
+		if(m_rebuild_pos < m_threadtable.size())
+		{
+			return false;
+		}
+
+		m_rebuild_phase = REBUILD_IDLE;
+		m_rebuild_nchilds.clear();
+	}
+
+	return true;
+}
+
+void sinsp_thread_manager::rebuild_count_thread(sinsp_threadinfo* tinfo)
+{
+	if(tinfo->m_flags & PPM_CL_CLONE_THREAD)
+	{
+		ASSERT(tinfo->m_pid != tinfo->m_tid);
+
+		//
+		// Same lookup as increment_mainthread_childcount(), which can add
+		// the main thread to the table past m_rebuild_pos
+		//
+		sinsp_threadinfo* main_thread = &*m_inspector->get_thread_ref(tinfo->m_pid, true, true);
+		if(main_thread)
+		{
+			++m_rebuild_nchilds[tinfo->m_pid];
+		}
+		else
+		{
+			ASSERT(false);
+		}
+	}
+}
+
+void sinsp_thread_manager::rebuild_assign_thread(sinsp_threadinfo* tinfo)
+{
+	auto it = m_rebuild_nchilds.find(tinfo->m_tid);
+
+	tinfo->m_nchilds = it != m_rebuild_nchilds.end() ? it->second : 0;
+	clear_thread_pointers(*tinfo);
+}
+
+//
+// Called before tinfo is erased from the table, which moves the last thread
+// in its place
+//
+void sinsp_thread_manager::rebuild_erase_thread(sinsp_threadinfo* tinfo)
+{
+	uint32_t pos;
+
+	if(m_rebuild_phase == REBUILD_IDLE ||
+	   !m_threadtable.position(tinfo->m_tid, &pos))
+	{
+		return;
+	}
+
+	uint32_t last = (uint32_t)m_threadtable.size() - 1;
+	bool done = pos < m_rebuild_pos;
+
+	if(tinfo->m_flags & PPM_CL_CLONE_THREAD)
+	{
+		//
+		// The count phase forgets the threads it counted, the assign phase
+		// follows the decrement of the main thread done by remove_thread()
+		//
+		if(done || m_rebuild_phase == REBUILD_ASSIGN)
+		{
+			auto it = m_rebuild_nchilds.find(tinfo->m_pid);
+			if(it != m_rebuild_nchilds.end() && it->second > 0)
+			{
+				it->second--;
+			}
+		}
+	}
+
+	//
+	// The last thread is moving before m_rebuild_pos, process it now
+	//
+	if(done && last >= m_rebuild_pos)
+	{
+		if(m_rebuild_phase == REBUILD_COUNT)
+		{
+			rebuild_count_thread(m_threadtable.at(last));
+		}
+		else
+		{
+			rebuild_assign_thread(m_threadtable.at(last));
+		}
+	}
+
+	if(m_rebuild_pos > last)
+	{
+		m_rebuild_pos = last;
+	}
+}
+
 void sinsp_thread_manager::update_statistics()
 {
 #ifdef GATHER_INTERNAL_STATS
 	m_inspector->m_stats.m_n_threads = get_thread_count();
 
 	m_inspector->m_stats.m_n_fds = 0;
-	for(threadinfo_map_iterator_t it = m_threadtable.begin(); it != m_threadtable.end(); it++)
-	{
-		m_inspector->m_stats.m_n_fds += it->second.get_fd_table()->size();
-	}
+	m_threadtable.loop([&] (sinsp_threadinfo& tinfo) {
+		sinsp_fdtable* fdt = tinfo.get_fd_table();
+		if(fdt != NULL)
+		{
+			m_inspector->m_stats.m_n_fds += fdt->size();
+		}
+		return true;
+	});
 #endif
 }
 
@@ -1618,9 +1886,7 @@ void sinsp_thread_manager::dump_threads_to_file(scap_dumper_t* dumper)
 			//
 			// Add the FDs
 			//
-			unordered_map<int64_t, sinsp_fdinfo_t>& fdtable = tinfo.get_fd_table()->m_table;
-			for(auto it = fdtable.begin(); it != fdtable.end(); ++it)
-			{
+			tinfo.get_fd_table()->loop([&] (int64_t fd, sinsp_fdinfo_t& fdinfo) {
 				//
 				// Allocate the scap fd info
 				//
@@ -1634,18 +1900,19 @@ void sinsp_thread_manager::dump_threads_to_file(scap_dumper_t* dumper)
 				//
 				// Populate the fd info
 				//
-				scfdinfo->fd = it->first;
-				tinfo.fd_to_scap(scfdinfo, &it->second);
+				scfdinfo->fd = fd;
+				tinfo.fd_to_scap(scfdinfo, &fdinfo);
 
 				//
 				// Add the new fd to the scap table.
 				//
-				if(scap_fd_add(m_inspector->m_h, sctinfo, it->first, scfdinfo) != SCAP_SUCCESS)
+				if(scap_fd_add(m_inspector->m_h, sctinfo, fd, scfdinfo) != SCAP_SUCCESS)
 				{
 					scap_proc_free(m_inspector->m_h, sctinfo);
 					throw sinsp_exception("error calling scap_fd_add in sinsp_thread_manager::to_scap (" + string(scap_getlasterr(m_inspector->m_h)) + ")");
 				}
-			}
+				return true;
+			});
 		}
 
 		//
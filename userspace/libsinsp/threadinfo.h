@@ -33,6 +33,8 @@ struct iovec {
 #include <functional>
 #include <memory>
 #include <set>
+#include <unordered_map>
+#include "cow_vector.h"
 #include "fdinfo.h"
 #include "internal_metrics.h"
 
@@ -252,9 +254,13 @@ public:
 	std::string m_comm; ///< Command name (e.g. "top")
 	std::string m_exe; ///< argv[0] (e.g. "sshd: user@pts/4")
 	std::string m_exepath; ///< full executable path
-	std::vector<std::string> m_args; ///< Command line arguments (e.g. "-d1")
-	std::vector<std::string> m_env; ///< Environment variables
-	std::vector<std::pair<std::string, std::string>> m_cgroups; ///< subsystem-cgroup pairs
+	//
+	// args, env and cgroups are the same for most threads of a process, so
+	// they are shared between threadinfos and cloned only when modified
+	//
+	libsinsp::cow_vector<std::string> m_args; ///< Command line arguments (e.g. "-d1")
+	libsinsp::cow_vector<std::string> m_env; ///< Environment variables
+	libsinsp::cow_vector<std::pair<std::string, std::string>> m_cgroups; ///< subsystem-cgroup pairs
 	std::string m_container_id; ///< heuristic-based container id
 	uint32_t m_flags; ///< The thread flags. See the PPM_CL_* declarations in ppm_events_public.h.
 	int64_t m_fdlimit;  ///< The maximum number of FDs this thread can open
@@ -439,6 +445,7 @@ VISIBILITY_PRIVATE
 	uint16_t m_lastevent_cpuid;
 	sinsp_evt::category m_lastevent_category;
 	bool m_parent_loop_detected;
+	uint64_t m_expiry_slot; // Slot of the thread manager expiry wheel this thread is scheduled in
 	blprogram* m_blprogram;
 
 	friend class sinsp;
@@ -455,6 +462,16 @@ VISIBILITY_PRIVATE
 
 /*@}*/
 
+//
+// The thread table. The threads are kept in a dense array of entries, which
+// is what loop() walks, and indexed by tid with an open addressing hash table
+// (linear probing, backward shift deletion, so no tombstones). Every index
+// slot is 8 bytes: the position of the entry and the low 32 bits of the tid,
+// so a lookup only touches the slot and the entry of the thread. Erasing moves the last entry
+// in the place of the erased one, so the order of loop() changes, but the
+// threadinfos don't move and the pointers returned by get() and get_ref()
+// stay valid until the thread is erased.
+//
 class threadinfo_map_t
 {
 public:
@@ -462,46 +479,105 @@ public:
 	typedef std::function<bool(sinsp_threadinfo&)> visitor_t;
 	typedef std::shared_ptr<sinsp_threadinfo> ptr_t;
 
+	threadinfo_map_t():
+		m_mask(0),
+		m_bits(0)
+	{
+	}
+
 	inline void put(sinsp_threadinfo* tinfo)
 	{
-		m_threads[tinfo->m_tid] = ptr_t(tinfo);
+		int64_t tid = tinfo->m_tid;
+		uint32_t slot;
+
+		if(find_slot(tid, &slot))
+		{
+			m_entries[m_index[slot].m_entry].m_ptr = ptr_t(tinfo);
+			return;
+		}
+
+		if((m_entries.size() + 1) * 4 > m_index.size() * 3)
+		{
+			grow();
+			find_slot(tid, &slot);
+		}
+
+		m_index[slot].m_tag = (uint32_t)tid;
+		m_index[slot].m_entry = (uint32_t)m_entries.size();
+		m_entries.push_back(entry{tid, ptr_t(tinfo)});
 	}
 
 	inline sinsp_threadinfo* get(uint64_t tid)
 	{
-		auto it = m_threads.find(tid);
-		if (it == m_threads.end())
+		uint32_t slot;
+
+		if(!find_slot((int64_t)tid, &slot))
 		{
-			return  nullptr;
+			return nullptr;
 		}
-		return it->second.get();
+		return m_entries[m_index[slot].m_entry].m_ptr.get();
 	}
 
 	inline ptr_t get_ref(uint64_t tid)
 	{
-		auto it = m_threads.find(tid);
-		if (it == m_threads.end())
+		uint32_t slot;
+
+		if(!find_slot((int64_t)tid, &slot))
 		{
-			return  nullptr;
+			return nullptr;
 		}
-		return it->second;
+		return m_entries[m_index[slot].m_entry].m_ptr;
 	}
 
 	inline void erase(uint64_t tid)
 	{
-		m_threads.erase(tid);
+		uint32_t slot;
+
+		if(!find_slot((int64_t)tid, &slot))
+		{
+			return;
+		}
+
+		uint32_t pos = m_index[slot].m_entry;
+		uint32_t last = (uint32_t)m_entries.size() - 1;
+
+		//
+		// The threadinfo is released once the table is consistent again,
+		// since its destructor might look the table up
+		//
+		ptr_t removed = std::move(m_entries[pos].m_ptr);
+
+		//
+		// Move the last entry in the hole and point its slot to the new position
+		//
+		if(pos != last)
+		{
+			uint32_t last_slot;
+
+			find_slot(m_entries[last].m_tid, &last_slot);
+			m_index[last_slot].m_entry = pos;
+			m_entries[pos] = std::move(m_entries[last]);
+		}
+
+		m_entries.pop_back();
+		remove_slot(slot);
 	}
 
 	inline void clear()
 	{
-		m_threads.clear();
+		std::vector<entry> entries;
+
+		entries.swap(m_entries);
+		m_index.clear();
+		m_mask = 0;
+		m_bits = 0;
 	}
 
 	bool const_loop(const_visitor_t callback) const
 	{
-		for (const auto& it : m_threads)
+		for (const auto& it : m_entries)
 		{
-			if (!callback(*it.second.get()))
+			if (!callback(*it.m_ptr.get()))
 			{
 				return false;
 			}
@@ -511,9 +587,9 @@ public:
 
 	bool loop(visitor_t callback)
 	{
-		for (auto& it : m_threads)
+		for (auto& it : m_entries)
 		{
-			if (!callback(*it.second.get()))
+			if (!callback(*it.m_ptr.get()))
 			{
 				return false;
 			}
@@ -523,11 +599,149 @@ public:
 
 	inline size_t size() const
 	{
-		return m_threads.size();
+		return m_entries.size();
+	}
+
+	//
+	// Thread at position pos of the order of loop(), pos < size()
+	//
+	inline sinsp_threadinfo* at(uint32_t pos)
+	{
+		return m_entries[pos].m_ptr.get();
+	}
+
+	inline bool position(int64_t tid, uint32_t* pos) const
+	{
+		uint32_t slot;
+
+		if(!find_slot(tid, &slot))
+		{
+			return false;
+		}
+		*pos = m_index[slot].m_entry;
+		return true;
+	}
+
+	//
+	// Make room for nthreads threads without rehashing
+	//
+	void reserve(size_t nthreads)
+	{
+		m_entries.reserve(nthreads);
+		while(nthreads * 4 > m_index.size() * 3)
+		{
+			grow();
+		}
 	}
 
 protected:
-	std::unordered_map<int64_t, ptr_t> m_threads;
+	struct entry
+	{
+		int64_t m_tid;
+		ptr_t m_ptr;
+	};
+
+	struct slot_t
+	{
+		uint32_t m_tag; // Low 32 bits of the tid
+		uint32_t m_entry; // Position in m_entries, or EMPTY_SLOT
+	};
+
+	static const uint32_t EMPTY_SLOT = 0xffffffff;
+	static const uint32_t MIN_BITS = 6;
+
+	//
+	// Fibonacci hashing: the tids are mostly consecutive, the multiplication
+	// spreads them over the whole table
+	//
+	inline uint32_t home_slot(int64_t tid) const
+	{
+		return (uint32_t)(((uint64_t)tid * 0x9E3779B97F4A7C15ULL) >> (64 - m_bits));
+	}
+
+	//
+	// Returns true and the slot of tid if found, otherwise false and the
+	// empty slot where tid would go
+	//
+	inline bool find_slot(int64_t tid, uint32_t* pslot) const
+	{
+		if(m_index.empty())
+		{
+			*pslot = 0;
+			return false;
+		}
+
+		uint32_t slot = home_slot(tid);
+
+		while(true)
+		{
+			const slot_t& s = m_index[slot];
+
+			if(s.m_entry == EMPTY_SLOT)
+			{
+				*pslot = slot;
+				return false;
+			}
+
+			if(s.m_tag == (uint32_t)tid && m_entries[s.m_entry].m_tid == tid)
+			{
+				*pslot = slot;
+				return true;
+			}
+
+			slot = (slot + 1) & m_mask;
+		}
+	}
+
+	//
+	// Backward shift deletion: move back the slots of the run that follows
+	// the freed one, unless that would move them before their home slot
+	//
+	inline void remove_slot(uint32_t hole)
+	{
+		uint32_t slot = hole;
+
+		while(true)
+		{
+			slot = (slot + 1) & m_mask;
+
+			if(m_index[slot].m_entry == EMPTY_SLOT)
+			{
+				break;
+			}
+
+			uint32_t home = home_slot(m_entries[m_index[slot].m_entry].m_tid);
+
+			if(((slot - home) & m_mask) >= ((slot - hole) & m_mask))
+			{
+				m_index[hole] = m_index[slot];
+				hole = slot;
+			}
+		}
+
+		m_index[hole].m_entry = EMPTY_SLOT;
+	}
+
+	void grow()
+	{
+		m_bits = m_bits ? m_bits + 1 : MIN_BITS;
+		m_index.assign((size_t)1 << m_bits, slot_t{0, EMPTY_SLOT});
+		m_mask = (uint32_t)m_index.size() - 1;
+
+		for(uint32_t j = 0; j < m_entries.size(); j++)
+		{
+			uint32_t slot;
+
+			find_slot(m_entries[j].m_tid, &slot);
+			m_index[slot].m_tag = (uint32_t)m_entries[j].m_tid;
+			m_index[slot].m_entry = j;
+		}
+	}
+
+	std::vector<entry> m_entries;
+	std::vector<slot_t> m_index;
+	uint32_t m_mask;
+	uint32_t m_bits;
 };
 
 
@@ -568,7 +782,8 @@ public:
 
 	bool add_thread(sinsp_threadinfo *threadinfo, bool from_scap_proctable);
 	void remove_thread(int64_t tid, bool force);
-	// Returns true if the table is actually scanned
+	// Expires a bounded number of inactive threads. Returns true if some
+	// expiry work was done
 	// NOTE: this is implemented in sinsp.cpp so we can inline it from there
 	inline bool remove_inactive_threads();
 	void fix_sockets_coming_from_proc();
@@ -576,6 +791,14 @@ public:
 	void create_child_dependencies();
 	void recreate_child_dependencies();
 
+	//
+	// Rebuild the child counts like recreate_child_dependencies(), but
+	// CHILD_REBUILD_BUDGET threads at a time over the next
+	// remove_inactive_threads() calls
+	//
+	void start_child_dependencies_rebuild();
+	bool is_child_dependencies_rebuild_pending() const { return m_rebuild_phase != REBUILD_IDLE; }
+
 	/*!
       \brief Look up a thread given its tid and return its information,
        and optionally go dig into proc if the thread is not in the thread table.
@@ -632,7 +855,31 @@ public:
 
 	void set_m_max_n_proc_lookups(int32_t val) { m_max_n_proc_lookups = val; }
 	void set_m_max_n_proc_socket_lookups(int32_t val) { m_max_n_proc_socket_lookups = val; }
+
+	//
+	// Longest time spent in a single remove_inactive_threads() call that
+	// did some work, since the last reset
+	//
+	uint64_t get_max_maintenance_pause_ns() const { return m_max_maintenance_pause_ns; }
+	void reset_max_maintenance_pause() { m_max_maintenance_pause_ns = 0; }
+
+	//
+	// Granularity and size of the expiry wheel, and maximum number of
+	// wheel entries or empty slots processed by a remove_inactive_threads()
+	// call
+	//
+	static const uint64_t EXPIRY_SLOT_NS = 1000000000ULL;
+	static const uint32_t EXPIRY_WHEEL_SIZE = 4096;
+	static const uint32_t EXPIRY_BUDGET = 32;
+	static const uint32_t CHILD_REBUILD_BUDGET = 256;
+
 private:
+	void schedule_expiry(sinsp_threadinfo* tinfo, uint64_t ts);
+	void expire_thread(int64_t tid, uint64_t slot);
+	bool step_child_dependencies_rebuild(uint32_t budget);
+	void rebuild_count_thread(sinsp_threadinfo* tinfo);
+	void rebuild_assign_thread(sinsp_threadinfo* tinfo);
+	void rebuild_erase_thread(sinsp_threadinfo* tinfo);
 	void increment_mainthread_childcount(sinsp_threadinfo* threadinfo);
 	inline void clear_thread_pointers(sinsp_threadinfo& threadinfo);
 	void free_dump_fdinfos(std::vector<scap_fdinfo*>* fdinfos_to_free);
@@ -643,6 +890,44 @@ private:
 	int64_t m_last_tid;
 	std::weak_ptr<sinsp_threadinfo> m_last_tinfo;
 	uint64_t m_last_flush_time_ns;
+
+	//
+	// Inactive thread expiry wheel. Every thread is in the bucket of the
+	// slot (EXPIRY_SLOT_NS wide) when it must be checked next, stored in
+	// its m_expiry_slot. Being accessed doesn't move a thread: when its
+	// slot comes, it is rescheduled if its m_lastaccess_ts is recent
+	// enough. Entries whose slot doesn't match the one of their thread
+	// anymore are stale and are dropped.
+	//
+	struct expiry_entry
+	{
+		int64_t m_tid;
+		uint64_t m_slot;
+	};
+	std::vector<std::vector<expiry_entry>> m_expiry_wheel;
+	// Threads added before the wheel was started
+	std::vector<int64_t> m_expiry_pending;
+	// Next slot to process, 0 until the wheel is started
+	uint64_t m_expiry_cur_slot;
+
+	//
+	// Incremental child count rebuild. The count phase walks the table
+	// collecting the number of children of every main thread in
+	// m_rebuild_nchilds, the assign phase walks it again copying them to
+	// m_nchilds. m_rebuild_pos is the position reached in the order of
+	// loop(): threads added meanwhile are appended past it, and the ones
+	// erased are accounted for by rebuild_erase_thread().
+	//
+	enum rebuild_phase
+	{
+		REBUILD_IDLE,
+		REBUILD_COUNT,
+		REBUILD_ASSIGN,
+	};
+	rebuild_phase m_rebuild_phase;
+	uint32_t m_rebuild_pos;
+	std::unordered_map<int64_t, uint64_t> m_rebuild_nchilds;
+	uint64_t m_max_maintenance_pause_ns;
 	uint32_t m_n_drops;
 	const uint32_t m_thread_table_absolute_max_size = 131072;
 	uint32_t m_max_thread_table_size;
@@ -657,6 +942,7 @@ private:
 	INTERNAL_COUNTER(m_non_cached_lookups);
 	INTERNAL_COUNTER(m_added_threads);
 	INTERNAL_COUNTER(m_removed_threads);
+	INTERNAL_COUNTER(m_max_pause);
 
 	friend class sinsp_parser;
 	friend class sinsp_analyzer;